@@ -0,0 +1,138 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+/* completion time of batches of host fcp queries with very skewed
+   per-query costs (clustered points; some queries in the clusters,
+   some in the voids between them, some far outside), with one static
+   range of queries per thread vs with the work-stealing scheduler
+   from batch.h. Reports the median and the 99th percentile over many
+   batches; the latter is what a service running these batches
+   would see as its tail latency */
+
+#include "cukd/builder_host.h"
+#include "cukd/batch.h"
+#include <random>
+#include <algorithm>
+#include <iomanip>
+
+using namespace cukd;
+using namespace cukd::common;
+
+/*! one static, equally sized range of queries per thread */
+void fcp_static(const float3 *queries, int numQueries, int *results,
+                const float3 *tree, int numPoints, int numThreads)
+{
+  std::vector<std::thread> threads;
+  for (int t=0;t<numThreads;t++)
+    threads.push_back(std::thread([=]() {
+          const int begin = int(size_t(numQueries)*t/numThreads);
+          const int end   = int(size_t(numQueries)*(t+1)/numThreads);
+          for (int q=begin;q<end;q++)
+            results[q] = stackBased::fcp(queries[q],tree,numPoints);
+        }));
+  for (auto &t : threads) t.join();
+}
+
+/*! returns the given percentile of (sorted) times */
+double percentile(const std::vector<double> &sorted, double p)
+{
+  return sorted[std::min(sorted.size()-1,size_t(p*sorted.size()))];
+}
+
+int main(int ac, const char **av)
+{
+  int numPoints  = 1000000;
+  int batchSize  = 10000;
+  int numBatches = 200;
+  int numThreads = std::thread::hardware_concurrency();
+  float farFraction = .02f;
+  for (int i=1;i<ac;i++) {
+    std::string arg = av[i];
+    if (arg == "-np")
+      numPoints = std::stoi(av[++i]);
+    else if (arg == "-bs")
+      batchSize = std::stoi(av[++i]);
+    else if (arg == "-nb")
+      numBatches = std::stoi(av[++i]);
+    else if (arg == "-nt")
+      numThreads = std::stoi(av[++i]);
+    else if (arg == "--far-fraction")
+      farFraction = std::stof(av[++i]);
+    else
+      throw std::runtime_error("unknown cmdline arg "+arg);
+  }
+  std::cout << prettyNumber(numPoints) << " points, " << numBatches
+            << " batches of " << prettyNumber(batchSize) << " queries, "
+            << numThreads << " threads" << std::endl;
+
+  std::mt19937 gen(0x1234);
+  std::uniform_real_distribution<float> uniform(0.f,1.f);
+  std::normal_distribution<float> gaussian(0.f,.002f);
+  std::vector<float3> centers(64);
+  for (auto &c : centers)
+    c = make_float3(uniform(gen),uniform(gen),uniform(gen));
+  std::vector<float3> points(numPoints);
+  for (int i=0;i<numPoints;i++) {
+    const float3 c = centers[i % centers.size()];
+    points[i] = make_float3(c.x+gaussian(gen),c.y+gaussian(gen),c.z+gaussian(gen));
+  }
+  buildTree_host(points.data(),numPoints);
+
+  // batches are contiguous runs of queries, the way a service would
+  // see them: bursts of queries near each other, with the expensive
+  // ones clumped together rather than evenly spread
+  std::vector<std::vector<float3>> batches(numBatches);
+  for (auto &batch : batches) {
+    batch.resize(batchSize);
+    for (int q=0;q<batchSize;q++) {
+      const float3 c = centers[(q*centers.size())/batchSize];
+      batch[q]
+        = (uniform(gen) < farFraction)
+        ? make_float3(3.f*uniform(gen)-1.f,3.f*uniform(gen)-1.f,3.f*uniform(gen)-1.f)
+        : make_float3(c.x+gaussian(gen),c.y+gaussian(gen),c.z+gaussian(gen));
+    }
+    std::sort(batch.begin(),batch.end(),[](float3 a, float3 b) { return a.x < b.x; });
+  }
+
+  std::vector<int> results(batchSize);
+  std::vector<double> t_static, t_stealing;
+  WorkStealingStats stats;
+  for (auto &batch : batches) {
+    double t0 = getCurrentTime();
+    fcp_static(batch.data(),batchSize,results.data(),
+               points.data(),numPoints,numThreads);
+    double t1 = getCurrentTime();
+    batch::fcp_host<float3>(batch.data(),batchSize,results.data(),
+                            points.data(),numPoints,FcpSearchParams{},
+                            numThreads,&stats);
+    double t2 = getCurrentTime();
+    t_static.push_back(t1-t0);
+    t_stealing.push_back(t2-t1);
+  }
+  std::sort(t_static.begin(),t_static.end());
+  std::sort(t_stealing.begin(),t_stealing.end());
+
+  std::cout << std::fixed << std::setprecision(2)
+            << "  static ranges : p50 " << 1000.*percentile(t_static,.5)
+            << "ms, p99 " << 1000.*percentile(t_static,.99) << "ms" << std::endl
+            << "  work stealing : p50 " << 1000.*percentile(t_stealing,.5)
+            << "ms, p99 " << 1000.*percentile(t_stealing,.99) << "ms ("
+            << prettyNumber(stats.numChunks/numBatches) << " chunks, "
+            << prettyNumber(stats.numSteals/numBatches) << " steals per batch)"
+            << std::endl;
+  return 0;
+}
@@ -0,0 +1,115 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* recall-vs-speed trade-off of best-bin-first knn (for different
+   far-node budgets) on clustered, high-dimensional vec_float<D>
+   descriptors, compared to exact stack-based and cct knn */
+
+#include "cukd/builder_host.h"
+#include "cukd/knn.h"
+#include <random>
+#include <iomanip>
+
+using namespace cukd;
+using namespace cukd::common;
+
+enum { k = 8 };
+
+template<int D>
+void runBenchmark(int numPoints, int numQueries, int numClusters)
+{
+  using point_t = vec_float<D>;
+  std::mt19937 gen(D);
+  std::uniform_real_distribution<float> uniform(0.f,1.f);
+  std::normal_distribution<float> noise(0.f,.05f);
+  std::vector<point_t> centers(numClusters);
+  for (auto &c : centers)
+    for (int d=0;d<D;d++) c.v[d] = uniform(gen);
+  std::vector<point_t> points(numPoints), queries(numQueries);
+  for (auto *set : { &points, &queries })
+    for (auto &p : *set) {
+      p = centers[gen()%numClusters];
+      for (int d=0;d<D;d++) p.v[d] += noise(gen);
+    }
+  buildTree_host(points.data(),numPoints);
+  box_t<point_t> worldBounds;
+  worldBounds.setInfinite();
+
+  // exact results, for computing recall
+  std::vector<float> kthDist2(numQueries);
+  double t0 = getCurrentTime();
+  for (int q=0;q<numQueries;q++) {
+    FixedCandidateList<k> result(INFINITY);
+    kthDist2[q] = stackBased::knn(result,queries[q],points.data(),numPoints);
+  }
+  double t_sb = getCurrentTime()-t0;
+  t0 = getCurrentTime();
+  for (int q=0;q<numQueries;q++) {
+    FixedCandidateList<k> result(INFINITY);
+    cct::knn(result,queries[q],worldBounds,points.data(),numPoints);
+  }
+  double t_cct = getCurrentTime()-t0;
+
+  std::cout << "D=" << D << ":" << std::endl
+            << "  stackBased::knn (exact) : "
+            << prettyNumber(size_t(numQueries/t_sb)) << " queries/s" << std::endl
+            << "  cct::knn (exact)        : "
+            << prettyNumber(size_t(numQueries/t_cct)) << " queries/s" << std::endl;
+  for (int budget : { 0, 4, 16, 64, 256, 1024, INT_MAX }) {
+    FcpSearchParams params;
+    params.far_node_inspect_budget = budget;
+    size_t numCorrect = 0;
+    t0 = getCurrentTime();
+    for (int q=0;q<numQueries;q++) {
+      FixedCandidateList<k> result(INFINITY);
+      bbf::knn(result,queries[q],points.data(),numPoints,params);
+      for (int i=0;i<k;i++)
+        numCorrect += (result.get_dist2(i) <= kthDist2[q]);
+    }
+    double t_bbf = getCurrentTime()-t0;
+    std::cout << "  bbf::knn, budget "
+              << std::setw(10) << (budget == INT_MAX ? std::string("unlimited")
+                                   : std::to_string(budget))
+              << " : " << prettyNumber(size_t(numQueries/t_bbf)) << " queries/s, recall "
+              << std::fixed << std::setprecision(1)
+              << (100.*numCorrect/(double(numQueries)*k)) << "%" << std::endl;
+  }
+}
+
+int main(int ac, const char **av)
+{
+  int numPoints   = 100000;
+  int numQueries  = 1000;
+  int numClusters = 1000;
+  for (int i=1;i<ac;i++) {
+    std::string arg = av[i];
+    if (arg[0] != '-')
+      numPoints = std::stoi(arg);
+    else if (arg == "-nq")
+      numQueries = atoi(av[++i]);
+    else if (arg == "-nc")
+      numClusters = atoi(av[++i]);
+    else
+      throw std::runtime_error("unknown cmdline arg "+arg);
+  }
+  std::cout << "k=" << k << " queries on " << prettyNumber(numPoints)
+            << " descriptors in " << numClusters << " clusters" << std::endl;
+  runBenchmark<16>(numPoints,numQueries,numClusters);
+  runBenchmark<32>(numPoints,numQueries,numClusters);
+  runBenchmark<64>(numPoints,numQueries,numClusters);
+  runBenchmark<128>(numPoints,numQueries,numClusters);
+  return 0;
+}
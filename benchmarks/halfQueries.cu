@@ -0,0 +1,105 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* compares host-side fcp and knn query throughput on trees over
+   float3 points vs trees over the same points stored as half3 and
+   bfloat16_3 (at the same number of points) */
+
+#include "cukd/builder_host.h"
+#include "cukd/knn.h"
+#include "cukd/half.h"
+#include <random>
+#include <iomanip>
+
+using namespace cukd;
+using namespace cukd::common;
+
+template<typename data_t, typename data_traits>
+void runBenchmark(const std::string &name,
+                  std::vector<data_t> points,
+                  const std::vector<float3> &queries,
+                  int nRepeats)
+{
+  const int numPoints = (int)points.size();
+  buildTree_host<data_t,data_traits>(points.data(),numPoints);
+
+  double t_fcp = INFINITY, t_knn = INFINITY;
+  size_t checkSum = 0;
+  for (int r=0;r<nRepeats;r++) {
+    double t0 = getCurrentTime();
+    for (auto query : queries)
+      checkSum += stackBased::fcp<data_t,data_traits>
+        (query,points.data(),numPoints);
+    double t1 = getCurrentTime();
+    for (auto query : queries) {
+      FixedCandidateList<8> result(INFINITY);
+      stackBased::knn<FixedCandidateList<8>,data_t,data_traits>
+        (result,query,points.data(),numPoints);
+      checkSum += result.get_pointID(0);
+    }
+    double t2 = getCurrentTime();
+    t_fcp = std::min(t_fcp,t1-t0);
+    t_knn = std::min(t_knn,t2-t1);
+  }
+  std::cout << name << " (" << sizeof(data_t) << " bytes/point, tree is "
+            << prettyNumber(numPoints*sizeof(data_t)) << "B):" << std::endl
+            << "  fcp     : " << prettyNumber(size_t(queries.size()/t_fcp))
+            << " queries/s" << std::endl
+            << "  knn k=8 : " << prettyNumber(size_t(queries.size()/t_knn))
+            << " queries/s" << std::endl
+            << "  (checksum " << checkSum << ")" << std::endl;
+}
+
+int main(int ac, const char **av)
+{
+  int numPoints  = 1000000;
+  int numQueries = 1000000;
+  int nRepeats   = 1;
+  for (int i=1;i<ac;i++) {
+    std::string arg = av[i];
+    if (arg[0] != '-')
+      numPoints = std::stoi(arg);
+    else if (arg == "-nq")
+      numQueries = atoi(av[++i]);
+    else if (arg == "-nr")
+      nRepeats = atoi(av[++i]);
+    else
+      throw std::runtime_error("unknown cmdline arg "+arg);
+  }
+
+  std::mt19937 gen(0x1234);
+  std::uniform_real_distribution<float> dist(0.f,1000.f);
+  std::vector<float3> points(numPoints), queries(numQueries);
+  for (auto &p : points)
+    p = make_float3(dist(gen),dist(gen),dist(gen));
+  for (auto &q : queries)
+    q = make_float3(dist(gen),dist(gen),dist(gen));
+  std::cout << prettyNumber(numQueries) << " queries on "
+            << prettyNumber(numPoints) << " uniform random points" << std::endl;
+
+  std::vector<half3> halfPoints(numPoints);
+  std::vector<bfloat16_3> bfloatPoints(numPoints);
+  for (int i=0;i<numPoints;i++) {
+    halfPoints[i]   = narrow<half3>(points[i]);
+    bfloatPoints[i] = narrow<bfloat16_3>(points[i]);
+  }
+
+  runBenchmark<float3,default_data_traits<float3>>("float3",points,queries,nRepeats);
+  runBenchmark<half3,half_data_traits<half3>>("half3",halfPoints,queries,nRepeats);
+  runBenchmark<bfloat16_3,half_data_traits<bfloat16_3>>
+    ("bfloat16_3",bfloatPoints,queries,nRepeats);
+  return 0;
+}
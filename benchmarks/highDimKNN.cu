@@ -0,0 +1,136 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* host-side knn throughput on clustered, high-dimensional
+   vec_float<D> "descriptors", for D=16, 32, 64, and 128: tree
+   traversals (stack-based and cct) vs. linear scans, with and without
+   early exit from the distance computations */
+
+#include "cukd/builder_host.h"
+#include "cukd/knn.h"
+#include <random>
+
+using namespace cukd;
+using namespace cukd::common;
+
+enum { k = 8 };
+
+template<int D>
+std::vector<vec_float<D>> generateDescriptors(std::mt19937 &gen,
+                                              const std::vector<vec_float<D>> &centers,
+                                              int count)
+{
+  std::uniform_int_distribution<int> whichCenter(0,(int)centers.size()-1);
+  std::normal_distribution<float> noise(0.f,.05f);
+  std::vector<vec_float<D>> result(count);
+  for (auto &p : result) {
+    p = centers[whichCenter(gen)];
+    for (int d=0;d<D;d++) p.v[d] += noise(gen);
+  }
+  return result;
+}
+
+/*! runs given knn kernel over all queries, and returns queries/s */
+template<typename Lambda>
+double measure(int numQueries, int nRepeats, size_t &checkSum, const Lambda &knn)
+{
+  double best = INFINITY;
+  for (int r=0;r<nRepeats;r++) {
+    double t0 = getCurrentTime();
+    for (int q=0;q<numQueries;q++)
+      checkSum += knn(q);
+    double t1 = getCurrentTime();
+    best = std::min(best,t1-t0);
+  }
+  return numQueries/best;
+}
+
+template<int D>
+void runBenchmark(int numPoints, int numQueries, int numClusters, int nRepeats)
+{
+  using point_t = vec_float<D>;
+  std::mt19937 gen(D);
+  std::uniform_real_distribution<float> uniform(0.f,1.f);
+  std::vector<point_t> centers(numClusters);
+  for (auto &c : centers)
+    for (int d=0;d<D;d++) c.v[d] = uniform(gen);
+  std::vector<point_t> points  = generateDescriptors<D>(gen,centers,numPoints);
+  std::vector<point_t> queries = generateDescriptors<D>(gen,centers,numQueries);
+  std::vector<point_t> tree = points;
+  buildTree_host(tree.data(),numPoints);
+  box_t<point_t> worldBounds;
+  worldBounds.setInfinite();
+
+  size_t checkSum = 0;
+  const double sb = measure(numQueries,nRepeats,checkSum,[&](int q) {
+      FixedCandidateList<k> result(INFINITY);
+      stackBased::knn(result,queries[q],tree.data(),numPoints);
+      return result.get_pointID(0);
+    });
+  const double cct = measure(numQueries,nRepeats,checkSum,[&](int q) {
+      FixedCandidateList<k> result(INFINITY);
+      cct::knn(result,queries[q],worldBounds,tree.data(),numPoints);
+      return result.get_pointID(0);
+    });
+  const double scanEarlyExit = measure(numQueries,nRepeats,checkSum,[&](int q) {
+      FixedCandidateList<k> result(INFINITY);
+      float cullDist = result.initialCullDist2();
+      for (int i=0;i<numPoints;i++)
+        cullDist = result.processCandidate
+          (i,sqrDistanceUpTo(points[i],queries[q],cullDist));
+      return result.get_pointID(0);
+    });
+  const double scanFull = measure(numQueries,nRepeats,checkSum,[&](int q) {
+      FixedCandidateList<k> result(INFINITY);
+      for (int i=0;i<numPoints;i++)
+        result.processCandidate(i,sqrDistance(points[i],queries[q]));
+      return result.get_pointID(0);
+    });
+  std::cout << "D=" << D << ":" << std::endl
+            << "  stackBased::knn           : " << prettyNumber(size_t(sb)) << " queries/s" << std::endl
+            << "  cct::knn                  : " << prettyNumber(size_t(cct)) << " queries/s" << std::endl
+            << "  linear scan, early exit   : " << prettyNumber(size_t(scanEarlyExit)) << " queries/s" << std::endl
+            << "  linear scan, full distance: " << prettyNumber(size_t(scanFull)) << " queries/s" << std::endl
+            << "  (checksum " << checkSum << ")" << std::endl;
+}
+
+int main(int ac, const char **av)
+{
+  int numPoints   = 100000;
+  int numQueries  = 1000;
+  int numClusters = 1000;
+  int nRepeats    = 1;
+  for (int i=1;i<ac;i++) {
+    std::string arg = av[i];
+    if (arg[0] != '-')
+      numPoints = std::stoi(arg);
+    else if (arg == "-nq")
+      numQueries = atoi(av[++i]);
+    else if (arg == "-nc")
+      numClusters = atoi(av[++i]);
+    else if (arg == "-nr")
+      nRepeats = atoi(av[++i]);
+    else
+      throw std::runtime_error("unknown cmdline arg "+arg);
+  }
+  std::cout << "k=" << k << " queries on " << prettyNumber(numPoints)
+            << " descriptors in " << numClusters << " clusters" << std::endl;
+  runBenchmark<16>(numPoints,numQueries,numClusters,nRepeats);
+  runBenchmark<32>(numPoints,numQueries,numClusters,nRepeats);
+  runBenchmark<64>(numPoints,numQueries,numClusters,nRepeats);
+  runBenchmark<128>(numPoints,numQueries,numClusters,nRepeats);
+  return 0;
+}
@@ -0,0 +1,120 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+/* host_computeBounds: a plain serial loop vs the unrolled,
+   multi-threaded version; and a host build that computes the world
+   bounds itself vs one that gets them passed in. Uniformly random
+   float3s, by default 10M of them */
+
+#include "cukd/builder_host.h"
+#include <random>
+#include <cstring>
+#include <iomanip>
+
+using namespace cukd;
+using namespace cukd::common;
+
+template<typename Lambda>
+double timeBest(int nRepeats, const Lambda &func)
+{
+  double best = INFINITY;
+  for (int r=0;r<nRepeats;r++)
+    best = std::min(best,func());
+  return best;
+}
+
+void runBenchmark(int numPoints, int nRepeats)
+{
+  std::mt19937 gen(0x1234);
+  std::uniform_real_distribution<float> dist(0.f,1.f);
+  std::vector<float3> input(numPoints);
+  for (auto &p : input)
+    p = make_float3(dist(gen),dist(gen),dist(gen));
+
+  // ------------------------------------------------------------------
+  // bounds only
+  // ------------------------------------------------------------------
+  box_t<float3> serial, bounds;
+  double t_serial = timeBest(nRepeats,[&]() {
+      double t0 = getCurrentTime();
+      serial.setEmpty();
+      for (int i=0;i<numPoints;i++)
+        serial.grow(input[i]);
+      return getCurrentTime()-t0;
+    });
+  auto timeBounds = [&](int numThreads) {
+    return timeBest(nRepeats,[&]() {
+        double t0 = getCurrentTime();
+        host_computeBounds(&bounds,input.data(),numPoints,numThreads);
+        return getCurrentTime()-t0;
+      });
+  };
+  const int numThreads = std::thread::hardware_concurrency();
+  double t_bounds1 = timeBounds(1);
+  double t_boundsN = timeBounds(numThreads);
+  if (memcmp(&serial,&bounds,sizeof(bounds)) != 0)
+    throw std::runtime_error("bounds do not match!");
+
+  // ------------------------------------------------------------------
+  // full (re-)build, with and without precomputed bounds
+  // ------------------------------------------------------------------
+  std::vector<float3> points;
+  HostBuildConfig config;
+  config.inputOrder = UNSORTED_INPUT;
+  auto timeBuild = [&](bool boundsAreValid) {
+    config.worldBoundsAreValid = boundsAreValid;
+    return timeBest(nRepeats,[&]() {
+        points = input;
+        double t0 = getCurrentTime();
+        buildTree_host(points.data(),numPoints,&bounds,config);
+        return getCurrentTime()-t0;
+      });
+  };
+  double t_build = timeBuild(false);
+  double t_buildPrecomputed = timeBuild(true);
+  
+  std::cout << prettyNumber(numPoints) << " points:" << std::endl
+            << "  bounds, serial loop             : " << prettyDouble(t_serial) << "s" << std::endl
+            << "  host_computeBounds, 1 thread    : " << prettyDouble(t_bounds1) << "s" << std::endl
+            << "  host_computeBounds, " << std::setw(3) << numThreads << " thr.   : "
+            << prettyDouble(t_boundsN) << "s ("
+            << std::fixed << std::setprecision(2) << (t_serial/t_boundsN) << "x)"
+            << std::endl
+            << "  buildTree_host                  : " << prettyDouble(t_build) << "s" << std::endl
+            << "  buildTree_host, given bounds    : " << prettyDouble(t_buildPrecomputed) << "s"
+            << std::endl;
+}
+
+int main(int ac, const char **av)
+{
+  std::vector<int> sizes;
+  int nRepeats = 3;
+  for (int i=1;i<ac;i++) {
+    std::string arg = av[i];
+    if (arg[0] != '-')
+      sizes.push_back(std::stoi(arg));
+    else if (arg == "-nr")
+      nRepeats = atoi(av[++i]);
+    else
+      throw std::runtime_error("unknown cmdline arg "+arg);
+  }
+  if (sizes.empty())
+    sizes = { 10000000 };
+  for (auto numPoints : sizes)
+    runBenchmark(numPoints,nRepeats);
+  return 0;
+}
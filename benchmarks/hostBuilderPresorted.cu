@@ -0,0 +1,145 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* compares the (fully sort-based) host builder against the
+   partitioning fast path for spatially sorted inputs, on uniformly
+   random points in random order, in Morton order, and in "nearly"
+   Morton order (a small fraction of points swapped to random
+   places) */
+
+#include "cukd/builder_host.h"
+#include <random>
+#include <cstring>
+#include <iomanip>
+
+using namespace cukd;
+using namespace cukd::common;
+
+/*! spreads the lower 21 bits of 'x' to every third bit */
+inline uint64_t spreadBits3(uint64_t x)
+{
+  x &= 0x1fffff;
+  x = (x | x << 32) & 0x1f00000000ffffull;
+  x = (x | x << 16) & 0x1f0000ff0000ffull;
+  x = (x | x <<  8) & 0x100f00f00f00f00full;
+  x = (x | x <<  4) & 0x10c30c30c30c30c3ull;
+  x = (x | x <<  2) & 0x1249249249249249ull;
+  return x;
+}
+
+/*! morton code of a point in [0,1)^3; with x in the most significant
+    bit of each triple, to match the builder's x-first split order */
+inline uint64_t mortonCode(float3 p)
+{
+  const float scale = float(1<<21);
+  auto quantize = [&](float f)
+  { return uint64_t(std::min(std::max(f*scale,0.f),scale-1.f)); };
+  return
+    (spreadBits3(quantize(p.x)) << 2) |
+    (spreadBits3(quantize(p.y)) << 1) |
+    (spreadBits3(quantize(p.z)) << 0);
+}
+
+void sortByMortonCode(std::vector<float3> &points)
+{
+  std::vector<std::pair<uint64_t,float3>> keyed(points.size());
+  for (size_t i=0;i<points.size();i++)
+    keyed[i] = { mortonCode(points[i]), points[i] };
+  std::sort(keyed.begin(),keyed.end(),
+            [](const std::pair<uint64_t,float3> &a,
+               const std::pair<uint64_t,float3> &b)
+            { return a.first < b.first; });
+  for (size_t i=0;i<points.size();i++)
+    points[i] = keyed[i].second;
+}
+
+double timeBuild(const std::vector<float3> &input,
+                 std::vector<float3> &result,
+                 const HostBuildConfig *config,
+                 int nRepeats)
+{
+  double best = INFINITY;
+  for (int r=0;r<nRepeats;r++) {
+    result = input;
+    double t0 = getCurrentTime();
+    if (config)
+      buildTree_host(result.data(),(int)result.size(),0,*config);
+    else
+      buildTree_host(result.data(),(int)result.size());
+    double t1 = getCurrentTime();
+    best = std::min(best,t1-t0);
+  }
+  return best;
+}
+
+void runBenchmark(const std::string &name,
+                  const std::vector<float3> &input,
+                  int nRepeats)
+{
+  HostBuildConfig detect;
+  std::vector<float3> sortBuilt, fastBuilt;
+  double t_sort = timeBuild(input,sortBuilt,nullptr,nRepeats);
+  double t_fast = timeBuild(input,fastBuilt,&detect,nRepeats);
+  const bool detected = isSpatiallySorted(input.data(),(int)input.size());
+  const bool same
+    = memcmp(sortBuilt.data(),fastBuilt.data(),input.size()*sizeof(float3)) == 0;
+  std::cout << name << ":" << std::endl
+            << "  detected as spatially sorted : " << (detected?"yes":"no") << std::endl
+            << "  sort-based build             : " << prettyDouble(t_sort) << "s" << std::endl
+            << "  with input order detection   : " << prettyDouble(t_fast) << "s" << std::endl
+            << "  speedup                      : "
+            << std::fixed << std::setprecision(2) << (t_sort/t_fast) << "x"
+            << (same ? "" : " (trees differ - valid if there are duplicate coordinates)") << std::endl;
+}
+
+int main(int ac, const char **av)
+{
+  int   numPoints = 1000000;
+  int   nRepeats  = 1;
+  float swapRate  = .01f;
+  for (int i=1;i<ac;i++) {
+    std::string arg = av[i];
+    if (arg[0] != '-')
+      numPoints = std::stoi(arg);
+    else if (arg == "-nr")
+      nRepeats = atoi(av[++i]);
+    else if (arg == "--swap-rate")
+      swapRate = std::stof(av[++i]);
+    else
+      throw std::runtime_error("unknown cmdline arg "+arg);
+  }
+
+  std::mt19937 gen(0x1234);
+  std::uniform_real_distribution<float> dist(0.f,1.f);
+  std::vector<float3> points(numPoints);
+  for (auto &p : points)
+    p = make_float3(dist(gen),dist(gen),dist(gen));
+  std::cout << "building over " << prettyNumber(numPoints)
+            << " uniform random float3s" << std::endl;
+  
+  runBenchmark("random order",points,nRepeats);
+
+  sortByMortonCode(points);
+  runBenchmark("morton order",points,nRepeats);
+
+  const int numSwaps = int(swapRate*numPoints);
+  std::uniform_int_distribution<int> randomIndex(0,numPoints-1);
+  for (int i=0;i<numSwaps;i++)
+    std::swap(points[randomIndex(gen)],points[randomIndex(gen)]);
+  runBenchmark("nearly morton order ("+std::to_string(numSwaps)+" random swaps)",
+               points,nRepeats);
+  return 0;
+}
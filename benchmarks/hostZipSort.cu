@@ -0,0 +1,160 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+/* compares the host port of the bitonic zip-sort against std::sort
+   and thrust::sort(thrust::host,...), on the same kind of (tag,
+   float3) pairs that the builders sort in each level (tags being
+   random subtree IDs on a given level); and the host bitonic builder
+   against the (thrust-sort based) host builder */
+
+#include "cukd/builder_bitonic.h"
+#include <random>
+#include <iomanip>
+
+using namespace cukd;
+using namespace cukd::common;
+
+using ZipLess = bitonicSortBuilder::ZipLess<float3,default_data_traits<float3>>;
+using ZipCompare = thrustSortBuilder::ZipCompare<float3,default_data_traits<float3>>;
+
+template<typename Lambda>
+double timeBest(int nRepeats, const Lambda &func)
+{
+  double best = INFINITY;
+  for (int r=0;r<nRepeats;r++) {
+    double t = func();
+    best = std::min(best,t);
+  }
+  return best;
+}
+
+void checkSorted(const std::vector<uint32_t> &tags,
+                 const std::vector<float3> &points,
+                 const std::string &what)
+{
+  for (size_t i=1;i<tags.size();i++)
+    if (ZipLess{0}({tags[i],points[i]},{tags[i-1],points[i-1]}))
+      throw std::runtime_error(what+" did not sort correctly");
+}
+
+void benchSort(const std::vector<float3> &points, int level, int nRepeats)
+{
+  const int numPoints = (int)points.size();
+  std::mt19937 gen(level);
+  std::uniform_int_distribution<uint32_t> subtree((1u<<level)-1,(2u<<level)-2);
+  std::vector<uint32_t> inputTags(numPoints);
+  for (auto &tag : inputTags) tag = subtree(gen);
+  
+  std::vector<uint32_t> tags;
+  std::vector<float3>   sorted;
+  
+  // std::sort needs the pairs in one array (so that's what we do,
+  // including the conversion back and forth)
+  double t_std = timeBest(nRepeats,[&]() {
+      tags = inputTags; sorted = points;
+      double t0 = getCurrentTime();
+      std::vector<std::pair<uint32_t,float3>> pairs(numPoints);
+      for (int i=0;i<numPoints;i++) pairs[i] = { tags[i],sorted[i] };
+      std::sort(pairs.begin(),pairs.end(),
+                [](const std::pair<uint32_t,float3> &a,
+                   const std::pair<uint32_t,float3> &b)
+                { return ZipLess{0}({a.first,a.second},{b.first,b.second}); });
+      for (int i=0;i<numPoints;i++) { tags[i] = pairs[i].first; sorted[i] = pairs[i].second; }
+      return getCurrentTime()-t0;
+    });
+  checkSorted(tags,sorted,"std::sort");
+
+  double t_thrust = timeBest(nRepeats,[&]() {
+      tags = inputTags; sorted = points;
+      double t0 = getCurrentTime();
+      auto begin = thrust::make_zip_iterator
+        (thrust::make_tuple(tags.data(),sorted.data()));
+      auto end = thrust::make_zip_iterator
+        (thrust::make_tuple(tags.data()+numPoints,sorted.data()+numPoints));
+      thrust::sort(thrust::host,begin,end,ZipCompare(0,sorted.data()));
+      return getCurrentTime()-t0;
+    });
+  checkSorted(tags,sorted,"thrust::sort");
+
+  auto timeZipSort = [&](int numThreads) {
+    double t = timeBest(nRepeats,[&]() {
+        tags = inputTags; sorted = points;
+        double t0 = getCurrentTime();
+        cubit::host_zip_sort(tags.data(),sorted.data(),numPoints,ZipLess{0},numThreads);
+        return getCurrentTime()-t0;
+      });
+    checkSorted(tags,sorted,"cubit::host_zip_sort");
+    return t;
+  };
+  const int numThreads = std::thread::hardware_concurrency();
+  double t_zip1 = timeZipSort(1);
+  double t_zipN = timeZipSort(numThreads);
+  
+  std::cout << "sort, tags on level " << level << ":" << std::endl
+            << "  std::sort (via array of pairs)    : " << prettyDouble(t_std) << "s" << std::endl
+            << "  thrust::sort(thrust::host)        : " << prettyDouble(t_thrust) << "s" << std::endl
+            << "  host_zip_sort, 1 thread           : " << prettyDouble(t_zip1) << "s" << std::endl
+            << "  host_zip_sort, " << std::setw(3) << numThreads << " thread(s)    : "
+            << prettyDouble(t_zipN) << "s" << std::endl;
+}
+
+int main(int ac, const char **av)
+{
+  int numPoints = 1000000;
+  int nRepeats  = 1;
+  for (int i=1;i<ac;i++) {
+    std::string arg = av[i];
+    if (arg[0] != '-')
+      numPoints = std::stoi(arg);
+    else if (arg == "-nr")
+      nRepeats = atoi(av[++i]);
+    else
+      throw std::runtime_error("unknown cmdline arg "+arg);
+  }
+
+  std::mt19937 gen(0x1234);
+  std::uniform_real_distribution<float> dist(0.f,1.f);
+  std::vector<float3> points(numPoints);
+  for (auto &p : points)
+    p = make_float3(dist(gen),dist(gen),dist(gen));
+  std::cout << "sorting/building over " << prettyNumber(numPoints)
+            << " uniform random float3s" << std::endl;
+
+  for (int level : { 0, 4, 12 })
+    benchSort(points,level,nRepeats);
+
+  std::vector<float3> built;
+  double t_host = timeBest(nRepeats,[&]() {
+      built = points;
+      double t0 = getCurrentTime();
+      buildTree_host(built.data(),numPoints);
+      return getCurrentTime()-t0;
+    });
+  double t_bitonic = timeBest(nRepeats,[&]() {
+      built = points;
+      double t0 = getCurrentTime();
+      buildTree_bitonic_host(built.data(),numPoints);
+      return getCurrentTime()-t0;
+    });
+  std::cout << "build:" << std::endl
+            << "  buildTree_host (thrust::sort)     : " << prettyDouble(t_host) << "s"
+            << " (plus ~" << prettyNumber(numPoints*(sizeof(uint32_t)+sizeof(float3)))
+            << "B temp memory for the sort)" << std::endl
+            << "  buildTree_bitonic_host            : " << prettyDouble(t_bitonic) << "s"
+            << " (no temp memory other than tags)" << std::endl;
+  return 0;
+}
@@ -0,0 +1,112 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+/* host fcp query throughput for a tree in regular pages, in
+   transparent huge pages, and in explicit 2MB and 1GB huge pages
+   (where available - see /proc/sys/vm/nr_hugepages; otherwise these
+   fall back to transparent huge pages, which gets reported). Also
+   reports how much of each tree actually sits on huge pages.
+   Uniformly random float3s, by default 100M points and 10M queries */
+
+#include "cukd/builder_host.h"
+#include "cukd/fcp.h"
+#include "cukd/hugepages.h"
+#include <random>
+#include <cstring>
+#include <iomanip>
+#include <atomic>
+#include <thread>
+
+using namespace cukd;
+using namespace cukd::common;
+
+/*! runs all queries on all hardware threads; returns queries per
+    second */
+double runQueries(const std::vector<float3> &queries,
+                  const float3 *tree,
+                  int numPoints)
+{
+  const int numQueries = (int)queries.size();
+  const int blockSize = 1024;
+  std::atomic<int> nextBlock(0);
+  std::atomic<int> checksum(0);
+  double t0 = getCurrentTime();
+  std::vector<std::thread> threads;
+  for (int t=0;t<(int)std::max(1u,std::thread::hardware_concurrency());t++)
+    threads.push_back(std::thread([&]() {
+          int sum = 0;
+          while (true) {
+            const int begin = blockSize*nextBlock++;
+            if (begin >= numQueries) break;
+            const int end = std::min(begin+blockSize,numQueries);
+            for (int q=begin;q<end;q++)
+              sum += stackBased::fcp(queries[q],tree,numPoints);
+          }
+          checksum += sum;
+        }));
+  for (auto &t : threads) t.join();
+  return numQueries/(getCurrentTime()-t0);
+}
+
+int main(int ac, const char **av)
+{
+  int numPoints  = 100000000;
+  int numQueries = 10000000;
+  for (int i=1;i<ac;i++) {
+    std::string arg = av[i];
+    if (arg == "-np")
+      numPoints = std::stoi(av[++i]);
+    else if (arg == "-nq")
+      numQueries = std::stoi(av[++i]);
+    else
+      throw std::runtime_error("unknown cmdline arg "+arg);
+  }
+  std::cout << prettyNumber(numPoints) << " points, "
+            << prettyNumber(numQueries) << " queries" << std::endl;
+  
+  std::mt19937 gen(0x1234);
+  std::uniform_real_distribution<float> dist(0.f,1.f);
+  std::vector<float3> points(numPoints);
+  for (auto &p : points)
+    p = make_float3(dist(gen),dist(gen),dist(gen));
+  buildTree_host(points.data(),numPoints);
+  std::vector<float3> queries(numQueries);
+  for (auto &q : queries)
+    q = make_float3(dist(gen),dist(gen),dist(gen));
+
+  const size_t numBytes = numPoints*sizeof(float3);
+  double qps_baseline = 0.;
+  for (auto mode : { NO_HUGE_PAGES, TRANSPARENT_HUGE_PAGES,
+                     HUGE_PAGES_2MB, HUGE_PAGES_1GB }) {
+    HugePageHostMemoryResource hugePages(mode);
+    float3 *tree = (float3 *)hugePages.malloc(numBytes);
+    memcpy(tree,points.data(),numBytes);
+    const size_t onHugePages = bytesOnHugePages(tree,numBytes);
+    const double qps = runQueries(queries,tree,numPoints);
+    if (mode == NO_HUGE_PAGES) qps_baseline = qps;
+    std::cout << "  " << std::setw(22) << std::left << toString(mode) << ": "
+              << prettyDouble(qps) << " queries/s ("
+              << std::fixed << std::setprecision(2) << (qps/qps_baseline)
+              << "x), " << prettyNumber(onHugePages) << "B of "
+              << prettyNumber(numBytes) << "B on huge pages";
+    if (hugePages.modeOf(tree) != mode)
+      std::cout << " [fell back to " << toString(hugePages.modeOf(tree)) << "]";
+    std::cout << std::endl;
+    hugePages.free(tree);
+  }
+  return 0;
+}
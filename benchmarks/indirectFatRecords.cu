@@ -0,0 +1,125 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+/* host builder vs index-indirect host builder, for float3 points
+   with 0 to 116 bytes of payload: the regular builder moves entire
+   records in every sort of every level, the indirect one only moves
+   each record once */
+
+#include "cukd/builder_host.h"
+#include <random>
+#include <cstring>
+#include <iomanip>
+
+using namespace cukd;
+using namespace cukd::common;
+
+template<int PAYLOAD_BYTES>
+struct Record {
+  float3  position;
+  uint8_t payload[PAYLOAD_BYTES];
+};
+
+template<>
+struct Record<0> {
+  float3  position;
+};
+
+template<int PAYLOAD_BYTES>
+struct Record_traits : public default_data_traits<float3> {
+  using data_t = Record<PAYLOAD_BYTES>;
+  static inline __both__ const float3 &get_point(const data_t &r) { return r.position; }
+  static inline __both__ float get_coord(const data_t &r, int d)
+  { return cukd::get_coord(r.position,d); }
+};
+
+template<typename Lambda>
+double timeBest(int nRepeats, const Lambda &func)
+{
+  double best = INFINITY;
+  for (int r=0;r<nRepeats;r++)
+    best = std::min(best,func());
+  return best;
+}
+
+template<int PAYLOAD_BYTES>
+void runBenchmark(int numPoints, int nRepeats)
+{
+  using record_t = Record<PAYLOAD_BYTES>;
+  using traits_t = Record_traits<PAYLOAD_BYTES>;
+  
+  std::mt19937 gen(0x1234);
+  std::uniform_real_distribution<float> dist(0.f,1.f);
+  std::vector<record_t> input(numPoints);
+  for (int i=0;i<numPoints;i++) {
+    memset(&input[i],0,sizeof(record_t));
+    input[i].position = make_float3(dist(gen),dist(gen),dist(gen));
+  }
+
+  std::vector<record_t> regular, indirect, output(numPoints);
+  double t_regular = timeBest(nRepeats,[&]() {
+      regular = input;
+      double t0 = getCurrentTime();
+      buildTree_host<record_t,traits_t>(regular.data(),numPoints);
+      return getCurrentTime()-t0;
+    });
+  double t_inPlace = timeBest(nRepeats,[&]() {
+      indirect = input;
+      double t0 = getCurrentTime();
+      buildTree_indirect_host<record_t,traits_t>(indirect.data(),numPoints);
+      return getCurrentTime()-t0;
+    });
+  double t_output = timeBest(nRepeats,[&]() {
+      double t0 = getCurrentTime();
+      buildTree_indirect_host<record_t,traits_t>(input.data(),output.data(),numPoints);
+      return getCurrentTime()-t0;
+    });
+  const bool same
+    =  memcmp(regular.data(),indirect.data(),numPoints*sizeof(record_t)) == 0
+    && memcmp(regular.data(),output.data(),numPoints*sizeof(record_t)) == 0;
+  std::cout << std::setw(3) << sizeof(record_t) << "-byte records: "
+            << "regular " << prettyDouble(t_regular) << "s"
+            << ", indirect (in place) " << prettyDouble(t_inPlace) << "s"
+            << ", indirect (to output) " << prettyDouble(t_output) << "s"
+            << ", speedup " << std::fixed << std::setprecision(2)
+            << (t_regular/t_inPlace) << "x"
+            << (same ? "" : " (trees differ - valid if there are duplicate coordinates)")
+            << std::endl;
+}
+
+int main(int ac, const char **av)
+{
+  int numPoints = 1000000;
+  int nRepeats  = 1;
+  for (int i=1;i<ac;i++) {
+    std::string arg = av[i];
+    if (arg[0] != '-')
+      numPoints = std::stoi(arg);
+    else if (arg == "-nr")
+      nRepeats = atoi(av[++i]);
+    else
+      throw std::runtime_error("unknown cmdline arg "+arg);
+  }
+  std::cout << "building over " << prettyNumber(numPoints)
+            << " uniform random points" << std::endl;
+  runBenchmark<0>(numPoints,nRepeats);
+  runBenchmark<4>(numPoints,nRepeats);
+  runBenchmark<20>(numPoints,nRepeats);
+  runBenchmark<52>(numPoints,nRepeats);
+  runBenchmark<116>(numPoints,nRepeats);
+  return 0;
+}
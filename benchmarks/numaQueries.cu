@@ -0,0 +1,114 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+/* host fcp query throughput, with query threads pinned to all NUMA
+   nodes, for a tree that sits entirely on one node (as it does after
+   a single-threaded build or copy), one whose pages are interleaved
+   across nodes, and one replica per node. Uniformly random float3s,
+   by default 10M points and 10M queries */
+
+#include "cukd/builder_host.h"
+#include "cukd/fcp.h"
+#include "cukd/numa.h"
+#include <random>
+#include <cstring>
+#include <iomanip>
+
+using namespace cukd;
+using namespace cukd::common;
+
+/*! runs all queries on pinned threads on all nodes, on the tree
+    returned by treeOf(node); returns queries per second */
+template<typename Lambda>
+double runQueries(const std::vector<float3> &queries,
+                  int numPoints,
+                  const Lambda &treeOf)
+{
+  const int numQueries = (int)queries.size();
+  const int blockSize = 1024;
+  std::atomic<int> nextBlock(0);
+  std::atomic<int> checksum(0);
+  double t0 = getCurrentTime();
+  numa::forEachNode(0,[&](int node, int) {
+      const float3 *tree = treeOf(node);
+      int sum = 0;
+      while (true) {
+        const int begin = blockSize*nextBlock++;
+        if (begin >= numQueries) break;
+        const int end = std::min(begin+blockSize,numQueries);
+        for (int q=begin;q<end;q++)
+          sum += stackBased::fcp(queries[q],tree,numPoints);
+      }
+      checksum += sum;
+    });
+  return numQueries/(getCurrentTime()-t0);
+}
+
+int main(int ac, const char **av)
+{
+  int numPoints  = 10000000;
+  int numQueries = 10000000;
+  for (int i=1;i<ac;i++) {
+    std::string arg = av[i];
+    if (arg == "-np")
+      numPoints = std::stoi(av[++i]);
+    else if (arg == "-nq")
+      numQueries = std::stoi(av[++i]);
+    else
+      throw std::runtime_error("unknown cmdline arg "+arg);
+  }
+  std::cout << numa::numNodes() << " NUMA node(s), " << prettyNumber(numPoints)
+            << " points, " << prettyNumber(numQueries) << " queries" << std::endl;
+  
+  std::mt19937 gen(0x1234);
+  std::uniform_real_distribution<float> dist(0.f,1.f);
+  std::vector<float3> points(numPoints);
+  for (auto &p : points)
+    p = make_float3(dist(gen),dist(gen),dist(gen));
+  buildTree_host(points.data(),numPoints);
+  std::vector<float3> queries(numQueries);
+  for (auto &q : queries)
+    q = make_float3(dist(gen),dist(gen),dist(gen));
+  
+  // all on node 0: copied by a single thread pinned to that node
+  float3 *onOneNode = 0;
+  std::thread([&]() {
+      numa::pinThreadToNode(0);
+      onOneNode = (float3*)malloc(numPoints*sizeof(float3));
+      memcpy(onOneNode,points.data(),numPoints*sizeof(float3));
+    }).join();
+  double qps_oneNode
+    = runQueries(queries,numPoints,[&](int) { return onOneNode; });
+  free(onOneNode);
+  
+  float3 *interleaved = numa::allocate<float3>(numPoints);
+  memcpy(interleaved,points.data(),numPoints*sizeof(float3));
+  double qps_interleaved
+    = runQueries(queries,numPoints,[&](int) { return (const float3*)interleaved; });
+  numa::free(interleaved);
+  
+  numa::ReplicatedTree<float3> replicas(points.data(),numPoints);
+  double qps_replicated
+    = runQueries(queries,numPoints,[&](int node) { return replicas.replica(node); });
+
+  std::cout << "  tree on one node   : " << prettyDouble(qps_oneNode) << " queries/s" << std::endl
+            << "  interleaved pages  : " << prettyDouble(qps_interleaved) << " queries/s" << std::endl
+            << "  replica per node   : " << prettyDouble(qps_replicated) << " queries/s ("
+            << std::fixed << std::setprecision(2) << (qps_replicated/qps_oneNode)
+            << "x)" << std::endl;
+  return 0;
+}
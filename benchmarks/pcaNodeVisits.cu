@@ -0,0 +1,162 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* number of nodes visited (and time taken) by host-side fcp and knn
+   queries on trees over strongly anisotropic, not axis-aligned point
+   sets - a diagonal road corridor, and a slanted facade - with and
+   without rotating the points into their PCA frame first */
+
+#include "cukd/builder_host.h"
+#include "cukd/knn.h"
+#include "cukd/pca.h"
+#include <random>
+#include <iomanip>
+
+using namespace cukd;
+using namespace cukd::common;
+
+struct PointAndDim {
+  float3 point;
+  int    dim;
+};
+
+struct PointAndDim_traits : public default_data_traits<float3> {
+  using data_t = PointAndDim;
+  enum { has_explicit_dim = true };
+  static inline __both__ const float3 &get_point(const PointAndDim &n)
+  { return n.point; }
+  static inline __both__ float get_coord(const PointAndDim &n, int d)
+  { return cukd::get_coord(n.point,d); }
+  static inline __both__ int  get_dim(const PointAndDim &n) { return n.dim; }
+  static inline __both__ void set_dim(PointAndDim &n, int d) { n.dim = d; }
+};
+
+/*! wraps a result type, and counts how many nodes got visited */
+template<typename result_t>
+struct Counting : public result_t {
+  using result_t::result_t;
+  inline float processCandidate(int primID, float dist2)
+  { ++numVisited; return result_t::processCandidate(primID,dist2); }
+  size_t numVisited = 0;
+};
+
+template<typename data_t, typename data_traits>
+void measure(const std::string &name,
+             const std::vector<data_t> &tree,
+             const std::vector<float3> &queries)
+{
+  const int N = (int)tree.size();
+  size_t fcpVisits = 0, knnVisits = 0;
+  double t0 = getCurrentTime();
+  for (auto query : queries) {
+    Counting<FCPResult> result;
+    result.clear(INFINITY);
+    traverse_default<Counting<FCPResult>,data_t,data_traits>
+      (result,query,tree.data(),N);
+    fcpVisits += result.numVisited;
+  }
+  double t1 = getCurrentTime();
+  for (auto query : queries) {
+    Counting<FixedCandidateList<8>> result(INFINITY);
+    traverse_default<Counting<FixedCandidateList<8>>,data_t,data_traits>
+      (result,query,tree.data(),N);
+    knnVisits += result.numVisited;
+  }
+  double t2 = getCurrentTime();
+  const double numQueries = (double)queries.size();
+  std::cout << "  " << std::left << std::setw(26) << name << std::right
+            << " fcp: " << std::setw(7) << std::fixed << std::setprecision(1)
+            << fcpVisits/numQueries << " nodes, "
+            << prettyNumber(size_t(numQueries/(t1-t0))) << " queries/s;"
+            << " knn k=8: " << std::setw(7) << knnVisits/numQueries << " nodes, "
+            << prettyNumber(size_t(numQueries/(t2-t1))) << " queries/s" << std::endl;
+}
+
+void runBenchmark(const std::string &name,
+                  const std::vector<float3> &points,
+                  const std::vector<float3> &queries)
+{
+  std::cout << name << ":" << std::endl;
+  const int N = (int)points.size();
+  auto frame = pca::computeFrame_host(points.data(),N);
+  std::vector<float3> rotated = points, rotatedQueries = queries;
+  pca::transform_host(frame,rotated.data(),N);
+  pca::transform_host(frame,rotatedQueries.data(),(int)queries.size());
+
+  for (int usePCA=0;usePCA<2;usePCA++) {
+    const auto &p = usePCA ? rotated : points;
+    const auto &q = usePCA ? rotatedQueries : queries;
+    std::vector<float3> roundRobin = p;
+    buildTree_host(roundRobin.data(),N);
+    measure<float3,default_data_traits<float3>>
+      (usePCA ? "PCA frame, round-robin" : "axis-aligned, round-robin",roundRobin,q);
+
+    std::vector<PointAndDim> widest(N);
+    for (int i=0;i<N;i++) widest[i] = { p[i], 0 };
+    box_t<float3> bounds;
+    buildTree_host<PointAndDim,PointAndDim_traits>(widest.data(),N,&bounds);
+    measure<PointAndDim,PointAndDim_traits>
+      (usePCA ? "PCA frame, widest dim" : "axis-aligned, widest dim",widest,q);
+  }
+}
+
+int main(int ac, const char **av)
+{
+  int numPoints  = 1000000;
+  int numQueries = 100000;
+  for (int i=1;i<ac;i++) {
+    std::string arg = av[i];
+    if (arg[0] != '-')
+      numPoints = std::stoi(arg);
+    else if (arg == "-nq")
+      numQueries = atoi(av[++i]);
+    else
+      throw std::runtime_error("unknown cmdline arg "+arg);
+  }
+
+  std::mt19937 gen(0x1234);
+  std::uniform_real_distribution<float> uniform(-1.f,1.f);
+  auto generate = [&](int count, float3 a, float3 b, float3 c) {
+    std::vector<float3> result(count);
+    for (auto &p : result) {
+      const float u = uniform(gen), v = uniform(gen), w = uniform(gen);
+      p = make_float3(u*a.x+v*b.x+w*c.x,u*a.y+v*b.y+w*c.y,u*a.z+v*b.z+w*c.z);
+    }
+    return result;
+  };
+  std::cout << prettyNumber(numQueries) << " queries on "
+            << prettyNumber(numPoints) << " points" << std::endl;
+
+  // 2km long, 8m wide, 1m high road corridor, running diagonally
+  {
+    const float3 dir  = make_float3(1000.f*.6917f,1000.f*.6917f,1000.f*.2075f);
+    const float3 side = make_float3(4.f*-.7071f,4.f*.7071f,0.f);
+    const float3 up   = make_float3(.5f*-.1467f,.5f*-.1467f,.5f*.9782f);
+    runBenchmark("road corridor",
+                 generate(numPoints,dir,side,up),
+                 generate(numQueries,dir,side,up));
+  }
+  // 200x50m facade, 20cm thick, at 30 degrees to the x axis, leaning back 10 degrees
+  {
+    const float3 width  = make_float3(100.f*.8660f,100.f*.5f,0.f);
+    const float3 height = make_float3(25.f*-.0868f,25.f*.1504f,25.f*.9848f);
+    const float3 normal = make_float3(.1f*.4924f,.1f*-.8529f,.1f*.1736f);
+    runBenchmark("slanted facade",
+                 generate(numPoints,width,height,normal),
+                 generate(numQueries,width,height,normal));
+  }
+  return 0;
+}
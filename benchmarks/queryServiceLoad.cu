@@ -0,0 +1,145 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+/* load generator for the QueryService (query-service.h): a number of
+   producer threads that each keep a few single-query fcp requests in
+   flight, for a fixed amount of time. Reports throughput and p50/p99
+   request latency, for the producers querying the tree directly
+   (one query at a time, on their own threads) and for the service
+   with a range of maxBatchSize/maxDelay settings - i.e., how much
+   latency each batching setting trades for how much throughput */
+
+#include "cukd/builder_host.h"
+#include "cukd/query-service.h"
+#include <random>
+#include <deque>
+#include <iomanip>
+
+using namespace cukd;
+using namespace cukd::common;
+
+struct LoadResult {
+  double queriesPerSecond;
+  double p50, p99;
+};
+
+/*! runs numProducers threads that each keep 'inFlight' requests going
+    for 'duration' seconds; submit(query) has to return a future */
+template<typename Submit>
+LoadResult runLoad(int numProducers, int inFlight, double duration,
+                   const Submit &submit)
+{
+  std::vector<std::vector<double>> latencies(numProducers);
+  std::vector<std::thread> producers;
+  const double t0 = getCurrentTime();
+  for (int p=0;p<numProducers;p++)
+    producers.push_back(std::thread([&,p]() {
+          std::mt19937 gen(p);
+          std::uniform_real_distribution<float> uniform(0.f,1.f);
+          std::deque<std::pair<std::future<int>,double>> pending;
+          while (true) {
+            const double now = getCurrentTime();
+            if (now-t0 < duration && (int)pending.size() < inFlight) {
+              pending.push_back({submit(make_float3(uniform(gen),uniform(gen),uniform(gen))),
+                                 now});
+              continue;
+            }
+            if (pending.empty()) break;
+            pending.front().first.get();
+            latencies[p].push_back(getCurrentTime()-pending.front().second);
+            pending.pop_front();
+          }
+        }));
+  for (auto &p : producers) p.join();
+  const double t1 = getCurrentTime();
+  
+  std::vector<double> all;
+  for (auto &l : latencies) all.insert(all.end(),l.begin(),l.end());
+  std::sort(all.begin(),all.end());
+  LoadResult result;
+  result.queriesPerSecond = all.size()/(t1-t0);
+  result.p50 = all.empty() ? 0. : all[all.size()/2];
+  result.p99 = all.empty() ? 0. : all[std::min(all.size()-1,size_t(.99*all.size()))];
+  return result;
+}
+
+void print(const std::string &what, const LoadResult &result)
+{
+  std::cout << "  " << std::setw(28) << std::left << what << ": "
+            << std::setw(10) << prettyDouble(result.queriesPerSecond) << " queries/s, "
+            << std::fixed << std::setprecision(1)
+            << "latency p50 " << std::setw(7) << std::right << 1e6*result.p50
+            << "us, p99 " << std::setw(7) << 1e6*result.p99 << "us" << std::endl;
+}
+
+int main(int ac, const char **av)
+{
+  int numPoints    = 10000000;
+  int numProducers = 64;
+  int inFlight     = 4;
+  double duration  = 2.;
+  for (int i=1;i<ac;i++) {
+    std::string arg = av[i];
+    if (arg == "-np")
+      numPoints = std::stoi(av[++i]);
+    else if (arg == "--producers")
+      numProducers = std::stoi(av[++i]);
+    else if (arg == "--in-flight")
+      inFlight = std::stoi(av[++i]);
+    else if (arg == "--duration")
+      duration = std::stod(av[++i]);
+    else
+      throw std::runtime_error("unknown cmdline arg "+arg);
+  }
+  std::cout << prettyNumber(numPoints) << " points, " << numProducers
+            << " producers with " << inFlight << " requests in flight each, "
+            << duration << "s per run" << std::endl;
+  
+  std::mt19937 gen(0x1234);
+  std::uniform_real_distribution<float> uniform(0.f,1.f);
+  std::vector<float3> points(numPoints);
+  for (auto &p : points)
+    p = make_float3(uniform(gen),uniform(gen),uniform(gen));
+  buildTree_host(points.data(),numPoints);
+
+  // baseline: every producer runs its queries itself, one at a time
+  print("direct, one at a time",
+        runLoad(numProducers,inFlight,duration,[&](const float3 &query) {
+            std::promise<int> result;
+            result.set_value(stackBased::fcp(query,points.data(),numPoints));
+            return result.get_future();
+          }));
+
+  for (int maxBatchSize : { 256, 4096 })
+    for (double maxDelay : { 50e-6, 500e-6 }) {
+      QueryServiceConfig config;
+      config.maxBatchSize = maxBatchSize;
+      config.maxDelay     = maxDelay;
+      QueryService<float3> service(points.data(),numPoints,config);
+      LoadResult result
+        = runLoad(numProducers,inFlight,duration,[&](const float3 &query) {
+            return service.fcp(query);
+          });
+      QueryServiceStats stats = service.stats();
+      print("batch "+std::to_string(maxBatchSize)+", delay "
+            +std::to_string(int(1e6*maxDelay))+"us",result);
+      std::cout << "      (" << stats.numBatches << " batches, avg "
+                << (stats.numQueries/std::max(stats.numBatches,size_t(1)))
+                << " queries, " << stats.numFullBatches << " full)" << std::endl;
+    }
+  return 0;
+}
@@ -0,0 +1,97 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+/* host builder (comparison sort per level) vs radix-sort based host
+   builder, on uniformly random float3s; by default for 1M, 10M, and
+   100M points (note the latter needs several GBs of memory) */
+
+#include "cukd/builder_host.h"
+#include "cukd/builder_radix.h"
+#include <random>
+#include <cstring>
+#include <iomanip>
+
+using namespace cukd;
+using namespace cukd::common;
+
+template<typename Lambda>
+double timeBest(int nRepeats, const Lambda &func)
+{
+  double best = INFINITY;
+  for (int r=0;r<nRepeats;r++)
+    best = std::min(best,func());
+  return best;
+}
+
+void runBenchmark(int numPoints, int nRepeats)
+{
+  std::mt19937 gen(0x1234);
+  std::uniform_real_distribution<float> dist(0.f,1.f);
+  std::vector<float3> input(numPoints);
+  for (auto &p : input)
+    p = make_float3(dist(gen),dist(gen),dist(gen));
+
+  std::vector<float3> regular, radix;
+  double t_host = timeBest(nRepeats,[&]() {
+      regular = input;
+      double t0 = getCurrentTime();
+      buildTree_host(regular.data(),numPoints);
+      return getCurrentTime()-t0;
+    });
+  auto timeRadix = [&](int numThreads) {
+    return timeBest(nRepeats,[&]() {
+        radix = input;
+        double t0 = getCurrentTime();
+        buildTree_radix_host(radix.data(),numPoints,0,numThreads);
+        return getCurrentTime()-t0;
+      });
+  };
+  const int numThreads = std::thread::hardware_concurrency();
+  double t_radix1 = timeRadix(1);
+  double t_radixN = timeRadix(numThreads);
+  const bool same
+    = memcmp(regular.data(),radix.data(),numPoints*sizeof(float3)) == 0;
+  std::cout << prettyNumber(numPoints) << " points:" << std::endl
+            << "  buildTree_host                  : " << prettyDouble(t_host) << "s" << std::endl
+            << "  buildTree_radix_host, 1 thread  : " << prettyDouble(t_radix1) << "s" << std::endl
+            << "  buildTree_radix_host, " << std::setw(3) << numThreads << " thr. : "
+            << prettyDouble(t_radixN) << "s" << std::endl
+            << "  speedup                         : "
+            << std::fixed << std::setprecision(2) << (t_host/t_radixN) << "x"
+            << (same ? "" : " (trees differ - valid if there are duplicate coordinates)")
+            << std::endl;
+}
+
+int main(int ac, const char **av)
+{
+  std::vector<int> sizes;
+  int nRepeats = 1;
+  for (int i=1;i<ac;i++) {
+    std::string arg = av[i];
+    if (arg[0] != '-')
+      sizes.push_back(std::stoi(arg));
+    else if (arg == "-nr")
+      nRepeats = atoi(av[++i]);
+    else
+      throw std::runtime_error("unknown cmdline arg "+arg);
+  }
+  if (sizes.empty())
+    sizes = { 1000000, 10000000, 100000000 };
+  for (auto numPoints : sizes)
+    runBenchmark(numPoints,nRepeats);
+  return 0;
+}
@@ -0,0 +1,158 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* speed (and number of points visited) of host-side sf-imp and cct
+   fcp/knn queries on clustered data, without and with subtree bounds
+   tables of different precisions and sizes */
+
+#include "cukd/builder_host.h"
+#include "cukd/knn.h"
+#include <random>
+#include <iomanip>
+
+using namespace cukd;
+using namespace cukd::common;
+
+/*! wraps a result type, and counts how many points got visited */
+template<typename result_t>
+struct Counting : public result_t {
+  using result_t::result_t;
+  inline float processCandidate(int primID, float dist2)
+  { ++numVisited; return result_t::processCandidate(primID,dist2); }
+  size_t numVisited = 0;
+};
+
+template<typename bounds_table_t>
+void measure(const std::string &name,
+             const std::vector<float3> &tree,
+             const box_t<float3> &worldBounds,
+             const std::vector<float3> &queries,
+             const bounds_table_t &table,
+             size_t tableBytes)
+{
+  const int N = (int)tree.size();
+  const double numQueries = (double)queries.size();
+  std::cout << "  " << std::left << std::setw(24) << name << std::right
+            << std::setw(10) << prettyNumber(tableBytes) << "B";
+  for (int useCCT=0;useCCT<2;useCCT++) {
+    size_t fcpVisits = 0, knnVisits = 0;
+    double t0 = getCurrentTime();
+    for (auto query : queries) {
+      Counting<FCPResult> result;
+      result.clear(INFINITY);
+      if (useCCT)
+        traverse_cct<Counting<FCPResult>,float3,default_data_traits<float3>,bounds_table_t>
+          (result,query,worldBounds,tree.data(),N,table);
+      else
+        traverse_sf_imp<Counting<FCPResult>,float3,default_data_traits<float3>,bounds_table_t>
+          (result,query,worldBounds,tree.data(),N,table);
+      fcpVisits += result.numVisited;
+    }
+    double t1 = getCurrentTime();
+    for (auto query : queries) {
+      Counting<FixedCandidateList<8>> result(INFINITY);
+      if (useCCT)
+        traverse_cct<Counting<FixedCandidateList<8>>,float3,
+                     default_data_traits<float3>,bounds_table_t>
+          (result,query,worldBounds,tree.data(),N,table);
+      else
+        traverse_sf_imp<Counting<FixedCandidateList<8>>,float3,
+                        default_data_traits<float3>,bounds_table_t>
+          (result,query,worldBounds,tree.data(),N,table);
+      knnVisits += result.numVisited;
+    }
+    double t2 = getCurrentTime();
+    std::cout << (useCCT ? " | cct" : " | sf-imp")
+              << " fcp: " << std::setw(6) << std::fixed << std::setprecision(1)
+              << fcpVisits/numQueries << " pts, "
+              << std::setw(6) << prettyNumber(size_t(numQueries/(t1-t0))) << "q/s;"
+              << " knn8: " << std::setw(6) << knnVisits/numQueries << " pts, "
+              << std::setw(6) << prettyNumber(size_t(numQueries/(t2-t1))) << "q/s";
+  }
+  std::cout << std::endl;
+}
+
+template<typename table_t>
+void measureTable(const std::string &name,
+                  const std::vector<float3> &tree,
+                  const box_t<float3> &worldBounds,
+                  const std::vector<float3> &queries,
+                  SubtreeBoundsConfig config)
+{
+  table_t table;
+  buildSubtreeBounds_host(table,tree.data(),(int)tree.size(),config);
+  measure(name,tree,worldBounds,queries,table,
+          table.numEntries*sizeof(typename table_t::Entry));
+  free_host(table);
+}
+
+int main(int ac, const char **av)
+{
+  int numPoints   = 1000000;
+  int numQueries  = 100000;
+  int numClusters = 1000;
+  for (int i=1;i<ac;i++) {
+    std::string arg = av[i];
+    if (arg[0] != '-')
+      numPoints = std::stoi(arg);
+    else if (arg == "-nq")
+      numQueries = atoi(av[++i]);
+    else if (arg == "-nc")
+      numClusters = atoi(av[++i]);
+    else
+      throw std::runtime_error("unknown cmdline arg "+arg);
+  }
+
+  // clustered data: gaussian blobs of random sizes, in a unit cube;
+  // queries uniformly distributed in that cube
+  std::mt19937 gen(0x1234);
+  std::uniform_real_distribution<float> uniform(0.f,1.f);
+  std::normal_distribution<float> gaussian(0.f,1.f);
+  std::vector<float3> centers(numClusters);
+  std::vector<float>  sigmas(numClusters);
+  for (int c=0;c<numClusters;c++) {
+    centers[c] = make_float3(uniform(gen),uniform(gen),uniform(gen));
+    sigmas[c]  = .001f+.01f*uniform(gen);
+  }
+  std::vector<float3> points(numPoints);
+  for (int i=0;i<numPoints;i++) {
+    const int c = i % numClusters;
+    points[i] = make_float3(centers[c].x+sigmas[c]*gaussian(gen),
+                            centers[c].y+sigmas[c]*gaussian(gen),
+                            centers[c].z+sigmas[c]*gaussian(gen));
+  }
+  std::vector<float3> queries(numQueries);
+  for (auto &q : queries) q = make_float3(uniform(gen),uniform(gen),uniform(gen));
+
+  box_t<float3> worldBounds;
+  buildTree_host(points.data(),numPoints,&worldBounds);
+
+  std::cout << prettyNumber(numQueries) << " queries on "
+            << prettyNumber(numPoints) << " points in "
+            << numClusters << " clusters" << std::endl;
+  measure("no table",points,worldBounds,queries,NoSubtreeBounds(),0);
+  for (int numLevels : { 8, 12, 16, 32 }) {
+    SubtreeBoundsConfig config;
+    config.maxLevels = numLevels;
+    measureTable<SubtreeBoundsTable<float3>>
+      ("full, top "+std::to_string(numLevels)+" levels",
+       points,worldBounds,queries,config);
+    measureTable<QuantizedSubtreeBoundsTable<float3>>
+      ("quantized, top "+std::to_string(numLevels)+" levels",
+       points,worldBounds,queries,config);
+  }
+  return 0;
+}
@@ -0,0 +1,298 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/*! \file cukd/aggregates.h Precomputed per-subtree aggregates for
+    (regular, balanced) k-d trees.
+
+    An optional, bottom-up pass over an already built tree that
+    computes, for each node, the tight bounding box of, number of, and
+    some user-defined aggregate over the payloads of all the points
+    in the subtree rooted at that node. These get stored in a side
+    array that is indexed exactly like the nodes. Range-count and
+    reduction queries can then take (or reject) whole subtrees based
+    on their bounds, rather than descending to every single point:
+
+    std::vector<cukd::SubtreeAggregate<float3>> aggregates(numPoints);
+    cukd::computeAggregates_host(aggregates.data(),points,numPoints);
+    int count = cukd::countInBox(box,points,aggregates.data(),numPoints);
+
+    Payload aggregates are described by 'aggregate traits', e.g. for
+    summing up photon power:
+
+    struct PowerSum_traits {
+      using payload_t = float;
+      static inline __both__ float payload_of(const Photon &p) { return p.power; }
+      static inline __both__ void  combine(float &a, float b) { a += b; }
+    };
+
+    The arrays have to be recomputed whenever the tree gets rebuilt.
+*/
+
+#pragma once
+
+#include "cukd/reduce.h"
+
+namespace cukd {
+
+  // ==================================================================
+  // INTERFACE SECTION
+  // ==================================================================
+
+  /*! empty payload, for aggregates of just bounds and count */
+  struct NoPayload {};
+
+  /*! aggregate traits for bounds and count only, without any payload */
+  template<typename data_t>
+  struct default_aggregate_traits {
+    using payload_t = NoPayload;
+    static inline __both__ payload_t payload_of(const data_t &) { return {}; }
+    static inline __both__ void combine(payload_t &, const payload_t &) {}
+  };
+
+  /*! aggregate over all points in one subtree */
+  template<typename point_t, typename payload_t=NoPayload>
+  struct SubtreeAggregate {
+    /*! tight bounds of the subtree's points (_not_ the subtree's
+        domain) */
+    box_t<point_t> bounds;
+    /*! number of points in the subtree */
+    int            count;
+    /*! user-defined aggregate over the subtree's payloads */
+    payload_t      payload;
+  };
+
+  /*! the aggregate type for given data and aggregate traits */
+  template<typename data_t,
+           typename data_traits=default_data_traits<data_t>,
+           typename aggregate_traits=default_aggregate_traits<data_t>>
+  using SubtreeAggregateFor
+  = SubtreeAggregate<typename data_traits::point_t,
+                     typename aggregate_traits::payload_t>;
+
+  /*! computes the aggregates for all subtrees of the given tree, on
+      the host; 'aggregates' has to have room for numPoints items */
+  template<typename data_t,
+           typename data_traits=default_data_traits<data_t>,
+           typename aggregate_traits=default_aggregate_traits<data_t>>
+  void computeAggregates_host(SubtreeAggregateFor<data_t,data_traits,aggregate_traits>
+                              *aggregates,
+                              const data_t *points,
+                              int numPoints);
+
+  /*! computes the aggregates for all subtrees of the given tree, on
+      the device (one kernel launch per tree level) */
+  template<typename data_t,
+           typename data_traits=default_data_traits<data_t>,
+           typename aggregate_traits=default_aggregate_traits<data_t>>
+  void computeAggregates(SubtreeAggregateFor<data_t,data_traits,aggregate_traits>
+                         *d_aggregates,
+                         const data_t *d_points,
+                         int numPoints,
+                         cudaStream_t stream=0);
+
+  /*! counts the points inside the given (closed) box */
+  template<typename data_t,
+           typename data_traits=default_data_traits<data_t>,
+           typename aggregate_t=SubtreeAggregateFor<data_t,data_traits>>
+  inline __both__
+  int countInBox(const box_t<typename data_traits::point_t> &box,
+                 const data_t *points,
+                 const aggregate_t *aggregates,
+                 int numPoints);
+
+  namespace stackBased {
+    /*! reduction query (see reduce.h) that uses the given subtree
+        aggregates to skip subtrees whose bounds are out of range,
+        and to pass subtrees whose bounds are entirely within the
+        radius to the reducer in one go, as
+
+        reducer.addSubtree(const aggregate_t &aggregate,
+                           float minDist2, float maxDist2);
+
+        with the square distances from the query point to the
+        closest and farthest point of the subtree's bounds. Reducers
+        for which that is not exact (e.g., with kernels that fall
+        off with distance) can use these to approximate. */
+    template<typename reducer_t,
+             typename data_t,
+             typename data_traits=default_data_traits<data_t>,
+             typename aggregate_t=SubtreeAggregateFor<data_t,data_traits>>
+    inline __both__
+    void reduce(reducer_t &reducer,
+                typename data_traits::point_t queryPoint,
+                float radius,
+                const data_t *d_nodes,
+                const aggregate_t *d_aggregates,
+                int numPoints);
+  } // ::cukd::stackBased
+
+  // ==================================================================
+  // IMPLEMENTATION SECTION
+  // ==================================================================
+
+  template<typename data_t,
+           typename data_traits,
+           typename aggregate_traits>
+  inline __both__
+  void computeAggregate(SubtreeAggregateFor<data_t,data_traits,aggregate_traits>
+                        *aggregates,
+                        const data_t *points,
+                        int numPoints,
+                        int nodeID)
+  {
+    auto &agg = aggregates[nodeID];
+    agg.bounds.lower = agg.bounds.upper = data_traits::get_point(points[nodeID]);
+    agg.count   = 1;
+    agg.payload = aggregate_traits::payload_of(points[nodeID]);
+    for (int child=BinaryTree::leftChildOf(nodeID), i=0; i<2; child++, i++) {
+      if (child >= numPoints) break;
+      const auto &childAgg = aggregates[child];
+      agg.bounds.lower = min(agg.bounds.lower,childAgg.bounds.lower);
+      agg.bounds.upper = max(agg.bounds.upper,childAgg.bounds.upper);
+      agg.count += childAgg.count;
+      aggregate_traits::combine(agg.payload,childAgg.payload);
+    }
+  }
+
+  template<typename data_t,
+           typename data_traits,
+           typename aggregate_traits>
+  void computeAggregates_host(SubtreeAggregateFor<data_t,data_traits,aggregate_traits>
+                              *aggregates,
+                              const data_t *points,
+                              int numPoints)
+  {
+    // children always have larger IDs than their parents
+    for (int nodeID=numPoints-1;nodeID>=0;--nodeID)
+      computeAggregate<data_t,data_traits,aggregate_traits>
+        (aggregates,points,numPoints,nodeID);
+  }
+
+  template<typename data_t,
+           typename data_traits,
+           typename aggregate_traits>
+  __global__
+  void computeAggregatesOfLevel(SubtreeAggregateFor<data_t,data_traits,aggregate_traits>
+                                *aggregates,
+                                const data_t *points,
+                                int numPoints,
+                                int level)
+  {
+    const int nodeID = ((1<<level)-1) + threadIdx.x+blockIdx.x*blockDim.x;
+    if (nodeID >= min(numPoints,(2<<level)-1)) return;
+    computeAggregate<data_t,data_traits,aggregate_traits>
+      (aggregates,points,numPoints,nodeID);
+  }
+
+  template<typename data_t,
+           typename data_traits,
+           typename aggregate_traits>
+  void computeAggregates(SubtreeAggregateFor<data_t,data_traits,aggregate_traits>
+                         *d_aggregates,
+                         const data_t *d_points,
+                         int numPoints,
+                         cudaStream_t stream)
+  {
+    if (numPoints < 1) return;
+    for (int level=BinaryTree::levelOf(numPoints-1);level>=0;--level) {
+      const int numNodesOnLevel = 1<<level;
+      computeAggregatesOfLevel<data_t,data_traits,aggregate_traits>
+        <<<divRoundUp(numNodesOnLevel,128),128,0,stream>>>
+        (d_aggregates,d_points,numPoints,level);
+    }
+  }
+
+  template<typename data_t,
+           typename data_traits,
+           typename aggregate_t>
+  inline __both__
+  int countInBox(const box_t<typename data_traits::point_t> &box,
+                 const data_t *points,
+                 const aggregate_t *aggregates,
+                 int numPoints)
+  {
+    if (numPoints < 1) return 0;
+
+    // pushing both children of each opened node never needs more
+    // than one entry per tree level
+    enum { stack_depth = 64 };
+    int stackBase[stack_depth];
+    int *stackPtr = stackBase;
+    *stackPtr++ = 0;
+
+    int count = 0;
+    while (stackPtr > stackBase) {
+      const int nodeID = *--stackPtr;
+      CUKD_DEVICE_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
+      const auto &agg = aggregates[nodeID];
+      if (!box.overlaps(agg.bounds))
+        continue;
+      if (box.contains(agg.bounds)) {
+        count += agg.count;
+        continue;
+      }
+      if (box.contains(data_traits::get_point(points[nodeID])))
+        count++;
+      const int lChild = BinaryTree::leftChildOf(nodeID);
+      if (lChild+1 < numPoints) *stackPtr++ = lChild+1;
+      if (lChild   < numPoints) *stackPtr++ = lChild;
+    }
+    return count;
+  }
+
+  template<typename reducer_t,
+           typename data_t,
+           typename data_traits,
+           typename aggregate_t>
+  inline __both__
+  void stackBased::reduce(reducer_t &reducer,
+                          typename data_traits::point_t queryPoint,
+                          float radius,
+                          const data_t *d_nodes,
+                          const aggregate_t *d_aggregates,
+                          int numPoints)
+  {
+    if (numPoints < 1) return;
+    const float radius2 = sqr(radius);
+
+    enum { stack_depth = 64 };
+    int stackBase[stack_depth];
+    int *stackPtr = stackBase;
+    *stackPtr++ = 0;
+
+    while (stackPtr > stackBase) {
+      const int nodeID = *--stackPtr;
+      CUKD_DEVICE_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
+      const auto &agg = d_aggregates[nodeID];
+      const float minDist2 = (float)sqrDistance(agg.bounds,queryPoint);
+      if (minDist2 >= radius2)
+        continue;
+      const float maxDist2 = (float)sqrMaxDistance(agg.bounds,queryPoint);
+      if (maxDist2 < radius2) {
+        reducer.addSubtree(agg,minDist2,maxDist2);
+        continue;
+      }
+      const float dist2
+        = (float)sqrDistance(data_traits::get_point(d_nodes[nodeID]),queryPoint);
+      if (dist2 < radius2)
+        reducer.add(nodeID,d_nodes[nodeID],dist2);
+      const int lChild = BinaryTree::leftChildOf(nodeID);
+      if (lChild+1 < numPoints) *stackPtr++ = lChild+1;
+      if (lChild   < numPoints) *stackPtr++ = lChild;
+    }
+  }
+
+} // ::cukd
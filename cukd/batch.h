@@ -0,0 +1,377 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+/*! \file cukd/batch.h Host-side batch queries on a work-stealing
+    scheduler.
+
+    Query costs can differ by orders of magnitude within one batch: a
+    query inside a dense cluster is done after a few nodes, one in a
+    void (or far away from all data) may have to visit a good part of
+    the tree. Cutting a batch into one static range per thread then
+    leaves most cores idle while the unlucky ones finish.
+
+    The batch fcp/knn/reduce calls in this file instead run on a
+    WorkStealingRanges scheduler: every thread starts out owning one
+    contiguous range of queries (so neighboring - and, for
+    spatially sorted queries, coherent - queries stay on the same
+    thread), and takes chunks off the front of that; chunks start
+    out large and shrink as the range runs empty. Threads that run
+    out steal the back half of whatever range has the most work
+    left. Owning and stealing are each a single compare-and-swap on
+    a (begin,end) pair, so there are no locks anywhere:
+
+    std::vector<int> closest(numQueries);
+    cukd::batch::fcp_host<float3>(queries,numQueries,closest.data(),
+                                  tree,numPoints);
+
+    parallelFor_workStealing() exposes the scheduler for other kinds
+    of per-item work; parallelForPerThread_workStealing() additionally
+    passes the thread ID, for work that keeps per-thread scratch
+    memory (such as knn_host()'s candidate lists) across chunks.
+*/
+
+#pragma once
+
+#include "cukd/fcp.h"
+#include "cukd/reduce.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace cukd {
+
+  // ==================================================================
+  // INTERFACE SECTION
+  // ==================================================================
+
+  /*! statistics of a work-stealing run */
+  struct WorkStealingStats {
+    /*! number of chunks handed out, in total */
+    size_t numChunks = 0;
+    /*! number of successful steals */
+    size_t numSteals = 0;
+  };
+  
+  /*! work-stealing scheduler for the items [0,numItems): each of the
+      numThreads threads calls run(threadID,func) (with a distinct
+      threadID in [0,numThreads)), which calls func(begin,end) for
+      chunks of items until all items are done; see top of file */
+  struct WorkStealingRanges {
+    WorkStealingRanges(int numItems,
+                       int numThreads,
+                       /*! smallest chunk handed out (except for the
+                           very last items of a range) */
+                       int minChunkSize = 16);
+
+    template<typename Lambda>
+    void run(int threadID, const Lambda &func);
+
+    const int numThreads;
+    const int minChunkSize;
+    std::atomic<size_t> numChunks;
+    std::atomic<size_t> numSteals;
+  private:
+    static inline uint64_t   pack(uint32_t begin, uint32_t end)
+    { return (uint64_t(begin) << 32) | end; }
+    static inline uint32_t   beginOf(uint64_t range) { return uint32_t(range >> 32); }
+    static inline uint32_t   endOf(uint64_t range)   { return uint32_t(range); }
+
+    /*! takes the next chunk off the front of thread t's range;
+        returns false if that is empty */
+    inline bool take(int t, uint32_t &begin, uint32_t &end);
+    /*! moves the back half of the fullest other range to thread t's
+        range; returns false if there is nothing left to steal */
+    inline bool steal(int t);
+    
+    /*! one (begin,end) range per thread, padded to a cache line so
+        threads do not false-share their ranges */
+    struct Slot {
+      std::atomic<uint64_t> range;
+      char                  padding[64-sizeof(std::atomic<uint64_t>)];
+    };
+    std::vector<Slot> slots;
+  };
+
+  /*! calls func(begin,end) for chunks of [0,numItems), on numThreads
+      threads, with work stealing between those threads */
+  template<typename Lambda>
+  void parallelFor_workStealing(int numItems,
+                                const Lambda &func,
+                                int numThreads = std::thread::hardware_concurrency(),
+                                WorkStealingStats *stats = 0,
+                                int minChunkSize = 16);
+
+  /*! same as parallelFor_workStealing(), but calls
+      func(threadID,begin,end), with threadID in
+      [0,max(numThreads,1)) and unique to the calling thread, so func
+      can keep per-thread state in an array indexed by threadID */
+  template<typename Lambda>
+  void parallelForPerThread_workStealing(int numItems,
+                                         const Lambda &func,
+                                         int numThreads = std::thread::hardware_concurrency(),
+                                         WorkStealingStats *stats = 0,
+                                         int minChunkSize = 16);
+  
+  namespace batch {
+    /*! find-closest-point for each of the numQueries queries, using
+        the default stack-based traversal; writes the ID of the
+        closest point (or -1) to results[q] */
+    template<typename data_t,
+             typename data_traits=default_data_traits<data_t>>
+    void fcp_host(const typename data_traits::point_t *queries,
+                  int numQueries,
+                  int *results,
+                  const data_t *tree,
+                  int numPoints,
+                  FcpSearchParams params = FcpSearchParams{},
+                  int numThreads = std::thread::hardware_concurrency(),
+                  WorkStealingStats *stats = 0);
+
+    /*! k nearest points (within cutOffRadius) for each query; writes
+        numQueries*k point IDs (sorted by distance, -1 for unused
+        entries) to results, and, if non-null, their square
+        distances to resultDist2. The candidate lists (one per
+        thread) come from memResource */
+    template<typename data_t,
+             typename data_traits=default_data_traits<data_t>>
+    void knn_host(const typename data_traits::point_t *queries,
+                  int numQueries,
+                  int k,
+                  float cutOffRadius,
+                  int *results,
+                  float *resultDist2,
+                  const data_t *tree,
+                  int numPoints,
+                  int numThreads = std::thread::hardware_concurrency(),
+                  WorkStealingStats *stats = 0,
+                  HostMemoryResource &memResource = defaultHostMemResource());
+
+    /*! radius query: passes each point within 'radius' of query q to
+        reducers[q].add() (see reduce.h) */
+    template<typename reducer_t,
+             typename data_t,
+             typename data_traits=default_data_traits<data_t>>
+    void reduce_host(reducer_t *reducers,
+                     const typename data_traits::point_t *queries,
+                     int numQueries,
+                     float radius,
+                     const data_t *tree,
+                     int numPoints,
+                     int numThreads = std::thread::hardware_concurrency(),
+                     WorkStealingStats *stats = 0);
+  } // ::cukd::batch
+  
+  // ==================================================================
+  // IMPLEMENTATION SECTION
+  // ==================================================================
+
+  inline WorkStealingRanges::WorkStealingRanges(int numItems,
+                                                int numThreads,
+                                                int minChunkSize)
+    : numThreads(std::max(numThreads,1)),
+      minChunkSize(std::max(minChunkSize,1)),
+      numChunks(0),
+      numSteals(0),
+      slots(std::max(numThreads,1))
+  {
+    numItems = std::max(numItems,0);
+    for (int t=0;t<this->numThreads;t++)
+      slots[t].range.store(pack(uint32_t(size_t(numItems)*t/this->numThreads),
+                                uint32_t(size_t(numItems)*(t+1)/this->numThreads)));
+  }
+
+  inline bool WorkStealingRanges::take(int t, uint32_t &begin, uint32_t &end)
+  {
+    uint64_t range = slots[t].range.load();
+    while (true) {
+      const uint32_t b = beginOf(range), e = endOf(range);
+      if (b >= e) return false;
+      // large chunks while there is lots of work left, for low
+      // overhead; ever smaller ones towards the end, so the last
+      // chunks of all threads finish at about the same time
+      const uint32_t chunk
+        = std::min(e-b,std::max(uint32_t(minChunkSize),(e-b)/8));
+      if (slots[t].range.compare_exchange_weak(range,pack(b+chunk,e))) {
+        begin = b;
+        end   = b+chunk;
+        return true;
+      }
+    }
+  }
+
+  inline bool WorkStealingRanges::steal(int t)
+  {
+    while (true) {
+      // find the victim with the most work left
+      int victim = -1;
+      uint64_t victimRange = 0;
+      uint32_t mostLeft = 0;
+      for (int i=1;i<numThreads;i++) {
+        const int v = (t+i) % numThreads;
+        const uint64_t range = slots[v].range.load();
+        const uint32_t left
+          = beginOf(range) < endOf(range) ? endOf(range)-beginOf(range) : 0;
+        if (left > mostLeft) {
+          mostLeft    = left;
+          victim      = v;
+          victimRange = range;
+        }
+      }
+      if (victim < 0) return false;
+      const uint32_t b = beginOf(victimRange), e = endOf(victimRange);
+      // leave the victim its next chunk; take the back half of the
+      // rest (or the last chunk, if that is all there is)
+      const uint32_t mid = (mostLeft <= uint32_t(minChunkSize)) ? b : b+(e-b+1)/2;
+      if (slots[victim].range.compare_exchange_strong(victimRange,pack(b,mid))) {
+        // our own range is empty, so nobody else can touch it
+        // (thieves only CAS non-empty ranges)
+        slots[t].range.store(pack(mid,e));
+        numSteals++;
+        return true;
+      }
+    }
+  }
+
+  template<typename Lambda>
+  void WorkStealingRanges::run(int threadID, const Lambda &func)
+  {
+    size_t myChunks = 0;
+    uint32_t begin, end;
+    while (true) {
+      while (take(threadID,begin,end)) {
+        func(int(begin),int(end));
+        myChunks++;
+      }
+      if (!steal(threadID)) break;
+    }
+    numChunks += myChunks;
+  }
+  
+  template<typename Lambda>
+  void parallelFor_workStealing(int numItems,
+                                const Lambda &func,
+                                int numThreads,
+                                WorkStealingStats *stats,
+                                int minChunkSize)
+  {
+    parallelForPerThread_workStealing
+      (numItems,[&func](int, int begin, int end) { func(begin,end); },
+       numThreads,stats,minChunkSize);
+  }
+  
+  template<typename Lambda>
+  void parallelForPerThread_workStealing(int numItems,
+                                         const Lambda &func,
+                                         int numThreads,
+                                         WorkStealingStats *stats,
+                                         int minChunkSize)
+  {
+    if (numItems <= 0) return;
+    numThreads
+      = std::max(1,std::min(numThreads,divRoundUp(numItems,std::max(minChunkSize,1))));
+    WorkStealingRanges ranges(numItems,numThreads,minChunkSize);
+    auto runThread = [&ranges,&func](int t) {
+      ranges.run(t,[&func,t](int begin, int end) { func(t,begin,end); });
+    };
+    if (numThreads == 1)
+      runThread(0);
+    else {
+      std::vector<std::thread> threads;
+      for (int t=0;t<numThreads;t++)
+        threads.push_back(std::thread(runThread,t));
+      for (auto &t : threads) t.join();
+    }
+    if (stats) {
+      stats->numChunks += ranges.numChunks;
+      stats->numSteals += ranges.numSteals;
+    }
+  }
+
+  template<typename data_t, typename data_traits>
+  void batch::fcp_host(const typename data_traits::point_t *queries,
+                       int numQueries,
+                       int *results,
+                       const data_t *tree,
+                       int numPoints,
+                       FcpSearchParams params,
+                       int numThreads,
+                       WorkStealingStats *stats)
+  {
+    parallelFor_workStealing
+      (numQueries,[&](int begin, int end) {
+        for (int q=begin;q<end;q++)
+          results[q] = stackBased::fcp<data_t,data_traits>
+            (queries[q],tree,numPoints,params);
+      },numThreads,stats);
+  }
+  
+  template<typename data_t, typename data_traits>
+  void batch::knn_host(const typename data_traits::point_t *queries,
+                       int numQueries,
+                       int k,
+                       float cutOffRadius,
+                       int *results,
+                       float *resultDist2,
+                       const data_t *tree,
+                       int numPoints,
+                       int numThreads,
+                       WorkStealingStats *stats,
+                       HostMemoryResource &memResource)
+  {
+    // one candidate list per thread, allocated on that thread's
+    // first chunk, and re-used for all its later ones
+    std::vector<std::unique_ptr<HostCandidateList>>
+      candidatesOf(std::max(numThreads,1));
+    parallelForPerThread_workStealing
+      (numQueries,[&](int threadID, int begin, int end) {
+        std::unique_ptr<HostCandidateList> &candidates = candidatesOf[threadID];
+        if (!candidates)
+          candidates.reset(new HostCandidateList(k,cutOffRadius,memResource));
+        for (int q=begin;q<end;q++) {
+          candidates->clear(cutOffRadius*cutOffRadius);
+          stackBased::knn<HostCandidateList,data_t,data_traits>
+            (*candidates,queries[q],tree,numPoints);
+          for (int i=0;i<k;i++) {
+            results[size_t(q)*k+i] = candidates->get_pointID(i);
+            if (resultDist2)
+              resultDist2[size_t(q)*k+i] = candidates->get_dist2(i);
+          }
+        }
+      },numThreads,stats);
+  }
+  
+  template<typename reducer_t, typename data_t, typename data_traits>
+  void batch::reduce_host(reducer_t *reducers,
+                          const typename data_traits::point_t *queries,
+                          int numQueries,
+                          float radius,
+                          const data_t *tree,
+                          int numPoints,
+                          int numThreads,
+                          WorkStealingStats *stats)
+  {
+    parallelFor_workStealing
+      (numQueries,[&](int begin, int end) {
+        for (int q=begin;q<end;q++)
+          stackBased::reduce<reducer_t,data_t,data_traits>
+            (reducers[q],queries[q],radius,tree,numPoints);
+      },numThreads,stats);
+  }
+  
+} // ::cukd
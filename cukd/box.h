@@ -29,6 +29,8 @@ namespace cukd {
   template<> inline __both__ float empty_box_upper<float>() { return -INFINITY; }
   template<> inline __both__ int empty_box_lower<int>() { return INT_MAX; }
   template<> inline __both__ int empty_box_upper<int>() { return INT_MIN; }
+  template<> inline __both__ double empty_box_lower<double>() { return +INFINITY; }
+  template<> inline __both__ double empty_box_upper<double>() { return -INFINITY; }
   
 
   template<typename point_t>
@@ -51,6 +53,21 @@ namespace cukd {
       return true;
     }
 
+    /*! returns true if the other box is entirely inside this one */
+    inline __both__ bool contains(const box_t &other) const
+    { return contains(other.lower) && contains(other.upper); }
+
+    /*! returns true if the two boxes share at least one point */
+    inline __both__ bool overlaps(const box_t &other) const
+    {
+      enum { num_dims = num_dims_of<point_t>::value };
+      for (int d=0;d<num_dims;d++) {
+        if (point_traits::get_coord(other.upper,d) < point_traits::get_coord(lower,d)) return false;
+        if (point_traits::get_coord(other.lower,d) > point_traits::get_coord(upper,d)) return false;
+      }
+      return true;
+    }
+
     inline __both__ void grow(const point_t &p)
     {
       lower = min(lower,p);
@@ -94,7 +111,7 @@ namespace cukd {
     itself, otherwise it'll be a point on the outside surface of the
     box */
   template<typename point_t>
-  inline __device__
+  inline __both__
   point_t project(const cukd::box_t<point_t>  &box,
                   const point_t               &point)
   {
@@ -103,10 +120,25 @@ namespace cukd {
 
   // ------------------------------------------------------------------
   template<typename point_t>
-  inline __device__
+  inline __both__
   auto sqrDistance(const box_t<point_t> &box, const point_t &point)
   { return cukd::sqrDistance(project(box,point),point); }
 
+  /*! square distance from 'point' to the farthest point of the box */
+  template<typename point_t>
+  inline __both__
+  auto sqrMaxDistance(const box_t<point_t> &box, const point_t &point)
+  {
+    using scalar_t = typename scalar_type_of<point_t>::type;
+    enum { num_dims = num_dims_of<point_t>::value };
+    typename dist2_type_of<scalar_t>::type sum = 0;
+    for (int d=0;d<num_dims;d++) {
+      const scalar_t p = get_coord(point,d);
+      sum += sqr(max(p-get_coord(box.lower,d),get_coord(box.upper,d)-p));
+    }
+    return sum;
+  }
+
   template<typename point_t>
   /*! returns the dimension in which the box has the widest extent */
   inline __both__ int box_t<point_t>::widestDimension() const
@@ -44,6 +44,11 @@
   - perf   1M float3s (4090) : ~220ms
   - perf  10M float3s (4090) : ~4.3s
 
+  To pick at runtime rather than with the CUKD_BUILDER_... defines,
+  pass a MemoryBudget to buildTree(), which then uses the fastest of
+  these that fits; tempMemoryNeeded() reports the numbers above for a
+  given N and sizeof(data_t).
+
  */
 
 #include "cukd/builder_thrust.h"
@@ -149,5 +154,92 @@ namespace cukd {
       (d_points,numPoints,worldBounds,stream,memResource);
 #endif
   }
+
+  /*! the device builders that buildTree() can choose from, from
+      fastest (and most memory-hungry) to slowest */
+  typedef enum {
+    BUILDER_THRUST = 0,
+    BUILDER_BITONIC,
+    BUILDER_INPLACE
+  } BuilderType;
+
+  inline const char *toString(BuilderType builder)
+  {
+    switch (builder) {
+    case BUILDER_THRUST:  return "thrust";
+    case BUILDER_BITONIC: return "bitonic";
+    case BUILDER_INPLACE: return "inPlace";
+    }
+    return "<invalid builder>";
+  }
+
+  /*! upper limit for how much temporary device memory a buildTree()
+      may use, in bytes */
+  struct MemoryBudget {
+    size_t bytes;
+  };
+  
+  /*! (estimated) number of bytes of temporary device memory that the
+      given builder needs to build a tree over numPoints data points of
+      sizeOfData bytes each; not counting the input data itself. For
+      the thrust builder this is an upper estimate (one tag per point,
+      plus what thrust's merge sort needs for its double-buffered
+      (tag,point) pairs), for the others it is exact */
+  inline size_t tempMemoryNeeded(BuilderType builder,
+                                 size_t numPoints,
+                                 size_t sizeOfData)
+  {
+    switch (builder) {
+    case BUILDER_THRUST:
+      return numPoints*sizeof(uint32_t)
+        + 2*numPoints*(sizeof(uint32_t)+sizeOfData);
+    case BUILDER_BITONIC:
+      return numPoints*sizeof(uint32_t);
+    default:
+      return 0;
+    }
+  }
+
+  /*! the fastest builder that gets by with the given budget of
+      temporary memory; the in-place builder always does */
+  inline BuilderType chooseBuilder(size_t numPoints,
+                                   size_t sizeOfData,
+                                   MemoryBudget budget)
+  {
+    for (BuilderType builder : { BUILDER_THRUST, BUILDER_BITONIC })
+      if (tempMemoryNeeded(builder,numPoints,sizeOfData) <= budget.bytes)
+        return builder;
+    return BUILDER_INPLACE;
+  }
+
+  /*! same as buildTree(), but rather than picking the builder at
+      compile time (through the CUKD_BUILDER_... defines), picks the
+      fastest one whose temporary memory fits into the given budget
+      (see chooseBuilder()); returns the builder that was used */
+  template<typename data_t, typename data_traits=default_data_traits<data_t>>
+  BuilderType buildTree(data_t *d_points,
+                        int numPoints,
+                        MemoryBudget budget,
+                        box_t<typename data_traits::point_t> *worldBounds=0,
+                        cudaStream_t stream=0,
+                        GpuMemoryResource &memResource=defaultGpuMemResource())
+  {
+    const BuilderType builder
+      = chooseBuilder(std::max(numPoints,0),sizeof(data_t),budget);
+    switch (builder) {
+    case BUILDER_THRUST:
+      buildTree_thrust<data_t,data_traits>
+        (d_points,numPoints,worldBounds,stream,memResource);
+      break;
+    case BUILDER_BITONIC:
+      buildTree_bitonic<data_t,data_traits>
+        (d_points,numPoints,worldBounds,stream,memResource);
+      break;
+    default:
+      buildTree_inPlace<data_t,data_traits>
+        (d_points,numPoints,worldBounds,stream,memResource);
+    }
+    return builder;
+  }
 }
 
@@ -17,8 +17,12 @@
 #pragma once
 
 #include "cukd/builder_common.h"
+/* for the (host-side) per-point tag updates */
+#include "cukd/builder_thrust.h"
 /* cuda bitonic sort package */
 #include "cukd/cubit/cubit_zip.h"
+/* ... and its host port */
+#include "cukd/cubit/cubit_zip_host.h"
 
 namespace cukd {
 
@@ -93,6 +97,21 @@ namespace cukd {
                            mem) */
                          GpuMemoryResource &memResource=defaultGpuMemResource());
 
+  /*! host version of buildTree_bitonic(): builds the same tree, over
+      host read/writeable data (using managed memory is fine), using
+      the host port of the same in-place bitonic zip-sort. Unlike
+      buildTree_host() - whose thrust sort needs about as much
+      temporary memory as the input data - this needs no memory other
+      than one uint32_t tag per point; and uses up to numThreads
+      threads for both sorts and tag updates. */
+  template<typename data_t,
+           typename data_traits=default_data_traits<data_t>>
+  void buildTree_bitonic_host(data_t *points,
+                              int numPoints,
+                              cukd::box_t<typename data_traits::point_t> *worldBounds = 0,
+                              int numThreads = std::thread::hardware_concurrency(),
+                              HostMemoryResource &memResource = defaultHostMemResource());
+
   // ==================================================================
   // IMPLEMENTATION SECTION
   // ==================================================================
@@ -100,7 +119,7 @@ namespace cukd {
     
     template<typename data_t, typename data_traits>
     struct ZipLess {
-      inline __device__
+      inline __both__
       bool operator()(const cubit::tuple<uint32_t, data_t> &a,
                       const cubit::tuple<uint32_t, data_t> &b) const;
       int dim;
@@ -317,7 +336,7 @@ namespace cukd {
       order, and the second the minor one (for those of same major
       sort key) */
     template<typename data_t, typename data_traits>
-    inline __device__
+    inline __both__
     bool ZipLess<data_t,data_traits>::operator()
       (const cubit::tuple<uint32_t, data_t> &a,
        const cubit::tuple<uint32_t, data_t> &b) const
@@ -341,6 +360,57 @@ namespace cukd {
       return coord_a < coord_b;
     }
 
+    template<typename data_t, typename data_traits>
+    void host_buildTree(data_t *points,
+                        int numPoints,
+                        const box_t<typename data_traits::point_t> *worldBounds,
+                        int numThreads,
+                        HostMemoryResource &memResource)
+    {
+      using point_t  = typename data_traits::point_t;
+      using point_traits = ::cukd::point_traits<point_t>;
+      enum { num_dims = point_traits::num_dims };
+      
+      if (numPoints < 1) return;
+
+      HostVector<uint32_t> tags(numPoints,HostAllocator<uint32_t>(memResource));
+      uint32_t *const d_tags = tags.data();
+      
+      const int numLevels = BinaryTree::numLevelsFor(numPoints);
+      const int deepestLevel = numLevels-1;
+
+      if (data_traits::has_explicit_dim)
+        thrustSortBuilder::host_chooseInitialDim<data_t,data_traits>
+          (worldBounds,points,numPoints);
+
+      for (int level=0;level<deepestLevel;level++) {
+        cubit::host_zip_sort(d_tags,points,numPoints,
+                             ZipLess<data_t,data_traits>{level%num_dims},
+                             numThreads);
+        // with explicit dims, each point's update walks up the tree
+        // to find its subtree's bounds, so this is worth spreading
+        // over threads, too
+        cubit::zip_host::parallel_for
+          (numPoints,numThreads,cubit::zip_host::min_pairs_per_thread,
+           [&](size_t begin, size_t end) {
+             for (int gid=(int)begin;gid<(int)end;gid++)
+               if (data_traits::has_explicit_dim)
+                 thrustSortBuilder::updateTagAndSetDim<data_t,data_traits>
+                   (gid,worldBounds,d_tags,points,numPoints,level);
+               else
+                 thrustSortBuilder::updateTag(gid,d_tags,numPoints,level);
+           });
+      }
+      
+      /* do one final sort, to put all elements in order - by now every
+         element has its final (and unique) nodeID stored in the tag[]
+         array, so the dimension we're sorting in really won't matter
+         any more */
+      cubit::host_zip_sort(d_tags,points,numPoints,
+                           ZipLess<data_t,data_traits>{deepestLevel%num_dims},
+                           numThreads);
+    }
+    
   } // ::cukd::bitonicSortBuilder
 
   template<typename data_t, typename data_traits>
@@ -378,4 +448,25 @@ namespace cukd {
       (d_points,numPoints,worldBounds,stream,memResource);
   }
 
+  template<typename data_t, typename data_traits>
+  void buildTree_bitonic_host(data_t *points,
+                              int numPoints,
+                              cukd::box_t<typename data_traits::point_t> *worldBounds,
+                              int numThreads,
+                              HostMemoryResource &memResource)
+  {
+    if (numPoints < 1) return;
+
+    if (data_traits::has_explicit_dim && !worldBounds)
+      throw std::runtime_error
+        ("cukd::buildTree_bitonic_host: asked to build k-d tree over "
+         "nodes with explicit dims, but no memory for world bounds provided");
+
+    if (worldBounds)
+      host_computeBounds<data_t,data_traits>(worldBounds,points,numPoints);
+    
+    bitonicSortBuilder::host_buildTree<data_t,data_traits>
+      (points,numPoints,worldBounds,numThreads,memResource);
+  }
+
 }
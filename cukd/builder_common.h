@@ -21,6 +21,8 @@
 #include "cukd/data.h"
 
 #include <cuda.h>
+#include <thread>
+#include <vector>
 
 namespace cukd {
 
@@ -63,11 +65,13 @@ namespace cukd {
                      int numPoints,
                      cudaStream_t stream=0);
   
+  /*! the same, on the host; uses up to numThreads threads */
   template<typename data_t, 
            typename data_traits=default_data_traits<data_t>>
   void host_computeBounds(cukd::box_t<typename data_traits::point_t> *d_bounds,
                           const data_t *d_points,
-                          int numPoints);
+                          int numPoints,
+                          int numThreads = std::thread::hardware_concurrency());
 
   // ==================================================================
   // IMPLEMENTATION SECTION
@@ -119,6 +123,38 @@ namespace cukd {
     } while(old!=assumed);
     return old;
   }
+
+  inline __device__
+  double atomicMin(double *addr, double value)
+  {
+    double old = *addr, assumed;
+    if(old <= value) return old;
+    do {
+      assumed = old;
+      old = __longlong_as_double
+        (atomicCAS((unsigned long long*)addr,
+                   (unsigned long long)__double_as_longlong(assumed),
+                   (unsigned long long)__double_as_longlong(value)));
+      value = min(value,old);
+    } while(old!=assumed);
+    return old;
+  }
+
+  inline __device__
+  double atomicMax(double *addr, double value)
+  {
+    double old = *addr, assumed;
+    if(old >= value) return old;
+    do {
+      assumed = old;
+      old = __longlong_as_double
+        (atomicCAS((unsigned long long*)addr,
+                   (unsigned long long)__double_as_longlong(assumed),
+                   (unsigned long long)__double_as_longlong(value)));
+      value = max(value,old);
+    } while(old!=assumed);
+    return old;
+  }
 #endif
 
   template<typename data_t,
@@ -162,15 +198,65 @@ namespace cukd {
       (d_bounds,d_points,numPoints);
   }
 
+  /*! bounds of points [begin,end); grows two separate boxes over
+      even and odd points, and merges them at the end, which halves
+      the dependency chain through each box's min/max */
+  template<typename data_t, typename data_traits>
+  cukd::box_t<typename data_traits::point_t>
+  host_computeBoundsOfRange(const data_t *d_points,
+                            size_t begin,
+                            size_t end)
+  {
+    using box_t = cukd::box_t<typename data_traits::point_t>;
+    box_t even, odd;
+    even.setEmpty();
+    odd.setEmpty();
+    size_t i = begin;
+    for (;i+2<=end;i+=2) {
+      even.grow(data_traits::get_point(d_points[i]));
+      odd.grow(data_traits::get_point(d_points[i+1]));
+    }
+    if (i<end)
+      even.grow(data_traits::get_point(d_points[i]));
+    even.lower = min(even.lower,odd.lower);
+    even.upper = max(even.upper,odd.upper);
+    return even;
+  }
+  
   /*! host-side helper function to compute bounding box of the data set */
   template<typename data_t, typename data_traits>
   void host_computeBounds(cukd::box_t<typename data_traits::point_t> *d_bounds,
                           const data_t *d_points,
-                          int numPoints)
+                          int numPoints,
+                          int numThreads)
   {
-    d_bounds->setEmpty();
-    for (int i=0;i<numPoints;i++)
-      d_bounds->grow(data_traits::get_point(d_points[i]));
+    using box_t = cukd::box_t<typename data_traits::point_t>;
+    // not worth spawning a thread for less than that
+    const int minPointsPerThread = 256*1024;
+    const int numChunks
+      = std::max(1,std::min(numThreads,numPoints/minPointsPerThread));
+    if (numChunks == 1) {
+      *d_bounds = host_computeBoundsOfRange<data_t,data_traits>(d_points,0,numPoints);
+      return;
+    }
+    
+    std::vector<box_t> chunkBounds(numChunks);
+    std::vector<std::thread> threads;
+    for (int c=0;c<numChunks;c++)
+      threads.push_back(std::thread([&,c]() {
+            chunkBounds[c] = host_computeBoundsOfRange<data_t,data_traits>
+              (d_points,
+               size_t(numPoints)*c/numChunks,
+               size_t(numPoints)*(c+1)/numChunks);
+          }));
+    for (auto &t : threads) t.join();
+    
+    box_t bounds = chunkBounds[0];
+    for (int c=1;c<numChunks;c++) {
+      bounds.lower = min(bounds.lower,chunkBounds[c].lower);
+      bounds.upper = max(bounds.upper,chunkBounds[c].upper);
+    }
+    *d_bounds = bounds;
   }
   
 
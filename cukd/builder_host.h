@@ -17,6 +17,272 @@
 #pragma once
 
 #include "cukd/builder_thrust.h"
+#include "cukd/builder_indirect.h"
+#include <algorithm>
 
 // buildTree_host is currently based on the thrust builder, and
-// implemented as part of builder_thrust.h
+// implemented as part of builder_thrust.h; this file adds a
+// partition-based fast path for input that is already spatially
+// sorted, and a way of selecting between the two.
+
+namespace cukd {
+
+  // ==================================================================
+  // INTERFACE SECTION
+  // ==================================================================
+
+  /*! what the host builder may assume about the order that the input
+      points come in */
+  typedef enum {
+    /*! sample the input, and check whether it looks spatially sorted */
+    DETECT_INPUT_ORDER = 0,
+    /*! input is in arbitrary order; always use the sort-based builder */
+    UNSORTED_INPUT,
+    /*! input is (at least roughly) sorted along a space filling
+        curve - e.g., in Morton/Z-order, as it often is after a
+        voxelization or simulation step */
+    SPATIALLY_SORTED_INPUT
+  } InputOrder;
+
+  /*! build config for the host builder */
+  struct HostBuildConfig {
+    InputOrder inputOrder = DETECT_INPUT_ORDER;
+    
+    /*! for DETECT_INPUT_ORDER: input counts as spatially sorted if
+        the (sampled) average squared distance between consecutive
+        points is less than this fraction of the (sampled) average
+        squared distance between random pairs of points */
+    float coherenceThreshold = .1f;
+
+    /*! for input that does not get built with the partitioning fast
+        path: sort only (tag,key,index) items, and move each point
+        only once, at the end (see builder_indirect.h). Produces the
+        same tree, but is much faster for large data_t's (say, 32
+        bytes and up), and needs much less temporary memory */
+    bool indirectSort = false;
+
+    /*! if set, '*worldBounds' already contains the bounds of the
+        input points (e.g., because the caller tracks them while
+        updating the points anyway), and the builder will use those
+        as is rather than computing them itself. Bounds that are
+        larger than the actual points' bounds are fine, too (the tree
+        is still valid, just possibly with different splits) */
+    bool worldBoundsAreValid = false;
+  };
+  
+  /*! builds tree on the host, using host read/writeable data (using
+      managed memory is fine). Produces the same tree as the
+      three-argument buildTree_host(), but if the input is (or, with
+      DETECT_INPUT_ORDER, looks) spatially sorted, it does so by
+      partitioning each subtree's range of points around its pivot
+      rather than fully sorting all points in every level; which is
+      much cheaper when each such range is already (almost)
+      partitioned, as it is for points that come in Morton order. */
+  template<typename data_t,
+           typename data_traits=default_data_traits<data_t>>
+  void buildTree_host(data_t *points,
+                      int numPoints,
+                      cukd::box_t<typename data_traits::point_t> *worldBounds,
+                      const HostBuildConfig &config,
+                      /*! memory resource for all temporary host memory */
+                      HostMemoryResource &memResource=defaultHostMemResource());
+
+  /*! checks - based on a sample of the input - whether given points
+      look like they are sorted along some space filling curve,
+      i.e., whether consecutive points are much closer to each other
+      than random pairs of points are */
+  template<typename data_t,
+           typename data_traits=default_data_traits<data_t>>
+  bool isSpatiallySorted(const data_t *points,
+                         int numPoints,
+                         float coherenceThreshold = .1f);
+  
+  // ==================================================================
+  // IMPLEMENTATION SECTION
+  // ==================================================================
+
+  namespace partitionBuilder {
+
+    template<typename data_t, typename data_traits>
+    struct Builder {
+      using point_t  = typename data_traits::point_t;
+      using box_t    = cukd::box_t<point_t>;
+      enum { num_dims = ::cukd::point_traits<point_t>::num_dims };
+
+      Builder(data_t *points, int numPoints, HostMemoryResource &memResource)
+        : points(points), numPoints(numPoints),
+          nodeIDs(numPoints,HostAllocator<uint32_t>(memResource))
+      {}
+
+      /*! builds the subtree under 'nodeID' over the points in
+          [begin,end), leaving those points in in-order layout (left
+          subtree, then pivot, then right subtree), and recording
+          each point's final node ID */
+      void buildRec(int begin, int end, int nodeID, int level,
+                    const box_t &domain);
+
+      /*! moves each point to the node ID recorded for it */
+      void moveToNodePositions();
+      
+      data_t *const points;
+      const int     numPoints;
+      HostVector<uint32_t> nodeIDs;
+    };
+
+    /*! returns whether [begin,end) is already partitioned around
+        'pivot' in dimension 'dim' - in which case we don't have to
+        touch (and re-order) any of the points in that range */
+    template<typename data_t, typename data_traits>
+    bool isPartitioned(const data_t *points, int begin, int pivot, int end, int dim)
+    {
+      const auto pivotCoord = data_traits::get_coord(points[pivot],dim);
+      for (int i=begin;i<pivot;i++)
+        if (data_traits::get_coord(points[i],dim) > pivotCoord)
+          return false;
+      for (int i=pivot+1;i<end;i++)
+        if (data_traits::get_coord(points[i],dim) < pivotCoord)
+          return false;
+      return true;
+    }
+    
+    template<typename data_t, typename data_traits>
+    void Builder<data_t,data_traits>::buildRec(int begin, int end,
+                                               int nodeID, int level,
+                                               const box_t &domain)
+    {
+      if (begin >= end) return;
+      
+      const int lChild = BinaryTree::leftChildOf(nodeID);
+      const int numLeft
+        = (lChild < numPoints)
+        ? ArbitraryBinaryTree(numPoints).numNodesInSubtree(lChild)
+        : 0;
+      const int pivot = begin+numLeft;
+      const int dim
+        = data_traits::has_explicit_dim
+        ? domain.widestDimension()
+        : (level % num_dims);
+
+      if (!isPartitioned<data_t,data_traits>(points,begin,pivot,end,dim))
+        std::nth_element(points+begin,points+pivot,points+end,
+                         [dim](const data_t &a, const data_t &b)
+                         { return data_traits::get_coord(a,dim)
+                             < data_traits::get_coord(b,dim); });
+      if_has_dims<data_t,data_traits,data_traits::has_explicit_dim>
+        ::set_dim(points[pivot],dim);
+      nodeIDs[pivot] = nodeID;
+
+      box_t lDomain = domain, rDomain = domain;
+      if (data_traits::has_explicit_dim) {
+        const auto pos = data_traits::get_coord(points[pivot],dim);
+        set_coord(lDomain.upper,dim,min(pos,get_coord(lDomain.upper,dim)));
+        set_coord(rDomain.lower,dim,max(pos,get_coord(rDomain.lower,dim)));
+      }
+      buildRec(begin,pivot,lChild,level+1,lDomain);
+      buildRec(pivot+1,end,lChild+1,level+1,rDomain);
+    }
+
+    template<typename data_t, typename data_traits>
+    void Builder<data_t,data_traits>::moveToNodePositions()
+    {
+      // in-place permutation: follow each cycle until every point
+      // in it has arrived where it belongs
+      for (int i=0;i<numPoints;i++)
+        while (nodeIDs[i] != (uint32_t)i) {
+          const uint32_t target = nodeIDs[i];
+          std::swap(points[i],points[target]);
+          std::swap(nodeIDs[i],nodeIDs[target]);
+        }
+    }
+    
+    /*! builds the tree by recursive partitioning; same result as
+        thrustSortBuilder::host_buildSubtree, but much faster if each
+        subtree's points are already (mostly) partitioned */
+    template<typename data_t, typename data_traits>
+    void host_build(data_t *points,
+                    int numPoints,
+                    const cukd::box_t<typename data_traits::point_t> *worldBounds,
+                    HostMemoryResource &memResource=defaultHostMemResource())
+    {
+      if (numPoints < 1) return;
+      if (data_traits::has_explicit_dim && !worldBounds)
+        throw std::runtime_error
+          ("cukd::builder_host: asked to build k-d tree over nodes"
+           " with explicit dims, but no memory for world bounds provided");
+      
+      Builder<data_t,data_traits> builder(points,numPoints,memResource);
+      cukd::box_t<typename data_traits::point_t> domain;
+      if (worldBounds) domain = *worldBounds; else domain.setInfinite();
+      builder.buildRec(0,numPoints,0,0,domain);
+      builder.moveToNodePositions();
+    }
+    
+  } // ::cukd::partitionBuilder
+  
+  template<typename data_t, typename data_traits>
+  bool isSpatiallySorted(const data_t *points,
+                         int numPoints,
+                         float coherenceThreshold)
+  {
+    using point_t = typename data_traits::point_t;
+    enum { num_dims = ::cukd::point_traits<point_t>::num_dims };
+    const int numSamples = 1024;
+
+    if (numPoints < 2) return true;
+    auto sqrDist = [&](int a, int b) {
+      double sum = 0.;
+      for (int d=0;d<num_dims;d++) {
+        const double diff
+          = double(data_traits::get_coord(points[a],d))
+          - double(data_traits::get_coord(points[b],d));
+        sum += diff*diff;
+      }
+      return sum;
+    };
+    double sumConsecutive = 0., sumRandom = 0.;
+    uint64_t seed = 0x9e3779b97f4a7c15ull;
+    for (int s=0;s<numSamples;s++) {
+      const int i = int((int64_t(s)*(numPoints-1))/numSamples);
+      sumConsecutive += sqrDist(i,i+1);
+      seed = seed*6364136223846793005ull + 1442695040888963407ull;
+      sumRandom += sqrDist(i,int((seed >> 33) % uint64_t(numPoints)));
+    }
+    return sumConsecutive <= coherenceThreshold * sumRandom;
+  }
+
+  template<typename data_t, typename data_traits>
+  void buildTree_host(data_t *points,
+                      int numPoints,
+                      cukd::box_t<typename data_traits::point_t> *worldBounds,
+                      const HostBuildConfig &config,
+                      HostMemoryResource &memResource)
+  {
+    if (numPoints < 1) return;
+
+    const bool presorted
+      =  (config.inputOrder == SPATIALLY_SORTED_INPUT)
+      || (config.inputOrder == DETECT_INPUT_ORDER
+          && isSpatiallySorted<data_t,data_traits>
+          (points,numPoints,config.coherenceThreshold));
+    if (config.worldBoundsAreValid && !worldBounds)
+      throw std::runtime_error
+        ("cukd::buildTree_host: config says world bounds are valid,"
+         " but no world bounds provided");
+    if (worldBounds && !config.worldBoundsAreValid)
+      host_computeBounds<data_t,data_traits>(worldBounds,points,numPoints);
+    
+    if (!presorted) {
+      if (config.indirectSort)
+        indirectSortBuilder::host_build<data_t,data_traits>
+          (points,numPoints,worldBounds,memResource);
+      else
+        thrustSortBuilder::host_buildSubtree<data_t,data_traits>
+          (points,numPoints,worldBounds,/*rootLevel*/0,memResource);
+      return;
+    }
+    
+    partitionBuilder::host_build<data_t,data_traits>
+      (points,numPoints,worldBounds,memResource);
+  }
+  
+} // ::cukd
@@ -0,0 +1,328 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+/*! \file cukd/builder_indirect.h Index-indirect host builder, for
+    large data_t's.
+
+    The regular builders sort (tag,data_t) pairs in every level, so
+    every swap in every sort moves an entire data_t; for 64 or
+    128-byte records (photons with payload, feature records, ...)
+    nearly all of the build's memory traffic goes into moving
+    payload. This builder instead sorts compact (tag,key,index)
+    items - 'key' being the point's coordinate in the dimension that
+    the current level sorts by, and 'index' the point's position in
+    the input - and only moves each data_t once, at the very end;
+    either in place (by following the permutation's cycles), or
+    into a caller-provided output array.
+
+    Temporary memory is one such item (12 bytes for float
+    coordinates) per point, plus one byte per point for the split
+    dimensions if data_traits::has_explicit_dim is true. The tree is
+    the same as the one buildTree_host() builds.
+*/
+
+#pragma once
+
+#include "cukd/builder_thrust.h"
+#include <algorithm>
+#include <vector>
+
+namespace cukd {
+
+  // ==================================================================
+  // INTERFACE SECTION
+  // ==================================================================
+
+  /*! builds a tree over the given (host read/writeable) points, in
+      place, sorting only indices during construction */
+  template<typename data_t,
+           typename data_traits=default_data_traits<data_t>>
+  void buildTree_indirect_host(data_t *points,
+                               int numPoints,
+                               cukd::box_t<typename data_traits::point_t> *worldBounds=0,
+                               HostMemoryResource &memResource=defaultHostMemResource());
+
+  /*! builds a tree over the given points, and writes it to 'output'
+      (which has to have room for numPoints data_t's); the input
+      points do not get modified */
+  template<typename data_t,
+           typename data_traits=default_data_traits<data_t>>
+  void buildTree_indirect_host(const data_t *points,
+                               data_t *output,
+                               int numPoints,
+                               cukd::box_t<typename data_traits::point_t> *worldBounds=0,
+                               HostMemoryResource &memResource=defaultHostMemResource());
+
+  // ==================================================================
+  // IMPLEMENTATION SECTION
+  // ==================================================================
+
+  namespace indirectSortBuilder {
+
+    template<typename scalar_t>
+    struct Item {
+      /*! subtree (and eventually, node) ID, as in the other builders */
+      uint32_t tag;
+      /*! coordinate in the dimension the current level sorts by */
+      scalar_t key;
+      /*! position of the point in the input array */
+      uint32_t index;
+    };
+
+    template<typename data_t, typename data_traits>
+    struct Builder {
+      using point_t  = typename data_traits::point_t;
+      using scalar_t = typename point_traits<point_t>::scalar_t;
+      using box_t    = cukd::box_t<point_t>;
+      using item_t   = Item<scalar_t>;
+      enum { num_dims = point_traits<point_t>::num_dims };
+
+      Builder(const data_t *points,
+              int numPoints,
+              const box_t *worldBounds,
+              HostMemoryResource &memResource);
+
+      /*! runs all levels; afterwards, items[nodeID].index is the
+          input position of the point that goes into node nodeID */
+      void build();
+
+      /*! moves the points to their node positions, in place */
+      void permuteInPlace(data_t *points);
+      
+      /*! writes the points to their node positions in 'output' */
+      void gather(data_t *output);
+
+    private:
+      /*! bounds of the given subtree's domain; same as
+          cukd::findBounds(), but looking up the (already settled)
+          ancestors' split planes in the items */
+      box_t findBounds(int subtree) const;
+      
+      const data_t *const points;
+      const int           numPoints;
+      const box_t *const  worldBounds;
+      HostVector<item_t>   items;
+      /*! split dims, indexed by input position; only used if
+          data_traits::has_explicit_dim */
+      HostVector<uint8_t>  dims;
+    };
+
+    template<typename data_t, typename data_traits>
+    Builder<data_t,data_traits>::Builder(const data_t *points,
+                                         int numPoints,
+                                         const box_t *worldBounds,
+                                         HostMemoryResource &memResource)
+      : points(points),
+        numPoints(numPoints),
+        worldBounds(worldBounds),
+        items(numPoints,HostAllocator<item_t>(memResource)),
+        dims(HostAllocator<uint8_t>(memResource))
+    {
+      for (int i=0;i<numPoints;i++)
+        items[i] = { 0u, scalar_t(0), uint32_t(i) };
+      if (data_traits::has_explicit_dim)
+        dims.resize(numPoints,(uint8_t)worldBounds->widestDimension());
+    }
+
+    template<typename data_t, typename data_traits>
+    typename Builder<data_t,data_traits>::box_t
+    Builder<data_t,data_traits>::findBounds(int subtree) const
+    {
+      box_t bounds = *worldBounds;
+      int curr = subtree;
+      while (curr > 0) {
+        const int parent = (curr+1)/2-1;
+        // a settled node's key is its coordinate in its split dim
+        const int      parent_dim = dims[items[parent].index];
+        const scalar_t parent_split_pos = items[parent].key;
+        if (curr & 1)
+          set_coord(bounds.upper,parent_dim,
+                    min(parent_split_pos,get_coord(bounds.upper,parent_dim)));
+        else
+          set_coord(bounds.lower,parent_dim,
+                    max(parent_split_pos,get_coord(bounds.lower,parent_dim)));
+        curr = parent;
+      }
+      return bounds;
+    }
+    
+    template<typename data_t, typename data_traits>
+    void Builder<data_t,data_traits>::build()
+    {
+      const int numLevels = BinaryTree::numLevelsFor(numPoints);
+      const int deepestLevel = numLevels-1;
+
+      auto byTagAndKey = [](const item_t &a, const item_t &b)
+      { return (a.tag < b.tag) || ((a.tag == b.tag) && (a.key < b.key)); };
+      
+      for (int level=0;level<deepestLevel;level++) {
+        // nodes settled two or more levels ago are in their final
+        // positions (and have smaller tags than anything else), so
+        // the sort doesn't have to look at those. Last level's
+        // pivots are settled, too, but still spread out over the
+        // array; this sort moves them to the front, and their keys
+        // (i.e., their split coordinates) stay as they are
+        const int numSettled = FullBinaryTreeOf(level).numNodes();
+        const int sortBegin  = FullBinaryTreeOf(std::max(level-1,0)).numNodes();
+        for (int i=sortBegin;i<numPoints;i++) {
+          item_t &item = items[i];
+          if (item.tag < uint32_t(numSettled)) continue;
+          const int dim
+            = data_traits::has_explicit_dim
+            ? dims[item.index]
+            : (level % num_dims);
+          item.key = data_traits::get_coord(points[item.index],dim);
+        }
+        std::sort(items.begin()+sortBegin,items.end(),byTagAndKey);
+
+        ArrayLayoutInStep layout(level,numPoints);
+        for (int gid=numSettled;gid<numPoints;gid++) {
+          item_t &item = items[gid];
+          uint32_t subtree = item.tag;
+          const int pivotPos = layout.pivotPosOf(subtree);
+          if (gid == pivotPos)
+            continue;
+          if (gid < pivotPos)
+            subtree = BinaryTree::leftChildOf(subtree);
+          else
+            subtree = BinaryTree::rightChildOf(subtree);
+          if (data_traits::has_explicit_dim) {
+            // pivots stay as they are; and none of the ones we change
+            // here is a pivot (or ancestor) anybody else looks at
+            box_t bounds = findBounds(item.tag);
+            const item_t &pivot = items[pivotPos];
+            const int pivotDim = dims[pivot.index];
+            if (gid < pivotPos)
+              set_coord(bounds.upper,pivotDim,pivot.key);
+            else
+              set_coord(bounds.lower,pivotDim,pivot.key);
+            dims[item.index] = (uint8_t)bounds.widestDimension();
+          }
+          item.tag = subtree;
+        }
+      }
+
+      /* do one final sort, to put all items in order - by now every
+         item has its final (and unique) nodeID stored in its tag */
+      std::sort(items.begin()+FullBinaryTreeOf(std::max(deepestLevel-1,0)).numNodes(),
+                items.end(),
+                [](const item_t &a, const item_t &b) { return a.tag < b.tag; });
+    }
+
+    template<typename data_t, typename data_traits>
+    void Builder<data_t,data_traits>::permuteInPlace(data_t *points)
+    {
+      if (data_traits::has_explicit_dim)
+        for (int i=0;i<numPoints;i++)
+          if_has_dims<data_t,data_traits,data_traits::has_explicit_dim>
+            ::set_dim(points[i],dims[i]);
+      
+      // follow each cycle of the permutation, moving every point
+      // exactly once; items we're done with get marked by pointing to
+      // themselves
+      for (int i=0;i<numPoints;i++) {
+        if (items[i].index == uint32_t(i)) continue;
+        const data_t tmp = points[i];
+        int curr = i;
+        while (true) {
+          const int src = items[curr].index;
+          items[curr].index = curr;
+          if (src == i) {
+            points[curr] = tmp;
+            break;
+          }
+          points[curr] = points[src];
+          curr = src;
+        }
+      }
+    }
+
+    template<typename data_t, typename data_traits>
+    void Builder<data_t,data_traits>::gather(data_t *output)
+    {
+      for (int i=0;i<numPoints;i++) {
+        output[i] = points[items[i].index];
+        if (data_traits::has_explicit_dim)
+          if_has_dims<data_t,data_traits,data_traits::has_explicit_dim>
+            ::set_dim(output[i],dims[items[i].index]);
+      }
+    }
+
+    template<typename data_t, typename data_traits>
+    void checkInputs(const cukd::box_t<typename data_traits::point_t> *worldBounds)
+    {
+      if (data_traits::has_explicit_dim && !worldBounds)
+        throw std::runtime_error
+          ("cukd::buildTree_indirect_host: asked to build k-d tree over nodes"
+           " with explicit dims, but no memory for world bounds provided");
+      if (data_traits::has_explicit_dim
+          && point_traits<typename data_traits::point_t>::num_dims > 256)
+        throw std::runtime_error
+          ("cukd::buildTree_indirect_host: explicit dims are only"
+           " supported for up to 256 dimensions");
+    }
+    
+    /*! builds the tree in place, with (if required) world bounds
+        that have already been computed */
+    template<typename data_t, typename data_traits>
+    void host_build(data_t *points,
+                    int numPoints,
+                    const cukd::box_t<typename data_traits::point_t> *worldBounds,
+                    HostMemoryResource &memResource=defaultHostMemResource())
+    {
+      if (numPoints < 1) return;
+      checkInputs<data_t,data_traits>(worldBounds);
+      Builder<data_t,data_traits> builder(points,numPoints,worldBounds,memResource);
+      builder.build();
+      builder.permuteInPlace(points);
+    }
+    
+  } // ::cukd::indirectSortBuilder
+
+  template<typename data_t, typename data_traits>
+  void buildTree_indirect_host(data_t *points,
+                               int numPoints,
+                               cukd::box_t<typename data_traits::point_t> *worldBounds,
+                               HostMemoryResource &memResource)
+  {
+    if (numPoints < 1) return;
+    indirectSortBuilder::checkInputs<data_t,data_traits>(worldBounds);
+    if (worldBounds)
+      host_computeBounds<data_t,data_traits>(worldBounds,points,numPoints);
+    indirectSortBuilder::host_build<data_t,data_traits>
+      (points,numPoints,worldBounds,memResource);
+  }
+  
+  template<typename data_t, typename data_traits>
+  void buildTree_indirect_host(const data_t *points,
+                               data_t *output,
+                               int numPoints,
+                               cukd::box_t<typename data_traits::point_t> *worldBounds,
+                               HostMemoryResource &memResource)
+  {
+    if (numPoints < 1) return;
+    indirectSortBuilder::checkInputs<data_t,data_traits>(worldBounds);
+    if (worldBounds)
+      host_computeBounds<data_t,data_traits>(worldBounds,points,numPoints);
+    
+    indirectSortBuilder::Builder<data_t,data_traits>
+      builder(points,numPoints,worldBounds,memResource);
+    builder.build();
+    builder.gather(output);
+  }
+  
+} // ::cukd
@@ -0,0 +1,552 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "cukd/builder_host.h"
+#include "cukd/serialize.h"
+
+#include <vector>
+#include <cstdio>
+
+namespace cukd {
+
+  // ==================================================================
+  // INTERFACE SECTION
+  // ==================================================================
+
+  /*! parameters that control the out-of-core builder */
+  struct OutOfCoreBuildConfig {
+    /*! max number of bytes the builder will use for holding points
+        (and per-point temporary data) in memory. Subtrees whose
+        points fit into this budget get built in memory (with the
+        host builder); larger ones get split and streamed to disk */
+    size_t memoryBudget = size_t(1)<<30;
+
+    /*! file name prefix for the temporary per-subtree files; if empty
+        these will be created next to the output file */
+    std::string tempFilePrefix;
+
+    /*! number of points sampled (per iteration) when bracketing the
+        split plane of a subtree that doesn't fit into memory */
+    int numSamples = 1<<14;
+  };
+
+  /*! builds a left-balanced k-d tree over a set of points that is too
+    large to fit into memory, by streaming them from/to disk.
+
+    The input file has to be in the format read by cukd::loadPoints
+    (a size_t count, followed by that many data_t's); the result
+    gets written to 'outFileName' in the serialized format of
+    serialize.h, and can be queried directly from disk by memory
+    mapping it (see serialized::MappedTree), or be loaded with
+    serialized::loadTree if it does fit into memory.
+
+    Any subtree whose points exceed the config's memory budget gets
+    split by first bracketing its split plane from a sample of its
+    points, then selecting the exact (median) pivot from the points
+    within that bracket, and finally partitioning the subtree's
+    points into one temporary file per child. Subtrees that do fit
+    into memory get read, built with the host builder, and written
+    to their final positions in the output file. The resulting tree
+    is a regular left-balanced tree (same structure and split
+    dimensions as with any of the in-memory builders); it is just
+    not necessarily bit-wise identical to what those would produce
+    for points that share the same split coordinate. */
+  template<typename data_t,
+           typename data_traits=default_data_traits<data_t>>
+  void buildTree_outOfCore(const std::string &inFileName,
+                           const std::string &outFileName,
+                           const OutOfCoreBuildConfig &config
+                           = OutOfCoreBuildConfig{});
+
+  // ==================================================================
+  // IMPLEMENTATION SECTION
+  // ==================================================================
+
+  namespace outOfCoreBuilder {
+
+    /*! number of nodes in the subtree under 'node', in a
+        left-balanced tree of 'numNodes' nodes. Same as
+        ArbitraryBinaryTree::numNodesInSubtree, but with 64-bit
+        indices */
+    inline uint64_t numNodesInSubtree(uint64_t node, uint64_t numNodes)
+    {
+      uint64_t count = 0;
+      for (uint64_t first = node, width = 1;
+           first < numNodes;
+           first = 2*first+1, width *= 2)
+        count += std::min(width,numNodes-first);
+      return count;
+    }
+
+    /*! minimal RAII wrapper around a FILE, with 64-bit seeks and
+        error checking */
+    struct File {
+      File(const std::string &fileName, const char *mode)
+        : fileName(fileName)
+      {
+        handle = fopen(fileName.c_str(),mode);
+        if (!handle)
+          throw std::runtime_error("cukd::builder_outofcore: could not open '"
+                                   +fileName+"'");
+      }
+      ~File() { fclose(handle); }
+
+      void seek(uint64_t offset)
+      {
+        if (serialized::fseek64(handle,offset) != 0)
+          throw std::runtime_error("cukd::builder_outofcore: could not seek in '"
+                                   +fileName+"'");
+      }
+      void read(void *ptr, size_t size, size_t count)
+      {
+        if (fread(ptr,size,count,handle) != count)
+          throw std::runtime_error("cukd::builder_outofcore: could not read from '"
+                                   +fileName+"'");
+      }
+      void write(const void *ptr, size_t size, size_t count)
+      {
+        if (fwrite(ptr,size,count,handle) != count)
+          throw std::runtime_error("cukd::builder_outofcore: could not write to '"
+                                   +fileName+"'");
+      }
+
+      FILE             *handle;
+      const std::string fileName;
+    };
+
+    /*! a range of data points stored in a file */
+    struct FileRange {
+      std::string fileName;
+      uint64_t    offset;
+      uint64_t    count;
+      /*! whether this is one of our temp files (which we delete as
+          soon as we're done with it), or the user's input */
+      bool        isTemp;
+    };
+
+    /*! streams all points in the given range through 'buffer', and
+        calls lambda(const data_t *chunk, size_t chunkSize) on each
+        chunk */
+    template<typename data_t, typename Lambda>
+    void forEachChunk(const FileRange &range,
+                      std::vector<data_t> &buffer,
+                      const Lambda &lambda)
+    {
+      File file(range.fileName,"rb");
+      file.seek(range.offset);
+      for (uint64_t numDone = 0; numDone < range.count; ) {
+        size_t n = (size_t)std::min(uint64_t(buffer.size()),range.count-numDone);
+        file.read(buffer.data(),sizeof(data_t),n);
+        lambda((const data_t *)buffer.data(),n);
+        numDone += n;
+      }
+    }
+
+    /*! sequential, buffered writer for a (temp) file of data points */
+    template<typename data_t>
+    struct ChunkedWriter {
+      ChunkedWriter(const std::string &fileName, size_t chunkSize)
+        : file(fileName,"wb"), buffer(chunkSize)
+      {}
+
+      void push(const data_t &point)
+      {
+        buffer[numInBuffer++] = point;
+        if (numInBuffer == buffer.size()) flush();
+      }
+      void flush()
+      {
+        file.write(buffer.data(),sizeof(data_t),numInBuffer);
+        numWritten += numInBuffer;
+        numInBuffer = 0;
+      }
+
+      File                file;
+      std::vector<data_t> buffer;
+      size_t              numInBuffer = 0;
+      uint64_t            numWritten  = 0;
+    };
+
+    template<typename data_t, typename data_traits>
+    struct Builder {
+      using point_t      = typename data_traits::point_t;
+      using point_traits = ::cukd::point_traits<point_t>;
+      using scalar_t     = typename point_traits::scalar_t;
+      using box_t        = cukd::box_t<point_t>;
+      enum { num_dims    = point_traits::num_dims };
+
+      /*! bytes per point that building a subtree in memory will use:
+          the point itself and its tag, plus the same again for the
+          temporary memory of the host sort */
+      enum { inMemoryBytesPerPoint = 2*(sizeof(data_t)+sizeof(uint32_t)) };
+
+      Builder(const OutOfCoreBuildConfig &config,
+              const std::string &outFileName,
+              uint64_t numPoints,
+              const box_t &worldBounds);
+
+      /*! builds the subtree rooted at 'nodeID' (on tree level
+          'level', and with spatial domain 'domain') over the given
+          range of points */
+      void buildSubtree(const FileRange &range,
+                        uint64_t nodeID,
+                        int level,
+                        const box_t &domain);
+
+      /*! builds a subtree that fits into memory with the host
+          builder, and writes it into its place in the output file */
+      void buildInMemory(const FileRange &range,
+                         uint64_t nodeID,
+                         int level,
+                         const box_t &domain);
+
+      /*! finds the coordinate of the point with given rank (when
+          sorted along dimension 'dim'), as well as the number of
+          points that are strictly smaller than that */
+      scalar_t selectSplit(const FileRange &range,
+                           const box_t &domain,
+                           int dim,
+                           uint64_t rank,
+                           uint64_t &numLess);
+
+      /*! write 'count' points to the output file, starting at tree
+          node 'nodeID' */
+      void writeNodes(uint64_t nodeID, const data_t *points, size_t count);
+
+      std::string tempFileName(uint64_t nodeID) const
+      { return tempFilePrefix+".node"+std::to_string(nodeID)+".tmp"; }
+
+      const OutOfCoreBuildConfig config;
+      const uint64_t             numPoints;
+      const std::string          tempFilePrefix;
+      serialized::FileHeader     header;
+      File                       out;
+      /*! number of points per chunk when streaming from/to files */
+      size_t                     chunkSize;
+
+      /*! the buffer for streaming points in from files; gets
+          (re-)allocated on demand, since buildInMemory() releases it
+          to stay within the memory budget */
+      std::vector<data_t> &readBuffer()
+      { m_readBuffer.resize(chunkSize); return m_readBuffer; }
+      std::vector<data_t>        m_readBuffer;
+    };
+
+    /*! removes the given (temp) file when going out of scope -
+        whether or not it already got removed, and whether or not
+        we're leaving because of an exception */
+    struct TempFile {
+      TempFile(const std::string &fileName) : fileName(fileName) {}
+      ~TempFile() { remove(fileName.c_str()); }
+      const std::string fileName;
+    };
+
+    template<typename data_t, typename data_traits>
+    Builder<data_t,data_traits>::Builder(const OutOfCoreBuildConfig &config,
+                                         const std::string &outFileName,
+                                         uint64_t numPoints,
+                                         const box_t &worldBounds)
+      : config(config),
+        numPoints(numPoints),
+        tempFilePrefix(config.tempFilePrefix.empty()
+                       ? outFileName
+                       : config.tempFilePrefix),
+        header(serialized::makeHeader<data_t,data_traits>(numPoints)),
+        out(outFileName,"wb")
+    {
+      out.write(&header,sizeof(header),1);
+      out.seek(header.boundsOffset);
+      out.write(&worldBounds,sizeof(worldBounds),1);
+      // while partitioning we hold one read and two write buffers
+      chunkSize = std::max(size_t(1),config.memoryBudget/(3*sizeof(data_t)));
+    }
+
+    template<typename data_t, typename data_traits>
+    void Builder<data_t,data_traits>::writeNodes(uint64_t nodeID,
+                                                 const data_t *points,
+                                                 size_t count)
+    {
+      out.seek(header.dataOffset+nodeID*sizeof(data_t));
+      out.write(points,sizeof(data_t),count);
+    }
+
+    template<typename data_t, typename data_traits>
+    void Builder<data_t,data_traits>::buildInMemory(const FileRange &range,
+                                                    uint64_t nodeID,
+                                                    int level,
+                                                    const box_t &domain)
+    {
+      // the in-memory build may use all of the budget, so the read
+      // buffer must not stay around while it runs
+      std::vector<data_t>().swap(m_readBuffer);
+      
+      std::vector<data_t> points((size_t)range.count);
+      {
+        File in(range.fileName,"rb");
+        in.seek(range.offset);
+        in.read(points.data(),sizeof(data_t),points.size());
+      }
+      if (range.isTemp) remove(range.fileName.c_str());
+
+      thrustSortBuilder::host_buildSubtree<data_t,data_traits>
+        (points.data(),(int)points.size(),&domain,level);
+
+      // the i'th level of the local subtree is a contiguous range of
+      // nodes in the global tree, so we can write it in one go
+      const uint64_t count = points.size();
+      for (uint64_t first = 0, width = 1; first < count;
+           first = 2*first+1, width *= 2)
+        writeNodes((nodeID+1)*width-1,points.data()+first,
+                   (size_t)std::min(width,count-first));
+    }
+
+    template<typename data_t, typename data_traits>
+    typename Builder<data_t,data_traits>::scalar_t
+    Builder<data_t,data_traits>::selectSplit(const FileRange &range,
+                                             const box_t &domain,
+                                             int dim,
+                                             uint64_t rank,
+                                             uint64_t &numLess)
+    {
+      /* the set of 'candidate' coordinates that the searched-for one
+         must be in; initially that's all of them, i.e., the domain */
+      struct {
+        scalar_t lo, hi;
+        bool     loOpen = false, hiOpen = false;
+        inline bool contains(scalar_t c) const
+        { return (loOpen ? c > lo : c >= lo) && (hiOpen ? c < hi : c <= hi); }
+      } bracket;
+      bracket.lo = point_traits::get_coord(domain.lower,dim);
+      bracket.hi = point_traits::get_coord(domain.upper,dim);
+      /* number of coordinates below and inside the bracket */
+      uint64_t below = 0, inside = range.count;
+      bool useMargin = true;
+
+      // (leaving some of the budget for the read buffer)
+      const size_t maxCoordsInMemory
+        = std::max(size_t(1),config.memoryBudget/2/sizeof(scalar_t));
+      while (true) {
+        if (!bracket.loOpen && !bracket.hiOpen && bracket.lo == bracket.hi) {
+          // all candidates have the same coordinate - that's it.
+          numLess = below;
+          return bracket.lo;
+        }
+
+        if (inside <= maxCoordsInMemory) {
+          // few enough candidates left to select the exact one in memory
+          std::vector<scalar_t> coords;
+          coords.reserve((size_t)inside);
+          forEachChunk(range,readBuffer(),[&](const data_t *points, size_t n){
+            for (size_t i=0;i<n;i++) {
+              scalar_t c = data_traits::get_coord(points[i],dim);
+              if (bracket.contains(c)) coords.push_back(c);
+            }
+          });
+          auto nth = coords.begin()+(size_t)(rank-below);
+          std::nth_element(coords.begin(),nth,coords.end());
+          const scalar_t split = *nth;
+          numLess = below;
+          for (auto c : coords) if (c < split) ++numLess;
+          return split;
+        }
+
+        /* too many candidates to hold in memory: take a (strided)
+           sample of them, and use that to guess a much tighter
+           bracket around the target rank */
+        const size_t numSamples
+          = (size_t)std::min(uint64_t(std::min(size_t(std::max(config.numSamples,1)),
+                                               maxCoordsInMemory)),
+                             inside);
+        const uint64_t stride = inside / numSamples;
+        std::vector<scalar_t> samples;
+        samples.reserve(numSamples);
+        uint64_t candidateID = 0;
+        forEachChunk(range,readBuffer(),[&](const data_t *points, size_t n){
+          for (size_t i=0;i<n && samples.size() < numSamples;i++) {
+            scalar_t c = data_traits::get_coord(points[i],dim);
+            if (!bracket.contains(c)) continue;
+            if ((candidateID++ % stride) == 0) samples.push_back(c);
+          }
+        });
+        std::sort(samples.begin(),samples.end());
+        const size_t target
+          = std::min(samples.size()-1,
+                     size_t(double(rank-below)/double(inside)*samples.size()));
+        /* by default leave some margin around the expected position
+           so the bracket will likely contain the target; if that
+           didn't make progress, use a zero-width bracket, which will
+           always exclude at least the sampled coordinate */
+        const size_t margin
+          = useMargin ? size_t(2*std::sqrt(double(samples.size())))+1 : 0;
+        const scalar_t a = samples[target > margin ? target-margin : 0];
+        const scalar_t b = samples[std::min(samples.size()-1,target+margin)];
+
+        uint64_t numBelowA = 0, numInAB = 0, numAboveB = 0;
+        forEachChunk(range,readBuffer(),[&](const data_t *points, size_t n){
+          for (size_t i=0;i<n;i++) {
+            scalar_t c = data_traits::get_coord(points[i],dim);
+            if (!bracket.contains(c)) continue;
+            if (c < a)      ++numBelowA;
+            else if (c > b) ++numAboveB;
+            else            ++numInAB;
+          }
+        });
+
+        const uint64_t prevInside = inside;
+        if (rank-below < numBelowA) {
+          bracket.hi = a; bracket.hiOpen = true;
+          inside = numBelowA;
+        } else if (rank-below < numBelowA+numInAB) {
+          bracket.lo = a; bracket.loOpen = false;
+          bracket.hi = b; bracket.hiOpen = false;
+          below += numBelowA;
+          inside = numInAB;
+        } else {
+          bracket.lo = b; bracket.loOpen = true;
+          below += numBelowA+numInAB;
+          inside = numAboveB;
+        }
+        useMargin = (inside < prevInside);
+      }
+    }
+
+    template<typename data_t, typename data_traits>
+    void Builder<data_t,data_traits>::buildSubtree(const FileRange &range,
+                                                   uint64_t nodeID,
+                                                   int level,
+                                                   const box_t &domain)
+    {
+      if (range.count == 0) {
+        if (range.isTemp) remove(range.fileName.c_str());
+        return;
+      }
+
+      if (range.count <= uint64_t(INT_MAX) &&
+          range.count*inMemoryBytesPerPoint <= config.memoryBudget)
+        return buildInMemory(range,nodeID,level,domain);
+
+      const int dim
+        = data_traits::has_explicit_dim
+        ? domain.widestDimension()
+        : (level % num_dims);
+      const uint64_t lChild = 2*nodeID+1;
+      const uint64_t rChild = 2*nodeID+2;
+      /* number of points that have to go to the left; which is also
+         the rank of the pivot point */
+      const uint64_t numLeft = numNodesInSubtree(lChild,numPoints);
+      uint64_t numLess = 0;
+      const scalar_t split = selectSplit(range,domain,dim,numLeft,numLess);
+
+      /* partition into left and right temp files; the first
+         'numLeft-numLess' points that are _on_ the split plane go to
+         the left, the next one becomes this node's pivot, and all
+         others go to the right */
+      const uint64_t numTiesToLeft = numLeft - numLess;
+      uint64_t numTies = 0;
+      bool     havePivot = false;
+      data_t   pivot;
+      // the children's temp files get removed by the children as soon
+      // as they have been read; these only clean up if anything on
+      // the way there throws
+      TempFile lTemp(tempFileName(lChild));
+      TempFile rTemp(tempFileName(rChild));
+      {
+        ChunkedWriter<data_t> left(tempFileName(lChild),chunkSize);
+        ChunkedWriter<data_t> right(tempFileName(rChild),chunkSize);
+        forEachChunk(range,readBuffer(),[&](const data_t *points, size_t n){
+          for (size_t i=0;i<n;i++) {
+            const data_t &point = points[i];
+            const scalar_t c = data_traits::get_coord(point,dim);
+            if (c < split)
+              left.push(point);
+            else if (c > split)
+              right.push(point);
+            else if (numTies++ < numTiesToLeft)
+              left.push(point);
+            else if (!havePivot) {
+              pivot = point;
+              havePivot = true;
+            } else
+              right.push(point);
+          }
+        });
+        left.flush();
+        right.flush();
+        if (!havePivot || left.numWritten != numLeft)
+          throw std::runtime_error("cukd::builder_outofcore: internal error"
+                                   " - could not find pivot for node "
+                                   +std::to_string(nodeID));
+      }
+      if (range.isTemp) remove(range.fileName.c_str());
+
+      if_has_dims<data_t,data_traits,data_traits::has_explicit_dim>
+        ::set_dim(pivot,dim);
+      writeNodes(nodeID,&pivot,1);
+
+      box_t lDomain = domain;
+      point_traits::set_coord(lDomain.upper,dim,split);
+      box_t rDomain = domain;
+      point_traits::set_coord(rDomain.lower,dim,split);
+
+      buildSubtree({tempFileName(lChild),0,numLeft,true},
+                   lChild,level+1,lDomain);
+      buildSubtree({tempFileName(rChild),0,range.count-numLeft-1,true},
+                   rChild,level+1,rDomain);
+    }
+
+  } // ::cukd::outOfCoreBuilder
+
+  template<typename data_t, typename data_traits>
+  void buildTree_outOfCore(const std::string &inFileName,
+                           const std::string &outFileName,
+                           const OutOfCoreBuildConfig &config)
+  {
+    using namespace outOfCoreBuilder;
+    using box_t = cukd::box_t<typename data_traits::point_t>;
+
+    size_t numPoints = 0;
+    {
+      File in(inFileName,"rb");
+      in.read(&numPoints,sizeof(numPoints),1);
+    }
+    // fail up front rather than after hours of building a tree that
+    // no traversal (nor loadTree/MappedTree) could use
+    if (numPoints > serialized::maxNumPoints)
+      throw std::runtime_error("cukd::builder_outofcore: '"+inFileName+"' has "
+                               +std::to_string(numPoints)
+                               +" points, but trees are limited to 2^31-1 points");
+    const FileRange input = { inFileName, sizeof(size_t), numPoints, false };
+
+    /* first pass: world bounds, which we need both for the file
+       header and for the (explicit-dim) builders' domain boxes */
+    box_t worldBounds;
+    worldBounds.setEmpty();
+    {
+      std::vector<data_t> buffer
+        (std::max(size_t(1),config.memoryBudget/sizeof(data_t)));
+      forEachChunk(input,buffer,[&](const data_t *points, size_t n){
+        for (size_t i=0;i<n;i++)
+          worldBounds.grow(data_traits::get_point(points[i]));
+      });
+    }
+
+    Builder<data_t,data_traits> builder(config,outFileName,numPoints,worldBounds);
+    builder.buildSubtree(input,/*root node*/0,/*root level*/0,worldBounds);
+  }
+
+} // ::cukd
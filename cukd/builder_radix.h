@@ -0,0 +1,414 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+/*! \file cukd/builder_radix.h Radix-sort based host builder.
+
+    The tag-update algorithm that the other builders use only ever
+    sorts by (tag, coordinate in the current dimension) - and both of
+    these map to unsigned integers: the tag as is, and the coordinate
+    after flipping its bits such that unsigned integer order matches
+    float order (the same trick that AtomicBox::encode() in
+    spatial-kdtree.h uses for signed ints). So instead of a
+    comparison sort this builder sorts 64-bit composite keys (tag in
+    the upper, coordinate in the lower 32 bits) together with point
+    indices, using a parallel LSD radix sort; which makes each
+    level's cost linear in the number of points, and lets it scale
+    across cores. Like the index-indirect builder (builder_indirect.h)
+    it moves each data point only once, at the end.
+
+    Temporary memory is 24 bytes per point (keys and indices, double
+    buffered). Coordinates have to be float, int32_t, or uint32_t.
+*/
+
+#pragma once
+
+#include "cukd/builder_common.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace cukd {
+
+  // ==================================================================
+  // INTERFACE SECTION
+  // ==================================================================
+
+  /*! builds a tree over the given (host read/writeable) points, in
+      place, using up to numThreads threads; produces the same tree
+      as buildTree_host() */
+  template<typename data_t,
+           typename data_traits=default_data_traits<data_t>>
+  void buildTree_radix_host(data_t *points,
+                            int numPoints,
+                            cukd::box_t<typename data_traits::point_t> *worldBounds=0,
+                            int numThreads = std::thread::hardware_concurrency(),
+                            HostMemoryResource &memResource=defaultHostMemResource());
+
+  // ==================================================================
+  // IMPLEMENTATION SECTION
+  // ==================================================================
+
+  namespace radixSortBuilder {
+
+    /*! @{ maps a coordinate to a uint32_t with the same sort order */
+    inline uint32_t radixKeyOf(float f)
+    {
+      uint32_t bits;
+      memcpy(&bits,&f,sizeof(bits));
+      // -0.f compares equal to +0.f, so it has to get the same key;
+      // otherwise it would sort before it (and before all other
+      // points of that coordinate), unlike with the other builders
+      if (bits == 0x80000000u) bits = 0;
+      return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+    }
+    inline uint32_t radixKeyOf(int32_t i)  { return uint32_t(i) ^ 0x80000000u; }
+    inline uint32_t radixKeyOf(uint32_t i) { return i; }
+    /*! @} */
+
+    enum { digit_bits = 11, num_buckets = 1<<digit_bits };
+
+    /*! runs func(chunkID) for chunkID=0..numChunks-1, in parallel */
+    template<typename Lambda>
+    inline void forEachChunk(int numChunks, const Lambda &func)
+    {
+      if (numChunks <= 1) {
+        func(0);
+        return;
+      }
+      std::vector<std::thread> threads;
+      for (int i=0;i<numChunks;i++)
+        threads.push_back(std::thread(func,i));
+      for (auto &t : threads) t.join();
+    }
+
+    /*! stable LSD radix sort of the (keys[i],values[i]) pairs, by the
+        lower 'numKeyBits' bits of the keys; uses the tmp arrays as
+        second buffer. Passes in which all keys have the same digit
+        get skipped */
+    inline void radixSort(uint64_t *keys,
+                          uint32_t *values,
+                          uint64_t *tmpKeys,
+                          uint32_t *tmpValues,
+                          size_t    N,
+                          int       numKeyBits,
+                          int       numThreads,
+                          HostMemoryResource &memResource=defaultHostMemResource())
+    {
+      const int numChunks
+        = (int)std::max(size_t(1),std::min(size_t(std::max(numThreads,1)),
+                                           N/(64*1024)));
+      HostVector<size_t> offsets(numChunks*num_buckets,
+                                 HostAllocator<size_t>(memResource));
+      uint64_t *srcKeys = keys,    *dstKeys = tmpKeys;
+      uint32_t *srcVals = values,  *dstVals = tmpValues;
+      
+      for (int shift=0;shift<numKeyBits;shift+=digit_bits) {
+        // per-chunk histograms
+        forEachChunk(numChunks,[&](int chunk) {
+            size_t *hist = offsets.data()+chunk*num_buckets;
+            std::fill(hist,hist+num_buckets,size_t(0));
+            const size_t begin = N*chunk/numChunks;
+            const size_t end   = N*(chunk+1)/numChunks;
+            for (size_t i=begin;i<end;i++)
+              hist[(srcKeys[i] >> shift) & (num_buckets-1)]++;
+          });
+
+        // turn into per-chunk output offsets: bucket-major, then
+        // chunk-major, which keeps the sort stable
+        bool allInOneBucket = false;
+        size_t sum = 0;
+        for (int b=0;b<num_buckets;b++) {
+          size_t bucketSize = 0;
+          for (int c=0;c<numChunks;c++) {
+            const size_t count = offsets[c*num_buckets+b];
+            offsets[c*num_buckets+b] = sum;
+            sum += count;
+            bucketSize += count;
+          }
+          if (bucketSize == N) allInOneBucket = true;
+        }
+        if (allInOneBucket) continue;
+
+        forEachChunk(numChunks,[&](int chunk) {
+            size_t *offset = offsets.data()+chunk*num_buckets;
+            const size_t begin = N*chunk/numChunks;
+            const size_t end   = N*(chunk+1)/numChunks;
+            for (size_t i=begin;i<end;i++) {
+              const size_t pos = offset[(srcKeys[i] >> shift) & (num_buckets-1)]++;
+              dstKeys[pos] = srcKeys[i];
+              dstVals[pos] = srcVals[i];
+            }
+          });
+        std::swap(srcKeys,dstKeys);
+        std::swap(srcVals,dstVals);
+      }
+      if (srcKeys != keys) {
+        std::copy(srcKeys,srcKeys+N,keys);
+        std::copy(srcVals,srcVals+N,values);
+      }
+    }
+
+    template<typename data_t, typename data_traits>
+    struct Builder {
+      using point_t  = typename data_traits::point_t;
+      using scalar_t = typename point_traits<point_t>::scalar_t;
+      using box_t    = cukd::box_t<point_t>;
+      enum { num_dims = point_traits<point_t>::num_dims };
+
+      Builder(data_t *points,
+              int numPoints,
+              const box_t *worldBounds,
+              int numThreads,
+              HostMemoryResource &memResource);
+
+      /*! runs all levels, then moves the points to their node
+          positions */
+      void build();
+
+    private:
+      /*! runs func(begin,end) over ranges of [begin,end), in parallel */
+      template<typename Lambda>
+      void parallelFor(int begin, int end, const Lambda &func);
+      
+      /*! split dim of the point at input position 'index' */
+      inline int dimOf(uint32_t index, int level) const
+      {
+        return data_traits::has_explicit_dim
+          ? dims[index]
+          : (level % num_dims);
+      }
+
+      /*! bounds of the given subtree's domain; same as
+          cukd::findBounds(), but looking up the (already settled)
+          ancestors through the indices */
+      box_t findBounds(int subtree) const;
+
+      /*! sorts [begin,numPoints) by key */
+      void sort(int begin, int numKeyBits);
+
+      /*! moves each point to its node position, following the
+          permutation's cycles */
+      void permuteInPlace();
+      
+      data_t *const       points;
+      const int           numPoints;
+      const box_t *const  worldBounds;
+      const int           numThreads;
+      HostMemoryResource &memResource;
+      HostVector<uint64_t> keys,    tmpKeys;
+      HostVector<uint32_t> indices, tmpIndices;
+      /*! split dims, indexed by input position; only used if
+          data_traits::has_explicit_dim */
+      HostVector<uint8_t>  dims;
+    };
+
+    template<typename data_t, typename data_traits>
+    Builder<data_t,data_traits>::Builder(data_t *points,
+                                         int numPoints,
+                                         const box_t *worldBounds,
+                                         int numThreads,
+                                         HostMemoryResource &memResource)
+      : points(points),
+        numPoints(numPoints),
+        worldBounds(worldBounds),
+        numThreads(std::max(numThreads,1)),
+        memResource(memResource),
+        keys(numPoints,HostAllocator<uint64_t>(memResource)),
+        tmpKeys(numPoints,HostAllocator<uint64_t>(memResource)),
+        indices(numPoints,HostAllocator<uint32_t>(memResource)),
+        tmpIndices(numPoints,HostAllocator<uint32_t>(memResource)),
+        dims(HostAllocator<uint8_t>(memResource))
+    {
+      for (int i=0;i<numPoints;i++)
+        indices[i] = i;
+      if (data_traits::has_explicit_dim)
+        dims.resize(numPoints,(uint8_t)worldBounds->widestDimension());
+    }
+
+    template<typename data_t, typename data_traits>
+    template<typename Lambda>
+    void Builder<data_t,data_traits>::parallelFor(int begin, int end,
+                                                  const Lambda &func)
+    {
+      const int numItems = end-begin;
+      const int numChunks
+        = std::max(1,std::min(numThreads,numItems/(64*1024)));
+      forEachChunk(numChunks,[&](int chunk) {
+          func(begin+int(int64_t(numItems)*chunk/numChunks),
+               begin+int(int64_t(numItems)*(chunk+1)/numChunks));
+        });
+    }
+
+    template<typename data_t, typename data_traits>
+    typename Builder<data_t,data_traits>::box_t
+    Builder<data_t,data_traits>::findBounds(int subtree) const
+    {
+      box_t bounds = *worldBounds;
+      int curr = subtree;
+      while (curr > 0) {
+        const int parent = (curr+1)/2-1;
+        const uint32_t parentIdx  = indices[parent];
+        const int      parent_dim = dims[parentIdx];
+        const scalar_t parent_split_pos
+          = data_traits::get_coord(points[parentIdx],parent_dim);
+        if (curr & 1)
+          set_coord(bounds.upper,parent_dim,
+                    min(parent_split_pos,get_coord(bounds.upper,parent_dim)));
+        else
+          set_coord(bounds.lower,parent_dim,
+                    max(parent_split_pos,get_coord(bounds.lower,parent_dim)));
+        curr = parent;
+      }
+      return bounds;
+    }
+
+    template<typename data_t, typename data_traits>
+    void Builder<data_t,data_traits>::sort(int begin, int numKeyBits)
+    {
+      radixSort(keys.data()+begin,indices.data()+begin,
+                tmpKeys.data()+begin,tmpIndices.data()+begin,
+                numPoints-begin,numKeyBits,numThreads,memResource);
+    }
+    
+    template<typename data_t, typename data_traits>
+    void Builder<data_t,data_traits>::build()
+    {
+      const int numLevels = BinaryTree::numLevelsFor(numPoints);
+      const int deepestLevel = numLevels-1;
+      // tags are < numPoints, so only need that many bits
+      int numTagBits = 0;
+      while ((1ull<<numTagBits) < (uint64_t)numPoints) numTagBits++;
+      
+      for (int level=0;level<deepestLevel;level++) {
+        // see builder_indirect.h: nodes settled two or more levels
+        // ago are in their final positions, and last level's pivots
+        // only get moved to the front (by their tags) in this sort;
+        // so we only need to set up keys for the others
+        const int numSettled = FullBinaryTreeOf(level).numNodes();
+        const int sortBegin  = FullBinaryTreeOf(std::max(level-1,0)).numNodes();
+        parallelFor(sortBegin,numPoints,[&](int begin, int end) {
+            for (int i=begin;i<end;i++) {
+              const uint64_t tag = keys[i] >> 32;
+              if (tag < uint64_t(numSettled)) continue;
+              const uint32_t idx = indices[i];
+              keys[i]
+                = (tag << 32)
+                | radixKeyOf(data_traits::get_coord(points[idx],dimOf(idx,level)));
+            }
+          });
+        sort(sortBegin,32+numTagBits);
+
+        parallelFor(numSettled,numPoints,[&](int begin, int end) {
+            ArrayLayoutInStep layout(level,numPoints);
+            for (int gid=begin;gid<end;gid++) {
+              const uint32_t tag = uint32_t(keys[gid] >> 32);
+              const int pivotPos = layout.pivotPosOf(tag);
+              if (gid == pivotPos)
+                continue;
+              const uint32_t subtree
+                = (gid < pivotPos)
+                ? BinaryTree::leftChildOf(tag)
+                : BinaryTree::rightChildOf(tag);
+              if (data_traits::has_explicit_dim) {
+                // pivots (and their dims) stay as they are, so
+                // updating other points' dims in parallel is fine
+                box_t bounds = findBounds(tag);
+                const uint32_t pivotIdx = indices[pivotPos];
+                const int pivotDim = dims[pivotIdx];
+                const scalar_t pivotCoord
+                  = data_traits::get_coord(points[pivotIdx],pivotDim);
+                if (gid < pivotPos)
+                  set_coord(bounds.upper,pivotDim,pivotCoord);
+                else
+                  set_coord(bounds.lower,pivotDim,pivotCoord);
+                dims[indices[gid]] = (uint8_t)bounds.widestDimension();
+              }
+              keys[gid] = uint64_t(subtree) << 32;
+            }
+          });
+      }
+
+      /* do one final sort, to put all elements in order - by now every
+         element has its final (and unique) nodeID stored in its tag;
+         keys of settled nodes still have their coordinates in the
+         lower bits, but those never decide the order */
+      const int sortBegin = FullBinaryTreeOf(std::max(deepestLevel-1,0)).numNodes();
+      parallelFor(sortBegin,numPoints,[&](int begin, int end) {
+          for (int i=begin;i<end;i++)
+            keys[i] &= ~uint64_t(0xffffffffu);
+        });
+      sort(sortBegin,32+numTagBits);
+
+      permuteInPlace();
+    }
+
+    template<typename data_t, typename data_traits>
+    void Builder<data_t,data_traits>::permuteInPlace()
+    {
+      if (data_traits::has_explicit_dim)
+        for (int i=0;i<numPoints;i++)
+          if_has_dims<data_t,data_traits,data_traits::has_explicit_dim>
+            ::set_dim(points[i],dims[i]);
+      
+      // same as in builder_indirect.h: every point gets moved exactly
+      // once, and indices we're done with point to themselves
+      for (int i=0;i<numPoints;i++) {
+        if (indices[i] == uint32_t(i)) continue;
+        const data_t tmp = points[i];
+        int curr = i;
+        while (true) {
+          const int src = indices[curr];
+          indices[curr] = curr;
+          if (src == i) {
+            points[curr] = tmp;
+            break;
+          }
+          points[curr] = points[src];
+          curr = src;
+        }
+      }
+    }
+    
+  } // ::cukd::radixSortBuilder
+
+  template<typename data_t, typename data_traits>
+  void buildTree_radix_host(data_t *points,
+                            int numPoints,
+                            cukd::box_t<typename data_traits::point_t> *worldBounds,
+                            int numThreads,
+                            HostMemoryResource &memResource)
+  {
+    if (numPoints < 1) return;
+    if (data_traits::has_explicit_dim && !worldBounds)
+      throw std::runtime_error
+        ("cukd::buildTree_radix_host: asked to build k-d tree over nodes"
+         " with explicit dims, but no memory for world bounds provided");
+    if (data_traits::has_explicit_dim
+        && point_traits<typename data_traits::point_t>::num_dims > 256)
+      throw std::runtime_error
+        ("cukd::buildTree_radix_host: explicit dims are only"
+         " supported for up to 256 dimensions");
+    if (worldBounds)
+      host_computeBounds<data_t,data_traits>(worldBounds,points,numPoints);
+    
+    radixSortBuilder::Builder<data_t,data_traits>
+      builder(points,numPoints,worldBounds,numThreads,memResource);
+    builder.build();
+  }
+  
+} // ::cukd
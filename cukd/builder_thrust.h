@@ -115,7 +115,10 @@ namespace cukd {
            typename data_traits=default_data_traits<data_t>>
   void buildTree_host(data_t *d_points,
                       int numPoints,
-                      cukd::box_t<typename data_traits::point_t> *worldBounds=0);
+                      cukd::box_t<typename data_traits::point_t> *worldBounds=0,
+                      /*! memory resource for all temporary host
+                          memory, including thrust's own */
+                      HostMemoryResource &memResource=defaultHostMemResource());
   
   // ==================================================================
   // IMPLEMENTATION SECTION
@@ -156,7 +159,7 @@ namespace cukd {
     }
   
     template<typename data_t,typename data_traits>
-    void host_chooseInitialDim(cukd::box_t<typename data_traits::point_t> *d_bounds,
+    void host_chooseInitialDim(const cukd::box_t<typename data_traits::point_t> *d_bounds,
                                data_t *d_nodes,
                                int numPoints)
     {
@@ -511,93 +514,113 @@ namespace cukd {
     cudaStreamSynchronize(stream);
   }
       
+  namespace thrustSortBuilder {
+    
+    /*! builds a (sub-)tree on the host, over host read/writeable
+      data. 'domain' is the spatial domain that this subtree's points
+      live in (and must be provided if data_traits::has_explicit_dim
+      is true), and 'rootLevel' is the level (in some larger tree)
+      that this subtree's root lives on; this lets the out-of-core
+      builder build subtrees of a much larger tree with the same
+      split dimensions (and thus the same result) that building the
+      whole tree in one go would have produced. For a "regular" build
+      domain are the world bounds and rootLevel is 0. */
+    template<typename data_t, typename data_traits>
+    void host_buildSubtree(data_t *d_points,
+                           int numPoints,
+                           const cukd::box_t<typename data_traits::point_t> *domain,
+                           int rootLevel,
+                           HostMemoryResource &memResource=defaultHostMemResource())
+    {
+      using point_t      = typename data_traits::point_t;
+      using point_traits = ::cukd::point_traits<point_t>;
+      enum { num_dims   = point_traits::num_dims };
+    
+      /* thrust helper typedefs for the zip iterator, to make the code
+         below more readable */
+      typedef uint32_t *tag_iterator;
+      typedef data_t   *point_iterator;
+      typedef thrust::tuple<tag_iterator,point_iterator> iterator_tuple;
+      typedef thrust::zip_iterator<iterator_tuple> tag_point_iterator;
+
+      // check for invalid input, and return gracefully if so
+      if (numPoints < 1) return;
+
+      /* the helper array  we use to store each node's subtree ID in */
+      HostVector<uint32_t> tags(numPoints,HostAllocator<uint32_t>(memResource));
+      /* thrust's temporary memory (for the sorts) comes from the
+         same memory resource; thrust::host keeps whatever host system
+         (cpp, omp, tbb) thrust got configured with */
+      HostAllocator<char> thrustAlloc(memResource);
+      /* to kick off the build, every element is in the only
+         level-0 subtree there is, namely subtree number 0... duh */
+      thrust::fill(thrust::host,tags.begin(),tags.end(),0);
+
+      /* create the zip iterators we use for zip-sorting the tag and
+         points array */
+      tag_point_iterator begin = thrust::make_zip_iterator
+        (thrust::make_tuple(tags.data(),d_points));
+      tag_point_iterator end = thrust::make_zip_iterator
+        (thrust::make_tuple(tags.data()+numPoints,d_points+numPoints));
+
+      /* compute number of levels in the tree, which dicates how many
+         construction steps we need to run */
+      const int numLevels = BinaryTree::numLevelsFor(numPoints);
+      const int deepestLevel = numLevels-1;
+    
+      if (data_traits::has_explicit_dim) {
+        if (!domain)
+          throw std::runtime_error
+            ("cukd::builder_host: asked to build k-d tree over nodes"
+             " with explicit dims, but no memory for world bounds provided");
+      
+        host_chooseInitialDim<data_t,data_traits>
+          (domain,d_points,numPoints);
+      }
+    
+      /* now build each level, one after another, cycling through the
+         dimensoins */
+      for (int level=0;level<deepestLevel;level++) {
+        thrust::sort(thrust::host(thrustAlloc),begin,end,
+                     ZipCompare<data_t,data_traits>
+                     ((rootLevel+level)%num_dims,d_points));
+      
+        if (data_traits::has_explicit_dim) {
+          host_updateTagsAndSetDims<data_t,data_traits>
+            (domain,thrust::raw_pointer_cast(tags.data()),
+             d_points,numPoints,level);
+        } else {
+          host_updateTags
+            (thrust::raw_pointer_cast(tags.data()),numPoints,level);
+        }
+      }
+    
+      /* do one final sort, to put all elements in order - by now every
+         element has its final (and unique) nodeID stored in the tag[]
+         array, so the dimension we're sorting in really won't matter
+         any more */
+      thrust::sort(thrust::host(thrustAlloc),begin,end,
+                   ZipCompare<data_t,data_traits>
+                   ((rootLevel+deepestLevel)%num_dims,d_points)); 
+    }
+    
+  } // ::cukd::thrustSortBuilder
+  
   template<typename data_t, typename data_traits>
   void buildTree_host(data_t *d_points,
                       int numPoints,
-                      cukd::box_t<typename data_traits::point_t> *worldBounds)
+                      cukd::box_t<typename data_traits::point_t> *worldBounds,
+                      HostMemoryResource &memResource)
   {
-    using namespace thrustSortBuilder;
-
-    using point_t      = typename data_traits::point_t;
-    using point_traits = ::cukd::point_traits<point_t>;
-    using scalar_t    = typename point_traits::scalar_t;
-    enum { num_dims   = point_traits::num_dims };
-    
-    /* thrust helper typedefs for the zip iterator, to make the code
-       below more readable */
-#if 1
-    typedef uint32_t *tag_iterator;
-    typedef data_t   *point_iterator;
-#else
-    typedef typename thrust::device_vector<uint32_t>::iterator tag_iterator;
-    typedef typename thrust::device_vector<data_t>::iterator point_iterator;
-#endif
-    typedef thrust::tuple<tag_iterator,point_iterator> iterator_tuple;
-    typedef thrust::zip_iterator<iterator_tuple> tag_point_iterator;
-
     // check for invalid input, and return gracefully if so
     if (numPoints < 1) return;
 
-    /* the helper array  we use to store each node's subtree ID in */
-    // TODO allocate in stream?
-    std::vector<uint32_t> tags(numPoints);
-    /* to kick off the build, every element is in the only
-       level-0 subtree there is, namely subtree number 0... duh */
-    thrust::fill(thrust::host,tags.begin(),tags.end(),0);
-
-    /* create the zip iterators we use for zip-sorting the tag and
-       points array */
-    thrust::device_ptr<data_t> points_begin(d_points);
-    thrust::device_ptr<data_t> points_end(d_points+numPoints);
-    tag_point_iterator begin = thrust::make_zip_iterator
-      (thrust::make_tuple(tags.data(),d_points));
-    tag_point_iterator end = thrust::make_zip_iterator
-      (thrust::make_tuple(tags.data()+numPoints,d_points+numPoints));
-
-    /* compute number of levels in the tree, which dicates how many
-       construction steps we need to run */
-    const int numLevels = BinaryTree::numLevelsFor(numPoints);
-    const int deepestLevel = numLevels-1;
-    
-    using box_t = cukd::box_t<point_t>;
     if (worldBounds) {
       host_computeBounds<data_t,data_traits>
         (worldBounds,d_points,numPoints);
     }
-    if (data_traits::has_explicit_dim) {
-      if (!worldBounds)
-        throw std::runtime_error
-          ("cukd::builder_host: asked to build k-d tree over nodes"
-           " with explicit dims, but no memory for world bounds provided");
-      
-      host_chooseInitialDim<data_t,data_traits>
-        (worldBounds,d_points,numPoints);
-    }
-    
-    /* now build each level, one after another, cycling through the
-       dimensoins */
-    for (int level=0;level<deepestLevel;level++) {
-      thrust::sort(thrust::host,begin,end,
-                   ZipCompare<data_t,data_traits>
-                   ((level)%num_dims,d_points));
-      
-      if (data_traits::has_explicit_dim) {
-        host_updateTagsAndSetDims<data_t,data_traits>
-          (worldBounds,thrust::raw_pointer_cast(tags.data()),
-           d_points,numPoints,level);
-      } else {
-        host_updateTags
-          (thrust::raw_pointer_cast(tags.data()),numPoints,level);
-      }
-    }
-    
-    /* do one final sort, to put all elements in order - by now every
-       element has its final (and unique) nodeID stored in the tag[]
-       array, so the dimension we're sorting in really won't matter
-       any more */
-    thrust::sort(thrust::host,begin,end,
-                 ZipCompare<data_t,data_traits>
-                 ((deepestLevel)%num_dims,d_points)); 
+    thrustSortBuilder::host_buildSubtree<data_t,data_traits>
+      (d_points,numPoints,worldBounds,/*rootLevel*/0,memResource);
   }
 
 } // ::cukd
@@ -26,6 +26,7 @@
 #include <math_constants.h>
 #include <cuda.h>
 #include <stdio.h>
+#include <string.h>
 #include <iostream>
 #include <stdexcept>
 #include <memory>
@@ -353,6 +354,16 @@ namespace cukd {
 # define CUKD_STATS_ARG(a,b) /* nothing */
 #endif
 
+/* same as CUKD_STATS, but only for code that's compiled for the
+   device; traversal routines are also callable from the host (e.g.,
+   on a memory-mapped tree), and those host-side calls don't count
+   traversal steps */
+#if CUKD_ENABLE_STATS && defined(__CUDA_ARCH__)
+# define CUKD_DEVICE_STATS(a) a
+#else
+# define CUKD_DEVICE_STATS(a) /* nothing */
+#endif
+
 #if CUKD_ENABLE_STATS
 namespace cukd {
   __constant__ __device__ unsigned long long *g_traversalStats;
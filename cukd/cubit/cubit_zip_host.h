@@ -0,0 +1,261 @@
+// ======================================================================== //
+// Copyright 2022-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/*! cubit_zip_host.h: host port of the "zip"-sort in cubit_zip.h
+
+  Same algorithm, same in-place property (no temporary memory at all,
+  only swaps), same support for non-power of two sizes, and same
+  Less functor (taking two cubit::tuple<U,V>'s) as the CUDA version -
+  so code that sorts with cubit::zip_sort() on the device can do the
+  same on the host with cubit::host_zip_sort().
+
+  Where the CUDA version sorts blocks of 2x1024 items in shared
+  memory, this one sorts blocks of (at most) block_bytes bytes, so
+  that all the (many) small-stride steps of the sorting network run
+  within the L2 cache; only the few large-stride steps stream over
+  all of the data. Blocks (for the small strides) and ranges of
+  compare-exchange pairs (for the large ones) get spread over
+  multiple threads.
+
+  Each compare-exchange is written as an unconditional select (rather
+  than a conditional swap), so within a block the compiler can turn
+  the network's inner loops into branch-free (and, for simple key
+  types, vectorized) code; we do not hand-code any SIMD intrinsics
+  since U, V, and the Less functor are all user-supplied.
+*/
+
+#pragma once
+
+#include "../cubit/cubit_zip.h"
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace cubit {
+
+  /*! host version of cubit::zip_sort(): sorts the (us[i],vs[i])
+      pairs by the given Less functor, in place, using up to
+      numThreads threads */
+  template<typename U, typename V, typename Less>
+  inline void host_zip_sort(U *const __restrict__ us,
+                            V *const __restrict__ vs,
+                            size_t numValues,
+                            Less less,
+                            int numThreads = std::thread::hardware_concurrency());
+
+  namespace zip_host {
+
+    /*! max size (in bytes, for both arrays together) of a block
+        whose small-stride sorting steps get done in one go */
+    enum { block_bytes = 256*1024 };
+
+    /*! don't bother spawning threads for less than that many
+        compare-exchange pairs per thread */
+    enum { min_pairs_per_thread = 64*1024 };
+
+    /*! number of items per block: the largest power of two such that
+        the block's keys and values fit into block_bytes */
+    template<typename U, typename V>
+    inline size_t block_size()
+    {
+      size_t bs = 64;
+      while (2*bs*(sizeof(U)+sizeof(V)) <= block_bytes) bs *= 2;
+      return bs;
+    }
+
+    /*! calls func(begin,end) for numThreads (roughly) equally sized
+        sub-ranges of [0,numItems), in parallel */
+    template<typename Lambda>
+    inline void parallel_for(size_t numItems,
+                             int numThreads,
+                             size_t minItemsPerThread,
+                             const Lambda &func)
+    {
+      const size_t numChunks
+        = std::min(size_t(std::max(numThreads,1)),
+                   std::max(numItems/std::max(minItemsPerThread,size_t(1)),
+                            size_t(1)));
+      if (numChunks <= 1) {
+        func(size_t(0),numItems);
+        return;
+      }
+      std::vector<std::thread> threads;
+      for (size_t i=0;i<numChunks;i++)
+        threads.push_back(std::thread(func,
+                                      numItems*i/numChunks,
+                                      numItems*(i+1)/numChunks));
+      for (auto &t : threads) t.join();
+    }
+
+    template<typename U, typename V, typename Less>
+    inline void host_sort(U *const __restrict__ us,
+                          V *const __restrict__ vs,
+                          size_t a,
+                          size_t b,
+                          const Less &less)
+    {
+      const U ua = us[a];
+      const U ub = us[b];
+      const V va = vs[a];
+      const V vb = vs[b];
+      const bool swap = less(tuple<U,V>{ub,vb},tuple<U,V>{ua,va});
+      us[a] = swap ? ub : ua;
+      us[b] = swap ? ua : ub;
+      vs[a] = swap ? vb : va;
+      vs[b] = swap ? va : vb;
+    }
+
+    /*! the 'up' step for sequence length seqLen, for all
+        compare-exchange pairs in [pairBegin,pairEnd) - i.e., item l
+        gets compared to its mirror image r = l^(2*seqLen-1) within
+        the same 2*seqLen-sized group. Items at or beyond N are
+        (virtually) +infinity, so any pair with r >= N is a no-op */
+    template<typename U, typename V, typename Less>
+    inline void up(U *const __restrict__ us,
+                   V *const __restrict__ vs,
+                   size_t N,
+                   size_t seqLen,
+                   size_t pairBegin,
+                   size_t pairEnd,
+                   const Less &less)
+    {
+      // pair 'tid' is pair #i=tid%seqLen in the group that starts at
+      // item 2*(tid-i); walk the pairs group by group, so the inner
+      // loop has no index computations other than l++, r--
+      size_t tid = pairBegin;
+      while (tid < pairEnd) {
+        const size_t i = tid & (seqLen-1);
+        const size_t groupBegin = 2*(tid-i);
+        const size_t numPairs = std::min(seqLen-i,pairEnd-tid);
+        size_t l = groupBegin+i;
+        size_t r = groupBegin+2*seqLen-1-i;
+        for (size_t j=0;j<numPairs;j++,l++,r--)
+          if (r < N) host_sort(us,vs,l,r,less);
+        tid += numPairs;
+      }
+    }
+
+    /*! the 'down' step for sequence length seqLen: compares item l
+        to item l+seqLen */
+    template<typename U, typename V, typename Less>
+    inline void down(U *const __restrict__ us,
+                     V *const __restrict__ vs,
+                     size_t N,
+                     size_t seqLen,
+                     size_t pairBegin,
+                     size_t pairEnd,
+                     const Less &less)
+    {
+      size_t tid = pairBegin;
+      while (tid < pairEnd) {
+        const size_t i = tid & (seqLen-1);
+        const size_t l = 2*(tid-i)+i;
+        // pairs with r >= N are no-ops, and so are all later ones
+        if (l+seqLen >= N) return;
+        const size_t numPairs = std::min(std::min(seqLen-i,pairEnd-tid),
+                                         N-(l+seqLen));
+        for (size_t j=0;j<numPairs;j++)
+          host_sort(us,vs,l+j,l+j+seqLen,less);
+        tid += std::min(seqLen-i,pairEnd-tid);
+      }
+    }
+
+    /*! fully sorts the (blockSize-aligned) block that begins at
+        'begin'; equivalent to cubit::zip::block_sort_up */
+    template<typename U, typename V, typename Less>
+    inline void block_sort_up(U *const __restrict__ us,
+                              V *const __restrict__ vs,
+                              size_t N,
+                              size_t begin,
+                              size_t blockSize,
+                              const Less &less)
+    {
+      const size_t n = std::min(blockSize,N-begin);
+      for (size_t upLen=1;upLen<blockSize;upLen+=upLen) {
+        up(us+begin,vs+begin,n,upLen,0,blockSize/2,less);
+        for (size_t downLen=upLen/2;downLen>0;downLen/=2)
+          down(us+begin,vs+begin,n,downLen,0,blockSize/2,less);
+      }
+    }
+
+    /*! all down steps with seqLen < blockSize, for the block that
+        begins at 'begin'; equivalent to cubit::zip::block_sort_down */
+    template<typename U, typename V, typename Less>
+    inline void block_sort_down(U *const __restrict__ us,
+                                V *const __restrict__ vs,
+                                size_t N,
+                                size_t begin,
+                                size_t blockSize,
+                                const Less &less)
+    {
+      const size_t n = std::min(blockSize,N-begin);
+      for (size_t downLen=blockSize/2;downLen>0;downLen/=2)
+        down(us+begin,vs+begin,n,downLen,0,blockSize/2,less);
+    }
+
+  } // ::cubit::zip_host
+
+  template<typename U, typename V, typename Less>
+  inline void host_zip_sort(U *const __restrict__ us,
+                            V *const __restrict__ vs,
+                            size_t numValues,
+                            Less less,
+                            int numThreads)
+  {
+    using namespace zip_host;
+    if (numValues < 2) return;
+
+    const size_t N = numValues;
+    const size_t bs = block_size<U,V>();
+    const size_t numBlocks = (N+bs-1)/bs;
+    const size_t minBlocksPerThread
+      = std::max(size_t(min_pairs_per_thread)/bs,size_t(1));
+    // number of compare-exchange pairs in each of the large-stride
+    // steps: half the (virtual) power-of-two padded size
+    size_t numPairs = 1;
+    while (2*numPairs < N) numPairs *= 2;
+
+    // ==================================================================
+    // first - sort all blocks
+    // ==================================================================
+    parallel_for(numBlocks,numThreads,minBlocksPerThread,
+                 [&](size_t begin, size_t end) {
+                   for (size_t b=begin;b<end;b++)
+                     block_sort_up(us,vs,N,b*bs,bs,less);
+                 });
+
+    // ==================================================================
+    // then, merge into ever larger sorted sequences
+    // ==================================================================
+    for (size_t upLen=bs;upLen<N;upLen+=upLen) {
+      parallel_for(numPairs,numThreads,min_pairs_per_thread,
+                   [&](size_t begin, size_t end) {
+                     up(us,vs,N,upLen,begin,end,less);
+                   });
+      for (size_t downLen=upLen/2;downLen>=bs;downLen/=2)
+        parallel_for(numPairs,numThreads,min_pairs_per_thread,
+                     [&](size_t begin, size_t end) {
+                       down(us,vs,N,downLen,begin,end,less);
+                     });
+      parallel_for(numBlocks,numThreads,minBlocksPerThread,
+                   [&](size_t begin, size_t end) {
+                     for (size_t b=begin;b<end;b++)
+                       block_sort_down(us,vs,N,b*bs,bs,less);
+                   });
+    }
+  }
+
+}
@@ -46,6 +46,9 @@ namespace cukd {
   template<> struct scalar_type_of<int2>   { using type = int; };
   template<> struct scalar_type_of<int3>   { using type = int; };
   template<> struct scalar_type_of<int4>   { using type = int; };
+  template<> struct scalar_type_of<double2> { using type = double; };
+  template<> struct scalar_type_of<double3> { using type = double; };
+  template<> struct scalar_type_of<double4> { using type = double; };
   
   /*! template interface for cuda vector types (such as float3, int4,
       etc), that allows for querying which scalar type this vec is
@@ -57,6 +60,9 @@ namespace cukd {
   template<> struct num_dims_of<int2>   { enum { value = 2 }; };
   template<> struct num_dims_of<int3>   { enum { value = 3 }; };
   template<> struct num_dims_of<int4>   { enum { value = 4 }; };
+  template<> struct num_dims_of<double2> { enum { value = 2 }; };
+  template<> struct num_dims_of<double3> { enum { value = 3 }; };
+  template<> struct num_dims_of<double4> { enum { value = 4 }; };
 
   inline __both__ float get_coord(const float2 &v, int d) { return d?v.y:v.x; }
   inline __both__ float get_coord(const float3 &v, int d) { return (d==2)?v.z:(d?v.y:v.x); }
@@ -75,6 +81,14 @@ namespace cukd {
   inline __both__ int &get_coord(int3 &v, int d) { return (d==2)?v.z:(d?v.y:v.x); }
   inline __both__ int &get_coord(int4 &v, int d) { return (d>=2)?(d>2?v.w:v.z):(d?v.y:v.x); }
 
+  inline __both__ double get_coord(const double2 &v, int d) { return d?v.y:v.x; }
+  inline __both__ double get_coord(const double3 &v, int d) { return (d==2)?v.z:(d?v.y:v.x); }
+  inline __both__ double get_coord(const double4 &v, int d) { return (d>=2)?(d>2?v.w:v.z):(d?v.y:v.x); }
+  
+  inline __both__ double &get_coord(double2 &v, int d) { return d?v.y:v.x; }
+  inline __both__ double &get_coord(double3 &v, int d) { return (d==2)?v.z:(d?v.y:v.x); }
+  inline __both__ double &get_coord(double4 &v, int d) { return (d>=2)?(d>2?v.w:v.z):(d?v.y:v.x); }
+
   
   inline __both__ void set_coord(int2 &v, int d, int vv) { (d?v.y:v.x) = vv; }
   inline __both__ void set_coord(int3 &v, int d, int vv) { ((d==2)?v.z:(d?v.y:v.x)) = vv; }
@@ -84,6 +98,10 @@ namespace cukd {
   inline __both__ void set_coord(float3 &v, int d, float vv) { ((d==2)?v.z:(d?v.y:v.x)) = vv; }
   inline __both__ void set_coord(float4 &v, int d, float vv) { ((d>=2)?(d>2?v.w:v.z):(d?v.y:v.x)) = vv; }
   
+  inline __both__ void set_coord(double2 &v, int d, double vv) { (d?v.y:v.x) = vv; }
+  inline __both__ void set_coord(double3 &v, int d, double vv) { ((d==2)?v.z:(d?v.y:v.x)) = vv; }
+  inline __both__ void set_coord(double4 &v, int d, double vv) { ((d>=2)?(d>2?v.w:v.z):(d?v.y:v.x)) = vv; }
+  
   inline __both__ int32_t divRoundUp(int32_t a, int32_t b) { return (a+b-1)/b; }
   inline __both__ uint32_t divRoundUp(uint32_t a, uint32_t b) { return (a+b-1)/b; }
   inline __both__ int64_t divRoundUp(int64_t a, int64_t b) { return (a+b-1)/b; }
@@ -126,8 +144,39 @@ namespace cukd {
   { return make_float4(max(a.x,b.x),max(a.y,b.y),max(a.z,b.z),max(a.w,b.w)); }
 #endif
 
+  // (helper_math.h does not define any of these for double types)
+  inline __both__ double2 operator-(double2 a, double2 b)
+  { return make_double2(a.x-b.x,a.y-b.y); }
+  inline __both__ double3 operator-(double3 a, double3 b)
+  { return make_double3(a.x-b.x,a.y-b.y,a.z-b.z); }
+  inline __both__ double4 operator-(double4 a, double4 b)
+  { return make_double4(a.x-b.x,a.y-b.y,a.z-b.z,a.w-b.w); }
+
+  inline __both__ double dot(double2 a, double2 b)
+  { return a.x*b.x+a.y*b.y; }
+  inline __both__ double dot(double3 a, double3 b)
+  { return a.x*b.x+a.y*b.y+a.z*b.z; }
+  inline __both__ double dot(double4 a, double4 b)
+  { return a.x*b.x+a.y*b.y+a.z*b.z+a.w*b.w; }
+  
+  inline __both__ double2 min(double2 a, double2 b)
+  { return make_double2(min(a.x,b.x),min(a.y,b.y)); }
+  inline __both__ double3 min(double3 a, double3 b)
+  { return make_double3(min(a.x,b.x),min(a.y,b.y),min(a.z,b.z)); }
+  inline __both__ double4 min(double4 a, double4 b)
+  { return make_double4(min(a.x,b.x),min(a.y,b.y),min(a.z,b.z),min(a.w,b.w)); }
+
+  inline __both__ double2 max(double2 a, double2 b)
+  { return make_double2(max(a.x,b.x),max(a.y,b.y)); }
+  inline __both__ double3 max(double3 a, double3 b)
+  { return make_double3(max(a.x,b.x),max(a.y,b.y),max(a.z,b.z)); }
+  inline __both__ double4 max(double4 a, double4 b)
+  { return make_double4(max(a.x,b.x),max(a.y,b.y),max(a.z,b.z),max(a.w,b.w)); }
+
   inline std::ostream &operator<<(std::ostream &o, float3 v)
   { o << "(" << v.x << "," << v.y << "," << v.z << ")"; return o; }
+  inline std::ostream &operator<<(std::ostream &o, double3 v)
+  { o << "(" << v.x << "," << v.y << "," << v.z << ")"; return o; }
 
       
   // ==================================================================
@@ -193,10 +242,37 @@ namespace cukd {
   template<> inline __both__ float as_float_rz(float f) { return f; }
 #ifdef __CUDA_ARCH__
   template<> inline __device__ float as_float_rz(int i) { return __int2float_rz(i); }
+  template<> inline __device__ float as_float_rz(double d) { return __double2float_rz(d); }
+#else
+  template<> inline float as_float_rz(double d)
+  {
+    float f = (float)d;
+    return (fabs((double)f) > fabs(d)) ? nextafterf(f,0.f) : f;
+  }
 #endif
 
   /*! @] */
 
+  /*! @{ bit-casts between float and uint32_t that work on both host
+      and device (the cuda intrinsics for that are device-only) */
+  inline __both__ uint32_t float_as_uint(float f)
+  {
+#ifdef __CUDA_ARCH__
+    return __float_as_uint(f);
+#else
+    uint32_t u; memcpy(&u,&f,sizeof(u)); return u;
+#endif
+  }
+  
+  inline __both__ float uint_as_float(uint32_t u)
+  {
+#ifdef __CUDA_ARCH__
+    return __uint_as_float(u);
+#else
+    float f; memcpy(&f,&u,sizeof(f)); return f;
+#endif
+  }
+  /*! @} */
   
   // ------------------------------------------------------------------
   /*! float-accuracy (with round-to-zero mode) of distance between two point_t's */
@@ -213,11 +289,70 @@ namespace cukd {
   auto sqrDistance(const point_t &a, const point_t &b)
   { const point_t d = a-b; return dot(d,d); }
 
+  /*! sqr distance between two vec_float's, computed directly (without
+      building the difference vector first), and with four independent
+      partial sums, so the compiler can vectorize the loop rather than
+      having each add wait for the previous one. If 'earlyExit' is
+      true, this checks the partial sum every 16 coordinates, and
+      returns it as soon as it exceeds maxDist2 */
+  template<bool earlyExit, int N>
+  inline __both__
+  float sqrDistance_vec(const vec_float<N> &a, const vec_float<N> &b,
+                        float maxDist2)
+  {
+    float s0 = 0.f, s1 = 0.f, s2 = 0.f, s3 = 0.f;
+    int i = 0;
+#pragma unroll
+    for (;i+4<=N;i+=4) {
+      const float d0 = a.v[i+0]-b.v[i+0];
+      const float d1 = a.v[i+1]-b.v[i+1];
+      const float d2 = a.v[i+2]-b.v[i+2];
+      const float d3 = a.v[i+3]-b.v[i+3];
+      s0 += d0*d0;
+      s1 += d1*d1;
+      s2 += d2*d2;
+      s3 += d3*d3;
+      if (earlyExit && ((i+4) % 16) == 0 && i+4 < N) {
+        const float partial = (s0+s1)+(s2+s3);
+        if (partial > maxDist2) return partial;
+      }
+    }
+#pragma unroll
+    for (;i<N;i++) {
+      const float d = a.v[i]-b.v[i];
+      s0 += d*d;
+    }
+    return (s0+s1)+(s2+s3);
+  }
+  
+  template<int N>
+  inline __both__
+  float sqrDistance(const vec_float<N> &a, const vec_float<N> &b)
+  { return sqrDistance_vec<false>(a,b,0.f); }
+
+  /*! returns the sqr distance between a and b if that is <= maxDist2;
+      otherwise returns _some_ value > maxDist2 (which may be less
+      than the actual distance). Traversals use this for computing
+      candidate distances, since any candidate farther away than the
+      current cull distance gets rejected, anyway. For most point
+      types this is just sqrDistance; for high-dimensional vec_float's
+      it stops summing as soon as the partial sum exceeds maxDist2 */
+  template<typename point_t, typename dist2_t>
+  inline __both__
+  auto sqrDistanceUpTo(const point_t &a, const point_t &b, dist2_t maxDist2)
+  { return sqrDistance(a,b); }
+
+  template<int N, typename dist2_t>
+  inline __both__
+  float sqrDistanceUpTo(const vec_float<N> &a, const vec_float<N> &b, dist2_t maxDist2)
+  { return sqrDistance_vec<true>(a,b,(float)maxDist2); }
+
   // ------------------------------------------------------------------
   // scalar distance(point,point)
   // ------------------------------------------------------------------
 
   inline __both__ float square_root(float f) { return sqrtf(f); }
+  inline __both__ double square_root(double f) { return ::sqrt(f); }
   
   template<typename point_t>
   inline __both__ auto distance(const point_t &a, const point_t &b)
@@ -259,6 +394,13 @@ namespace cukd {
 
   template<> inline __device__ __host__
   float sqrt(float f) { return ::sqrtf(f); }
+  template<> inline __device__ __host__
+  double sqrt(double f) { return ::sqrt(f); }
+
+  /*! type that queries track (squared) distances in, for points over
+      a given scalar type: float, except for double-precision points */
+  template<typename scalar_t> struct dist2_type_of { using type = float; };
+  template<> struct dist2_type_of<double> { using type = double; };
 
 
 
@@ -22,6 +22,7 @@
 #include "cukd/helpers.h"
 #include "cukd/data.h"
 #include "cukd/spatial-kdtree.h"
+#include "cukd/subtree-bounds.h"
 
 // ==================================================================
 // INTERFACE SECTION
@@ -63,7 +64,7 @@ namespace cukd {
       typename data_t,
       /*! traits that describe these points (float3 etc have working defaults */
       typename data_traits=default_data_traits<data_t>>
-    inline __device__
+    inline __both__
     int fcp(typename data_traits::point_t queryPoint,
             // /*! the world-space bounding box of all data points */
             // const box_t<typename data_traits::point_t> worldBounds,
@@ -76,7 +77,7 @@ namespace cukd {
             FcpSearchParams params = FcpSearchParams{});
     template<typename data_t,
              typename data_traits=default_data_traits<data_t>>
-    inline __device__
+    inline __both__
     int fcp(typename data_traits::point_t queryPoint,
             const box_t<typename data_traits::point_t> worldBounds,
             const data_t *dataPoints,
@@ -91,7 +92,7 @@ namespace cukd {
     // the same, for a _spatial_ k-d tree 
     template<typename data_t,
              typename data_traits=default_data_traits<data_t>>
-    inline __device__
+    inline __both__
     int fcp(const SpatialKDTree<data_t,data_traits> &tree,
             typename data_traits::point_t queryPoint,
             FcpSearchParams params = FcpSearchParams{});
@@ -106,7 +107,7 @@ namespace cukd {
       stack (nor incur the memory overhead for that) */
     template<typename data_t,
              typename data_traits=default_data_traits<data_t>>
-    inline __device__
+    inline __both__
     int fcp(typename data_traits::point_t queryPoint,
             // /*! the world-space bounding box of all data points */
             // const box_t<typename data_traits::point_t> worldBounds,
@@ -119,7 +120,7 @@ namespace cukd {
             FcpSearchParams params = FcpSearchParams{});
     template<typename data_t,
              typename data_traits=default_data_traits<data_t>>
-    inline __device__
+    inline __both__
     int fcp(typename data_traits::point_t queryPoint,
             const box_t<typename data_traits::point_t> worldBounds,
             const data_t *dataPoints,
@@ -141,7 +142,7 @@ namespace cukd {
       queries */
     template<typename data_t,
              typename data_traits=default_data_traits<data_t>>
-    inline __device__
+    inline __both__
     int fcp(typename data_traits::point_t queryPoint,
             /*! the world-space bounding box of all data points */
             const box_t<typename data_traits::point_t> worldBounds,
@@ -153,14 +154,97 @@ namespace cukd {
             /*! paramteres to fine-tune the search */
             FcpSearchParams params = FcpSearchParams{});
     
+    /*! the same, but reading the bounds of the top subtrees from
+      a SubtreeBoundsTable or QuantizedSubtreeBoundsTable (see
+      subtree-bounds.h) */
+    template<typename data_t,
+             typename data_traits=default_data_traits<data_t>,
+             typename bounds_table_t>
+    inline __both__
+    int fcp(typename data_traits::point_t queryPoint,
+            const box_t<typename data_traits::point_t> worldBounds,
+            const bounds_table_t &subtreeBounds,
+            const data_t *dataPoints,
+            int numDataPoints,
+            FcpSearchParams params = FcpSearchParams{});
+    
     // the same, for a _spatial_ k-d tree 
     template<typename data_t,
              typename data_traits=default_data_traits<data_t>>
-    inline __device__
+    inline __both__
     int fcp(const SpatialKDTree<data_t,data_traits> &tree,
             typename data_traits::point_t queryPoint,
             FcpSearchParams params = FcpSearchParams{});
   } // ::cukd::cct
+
+  namespace sfImp {
+    /*! stack-free fcp kernel that, like cct, culls subtrees based on
+      their bounds - which, lacking a stack to track them on, it
+      re-computes from the split planes of the subtree's ancestors
+      (or, if given, reads from a subtree bounds table, see
+      subtree-bounds.h) */
+    template<typename data_t,
+             typename data_traits=default_data_traits<data_t>>
+    inline __both__
+    int fcp(typename data_traits::point_t queryPoint,
+            const box_t<typename data_traits::point_t> worldBounds,
+            const data_t *dataPoints,
+            int numDataPoints,
+            FcpSearchParams params = FcpSearchParams{});
+
+    template<typename data_t,
+             typename data_traits=default_data_traits<data_t>,
+             typename bounds_table_t>
+    inline __both__
+    int fcp(typename data_traits::point_t queryPoint,
+            const box_t<typename data_traits::point_t> worldBounds,
+            const bounds_table_t &subtreeBounds,
+            const data_t *dataPoints,
+            int numDataPoints,
+            FcpSearchParams params = FcpSearchParams{});
+  } // ::cukd::sfImp
+
+  namespace mixed {
+    /*! mixed-precision fcp kernel for trees over double-precision
+      points (double2/3/4, or anything with a double point_t): does
+      all culling tests in float, on query-relative offsets, and
+      only computes exact (double) distances for the few candidates
+      that pass those tests. Returns the same point as the
+      (full-double) stackBased::fcp */
+    template<typename data_t,
+             typename data_traits=default_data_traits<data_t>>
+    inline __both__
+    int fcp(typename data_traits::point_t queryPoint,
+            /*! device(!)-side array of data point, ordered in the
+              right way as produced by buildTree()*/
+            const data_t *dataPoints,
+            /*! number of data points in the tree */
+            int numDataPoints,
+            /*! paramteres to fine-tune the search */
+            FcpSearchParams params = FcpSearchParams{});
+  } // ::cukd::mixed
+
+  namespace bbf {
+    /*! (approximate) find-closest-point kernel using best-bin-first
+      traversal (see traverse-bbf.h): uses params.far_node_inspect_budget
+      and params.eps to trade accuracy for speed. With the default
+      params this is an exact search _only_ as long as no more than
+      queue_size subtrees are pending at any time; beyond that the
+      farthest pending ones get dropped, which is common for
+      high-dimensional data - raise queue_size if that matters */
+    template<typename data_t,
+             typename data_traits=default_data_traits<data_t>,
+             int queue_size=64>
+    inline __both__
+    int fcp(typename data_traits::point_t queryPoint,
+            /*! device(!)-side array of data point, ordered in the
+              right way as produced by buildTree()*/
+            const data_t *dataPoints,
+            /*! number of data points in the tree */
+            int numDataPoints,
+            /*! paramteres to fine-tune the search */
+            FcpSearchParams params = FcpSearchParams{});
+  } // ::cukd::bbf
   
 } // ::cukd
 
@@ -171,16 +255,21 @@ namespace cukd {
 
 #include "traverse-default-stack-based.h"
 #include "traverse-cct.h"
+#include "traverse-sf-imp.h"
 #include "traverse-stack-free.h"
+#include "traverse-mixed.h"
+#include "traverse-bbf.h"
 
 namespace cukd {
 
-  /*! helper struct to hold the current-best results of a fcp kernel during traversal */
-  struct FCPResult {
-    inline __device__ float initialCullDist2() const
+  /*! helper struct to hold the current-best results of a fcp kernel
+      during traversal, with (square) distances tracked in dist2_t */
+  template<typename dist2_t>
+  struct FCPResultT {
+    inline __both__ dist2_t initialCullDist2() const
     { return closestDist2; }
     
-    inline __device__ float clear(float initialDist2)
+    inline __both__ dist2_t clear(dist2_t initialDist2)
     {
       closestDist2 = initialDist2;
       closestPrimID = -1;
@@ -190,7 +279,7 @@ namespace cukd {
     /*! process a new candidate with given ID and (square) distance;
       and return square distance to be used for subsequent
       queries */
-    inline __device__ float processCandidate(int candPrimID, float candDist2)
+    inline __both__ dist2_t processCandidate(int candPrimID, dist2_t candDist2)
     {
       if (candDist2 < closestDist2) {
         closestDist2 = candDist2;
@@ -199,63 +288,162 @@ namespace cukd {
       return closestDist2;
     }
 
-    inline __device__ int returnValue() const
+    inline __both__ int returnValue() const
     { return closestPrimID; }
     
-    int   closestPrimID;
-    float closestDist2;
+    int     closestPrimID;
+    dist2_t closestDist2;
   };
 
+  /*! the default fcp result, with float distances */
+  using FCPResult = FCPResultT<float>;
+
+  /*! fcp result to use for trees over given data: float distances,
+      except for double-precision points */
+  template<typename data_traits>
+  using FCPResultFor
+  = FCPResultT<typename dist2_type_of<typename scalar_type_of
+                                      <typename data_traits::point_t>::type>::type>;
+
 
   template<typename data_t,
            typename data_traits>
-  inline __device__
+  inline __both__
   int cct::fcp(typename data_traits::point_t queryPoint,
                const box_t<typename data_traits::point_t> worldBounds,
                const data_t *d_nodes,
                int N,
                FcpSearchParams params)
   {
-    FCPResult result;
+    using result_t = FCPResultFor<data_traits>;
+    result_t result;
     result.clear(sqr(params.cutOffRadius));
-    traverse_cct<FCPResult,data_t,data_traits>
+    traverse_cct<result_t,data_t,data_traits>
       (result,queryPoint,worldBounds,d_nodes,N);
     return result.returnValue();
   }
 
+  template<typename data_t,
+           typename data_traits,
+           typename bounds_table_t>
+  inline __both__
+  int cct::fcp(typename data_traits::point_t queryPoint,
+               const box_t<typename data_traits::point_t> worldBounds,
+               const bounds_table_t &subtreeBounds,
+               const data_t *d_nodes,
+               int N,
+               FcpSearchParams params)
+  {
+    using result_t = FCPResultFor<data_traits>;
+    result_t result;
+    result.clear(sqr(params.cutOffRadius));
+    traverse_cct<result_t,data_t,data_traits,bounds_table_t>
+      (result,queryPoint,worldBounds,d_nodes,N,subtreeBounds);
+    return result.returnValue();
+  }
+
+  template<typename data_t,
+           typename data_traits>
+  inline __both__
+  int sfImp::fcp(typename data_traits::point_t queryPoint,
+                 const box_t<typename data_traits::point_t> worldBounds,
+                 const data_t *d_nodes,
+                 int N,
+                 FcpSearchParams params)
+  {
+    using result_t = FCPResultFor<data_traits>;
+    result_t result;
+    result.clear(sqr(params.cutOffRadius));
+    traverse_sf_imp<result_t,data_t,data_traits>
+      (result,queryPoint,worldBounds,d_nodes,N);
+    return result.returnValue();
+  }
+
+  template<typename data_t,
+           typename data_traits,
+           typename bounds_table_t>
+  inline __both__
+  int sfImp::fcp(typename data_traits::point_t queryPoint,
+                 const box_t<typename data_traits::point_t> worldBounds,
+                 const bounds_table_t &subtreeBounds,
+                 const data_t *d_nodes,
+                 int N,
+                 FcpSearchParams params)
+  {
+    using result_t = FCPResultFor<data_traits>;
+    result_t result;
+    result.clear(sqr(params.cutOffRadius));
+    traverse_sf_imp<result_t,data_t,data_traits,bounds_table_t>
+      (result,queryPoint,worldBounds,d_nodes,N,subtreeBounds);
+    return result.returnValue();
+  }
+
   template<typename data_t,
            typename data_traits>
-  inline __device__
+  inline __both__
   int stackFree::fcp(typename data_traits::point_t queryPoint,
                      const data_t *d_nodes,
                      int N,
                      FcpSearchParams params)
   {
-    FCPResult result;
+    using result_t = FCPResultFor<data_traits>;
+    result_t result;
     result.clear(sqr(params.cutOffRadius));
-    traverse_stack_free<FCPResult,data_t,data_traits>
+    traverse_stack_free<result_t,data_t,data_traits>
       (result,queryPoint,d_nodes,N,params.eps);
     return result.returnValue();
   }
 
   template<typename data_t,
            typename data_traits>
-  inline __device__
+  inline __both__
   int stackBased::fcp(typename data_traits::point_t queryPoint,
                       const data_t *d_nodes,
                       int N,
                       FcpSearchParams params)
   {
-    FCPResult result;
+    using result_t = FCPResultFor<data_traits>;
+    result_t result;
     result.clear(sqr(params.cutOffRadius));
-    traverse_default<FCPResult,data_t,data_traits>
+    traverse_default<result_t,data_t,data_traits>
+      (result,queryPoint,d_nodes,N);
+    return result.returnValue();
+  }
+
+  template<typename data_t,
+           typename data_traits>
+  inline __both__
+  int mixed::fcp(typename data_traits::point_t queryPoint,
+                 const data_t *d_nodes,
+                 int N,
+                 FcpSearchParams params)
+  {
+    FCPResultT<double> result;
+    result.clear(sqr(double(params.cutOffRadius)));
+    traverse_mixed<FCPResultT<double>,data_t,data_traits>
       (result,queryPoint,d_nodes,N);
     return result.returnValue();
   }
 
+  template<typename data_t,
+           typename data_traits,
+           int queue_size>
+  inline __both__
+  int bbf::fcp(typename data_traits::point_t queryPoint,
+               const data_t *d_nodes,
+               int N,
+               FcpSearchParams params)
+  {
+    FCPResult result;
+    result.clear(sqr(params.cutOffRadius));
+    traverse_bbf<FCPResult,data_t,data_traits,queue_size>
+      (result,queryPoint,d_nodes,N,params);
+    return result.returnValue();
+  }
+
   template<typename data_t,
            typename data_traits>
-  inline __device__
+  inline __both__
   int cct::fcp(const SpatialKDTree<data_t,data_traits> &tree,
                typename data_traits::point_t queryPoint,
                FcpSearchParams params)
@@ -291,7 +479,7 @@ namespace cukd {
     while (true) {
       while (true) {
         numSteps++;
-        CUKD_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
+        CUKD_DEVICE_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
         node = tree.nodes[nodeID];
         if (node.count)
           // this is a leaf...
@@ -324,11 +512,11 @@ namespace cukd {
 
       for (int i=0;i<node.count;i++) {
         int primID = tree.primIDs[node.offset+i];
-        CUKD_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
+        CUKD_DEVICE_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
         auto dp = data_traits::get_point(tree.data[primID]);
           
-        const auto sqrDist = sqrDistance(data_traits::get_point(tree.data[primID]),
-                                         queryPoint);
+        const auto sqrDist = sqrDistanceUpTo(data_traits::get_point(tree.data[primID]),
+                                             queryPoint,cullDist);
         cullDist = result.processCandidate(primID,sqrDist);
       }
       
@@ -348,7 +536,7 @@ namespace cukd {
 
   template<typename data_t,
            typename data_traits>
-  inline __device__
+  inline __both__
   int stackBased::fcp(const SpatialKDTree<data_t,data_traits> &tree,
                       typename data_traits::point_t queryPoint,
                       FcpSearchParams params)
@@ -379,7 +567,7 @@ namespace cukd {
 
     while (true) {
       while (true) {
-        CUKD_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
+        CUKD_DEVICE_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
         node = tree.nodes[nodeID];
         ++numSteps;
         if (node.count)
@@ -408,8 +596,9 @@ namespace cukd {
 
       for (int i=0;i<node.count;i++) {
         int primID = tree.primIDs[node.offset+i];
-        const auto sqrDist = sqrDistance(data_traits::get_point(tree.data[primID]),queryPoint);
-        CUKD_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
+        const auto sqrDist = sqrDistanceUpTo(data_traits::get_point(tree.data[primID]),
+                                             queryPoint,cullDist);
+        CUKD_DEVICE_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
         cullDist = result.processCandidate(primID,sqrDist);
       }
       
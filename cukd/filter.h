@@ -0,0 +1,330 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/*! \file cukd/filter.h Predicate-filtered fcp and knn queries.
+
+    For queries like "closest point with the same class label as the
+    query", "closest point that is not the query point itself", or
+    "k nearest points newer than t", the fcp/knn overloads in this
+    file take a user-supplied filter functor (as first argument, or
+    right after the candidate list for knn)
+
+    struct SameLabel {
+      inline __both__ bool operator()(const LabeledPoint &p) const
+      { return p.label == label; }
+      int label;
+    };
+
+    that gets evaluated during traversal, for every point that would
+    otherwise have been passed to the result; only accepted points
+    ever reach the result (so the cull radius only shrinks on those),
+    which avoids over-fetching with a large k and filtering
+    afterwards:
+
+    int closest = cukd::stackBased::fcp<LabeledPoint,LabeledPoint_traits>
+      (SameLabel{label},queryPoint,d_points,numPoints);
+
+    For filters on class labels, a LabelMaskFilter additionally lets
+    the stack-based traversal skip entire subtrees that do not contain
+    any point of a matching label; this needs one 32-bit mask (of
+    labels that occur in that subtree) per node, computed once per
+    tree with computeLabelMasks().
+*/
+
+#pragma once
+
+#include "cukd/knn.h"
+
+namespace cukd {
+
+  // ==================================================================
+  // INTERFACE SECTION
+  // ==================================================================
+
+  /*! subtree filter for traverse_default() that skips all subtrees
+      that do not contain any point with one of the labels in
+      queryMask; labels are taken modulo 32 */
+  struct LabelMaskFilter {
+    inline __both__ bool accepts(int nodeID) const
+    { return subtreeMasks[nodeID] & queryMask; }
+
+    /*! one mask per node, as computed by computeLabelMasks() */
+    const uint32_t *subtreeMasks;
+    /*! mask of all labels the query is interested in */
+    uint32_t        queryMask;
+  };
+
+  /*! the bit that represents given label in label masks */
+  inline __both__ uint32_t labelMaskOf(int label)
+  { return 1u << (label & 31); }
+
+  /*! computes, for each node of the given tree, the mask of labels
+      that occur in that node's subtree, on the host. get_label is a
+      functor that returns the label of a data_t */
+  template<typename data_t, typename get_label_t>
+  void computeLabelMasks_host(uint32_t *subtreeMasks,
+                              const data_t *points,
+                              int numPoints,
+                              const get_label_t &getLabel);
+
+  /*! the same, on the device (one kernel launch per tree level) */
+  template<typename data_t, typename get_label_t>
+  void computeLabelMasks(uint32_t *d_subtreeMasks,
+                         const data_t *d_points,
+                         int numPoints,
+                         const get_label_t &getLabel,
+                         cudaStream_t stream=0);
+
+  namespace stackBased {
+    /*! find-closest-point among all points that pass the given
+        filter; returns -1 if there is none (within the cut-off
+        radius) */
+    template<typename data_t,
+             typename data_traits=default_data_traits<data_t>,
+             typename filter_t,
+             typename subtree_filter_t=AcceptAllSubtrees>
+    inline __both__
+    int fcp(const filter_t &filter,
+            typename data_traits::point_t queryPoint,
+            const data_t *dataPoints,
+            int numDataPoints,
+            /*! optional filter for whole subtrees, such as a
+                LabelMaskFilter */
+            const subtree_filter_t &subtreeFilter = subtree_filter_t(),
+            FcpSearchParams params = FcpSearchParams{});
+
+    /*! knn among all points that pass the given filter */
+    template<typename CandidateList,
+             typename data_t,
+             typename data_traits=default_data_traits<data_t>,
+             typename filter_t,
+             typename subtree_filter_t=AcceptAllSubtrees>
+    inline __both__
+    float knn(CandidateList &result,
+              const filter_t &filter,
+              typename data_traits::point_t queryPoint,
+              const data_t *d_nodes,
+              int N,
+              const subtree_filter_t &subtreeFilter = subtree_filter_t());
+  } // ::cukd::stackBased
+
+  namespace cct {
+    /*! closest-corner-tracking find-closest-point among all points
+        that pass the given filter */
+    template<typename data_t,
+             typename data_traits=default_data_traits<data_t>,
+             typename filter_t>
+    inline __both__
+    int fcp(const filter_t &filter,
+            typename data_traits::point_t queryPoint,
+            const box_t<typename data_traits::point_t> worldBounds,
+            const data_t *dataPoints,
+            int numDataPoints,
+            FcpSearchParams params = FcpSearchParams{});
+
+    /*! closest-corner-tracking knn among all points that pass the
+        given filter */
+    template<typename CandidateList,
+             typename data_t,
+             typename data_traits=default_data_traits<data_t>,
+             typename filter_t>
+    inline __both__
+    float knn(CandidateList &result,
+              const filter_t &filter,
+              typename data_traits::point_t queryPoint,
+              const box_t<typename data_traits::point_t> worldBounds,
+              const data_t *d_nodes,
+              int N);
+  } // ::cukd::cct
+
+  // ==================================================================
+  // IMPLEMENTATION SECTION
+  // ==================================================================
+
+  /*! wraps a result_t such that only candidates that pass the filter
+      get passed on to it */
+  template<typename result_t,
+           typename filter_t,
+           typename data_t,
+           typename dist2_t>
+  struct FilteredResult {
+    inline __both__ FilteredResult(result_t &result,
+                                   const filter_t &filter,
+                                   const data_t *points)
+      : result(result), filter(filter), points(points),
+        cullDist2(result.initialCullDist2())
+    {}
+
+    inline __both__ dist2_t initialCullDist2() const
+    { return cullDist2; }
+
+    inline __both__ dist2_t processCandidate(int pointID, dist2_t dist2)
+    {
+      // test the (cheap) distance first, so the filter only ever
+      // sees candidates that would actually make it into the result
+      if (dist2 < cullDist2 && filter(points[pointID]))
+        cullDist2 = result.processCandidate(pointID,dist2);
+      return cullDist2;
+    }
+
+    result_t       &result;
+    const filter_t &filter;
+    const data_t   *points;
+    dist2_t         cullDist2;
+  };
+
+  template<typename result_t, typename filter_t, typename data_t, typename data_traits>
+  using FilteredResultFor
+  = FilteredResult<result_t,filter_t,data_t,
+                   typename dist2_type_of<typename scalar_type_of
+                                          <typename data_traits::point_t>::type>::type>;
+
+  template<typename data_t, typename get_label_t>
+  inline __both__
+  void computeLabelMask(uint32_t *subtreeMasks,
+                        const data_t *points,
+                        int numPoints,
+                        const get_label_t &getLabel,
+                        int nodeID)
+  {
+    uint32_t mask = labelMaskOf(getLabel(points[nodeID]));
+    const int lChild = BinaryTree::leftChildOf(nodeID);
+    if (lChild   < numPoints) mask |= subtreeMasks[lChild];
+    if (lChild+1 < numPoints) mask |= subtreeMasks[lChild+1];
+    subtreeMasks[nodeID] = mask;
+  }
+
+  template<typename data_t, typename get_label_t>
+  void computeLabelMasks_host(uint32_t *subtreeMasks,
+                              const data_t *points,
+                              int numPoints,
+                              const get_label_t &getLabel)
+  {
+    // children always have larger IDs than their parents
+    for (int nodeID=numPoints-1;nodeID>=0;--nodeID)
+      computeLabelMask(subtreeMasks,points,numPoints,getLabel,nodeID);
+  }
+
+  template<typename data_t, typename get_label_t>
+  __global__
+  void computeLabelMasksOfLevel(uint32_t *subtreeMasks,
+                                const data_t *points,
+                                int numPoints,
+                                const get_label_t getLabel,
+                                int level)
+  {
+    const int nodeID = ((1<<level)-1) + threadIdx.x+blockIdx.x*blockDim.x;
+    if (nodeID >= min(numPoints,(2<<level)-1)) return;
+    computeLabelMask(subtreeMasks,points,numPoints,getLabel,nodeID);
+  }
+
+  template<typename data_t, typename get_label_t>
+  void computeLabelMasks(uint32_t *d_subtreeMasks,
+                         const data_t *d_points,
+                         int numPoints,
+                         const get_label_t &getLabel,
+                         cudaStream_t stream)
+  {
+    if (numPoints < 1) return;
+    for (int level=BinaryTree::levelOf(numPoints-1);level>=0;--level)
+      computeLabelMasksOfLevel
+        <<<divRoundUp(1<<level,128),128,0,stream>>>
+        (d_subtreeMasks,d_points,numPoints,getLabel,level);
+  }
+
+  template<typename data_t,
+           typename data_traits,
+           typename filter_t,
+           typename subtree_filter_t>
+  inline __both__
+  int stackBased::fcp(const filter_t &filter,
+                      typename data_traits::point_t queryPoint,
+                      const data_t *d_nodes,
+                      int N,
+                      const subtree_filter_t &subtreeFilter,
+                      FcpSearchParams params)
+  {
+    using result_t = FCPResultFor<data_traits>;
+    using filtered_t = FilteredResultFor<result_t,filter_t,data_t,data_traits>;
+    result_t result;
+    result.clear(sqr(params.cutOffRadius));
+    filtered_t filtered(result,filter,d_nodes);
+    traverse_default<filtered_t,data_t,data_traits,subtree_filter_t>
+      (filtered,queryPoint,d_nodes,N,subtreeFilter);
+    return result.returnValue();
+  }
+
+  template<typename CandidateList,
+           typename data_t,
+           typename data_traits,
+           typename filter_t,
+           typename subtree_filter_t>
+  inline __both__
+  float stackBased::knn(CandidateList &result,
+                        const filter_t &filter,
+                        typename data_traits::point_t queryPoint,
+                        const data_t *d_nodes,
+                        int N,
+                        const subtree_filter_t &subtreeFilter)
+  {
+    using filtered_t = FilteredResultFor<CandidateList,filter_t,data_t,data_traits>;
+    filtered_t filtered(result,filter,d_nodes);
+    traverse_default<filtered_t,data_t,data_traits,subtree_filter_t>
+      (filtered,queryPoint,d_nodes,N,subtreeFilter);
+    return result.returnValue();
+  }
+
+  template<typename data_t,
+           typename data_traits,
+           typename filter_t>
+  inline __both__
+  int cct::fcp(const filter_t &filter,
+               typename data_traits::point_t queryPoint,
+               const box_t<typename data_traits::point_t> worldBounds,
+               const data_t *d_nodes,
+               int N,
+               FcpSearchParams params)
+  {
+    using result_t = FCPResultFor<data_traits>;
+    using filtered_t = FilteredResultFor<result_t,filter_t,data_t,data_traits>;
+    result_t result;
+    result.clear(sqr(params.cutOffRadius));
+    filtered_t filtered(result,filter,d_nodes);
+    traverse_cct<filtered_t,data_t,data_traits>
+      (filtered,queryPoint,worldBounds,d_nodes,N);
+    return result.returnValue();
+  }
+
+  template<typename CandidateList,
+           typename data_t,
+           typename data_traits,
+           typename filter_t>
+  inline __both__
+  float cct::knn(CandidateList &result,
+                 const filter_t &filter,
+                 typename data_traits::point_t queryPoint,
+                 const box_t<typename data_traits::point_t> worldBounds,
+                 const data_t *d_nodes,
+                 int N)
+  {
+    using filtered_t = FilteredResultFor<CandidateList,filter_t,data_t,data_traits>;
+    filtered_t filtered(result,filter,d_nodes);
+    traverse_cct<filtered_t,data_t,data_traits>
+      (filtered,queryPoint,worldBounds,d_nodes,N);
+    return result.returnValue();
+  }
+
+} // ::cukd
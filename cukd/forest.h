@@ -0,0 +1,340 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/*! \file cukd/forest.h Randomized k-d forest (in the style of FLANN)
+    for approximate nearest neighbor queries on high-dimensional data.
+
+    A forest consists of several left-balanced k-d trees over the same
+    points, each of which - in each node - splits along a dimension
+    that gets randomly picked among the few dimensions with the
+    highest variance in that subtree. Since the trees differ, points
+    that one tree separates from the query often end up on the same
+    side in another one; so a best-bin-first search over all trees at
+    once (with one shared candidate list, and one shared budget of
+    distance computations, or 'checks') finds many more of the true
+    nearest neighbors per check than the same search in a single
+    tree.
+
+    Both building and querying are done on the host.
+*/
+
+#pragma once
+
+#include "cukd/knn.h"
+#include <random>
+#include <unordered_set>
+#include <queue>
+#include <algorithm>
+
+namespace cukd {
+  namespace forest {
+
+    // ==================================================================
+    // INTERFACE SECTION
+    // ==================================================================
+
+    /*! a node in one of the forest's trees: a copy of the point, the
+        index of that point in the input array, and the split
+        dimension that this tree picked for it */
+    template<typename point_t>
+    struct Node {
+      point_t point;
+      int     pointID;
+      int     dim;
+    };
+
+    /*! data traits for forest nodes, using an explicit split dim */
+    template<typename point_t>
+    struct Node_traits : public default_data_traits<point_t> {
+      using data_t = Node<point_t>;
+      enum { has_explicit_dim = true };
+
+      static inline __both__ const point_t &get_point(const data_t &n)
+      { return n.point; }
+      static inline __both__ auto get_coord(const data_t &n, int d)
+      { return cukd::get_coord(n.point,d); }
+      static inline __both__ int  get_dim(const data_t &n)
+      { return n.dim; }
+      static inline __both__ void set_dim(data_t &n, int d)
+      { n.dim = d; }
+    };
+
+    struct BuildConfig {
+      /*! number of trees in the forest */
+      int numTrees = 4;
+      /*! each node's split dimension gets picked randomly among this
+          many of the subtree's highest-variance dimensions */
+      int numCandidateDims = 5;
+      /*! number of points (per subtree) used to estimate the
+          per-dimension variances */
+      int numVarianceSamples = 100;
+      /*! seed for the random choices made during build */
+      uint32_t seed = 0x12345;
+    };
+
+    struct SearchParams {
+      /*! max number of distance computations (summed over all trees)
+          after which to stop searching; each tree always gets
+          descended into at least once */
+      int   maxChecks = INT_MAX;
+      /*! only visit subtrees whose lower-bound distance D satisfies
+          (1+eps)*D < current search radius */
+      float eps = 0.f;
+      /*! for fcp: only look for points closer than this (for knn, the
+          radius is the one the candidate list got initialized with) */
+      float cutOffRadius = INFINITY;
+    };
+
+    template<typename point_t>
+    struct Forest {
+      using node_t = Node<point_t>;
+
+      int numPoints = 0;
+      /*! one array of nodes per tree, each in regular (left-balanced,
+          implicit) k-d tree order */
+      std::vector<std::vector<node_t>> trees;
+    };
+
+    /*! builds a randomized forest over the given points; queries on
+        that forest return indices into this array */
+    template<typename point_t>
+    Forest<point_t> build(const point_t *points,
+                          int numPoints,
+                          const BuildConfig &config = BuildConfig{});
+
+    /*! (approximate) find-closest-point over all trees in the
+        forest; returns index of closest point found, or -1 */
+    template<typename point_t>
+    int fcp(const Forest<point_t> &forest,
+            point_t queryPoint,
+            const SearchParams &params = SearchParams{});
+
+    /*! (approximate) knn over all trees in the forest, with a single
+        candidate list (of the original point indices) that is shared
+        by all trees */
+    template<typename CandidateList, typename point_t>
+    float knn(CandidateList &result,
+              const Forest<point_t> &forest,
+              point_t queryPoint,
+              const SearchParams &params = SearchParams{});
+
+    // ==================================================================
+    // IMPLEMENTATION SECTION
+    // ==================================================================
+
+    template<typename point_t>
+    struct RandomizedBuilder {
+      using node_t   = Node<point_t>;
+      using traits   = Node_traits<point_t>;
+      enum { num_dims = num_dims_of<point_t>::value };
+
+      RandomizedBuilder(node_t *nodes, int numPoints,
+                        const BuildConfig &config, uint32_t seed)
+        : nodes(nodes), numPoints(numPoints), config(config),
+          rng(seed), nodeIDs(numPoints)
+      {}
+
+      /*! picks a random dimension among the ones with highest
+          (sampled) variance within [begin,end) */
+      int chooseDim(int begin, int end);
+
+      /*! builds the subtree under 'nodeID' over the nodes in
+          [begin,end), and records each node's final position */
+      void buildRec(int begin, int end, int nodeID);
+
+      /*! moves each node to the position recorded for it */
+      void moveToNodePositions();
+
+      node_t *const      nodes;
+      const int          numPoints;
+      const BuildConfig &config;
+      std::mt19937       rng;
+      std::vector<int>   nodeIDs;
+    };
+
+    template<typename point_t>
+    int RandomizedBuilder<point_t>::chooseDim(int begin, int end)
+    {
+      const int count = end-begin;
+      const int numSamples = std::min(count,std::max(1,config.numVarianceSamples));
+      double sum[num_dims], sum2[num_dims];
+      for (int d=0;d<num_dims;d++) sum[d] = sum2[d] = 0.;
+      for (int s=0;s<numSamples;s++) {
+        const int i = begin + int((int64_t(s)*count)/numSamples);
+        for (int d=0;d<num_dims;d++) {
+          const double f = get_coord(nodes[i].point,d);
+          sum[d]  += f;
+          sum2[d] += f*f;
+        }
+      }
+      std::pair<double,int> variance[num_dims];
+      for (int d=0;d<num_dims;d++)
+        variance[d] = { sum2[d]/numSamples - sqr(sum[d]/numSamples), d };
+      const int numCandidates
+        = std::max(1,std::min((int)num_dims,config.numCandidateDims));
+      std::partial_sort(variance,variance+numCandidates,variance+num_dims,
+                        [](const std::pair<double,int> &a,
+                           const std::pair<double,int> &b)
+                        { return a.first > b.first; });
+      return variance[std::uniform_int_distribution<int>(0,numCandidates-1)(rng)].second;
+    }
+
+    template<typename point_t>
+    void RandomizedBuilder<point_t>::buildRec(int begin, int end, int nodeID)
+    {
+      if (begin >= end) return;
+
+      const int lChild = BinaryTree::leftChildOf(nodeID);
+      const int numLeft
+        = (lChild < numPoints)
+        ? ArbitraryBinaryTree(numPoints).numNodesInSubtree(lChild)
+        : 0;
+      const int pivot = begin+numLeft;
+      const int dim = chooseDim(begin,end);
+      std::nth_element(nodes+begin,nodes+pivot,nodes+end,
+                       [dim](const node_t &a, const node_t &b)
+                       { return get_coord(a.point,dim) < get_coord(b.point,dim); });
+      traits::set_dim(nodes[pivot],dim);
+      nodeIDs[pivot] = nodeID;
+
+      buildRec(begin,pivot,lChild);
+      buildRec(pivot+1,end,lChild+1);
+    }
+
+    template<typename point_t>
+    void RandomizedBuilder<point_t>::moveToNodePositions()
+    {
+      for (int i=0;i<numPoints;i++)
+        while (nodeIDs[i] != i) {
+          const int target = nodeIDs[i];
+          std::swap(nodes[i],nodes[target]);
+          std::swap(nodeIDs[i],nodeIDs[target]);
+        }
+    }
+
+    template<typename point_t>
+    Forest<point_t> build(const point_t *points,
+                          int numPoints,
+                          const BuildConfig &config)
+    {
+      if (config.numTrees < 1)
+        throw std::runtime_error("cukd::forest::build: need at least one tree");
+      if (int64_t(numPoints)*config.numTrees > INT_MAX)
+        throw std::runtime_error("cukd::forest::build: too many points"
+                                 " (times number of trees) for int node IDs");
+
+      Forest<point_t> forest;
+      forest.numPoints = numPoints;
+      forest.trees.resize(config.numTrees);
+      for (int t=0;t<config.numTrees;t++) {
+        auto &nodes = forest.trees[t];
+        nodes.resize(numPoints);
+        for (int i=0;i<numPoints;i++)
+          nodes[i] = { points[i], i, 0 };
+        RandomizedBuilder<point_t> builder(nodes.data(),numPoints,
+                                           config,config.seed+t);
+        builder.buildRec(0,numPoints,0);
+        builder.moveToNodePositions();
+      }
+      return forest;
+    }
+
+    /*! best-bin-first traversal of all trees at once (see
+        traverse_bbf), with one priority queue for the subtrees of all
+        trees. Unlike traverse_bbf's this queue is unbounded, so with
+        unlimited checks this is an exact search. Since every point is
+        in every tree, this tracks which points already went into the
+        result, and never passes the same point twice */
+    template<typename result_t, typename point_t>
+    void traverse(result_t &result,
+                  const Forest<point_t> &forest,
+                  point_t queryPoint,
+                  const SearchParams &params)
+    {
+      using traits = Node_traits<point_t>;
+      const int N = forest.numPoints;
+      if (N < 1) return;
+
+      float cullDist = result.initialCullDist2();
+      const float epsScale = sqr(1.f+params.eps);
+      std::unordered_set<int> inResult;
+
+      // (lower-bound dist2, treeID*N+nodeID) pairs, closest first
+      using Branch = std::pair<float,int>;
+      std::priority_queue<Branch,std::vector<Branch>,std::greater<Branch>> queue;
+      for (int t=0;t<(int)forest.trees.size();t++)
+        queue.push({0.f,t*N});
+
+      int numChecks = 0;
+      int numInitialDescents = (int)forest.trees.size();
+      while (!queue.empty()) {
+        if (queue.top().first*epsScale >= cullDist)
+          break;
+        if (numInitialDescents-- <= 0 && numChecks >= params.maxChecks)
+          break;
+
+        const Branch branch = queue.top();
+        queue.pop();
+        const int treeID = branch.second / N;
+        const Node<point_t> *nodes = forest.trees[treeID].data();
+        int curr = branch.second % N;
+        while (curr < N) {
+          const Node<point_t> &node = nodes[curr];
+          const int dim = traits::get_dim(node);
+          ++numChecks;
+          const auto sqrDist = sqrDistanceUpTo(node.point,queryPoint,cullDist);
+          if (sqrDist < cullDist && inResult.insert(node.pointID).second)
+            cullDist = result.processCandidate(node.pointID,sqrDist);
+
+          const auto node_coord  = traits::get_coord(node,dim);
+          const auto query_coord = get_coord(queryPoint,dim);
+          const bool leftIsClose = query_coord < node_coord;
+          const int  lChild = 2*curr+1;
+          const int  rChild = lChild+1;
+          const int closeChild = leftIsClose?lChild:rChild;
+          const int farChild   = leftIsClose?rChild:lChild;
+
+          const float farDist2 = std::max(branch.first,(float)sqr(query_coord - node_coord));
+          if (farChild < N && farDist2*epsScale < cullDist)
+            queue.push({farDist2,treeID*N+farChild});
+          curr = closeChild;
+        }
+      }
+    }
+
+    template<typename point_t>
+    int fcp(const Forest<point_t> &forest,
+            point_t queryPoint,
+            const SearchParams &params)
+    {
+      FCPResult result;
+      result.clear(sqr(params.cutOffRadius));
+      traverse(result,forest,queryPoint,params);
+      return result.returnValue();
+    }
+
+    template<typename CandidateList, typename point_t>
+    float knn(CandidateList &result,
+              const Forest<point_t> &forest,
+              point_t queryPoint,
+              const SearchParams &params)
+    {
+      traverse(result,forest,queryPoint,params);
+      return result.returnValue();
+    }
+
+  } // ::cukd::forest
+} // ::cukd
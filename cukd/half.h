@@ -0,0 +1,160 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/*! \file cukd/half.h 16-bit (half or bfloat16) point storage.
+
+    Points get stored with 16 bits per coordinate (so a 3D point takes
+    6 instead of 12 bytes), but all math is done in float: the
+    half_data_traits below make the builders and traversals see each
+    stored point as a float3 (or float4), so trees get built over -
+    and queries get answered for - the widened, float values of the
+    stored points; queries themselves are regular float3/float4s.
+
+    Note that __half has only 11 bits of mantissa and a max value of
+    65504, so input data should be scaled to a suitable range; bfloat16
+    has the same range as float, but only 8 bits of mantissa.
+
+    Example:
+
+    std::vector<cukd::half3> points = ...;
+    using traits = cukd::half_data_traits<cukd::half3>;
+    cukd::buildTree<cukd::half3,traits>(d_points,numPoints);
+    ...
+    int closest = cukd::stackBased::fcp<cukd::half3,traits>
+       (queryPoint,d_points,numPoints);
+*/
+
+#pragma once
+
+#include "cukd/data.h"
+#include <cuda_fp16.h>
+#include <cuda_bf16.h>
+
+namespace cukd {
+
+  // ==================================================================
+  // 16-bit scalars
+  // ==================================================================
+
+  inline __both__ float to_float(__half h) { return __half2float(h); }
+  inline __both__ float to_float(__nv_bfloat16 h) { return __bfloat162float(h); }
+
+  /*! round-to-nearest conversion from float to given 16-bit type */
+  template<typename half_t> inline __both__ half_t from_float(float f);
+  template<> inline __both__ __half from_float(float f)
+  { return __float2half_rn(f); }
+  template<> inline __both__ __nv_bfloat16 from_float(float f)
+  { return __float2bfloat16_rn(f); }
+
+  // ==================================================================
+  // 16-bit point types
+  // ==================================================================
+
+  template<typename half_t> struct half2_t { half_t x, y; };
+  template<typename half_t> struct half3_t { half_t x, y, z; };
+  template<typename half_t> struct half4_t { half_t x, y, z, w; };
+
+  using half2 = half2_t<__half>;
+  using half3 = half3_t<__half>;
+  using half4 = half4_t<__half>;
+  using bfloat16_2 = half2_t<__nv_bfloat16>;
+  using bfloat16_3 = half3_t<__nv_bfloat16>;
+  using bfloat16_4 = half4_t<__nv_bfloat16>;
+
+  /* coordinates of 16-bit points always get read as (and written
+     from) floats; this is what makes the default point_traits work
+     for these types */
+  template<typename half_t> struct scalar_type_of<half2_t<half_t>> { using type = float; };
+  template<typename half_t> struct scalar_type_of<half3_t<half_t>> { using type = float; };
+  template<typename half_t> struct scalar_type_of<half4_t<half_t>> { using type = float; };
+  template<typename half_t> struct num_dims_of<half2_t<half_t>> { enum { value = 2 }; };
+  template<typename half_t> struct num_dims_of<half3_t<half_t>> { enum { value = 3 }; };
+  template<typename half_t> struct num_dims_of<half4_t<half_t>> { enum { value = 4 }; };
+
+  template<typename half_t>
+  inline __both__ float get_coord(const half2_t<half_t> &v, int d)
+  { return to_float(d?v.y:v.x); }
+  template<typename half_t>
+  inline __both__ float get_coord(const half3_t<half_t> &v, int d)
+  { return to_float((d==2)?v.z:(d?v.y:v.x)); }
+  template<typename half_t>
+  inline __both__ float get_coord(const half4_t<half_t> &v, int d)
+  { return to_float((d>=2)?(d>2?v.w:v.z):(d?v.y:v.x)); }
+
+  template<typename half_t>
+  inline __both__ void set_coord(half2_t<half_t> &v, int d, float vv)
+  { (d?v.y:v.x) = from_float<half_t>(vv); }
+  template<typename half_t>
+  inline __both__ void set_coord(half3_t<half_t> &v, int d, float vv)
+  { ((d==2)?v.z:(d?v.y:v.x)) = from_float<half_t>(vv); }
+  template<typename half_t>
+  inline __both__ void set_coord(half4_t<half_t> &v, int d, float vv)
+  { ((d>=2)?(d>2?v.w:v.z):(d?v.y:v.x)) = from_float<half_t>(vv); }
+
+  /*! the float vector type that a given 16-bit point type gets
+      widened to for all computations */
+  template<typename half_point_t> struct widened_point_of;
+  template<typename half_t> struct widened_point_of<half2_t<half_t>> { using type = float2; };
+  template<typename half_t> struct widened_point_of<half3_t<half_t>> { using type = float3; };
+  template<typename half_t> struct widened_point_of<half4_t<half_t>> { using type = float4; };
+
+  template<typename half_t>
+  inline __both__ float2 widen(const half2_t<half_t> &v)
+  { return make_float2(to_float(v.x),to_float(v.y)); }
+  template<typename half_t>
+  inline __both__ float3 widen(const half3_t<half_t> &v)
+  { return make_float3(to_float(v.x),to_float(v.y),to_float(v.z)); }
+  template<typename half_t>
+  inline __both__ float4 widen(const half4_t<half_t> &v)
+  { return make_float4(to_float(v.x),to_float(v.y),to_float(v.z),to_float(v.w)); }
+
+  /*! converts a float vector to the given 16-bit point type, with
+      round-to-nearest for each coordinate */
+  template<typename half_point_t>
+  inline __both__ half_point_t narrow(typename widened_point_of<half_point_t>::type v)
+  {
+    half_point_t result;
+    for (int d=0;d<num_dims_of<half_point_t>::value;d++)
+      set_coord(result,d,get_coord(v,d));
+    return result;
+  }
+
+  // ==================================================================
+  // data traits for building/querying trees over 16-bit points
+  // ==================================================================
+
+  /*! data traits for trees over 16-bit points: data_t is the 16-bit
+      point itself, point_t is the matching float type (float3 for
+      half3, etc). get_point() returns the widened point _by value_,
+      so all distance and split-plane tests are done in float */
+  template<typename half_point_t>
+  struct half_data_traits {
+    using point_t      = typename widened_point_of<half_point_t>::type;
+    using point_traits = ::cukd::point_traits<point_t>;
+    using data_t       = half_point_t;
+
+    static inline __both__ point_t get_point(const data_t &n)
+    { return widen(n); }
+
+    static inline __both__ float get_coord(const data_t &n, int d)
+    { return ::cukd::get_coord(n,d); }
+
+    enum { has_explicit_dim = false };
+    static inline __both__ int  get_dim(const data_t &) { return -1; }
+    static inline __both__ void set_dim(data_t &, int) {}
+  };
+
+} // ::cukd
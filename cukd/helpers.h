@@ -19,6 +19,12 @@
 #include "cukd/common.h"
 #include "cukd/cukd-math.h"
 
+#include <map>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
 namespace cukd {
 
   // ------------------------------------------------------------------
@@ -70,6 +76,160 @@ namespace cukd {
   }
 #endif
 
+  // ------------------------------------------------------------------
+  /*! the host-side equivalent of GpuMemoryResource: all temporary
+      host memory allocated by the host builders (and host-side batch
+      queries) goes through the memory resource passed to the
+      respective function. malloc() has to either return memory
+      suitably aligned for any type, or throw */
+  struct HostMemoryResource {
+    virtual void *malloc(size_t size) = 0;
+    virtual void free(void *ptr) = 0;
+  };
+
+  /*! plain malloc/free */
+  struct MallocHostMemoryResource : public HostMemoryResource {
+    void *malloc(size_t size) override
+    {
+      void *ptr = ::malloc(size ? size : 1);
+      if (!ptr) throw std::bad_alloc();
+      return ptr;
+    }
+    void free(void *ptr) override { ::free(ptr); }
+  };
+
+  inline HostMemoryResource &defaultHostMemResource() {
+    static MallocHostMemoryResource memResource;
+    return memResource;
+  }
+
+  /*! a host memory resource that keeps all memory freed through it,
+      and hands it out again for later allocations of (roughly) the
+      same size - so after the first build, repeated builds of the
+      same size (e.g., once per frame) do not allocate any memory from
+      the system at all. Also tracks how much memory is in use, and
+      the peak thereof. Thread safe. */
+  struct PooledHostMemoryResource : public HostMemoryResource {
+    ~PooledHostMemoryResource() { releaseUnused(); }
+    
+    void *malloc(size_t size) override
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      // only re-use blocks that are at most twice the requested
+      // size, so a few small allocations cannot 'steal' all the
+      // large blocks
+      auto it = freeBlocks.lower_bound(size);
+      void  *ptr;
+      size_t blockSize;
+      if (it != freeBlocks.end() && it->first <= 2*size) {
+        blockSize = it->first;
+        ptr       = it->second;
+        freeBlocks.erase(it);
+      } else {
+        blockSize = size;
+        ptr = ::malloc(size ? size : 1);
+        if (!ptr) throw std::bad_alloc();
+        counters.bytesReserved += blockSize;
+        counters.numSystemAllocs++;
+      }
+      usedBlocks[ptr] = blockSize;
+      counters.bytesInUse += blockSize;
+      counters.peakBytesInUse
+        = std::max(counters.peakBytesInUse,counters.bytesInUse);
+      return ptr;
+    }
+    
+    void free(void *ptr) override
+    {
+      if (!ptr) return;
+      std::lock_guard<std::mutex> lock(mutex);
+      auto it = usedBlocks.find(ptr);
+      if (it == usedBlocks.end())
+        throw std::runtime_error("cukd::PooledHostMemoryResource: "
+                                 "freeing memory not allocated from this pool");
+      counters.bytesInUse -= it->second;
+      freeBlocks.insert({it->second,ptr});
+      usedBlocks.erase(it);
+    }
+
+    /*! returns all currently unused blocks to the system */
+    void releaseUnused()
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (auto &block : freeBlocks) {
+        counters.bytesReserved -= block.first;
+        ::free(block.second);
+      }
+      freeBlocks.clear();
+    }
+
+    /*! resets the peak to what is currently in use - e.g., to
+        measure the peak of one particular build */
+    void resetPeak()
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      counters.peakBytesInUse = counters.bytesInUse;
+    }
+
+    struct Stats {
+      /*! bytes currently handed out */
+      size_t bytesInUse      = 0;
+      /*! max bytesInUse since construction (or the last resetPeak()) */
+      size_t peakBytesInUse  = 0;
+      /*! bytes held by the pool, in use or not */
+      size_t bytesReserved   = 0;
+      /*! number of times the pool had to get memory from the system */
+      size_t numSystemAllocs = 0;
+    };
+    
+    /*! a consistent snapshot of the pool's statistics; safe to call
+        while other threads allocate */
+    Stats stats() const
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      return counters;
+    }
+  private:
+    Stats                              counters;
+    mutable std::mutex                 mutex;
+    std::multimap<size_t,void *>       freeBlocks;
+    std::unordered_map<void *,size_t>  usedBlocks;
+  };
+
+  /*! std::allocator-compatible wrapper around a HostMemoryResource,
+      for use in std::vector's etc; also works as a temporary-memory
+      allocator for thrust's host algorithms (with T=char) */
+  template<typename T>
+  struct HostAllocator {
+    using value_type = T;
+
+    HostAllocator(HostMemoryResource &memResource = defaultHostMemResource())
+      : memResource(&memResource)
+    {}
+    template<typename U>
+    HostAllocator(const HostAllocator<U> &other)
+      : memResource(other.memResource)
+    {}
+
+    T *allocate(size_t n)
+    { return (T*)memResource->malloc(n*sizeof(T)); }
+    void deallocate(T *ptr, size_t)
+    { memResource->free(ptr); }
+
+    template<typename U>
+    bool operator==(const HostAllocator<U> &other) const
+    { return memResource == other.memResource; }
+    template<typename U>
+    bool operator!=(const HostAllocator<U> &other) const
+    { return memResource != other.memResource; }
+    
+    HostMemoryResource *memResource;
+  };
+
+  /*! a std::vector whose memory comes from a HostMemoryResource */
+  template<typename T>
+  using HostVector = std::vector<T,HostAllocator<T>>;
+
   /*! helper functions for a generic, arbitrary-size binary tree -
     mostly to compute level of a given node in that tree, and child
     IDs, parent IDs, etc */
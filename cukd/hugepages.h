@@ -0,0 +1,288 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+/*! \file cukd/hugepages.h Huge-page backed host memory.
+
+    Host-side traversals of very large trees (say, 100M points and
+    up) take a TLB miss on pretty much every node below the top few
+    levels; backing the tree's points (and any side arrays, such as
+    subtree bounds or aggregates) with 2MB or 1GB pages makes the
+    TLB cover that much more of the tree.
+
+    HugePageHostMemoryResource is a HostMemoryResource (see
+    helpers.h) that does that, either through transparent huge pages
+    (which the kernel may or may not grant, and may grant only for
+    some parts of an allocation), or through explicit (hugetlbfs)
+    pages of 2MB or 1GB (which have to have been reserved by the
+    admin, e.g., through /proc/sys/vm/nr_hugepages); explicit
+    allocations that fail fall back to transparent huge pages. It
+    can be used for host builds, for side arrays (through HostVector),
+    and for loading serialized trees:
+
+    cukd::HugePageHostMemoryResource hugePages(cukd::HUGE_PAGES_2MB);
+    float3 *points = cukd::serialized::loadTree_host<float3>
+      ("points.cukd",numPoints,&worldBounds,hugePages);
+    std::cout << cukd::prettyNumber(cukd::bytesOnHugePages(points,numPoints*sizeof(float3)))
+              << "B of the tree are on huge pages" << std::endl;
+
+    Allocations smaller than half a huge page would waste more than
+    they gain (and a builder makes many of those, e.g. for histograms
+    and sort buffers), so the resource serves these with plain malloc
+    instead (and reports them as NO_HUGE_PAGES); with HUGE_PAGES_1GB,
+    allocations smaller than half a 1GB page use 2MB pages instead,
+    so temporaries do not each use up a whole reserved 1GB page.
+
+    Huge pages are only supported on Linux; elsewhere, the resource
+    falls back to plain malloc, and bytesOnHugePages() returns 0.
+*/
+
+#pragma once
+
+#include "cukd/helpers.h"
+
+#include <fstream>
+#include <sstream>
+#ifdef __linux__
+# include <sys/mman.h>
+// older headers lack the flags for selecting the hugetlbfs page size
+# ifndef MAP_HUGE_SHIFT
+#  define MAP_HUGE_SHIFT 26
+# endif
+# ifndef MAP_HUGE_2MB
+#  define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+# endif
+# ifndef MAP_HUGE_1GB
+#  define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+# endif
+#endif
+
+namespace cukd {
+
+  // ==================================================================
+  // INTERFACE SECTION
+  // ==================================================================
+
+  /*! which kind of pages to back allocations with */
+  typedef enum {
+    /*! regular pages; with transparent huge pages explicitly
+        disabled for this memory (as a baseline) */
+    NO_HUGE_PAGES = 0,
+    /*! ask the kernel for transparent huge pages */
+    TRANSPARENT_HUGE_PAGES,
+    /*! explicit 2MB (hugetlbfs) pages */
+    HUGE_PAGES_2MB,
+    /*! explicit 1GB (hugetlbfs) pages */
+    HUGE_PAGES_1GB
+  } HugePageMode;
+
+  inline const char *toString(HugePageMode mode)
+  {
+    switch (mode) {
+    case NO_HUGE_PAGES:          return "no huge pages";
+    case TRANSPARENT_HUGE_PAGES: return "transparent huge pages";
+    case HUGE_PAGES_2MB:         return "2MB huge pages";
+    case HUGE_PAGES_1GB:         return "1GB huge pages";
+    }
+    return "<invalid huge page mode>";
+  }
+  
+  /*! number of bytes in [ptr,ptr+size) that are currently backed by
+      huge pages, according to /proc/self/smaps. For transparent huge
+      pages this only counts pages that have already been touched, and
+      is approximate if other memory shares the same mapping */
+  inline size_t bytesOnHugePages(const void *ptr, size_t size);
+  
+  /*! host memory resource that backs each allocation with (if
+      possible) huge pages; see the top of this file */
+  struct HugePageHostMemoryResource : public HostMemoryResource {
+    HugePageHostMemoryResource(HugePageMode mode = TRANSPARENT_HUGE_PAGES)
+      : mode(mode)
+    {}
+    ~HugePageHostMemoryResource();
+    
+    void *malloc(size_t size) override;
+    void free(void *ptr) override;
+
+    /*! what the given allocation actually got: the requested mode;
+        or TRANSPARENT_HUGE_PAGES if explicit pages were requested but
+        could not be obtained; or, for small allocations, see top of
+        file */
+    HugePageMode modeOf(const void *ptr);
+    
+    const HugePageMode mode;
+    /*! number of explicit allocations that had to fall back to
+        transparent huge pages */
+    size_t numFallbacks = 0;
+  private:
+    struct Allocation {
+      /*! 0 for allocations that come from plain malloc */
+      size_t       mappedSize;
+      HugePageMode mode;
+    };
+    static inline void release(void *ptr, const Allocation &alloc);
+    std::mutex                              mutex;
+    std::unordered_map<void *,Allocation>   allocations;
+  };
+  
+  // ==================================================================
+  // IMPLEMENTATION SECTION
+  // ==================================================================
+
+  inline size_t bytesOnHugePages(const void *ptr, size_t size)
+  {
+    size_t result = 0;
+#ifdef __linux__
+    const uint64_t begin = (uint64_t)ptr, end = begin+size;
+    std::ifstream smaps("/proc/self/smaps");
+    std::string line;
+    // overlap of the current mapping with [begin,end), and whether it
+    // is a hugetlbfs mapping
+    uint64_t overlap = 0;
+    while (std::getline(smaps,line)) {
+      unsigned long long lo, hi;
+      char perms[8];
+      if (sscanf(line.c_str(),"%llx-%llx %7s",&lo,&hi,perms) == 3) {
+        overlap
+          = (hi > begin && lo < end)
+          ? std::min(end,(uint64_t)hi)-std::max(begin,(uint64_t)lo)
+          : 0;
+        continue;
+      }
+      if (!overlap) continue;
+      std::stringstream ss(line);
+      std::string field;
+      size_t kB = 0;
+      ss >> field >> kB;
+      if (field == "KernelPageSize:" && kB > 4) {
+        // hugetlbfs mapping: all of it is on huge pages
+        result += overlap;
+        overlap = 0;
+      } else if (field == "AnonHugePages:") {
+        result += std::min(overlap,uint64_t(kB)*1024);
+      }
+    }
+#endif
+    return result;
+  }
+
+  inline void *HugePageHostMemoryResource::malloc(size_t size)
+  {
+    const size_t pageSize2MB = size_t(2)<<20;
+    const size_t pageSize1GB = size_t(1)<<30;
+    size = std::max(size,size_t(1));
+#ifdef __linux__
+    const bool usePlainMalloc = size < pageSize2MB/2;
+#else
+    const bool usePlainMalloc = true;
+#endif
+    if (usePlainMalloc) {
+      void *ptr = ::malloc(size);
+      if (!ptr) throw std::bad_alloc();
+      std::lock_guard<std::mutex> lock(mutex);
+      allocations[ptr] = { 0, NO_HUGE_PAGES };
+      return ptr;
+    }
+    
+#ifdef __linux__
+    void *ptr = MAP_FAILED;
+    Allocation alloc
+      = { 0, (mode == HUGE_PAGES_1GB && size < pageSize1GB/2) ? HUGE_PAGES_2MB : mode };
+
+    if (alloc.mode == HUGE_PAGES_2MB || alloc.mode == HUGE_PAGES_1GB) {
+      const size_t pageSize = (alloc.mode == HUGE_PAGES_1GB) ? pageSize1GB : pageSize2MB;
+      alloc.mappedSize = divRoundUp(size,pageSize)*pageSize;
+      ptr = mmap(NULL,alloc.mappedSize,PROT_READ|PROT_WRITE,
+                 MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB
+                 |(alloc.mode == HUGE_PAGES_1GB ? MAP_HUGE_1GB : MAP_HUGE_2MB),
+                 -1,0);
+      if (ptr == MAP_FAILED) {
+        std::lock_guard<std::mutex> lock(mutex);
+        numFallbacks++;
+        alloc.mode = TRANSPARENT_HUGE_PAGES;
+      }
+    }
+    
+    if (ptr == MAP_FAILED) {
+      // map with 2MB of slack, and cut off whatever is needed to have
+      // the allocation start on a 2MB boundary - the kernel can only
+      // use transparent huge pages for aligned 2MB ranges
+      alloc.mappedSize = divRoundUp(size,pageSize2MB)*pageSize2MB;
+      char *mapped = (char *)mmap(NULL,alloc.mappedSize+pageSize2MB,
+                                  PROT_READ|PROT_WRITE,
+                                  MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+      if (mapped == (char *)MAP_FAILED) throw std::bad_alloc();
+      char *aligned
+        = (char *)(divRoundUp((size_t)mapped,pageSize2MB)*pageSize2MB);
+      if (aligned > mapped)
+        munmap(mapped,aligned-mapped);
+      if (aligned+alloc.mappedSize < mapped+alloc.mappedSize+pageSize2MB)
+        munmap(aligned+alloc.mappedSize,
+               (mapped+alloc.mappedSize+pageSize2MB)-(aligned+alloc.mappedSize));
+      ptr = aligned;
+      madvise(ptr,alloc.mappedSize,
+              alloc.mode == NO_HUGE_PAGES ? MADV_NOHUGEPAGE : MADV_HUGEPAGE);
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    allocations[ptr] = alloc;
+    return ptr;
+#else
+    (void)pageSize1GB;
+    return nullptr;
+#endif
+  }
+
+  inline void HugePageHostMemoryResource::release(void *ptr, const Allocation &alloc)
+  {
+#ifdef __linux__
+    if (alloc.mappedSize) {
+      munmap(ptr,alloc.mappedSize);
+      return;
+    }
+#endif
+    ::free(ptr);
+  }
+
+  inline void HugePageHostMemoryResource::free(void *ptr)
+  {
+    if (!ptr) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = allocations.find(ptr);
+    if (it == allocations.end())
+      throw std::runtime_error("cukd::HugePageHostMemoryResource: "
+                               "freeing memory not allocated by this resource");
+    release(ptr,it->second);
+    allocations.erase(it);
+  }
+
+  inline HugePageMode HugePageHostMemoryResource::modeOf(const void *ptr)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = allocations.find((void *)ptr);
+    if (it == allocations.end())
+      throw std::runtime_error("cukd::HugePageHostMemoryResource: "
+                               "not an allocation of this resource");
+    return it->second.mode;
+  }
+  
+  inline HugePageHostMemoryResource::~HugePageHostMemoryResource()
+  {
+    for (auto &alloc : allocations)
+      release(alloc.first,alloc.second);
+  }
+  
+} // ::cukd
@@ -19,6 +19,7 @@
 #include "cukd/common.h"
 #include "cukd/helpers.h"
 #include "cukd/fcp.h"
+#include <vector>
 
 // ==================================================================
 // INTERFACE SECTION
@@ -48,25 +49,25 @@ namespace cukd {
     // ------------------------------------------------------------------
     // interface fcts with which _user_ can read results of query:
     // ------------------------------------------------------------------
-    inline __device__ CandidateList(float cutOffRadius) {}
+    inline __both__ CandidateList(float cutOffRadius) {}
     
     /*! returns _square_ of maximum radius of any found point, if k
       points were found. if less than k points were found, this
       returns the square of the max query radius/cut-off radius */
-    inline __device__ float maxRadius2() const /* abstract */;
+    inline __both__ float maxRadius2() const /* abstract */;
     
     /*! returns _square_ of distance to i'th found point. points will
       be sorted by distance in FixedCandidateList, but will _not_ be
       sorted in HeapCandidateList */
-    inline __device__ float get_dist2(int i) const;
+    inline __both__ float get_dist2(int i) const;
     
     /*! returns ID of i'th found k-nearest data point */
-    inline __device__ int   get_pointID(int i) const;
+    inline __both__ int   get_pointID(int i) const;
     
   protected:
-    inline __device__ uint64_t encode(float f, int i);
-    inline __device__ float decode_dist2(uint64_t v) const;
-    inline __device__ int   decode_pointID(uint64_t v) const;
+    inline __both__ uint64_t encode(float f, int i);
+    inline __both__ float decode_dist2(uint64_t v) const;
+    inline __both__ int   decode_pointID(uint64_t v) const;
     /*! storage for k elements; we encode those float:int pairs as a
         single int64 to make reading/writing/swapping faster */
     uint64_t entry[k];
@@ -88,7 +89,7 @@ namespace cukd {
       typename data_t,
       /*! traits of data in the underlying tree */
       typename data_traits=default_data_traits<data_t>>
-    inline __device__
+    inline __both__
     float knn(CandidateList &result,
               typename data_traits::point_t queryPoint,
               // const box_t<typename data_traits::point_t> worldBounds,
@@ -101,7 +102,7 @@ namespace cukd {
       typename data_t,
       /*! traits of data in the underlying tree */
       typename data_traits=default_data_traits<data_t>>
-    inline __device__
+    inline __both__
     float knn(CandidateList &result,
               typename data_traits::point_t queryPoint,
               const box_t<typename data_traits::point_t> worldBounds,
@@ -118,7 +119,7 @@ namespace cukd {
     template<typename CandidateList,
              typename data_t,
              typename data_traits=default_data_traits<data_t>>
-    inline __device__
+    inline __both__
     float knn(CandidateList &result,
               const SpatialKDTree<data_t,data_traits> &tree,
               typename data_traits::point_t queryPoint);
@@ -138,7 +139,7 @@ namespace cukd {
       typename data_t,
       /*! traits of data in the underlying tree */
       typename data_traits=default_data_traits<data_t>>
-    inline __device__
+    inline __both__
     float knn(CandidateList &result,
               typename data_traits::point_t queryPoint,
               // const box_t<typename data_traits::point_t> worldBounds,
@@ -147,7 +148,7 @@ namespace cukd {
     template<typename CandidateList,
              typename data_t,
              typename data_traits=default_data_traits<data_t>>
-    inline __device__
+    inline __both__
     float knn(CandidateList &result,
               typename data_traits::point_t queryPoint,
               const box_t<typename data_traits::point_t> worldBounds,
@@ -174,23 +175,111 @@ namespace cukd {
       typename data_t,
       /*! traits of data in the underlying tree */
       typename data_traits=default_data_traits<data_t>>
-    inline __device__
+    inline __both__
     float knn(CandidateList &result,
               typename data_traits::point_t queryPoint,
               const box_t<typename data_traits::point_t> worldBounds,
               const data_t *d_nodes,
               int N);
 
+    /*! the same, but reading the bounds of the top subtrees from
+      a subtree bounds table (see subtree-bounds.h) */
+    template<typename CandidateList,
+             typename data_t,
+             typename data_traits=default_data_traits<data_t>,
+             typename bounds_table_t>
+    inline __both__
+    float knn(CandidateList &result,
+              typename data_traits::point_t queryPoint,
+              const box_t<typename data_traits::point_t> worldBounds,
+              const bounds_table_t &subtreeBounds,
+              const data_t *d_nodes,
+              int N);
+
     /* the same, for a _spatial_ k-d tree */
     template<typename CandidateList,
              typename data_t,
              typename data_traits=default_data_traits<data_t>>
-    inline __device__
+    inline __both__
     float knn(CandidateList &result,
               const SpatialKDTree<data_t,data_traits> &tree,
               typename data_traits::point_t queryPoint);
   } // ::cukd::cct
 
+  namespace sfImp {
+    /*! kNN kernel with stack-free traversal that culls subtrees
+      based on their (re-computed, or, if given, read from a subtree
+      bounds table) bounds; see sfImp::fcp() */
+    template<typename CandidateList,
+             typename data_t,
+             typename data_traits=default_data_traits<data_t>>
+    inline __both__
+    float knn(CandidateList &result,
+              typename data_traits::point_t queryPoint,
+              const box_t<typename data_traits::point_t> worldBounds,
+              const data_t *d_nodes,
+              int N);
+
+    template<typename CandidateList,
+             typename data_t,
+             typename data_traits=default_data_traits<data_t>,
+             typename bounds_table_t>
+    inline __both__
+    float knn(CandidateList &result,
+              typename data_traits::point_t queryPoint,
+              const box_t<typename data_traits::point_t> worldBounds,
+              const bounds_table_t &subtreeBounds,
+              const data_t *d_nodes,
+              int N);
+  } // ::cukd::sfImp
+
+  namespace mixed {
+    /*! mixed-precision kNN kernel for trees over double-precision
+      points: culling tests are done in float on query-relative
+      offsets, and candidates are only inserted into the list (with
+      their exact double distances, rounded to float) once they
+      passed those tests. Same culling as stackBased::knn, but
+      without double-precision math for most of the visited nodes */
+    template<
+      /*! type of object to manage the k-nearest objects*/
+      typename CandidateList,
+      /*! type of data in the underlying tree */
+      typename data_t,
+      /*! traits of data in the underlying tree */
+      typename data_traits=default_data_traits<data_t>>
+    inline __both__
+    float knn(CandidateList &result,
+              typename data_traits::point_t queryPoint,
+              const data_t *d_nodes,
+              int N);
+  } // ::cukd::mixed
+
+  namespace bbf {
+    /*! (approximate) kNN kernel using best-bin-first traversal (see
+      traverse-bbf.h): params.far_node_inspect_budget and params.eps
+      trade accuracy for speed, while the search radius is the one
+      the candidate list got initialized with (params.cutOffRadius
+      gets ignored). With default params this is an exact search
+      _only_ as long as no more than queue_size subtrees are pending
+      at any time; beyond that the farthest pending ones get dropped
+      (see traverse-bbf.h), which is common for high-dimensional data */
+    template<
+      /*! type of object to manage the k-nearest objects*/
+      typename CandidateList,
+      /*! type of data in the underlying tree */
+      typename data_t,
+      /*! traits of data in the underlying tree */
+      typename data_traits=default_data_traits<data_t>,
+      /*! max number of pending subtrees */
+      int queue_size=64>
+    inline __both__
+    float knn(CandidateList &result,
+              typename data_traits::point_t queryPoint,
+              const data_t *d_nodes,
+              int N,
+              FcpSearchParams params = FcpSearchParams{});
+  } // ::cukd::bbf
+
 
   
   // ------------------------------------------------------------------
@@ -213,15 +302,15 @@ namespace cukd {
     // ------------------------------------------------------------------
     // interface fcts with which _user_ can read results of query:
     // ------------------------------------------------------------------
-    inline __device__ FixedCandidateList(float cutOffRadius);
-    inline __device__ float maxRadius2() const;
+    inline __both__ FixedCandidateList(float cutOffRadius);
+    inline __both__ float maxRadius2() const;
     // ------------------------------------------------------------------
     // interface for traversal/query routines to interact with this
     // ------------------------------------------------------------------
-    inline __device__ float returnValue() const;
-    inline __device__ float processCandidate(int candPrimID, float candDist2);
-    inline __device__ float initialCullDist2() const;
-    inline __device__ void  push(float dist, int pointID);
+    inline __both__ float returnValue() const;
+    inline __both__ float processCandidate(int candPrimID, float candDist2);
+    inline __both__ float initialCullDist2() const;
+    inline __both__ void  push(float dist, int pointID);
   };
 
   /*! candidate list (see above) that uses a heap to organize the
@@ -239,17 +328,51 @@ namespace cukd {
     // ------------------------------------------------------------------
     // interface fcts with which _user_ can read results of query:
     // ------------------------------------------------------------------
-    inline __device__ HeapCandidateList(float cutOffRadius);
-    inline __device__ float maxRadius2() const;
+    inline __both__ HeapCandidateList(float cutOffRadius);
+    inline __both__ float maxRadius2() const;
     // ------------------------------------------------------------------
     // interface for traversal/query routines to interact with this
     // ------------------------------------------------------------------
-    inline __device__ float returnValue() const;
-    inline __device__ float processCandidate(int candPrimID, float candDist2);
-    inline __device__ float initialCullDist2() const;
-    inline __device__ void  push(float dist, int pointID);
+    inline __both__ float returnValue() const;
+    inline __both__ float processCandidate(int candPrimID, float candDist2);
+    inline __both__ float initialCullDist2() const;
+    inline __both__ void  push(float dist, int pointID);
   };
 
+
+  /*! host-side candidate list, for which (unlike for the two above)
+    k does not have to be known at compile time. Entries are kept in
+    ascending order (like in the FixedCandidateList), but in a
+    std::vector, so this can't be used in device code; use this for
+    queries done on the host (e.g., on a memory-mapped tree). Its
+    storage comes from the given host memory resource, and gets
+    allocated once, in the constructor; so one list can be re-used
+    (via clear()) for any number of queries without allocating */
+  struct HostCandidateList
+  {
+    // ------------------------------------------------------------------
+    // interface fcts with which _user_ can read results of query:
+    // ------------------------------------------------------------------
+    inline HostCandidateList(int k, float cutOffRadius,
+                             HostMemoryResource &memResource
+                             = defaultHostMemResource());
+    /*! resets the list to k empty entries at the given (square)
+        distance; returns that distance */
+    inline float clear(float initialDist2);
+    inline float maxRadius2() const;
+    inline float get_dist2(int i) const;
+    inline int   get_pointID(int i) const;
+    inline int   size() const { return (int)entry.size(); }
+    // ------------------------------------------------------------------
+    // interface for traversal/query routines to interact with this
+    // ------------------------------------------------------------------
+    inline float returnValue() const;
+    inline float processCandidate(int candPrimID, float candDist2);
+    inline float initialCullDist2() const;
+    inline void  push(float dist, int pointID);
+
+    HostVector<uint64_t> entry;
+  };
   
 }
 
@@ -265,29 +388,29 @@ namespace cukd {
   // ------------------------------------------------------------------
 
   template<int k>
-  inline __device__
+  inline __both__
   float CandidateList<k>::get_dist2(int i) const
   { return decode_dist2(entry[i]); }
   
   template<int k>
-  inline __device__
+  inline __both__
   int CandidateList<k>::get_pointID(int i) const
   { return decode_pointID(entry[i]); }
     
   template<int k>
-  inline __device__
+  inline __both__
   uint64_t CandidateList<k>::encode(float f, int i)
   {
-    return (uint64_t(__float_as_uint(f)) << 32) | uint32_t(i);
+    return (uint64_t(float_as_uint(f)) << 32) | uint32_t(i);
   }
 
   template<int k>
-  inline __device__
+  inline __both__
   float CandidateList<k>::decode_dist2(uint64_t v) const
-  { return __uint_as_float(v >> 32); }
+  { return uint_as_float(uint32_t(v >> 32)); }
   
   template<int k>
-  inline __device__
+  inline __both__
   int CandidateList<k>::decode_pointID(uint64_t v) const
   { return int(uint32_t(v)); }
 
@@ -296,7 +419,7 @@ namespace cukd {
   // ------------------------------------------------------------------
 
   template<int k>
-  inline __device__
+  inline __both__
   HeapCandidateList<k>::HeapCandidateList(float cutOffRadius)
     : CandidateList<k>(cutOffRadius)
   {
@@ -306,12 +429,12 @@ namespace cukd {
   }
 
   template<int k>
-  inline __device__
+  inline __both__
   float HeapCandidateList<k>::returnValue() const
   { return maxRadius2(); }
   
   template<int k>
-  inline __device__
+  inline __both__
   float HeapCandidateList<k>::processCandidate(int candPrimID,
                                                float candDist2)
   {
@@ -320,12 +443,12 @@ namespace cukd {
   }
   
   template<int k>
-  inline __device__
+  inline __both__
   float HeapCandidateList<k>::initialCullDist2() const
   { return maxRadius2(); }
     
   template<int k>
-  inline __device__
+  inline __both__
   void HeapCandidateList<k>::push(float dist,
                                   int pointID)
   {
@@ -359,7 +482,7 @@ namespace cukd {
   }
     
   template<int k>
-  inline __device__
+  inline __both__
   float HeapCandidateList<k>::maxRadius2() const
   { return decode_dist2(entry[0]); }
     
@@ -372,7 +495,7 @@ namespace cukd {
   // ------------------------------------------------------------------
 
   template<int k>
-  inline __device__
+  inline __both__
   FixedCandidateList<k>::FixedCandidateList(float cutOffRadius)
     : CandidateList<k>(cutOffRadius)
   {
@@ -382,12 +505,12 @@ namespace cukd {
   }
 
   template<int k>
-  inline __device__
+  inline __both__
   float FixedCandidateList<k>::returnValue() const
   { return maxRadius2(); }
   
   template<int k>
-  inline __device__
+  inline __both__
   float FixedCandidateList<k>::processCandidate(int candPrimID,
                                                 float candDist2)
   {
@@ -396,12 +519,12 @@ namespace cukd {
   }
   
   template<int k>
-  inline __device__
+  inline __both__
   float FixedCandidateList<k>::initialCullDist2() const
   { return maxRadius2(); }
 
   template<int k>
-  inline __device__ void FixedCandidateList<k>::push(float dist, int pointID)
+  inline __both__ void FixedCandidateList<k>::push(float dist, int pointID)
   {
     uint64_t v = encode(dist,pointID);
 #pragma unroll
@@ -414,15 +537,95 @@ namespace cukd {
   }
 
   template<int k>
-  inline __device__
+  inline __both__
   float FixedCandidateList<k>::maxRadius2() const
   { return decode_dist2(entry[k-1]); }
     
+  // ------------------------------------------------------------------
+  // HostCandidateList
+  // ------------------------------------------------------------------
+
+  inline HostCandidateList::HostCandidateList(int k, float cutOffRadius,
+                                              HostMemoryResource &memResource)
+    : entry(std::max(k,1),0,HostAllocator<uint64_t>(memResource))
+  { clear(cutOffRadius*cutOffRadius); }
+
+  inline float HostCandidateList::clear(float initialDist2)
+  {
+    for (auto &e : entry)
+      e = (uint64_t(float_as_uint(initialDist2)) << 32) | uint32_t(-1);
+    return initialDist2;
+  }
+
+  inline float HostCandidateList::get_dist2(int i) const
+  { return uint_as_float(uint32_t(entry[i] >> 32)); }
+  
+  inline int HostCandidateList::get_pointID(int i) const
+  { return int(uint32_t(entry[i])); }
+
+  inline float HostCandidateList::maxRadius2() const
+  { return get_dist2(size()-1); }
+  
+  inline float HostCandidateList::returnValue() const
+  { return maxRadius2(); }
+  
+  inline float HostCandidateList::initialCullDist2() const
+  { return maxRadius2(); }
+
+  inline float HostCandidateList::processCandidate(int candPrimID,
+                                                   float candDist2)
+  {
+    push(candDist2,candPrimID);
+    return maxRadius2();
+  }
+
+  inline void HostCandidateList::push(float dist, int pointID)
+  {
+    const uint64_t v = (uint64_t(float_as_uint(dist)) << 32) | uint32_t(pointID);
+    if (v >= entry.back()) return;
+    entry.pop_back();
+    entry.insert(std::upper_bound(entry.begin(),entry.end(),v),v);
+  }
+  
+  namespace mixed {
+    template<typename CandidateList,
+             typename data_t,
+             typename data_traits>
+    inline __both__
+    float knn(CandidateList &result,
+              typename data_traits::point_t queryPoint,
+              const data_t *d_nodes,
+              int N)
+    {
+      traverse_mixed<CandidateList,data_t,data_traits>
+        (result,queryPoint,d_nodes,N);
+      return result.returnValue();
+    }
+  } // ::cukd::mixed
+
+  namespace bbf {
+    template<typename CandidateList,
+             typename data_t,
+             typename data_traits,
+             int queue_size>
+    inline __both__
+    float knn(CandidateList &result,
+              typename data_traits::point_t queryPoint,
+              const data_t *d_nodes,
+              int N,
+              FcpSearchParams params)
+    {
+      traverse_bbf<CandidateList,data_t,data_traits,queue_size>
+        (result,queryPoint,d_nodes,N,params);
+      return result.returnValue();
+    }
+  } // ::cukd::bbf
+  
   namespace cct {
     template<typename CandidateList,
              typename data_t,
              typename data_traits>
-    inline __device__
+    inline __both__
     float knn(CandidateList &result,
               typename data_traits::point_t queryPoint,
               const box_t<typename data_traits::point_t> worldBounds,
@@ -434,10 +637,27 @@ namespace cukd {
       return result.returnValue();
     }
 
+    template<typename CandidateList,
+             typename data_t,
+             typename data_traits,
+             typename bounds_table_t>
+    inline __both__
+    float knn(CandidateList &result,
+              typename data_traits::point_t queryPoint,
+              const box_t<typename data_traits::point_t> worldBounds,
+              const bounds_table_t &subtreeBounds,
+              const data_t *d_nodes,
+              int N)
+    {
+      traverse_cct<CandidateList,data_t,data_traits,bounds_table_t>
+        (result,queryPoint,worldBounds,d_nodes,N,subtreeBounds);
+      return result.returnValue();
+    }
+
     template<typename CandidateList,
              typename data_t,
              typename data_traits>
-    inline __device__
+    inline __both__
     float knn(CandidateList &result,
               const SpatialKDTree<data_t,data_traits> &tree,
               typename data_traits::point_t queryPoint)
@@ -467,7 +687,7 @@ namespace cukd {
       node_t node;
       while (true) {
         while (true) {
-          CUKD_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
+          CUKD_DEVICE_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
           node = tree.nodes[nodeID];
           if (node.count)
             // this is a leaf...
@@ -498,8 +718,9 @@ namespace cukd {
 
         for (int i=0;i<node.count;i++) {
           int primID = tree.primIDs[node.offset+i];
-          CUKD_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
-          const auto sqrDist = sqrDistance(data_traits::get_point(tree.data[primID]),queryPoint);
+          CUKD_DEVICE_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
+          const auto sqrDist = sqrDistanceUpTo(data_traits::get_point(tree.data[primID]),
+                                               queryPoint,cullDist);
           cullDist = result.processCandidate(primID,sqrDist);
         }
       
@@ -517,11 +738,45 @@ namespace cukd {
     }
   } // ::cukd::cct
 
+  namespace sfImp {
+    template<typename CandidateList,
+             typename data_t,
+             typename data_traits>
+    inline __both__
+    float knn(CandidateList &result,
+              typename data_traits::point_t queryPoint,
+              const box_t<typename data_traits::point_t> worldBounds,
+              const data_t *d_nodes,
+              int N)
+    {
+      traverse_sf_imp<CandidateList,data_t,data_traits>
+        (result,queryPoint,worldBounds,d_nodes,N);
+      return result.returnValue();
+    }
+
+    template<typename CandidateList,
+             typename data_t,
+             typename data_traits,
+             typename bounds_table_t>
+    inline __both__
+    float knn(CandidateList &result,
+              typename data_traits::point_t queryPoint,
+              const box_t<typename data_traits::point_t> worldBounds,
+              const bounds_table_t &subtreeBounds,
+              const data_t *d_nodes,
+              int N)
+    {
+      traverse_sf_imp<CandidateList,data_t,data_traits,bounds_table_t>
+        (result,queryPoint,worldBounds,d_nodes,N,subtreeBounds);
+      return result.returnValue();
+    }
+  } // ::cukd::sfImp
+
   namespace stackFree {
     template<typename CandidateList,
              typename data_t,
              typename data_traits>
-    inline __device__
+    inline __both__
     float knn(CandidateList &result,
               typename data_traits::point_t queryPoint,
               const data_t *d_nodes,
@@ -537,7 +792,7 @@ namespace cukd {
     template<typename CandidateList,
              typename data_t,
              typename data_traits>
-    inline __device__
+    inline __both__
     float knn(CandidateList &result,
               typename data_traits::point_t queryPoint,
               const data_t *d_nodes,
@@ -551,7 +806,7 @@ namespace cukd {
     template<typename CandidateList,
              typename data_t,
              typename data_traits>
-    inline __device__
+    inline __both__
     float knn(CandidateList &result,
               const SpatialKDTree<data_t,data_traits> &tree,
               typename data_traits::point_t queryPoint)
@@ -577,7 +832,7 @@ namespace cukd {
       node_t node;
       while (true) {
         while (true) {
-          CUKD_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
+          CUKD_DEVICE_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
           node = tree.nodes[nodeID];
           if (node.count)
             // this is a leaf...
@@ -605,8 +860,9 @@ namespace cukd {
 
         for (int i=0;i<node.count;i++) {
           int primID = tree.primIDs[node.offset+i];
-          CUKD_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
-          const auto sqrDist = sqrDistance(data_traits::get_point(tree.data[primID]),queryPoint);
+          CUKD_DEVICE_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
+          const auto sqrDist = sqrDistanceUpTo(data_traits::get_point(tree.data[primID]),
+                                               queryPoint,cullDist);
           cullDist = result.processCandidate(primID,sqrDist);
         }
       
@@ -0,0 +1,220 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/*! \file cukd/nearest-iterator.h Incremental nearest-neighbor search
+    ("distance browsing", after Hjaltason and Samet).
+
+    For queries that do not know k in advance - e.g., that want to
+    look at neighbors in order of distance until some predicate fails
+    - this provides a host-side iterator that returns the nearest,
+    then the second-nearest, etc, point on demand. Internally it keeps
+    a priority queue of both points and not-yet-opened subtrees
+    (keyed by the distance from the query to the subtree's domain),
+    so each call only does as much traversal work as needed to
+    guarantee that the next point is in fact the next-nearest one;
+    and none of that work ever gets repeated (unlike when re-running
+    knn queries with increasing k).
+
+    NearestNeighborIterator<float3> it(points,numPoints,query);
+    int pointID; float dist2;
+    while (it.next(pointID,dist2) && acceptable(pointID))
+       ...;
+
+    Works both for regular (balanced) k-d trees and for
+    SpatialKDTree's; in either case all of the tree's arrays have to
+    be host-accessible (e.g., managed memory).
+*/
+
+#pragma once
+
+#include "cukd/spatial-kdtree.h"
+#include <queue>
+#include <vector>
+
+namespace cukd {
+
+  template<typename data_t,
+           typename data_traits=default_data_traits<data_t>>
+  struct NearestNeighborIterator {
+    using point_t = typename data_traits::point_t;
+    using box_t   = cukd::box_t<point_t>;
+
+    /*! iterator over a regular (balanced) k-d tree, as built by
+        buildTree() or buildTree_host() */
+    NearestNeighborIterator(const data_t *points,
+                            int numPoints,
+                            point_t queryPoint,
+                            /*! only return points closer than this */
+                            float maxRadius = INFINITY);
+
+    /*! iterator over a spatial k-d tree */
+    NearestNeighborIterator(const SpatialKDTree<data_t,data_traits> &tree,
+                            point_t queryPoint,
+                            /*! only return points closer than this */
+                            float maxRadius = INFINITY);
+
+    /*! finds the next-nearest point; returns false if there is none
+        (within maxRadius) left */
+    bool next(int &pointID, float &dist2);
+
+    /*! number of subtrees that got opened so far */
+    size_t numNodesVisited = 0;
+
+  private:
+    typedef enum { POINT, BALANCED_SUBTREE, SPATIAL_NODE } Kind;
+
+    struct Entry {
+      float dist2;
+      Kind  kind;
+      int   id;
+      box_t domain;
+
+      /*! closest entries first; and for equal distances, points
+          before subtrees, so we never return a point while another
+          point at the same distance may still be hidden in a
+          subtree */
+      bool operator<(const Entry &other) const
+      {
+        if (dist2 != other.dist2) return dist2 > other.dist2;
+        return (kind != POINT) && (other.kind == POINT);
+      }
+    };
+
+    void push(Kind kind, int id, float dist2, const box_t &domain = box_t());
+    void openBalancedSubtree(const Entry &entry);
+    void openSpatialNode(const Entry &entry);
+
+    std::priority_queue<Entry> queue;
+    const point_t queryPoint;
+    const float   maxRadius2;
+
+    const data_t *points    = nullptr;
+    int           numPoints = 0;
+    const SpatialKDTree<data_t,data_traits> *spatialTree = nullptr;
+  };
+
+  // ==================================================================
+  // IMPLEMENTATION SECTION
+  // ==================================================================
+
+  template<typename data_t, typename data_traits>
+  NearestNeighborIterator<data_t,data_traits>::
+  NearestNeighborIterator(const data_t *points,
+                          int numPoints,
+                          point_t queryPoint,
+                          float maxRadius)
+    : queryPoint(queryPoint),
+      maxRadius2(maxRadius*maxRadius),
+      points(points),
+      numPoints(numPoints)
+  {
+    box_t domain;
+    domain.setInfinite();
+    if (numPoints > 0)
+      push(BALANCED_SUBTREE,0,0.f,domain);
+  }
+
+  template<typename data_t, typename data_traits>
+  NearestNeighborIterator<data_t,data_traits>::
+  NearestNeighborIterator(const SpatialKDTree<data_t,data_traits> &tree,
+                          point_t queryPoint,
+                          float maxRadius)
+    : queryPoint(queryPoint),
+      maxRadius2(maxRadius*maxRadius),
+      points(tree.data),
+      spatialTree(&tree)
+  {
+    if (tree.numPrims > 0)
+      push(SPATIAL_NODE,0,(float)sqrDistance(tree.bounds,queryPoint),tree.bounds);
+  }
+
+  template<typename data_t, typename data_traits>
+  void NearestNeighborIterator<data_t,data_traits>::push(Kind kind, int id,
+                                                         float dist2,
+                                                         const box_t &domain)
+  {
+    if (dist2 >= maxRadius2) return;
+    queue.push({dist2,kind,id,domain});
+  }
+
+  template<typename data_t, typename data_traits>
+  void NearestNeighborIterator<data_t,data_traits>::
+  openBalancedSubtree(const Entry &entry)
+  {
+    enum { num_dims = num_dims_of<point_t>::value };
+    const int nodeID = entry.id;
+    const data_t &node = points[nodeID];
+    push(POINT,nodeID,
+         (float)sqrDistance(data_traits::get_point(node),queryPoint));
+
+    const int dim
+      = data_traits::has_explicit_dim
+      ? data_traits::get_dim(node)
+      : (BinaryTree::levelOf(nodeID) % num_dims);
+    const auto pos = data_traits::get_coord(node,dim);
+    box_t lDomain = entry.domain, rDomain = entry.domain;
+    set_coord(lDomain.upper,dim,min(pos,get_coord(lDomain.upper,dim)));
+    set_coord(rDomain.lower,dim,max(pos,get_coord(rDomain.lower,dim)));
+
+    const int lChild = BinaryTree::leftChildOf(nodeID);
+    const int rChild = lChild+1;
+    if (lChild < numPoints)
+      push(BALANCED_SUBTREE,lChild,(float)sqrDistance(lDomain,queryPoint),lDomain);
+    if (rChild < numPoints)
+      push(BALANCED_SUBTREE,rChild,(float)sqrDistance(rDomain,queryPoint),rDomain);
+  }
+
+  template<typename data_t, typename data_traits>
+  void NearestNeighborIterator<data_t,data_traits>::
+  openSpatialNode(const Entry &entry)
+  {
+    const auto &node = spatialTree->nodes[entry.id];
+    if (node.count) {
+      for (int i=0;i<node.count;i++) {
+        const int primID = spatialTree->primIDs[node.offset+i];
+        push(POINT,primID,
+             (float)sqrDistance(data_traits::get_point(points[primID]),queryPoint));
+      }
+      return;
+    }
+    box_t lDomain = entry.domain, rDomain = entry.domain;
+    set_coord(lDomain.upper,node.dim,node.pos);
+    set_coord(rDomain.lower,node.dim,node.pos);
+    push(SPATIAL_NODE,node.offset+0,(float)sqrDistance(lDomain,queryPoint),lDomain);
+    push(SPATIAL_NODE,node.offset+1,(float)sqrDistance(rDomain,queryPoint),rDomain);
+  }
+
+  template<typename data_t, typename data_traits>
+  bool NearestNeighborIterator<data_t,data_traits>::next(int &pointID, float &dist2)
+  {
+    while (!queue.empty()) {
+      const Entry entry = queue.top();
+      queue.pop();
+      if (entry.kind == POINT) {
+        pointID = entry.id;
+        dist2   = entry.dist2;
+        return true;
+      }
+      ++numNodesVisited;
+      if (entry.kind == BALANCED_SUBTREE)
+        openBalancedSubtree(entry);
+      else
+        openSpatialNode(entry);
+    }
+    return false;
+  }
+
+} // ::cukd
@@ -0,0 +1,371 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+/*! \file cukd/numa.h NUMA-aware placement of host-side trees.
+
+    On multi-socket machines, memory lives on the NUMA node of the
+    thread that first touched it; a tree that got built (or copied)
+    by a single thread thus sits entirely on that thread's node, and
+    query threads on all other nodes pay remote-memory latency on
+    every node they visit. This file offers two remedies, neither of
+    which needs libnuma:
+
+    - allocate(): memory whose pages get first-touched, in parallel,
+      by threads pinned to all nodes in turn, so the pages end up
+      interleaved across nodes; and InterleavedHostMemoryResource,
+      which does the same for all of a host builder's temporaries.
+
+    - ReplicatedTree: one copy of a (built) tree per node, each
+      allocated and copied by threads on that node, plus a
+      forEachQuery() that runs batch queries on threads pinned to
+      each node, each querying its local copy:
+
+    cukd::numa::ReplicatedTree<float3> replicas(tree,numPoints);
+    replicas.forEachQuery(numQueries,[&](int q, const float3 *tree) {
+        results[q] = cukd::stackBased::fcp(queries[q],tree,numPoints);
+      });
+
+    The machine's topology is read from /sys/devices/system/node;
+    where that is not available (including on non-Linux systems)
+    everything falls back to a single node with all CPUs, and thread
+    pinning becomes a no-op.
+*/
+
+#pragma once
+
+#include "cukd/helpers.h"
+
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <unordered_map>
+#include <fstream>
+#include <sstream>
+#ifdef __linux__
+# include <pthread.h>
+# include <sched.h>
+# include <sys/mman.h>
+#endif
+
+namespace cukd {
+  namespace numa {
+
+    // ==================================================================
+    // INTERFACE SECTION
+    // ==================================================================
+
+    /*! the CPUs of each NUMA node, as read from sysfs */
+    inline const std::vector<std::vector<int>> &nodeCPUs();
+    
+    inline int numNodes() { return (int)nodeCPUs().size(); }
+
+    /*! pins the calling thread to the CPUs of the given node; returns
+        false if that is not supported on this system, or there is
+        only one node anyway */
+    inline bool pinThreadToNode(int node);
+
+    /*! the node that the calling thread currently runs on */
+    inline int currentNode();
+
+    /*! runs func(node,threadID) on numThreadsPerNode threads pinned
+        to each node (0 meaning one thread per CPU of that node), and
+        waits for all of them to finish */
+    template<typename Lambda>
+    void forEachNode(int numThreadsPerNode, const Lambda &func);
+
+    /*! allocates count T's (uninitialized), with the pages
+        interleaved across all nodes; release with free(). Allocations
+        smaller than one interleaving chunk (2MB) have nothing to
+        spread out, and come straight from malloc */
+    template<typename T>
+    T *allocate(size_t count);
+
+    /*! releases memory from allocate() */
+    template<typename T>
+    void free(T *ptr);
+
+    /*! memory whose pages are guaranteed not to have been touched
+        yet, so that first touch decides which node they end up on:
+        malloc may hand out (already touched) heap memory even for
+        large blocks, as glibc raises its mmap threshold after
+        frees, so on multi-node Linux systems blocks of at least
+        minSize bytes come straight from mmap instead. Release with
+        freePages() */
+    inline void *allocatePages(size_t numBytes, size_t minSize);
+    inline void freePages(void *ptr);
+
+    /*! host memory resource (see helpers.h) whose allocations get
+        interleaved across all nodes; e.g., so a host build's
+        temporaries do not all end up on the building thread's node */
+    struct InterleavedHostMemoryResource : public HostMemoryResource {
+      void *malloc(size_t size) override { return allocate<char>(size); }
+      void free(void *ptr) override { freePages(ptr); }
+    };
+
+    /*! one copy of a built tree per NUMA node */
+    template<typename data_t>
+    struct ReplicatedTree {
+      /*! makes a copy of the given tree on each node; the tree itself
+          can get released afterwards */
+      ReplicatedTree(const data_t *points, int numPoints);
+      ReplicatedTree(const ReplicatedTree &) = delete;
+      ~ReplicatedTree();
+
+      /*! the copy on the given node */
+      const data_t *replica(int node) const { return replicas[node]; }
+      /*! the copy on the calling thread's node */
+      const data_t *localReplica() const { return replicas[currentNode()]; }
+
+      /*! runs func(queryID,tree) for all queryID in [0,numQueries),
+          on numThreadsPerNode threads pinned to each node (0 meaning
+          one thread per CPU), with 'tree' the copy on that node */
+      template<typename Lambda>
+      void forEachQuery(int numQueries,
+                        const Lambda &func,
+                        int numThreadsPerNode = 0) const;
+      
+      const int            numPoints;
+      std::vector<data_t*> replicas;
+    };
+    
+    // ==================================================================
+    // IMPLEMENTATION SECTION
+    // ==================================================================
+
+    /*! parses a sysfs cpu (or node) list such as "0-3,8-11" */
+    inline std::vector<int> parseList(const std::string &list)
+    {
+      std::vector<int> cpus;
+      std::stringstream ss(list);
+      std::string range;
+      while (std::getline(ss,range,',')) {
+        if (range.empty() || range == "\n") continue;
+        const size_t dash = range.find('-');
+        const int begin = std::stoi(range.substr(0,dash));
+        const int end
+          = (dash == std::string::npos) ? begin : std::stoi(range.substr(dash+1));
+        for (int cpu=begin;cpu<=end;cpu++)
+          cpus.push_back(cpu);
+      }
+      return cpus;
+    }
+    
+    inline const std::vector<std::vector<int>> &nodeCPUs()
+    {
+      static std::vector<std::vector<int>> nodes = []() {
+        std::vector<std::vector<int>> nodes;
+        std::string list;
+        std::ifstream online("/sys/devices/system/node/online");
+        if (online.good()) std::getline(online,list);
+        // node IDs are usually, but not necessarily, dense; nodes
+        // without CPUs (e.g., memory-only ones) are of no use to us
+        for (int node : parseList(list)) {
+          std::ifstream in("/sys/devices/system/node/node"
+                           +std::to_string(node)+"/cpulist");
+          std::string cpuList;
+          if (in.good()) std::getline(in,cpuList);
+          std::vector<int> cpus = parseList(cpuList);
+          if (!cpus.empty()) nodes.push_back(cpus);
+        }
+        if (nodes.empty()) {
+          nodes.resize(1);
+          for (int i=0;i<(int)std::thread::hardware_concurrency();i++)
+            nodes[0].push_back(i);
+          if (nodes[0].empty()) nodes[0].push_back(0);
+        }
+        return nodes;
+      }();
+      return nodes;
+    }
+
+    inline bool pinThreadToNode(int node)
+    {
+#ifdef __linux__
+      if (numNodes() < 2) return false;
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      for (int cpu : nodeCPUs()[node % numNodes()])
+        if (cpu < CPU_SETSIZE) CPU_SET(cpu,&set);
+      return pthread_setaffinity_np(pthread_self(),sizeof(set),&set) == 0;
+#else
+      return false;
+#endif
+    }
+
+    inline int currentNode()
+    {
+#ifdef __linux__
+      if (numNodes() < 2) return 0;
+      const int cpu = sched_getcpu();
+      for (int node=0;node<numNodes();node++)
+        for (int c : nodeCPUs()[node])
+          if (c == cpu) return node;
+#endif
+      return 0;
+    }
+    
+    template<typename Lambda>
+    void forEachNode(int numThreadsPerNode, const Lambda &func)
+    {
+      std::vector<std::thread> threads;
+      for (int node=0;node<numNodes();node++) {
+        const int numThreads
+          = numThreadsPerNode > 0
+          ? numThreadsPerNode
+          : (int)nodeCPUs()[node].size();
+        for (int t=0;t<numThreads;t++)
+          threads.push_back(std::thread([&func,node,t]() {
+                pinThreadToNode(node);
+                func(node,t);
+              }));
+      }
+      for (auto &t : threads) t.join();
+    }
+    
+    /*! the blocks allocatePages() got from mmap, and their sizes */
+    struct MappedPages {
+      std::mutex                        mutex;
+      std::unordered_map<void *,size_t> sizeOf;
+    };
+    inline MappedPages &mappedPages()
+    {
+      static MappedPages mappedPages;
+      return mappedPages;
+    }
+    
+    inline void *allocatePages(size_t numBytes, size_t minSize)
+    {
+      numBytes = std::max(numBytes,size_t(1));
+#ifdef __linux__
+      if (numNodes() >= 2 && numBytes >= minSize) {
+        void *mem = mmap(NULL,numBytes,PROT_READ|PROT_WRITE,
+                         MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+        if (mem == MAP_FAILED) throw std::bad_alloc();
+        std::lock_guard<std::mutex> lock(mappedPages().mutex);
+        mappedPages().sizeOf[mem] = numBytes;
+        return mem;
+      }
+#endif
+      void *mem = ::malloc(numBytes);
+      if (!mem) throw std::bad_alloc();
+      return mem;
+    }
+
+    inline void freePages(void *ptr)
+    {
+      if (!ptr) return;
+#ifdef __linux__
+      {
+        std::lock_guard<std::mutex> lock(mappedPages().mutex);
+        auto it = mappedPages().sizeOf.find(ptr);
+        if (it != mappedPages().sizeOf.end()) {
+          munmap(ptr,it->second);
+          mappedPages().sizeOf.erase(it);
+          return;
+        }
+      }
+#endif
+      ::free(ptr);
+    }
+    
+    template<typename T>
+    T *allocate(size_t count)
+    {
+      // first touch of chunk c is done by a thread on node
+      // c%numNodes; chunks are multiples of (huge) page size
+      const size_t chunkSize = 2*1024*1024;
+      const size_t numBytes = count*sizeof(T);
+      char *mem = (char *)allocatePages(numBytes,chunkSize);
+      if (numNodes() < 2 || numBytes < chunkSize) return (T*)mem;
+      const size_t numChunks = (numBytes+chunkSize-1)/chunkSize;
+      const int numThreadsPerNode = 4;
+      forEachNode(numThreadsPerNode,[&](int node, int t) {
+          for (size_t c=node+size_t(t)*numNodes();c<numChunks;
+               c+=size_t(numThreadsPerNode)*numNodes()) {
+            const size_t begin = c*chunkSize;
+            memset(mem+begin,0,std::min(chunkSize,numBytes-begin));
+          }
+        });
+      return (T*)mem;
+    }
+
+    template<typename T>
+    void free(T *ptr)
+    {
+      freePages(ptr);
+    }
+
+    template<typename data_t>
+    ReplicatedTree<data_t>::ReplicatedTree(const data_t *points, int numPoints)
+      : numPoints(numPoints),
+        replicas(numNodes(),nullptr)
+    {
+      const size_t numBytes = std::max(numPoints,1)*sizeof(data_t);
+      try {
+        // fresh pages, so the copying threads' first touch places
+        // them; small trees stay in cache anyway
+        for (auto &replica : replicas)
+          replica = (data_t *)allocatePages(numBytes,size_t(2)<<20);
+      } catch (...) {
+        // the destructor won't run for a throwing constructor
+        for (auto allocated : replicas) freePages(allocated);
+        throw;
+      }
+      // each node's threads copy (and thus first-touch) the parts
+      // of that node's replica
+      std::vector<int> numThreads(numNodes());
+      for (int node=0;node<numNodes();node++)
+        numThreads[node] = (int)nodeCPUs()[node].size();
+      forEachNode(0,[&](int node, int t) {
+          const size_t begin = size_t(numPoints)*t/numThreads[node];
+          const size_t end   = size_t(numPoints)*(t+1)/numThreads[node];
+          memcpy(replicas[node]+begin,points+begin,(end-begin)*sizeof(data_t));
+        });
+    }
+    
+    template<typename data_t>
+    ReplicatedTree<data_t>::~ReplicatedTree()
+    {
+      for (auto replica : replicas)
+        freePages(replica);
+    }
+    
+    template<typename data_t>
+    template<typename Lambda>
+    void ReplicatedTree<data_t>::forEachQuery(int numQueries,
+                                              const Lambda &func,
+                                              int numThreadsPerNode) const
+    {
+      // queries get handed out in blocks, from one shared counter, so
+      // faster nodes (or threads) simply take more of them
+      const int blockSize = 64;
+      std::atomic<int> nextBlock(0);
+      forEachNode(numThreadsPerNode,[&](int node, int) {
+          const data_t *tree = replicas[node];
+          while (true) {
+            const int begin = blockSize*nextBlock++;
+            if (begin >= numQueries) break;
+            const int end = std::min(begin+blockSize,numQueries);
+            for (int q=begin;q<end;q++)
+              func(q,tree);
+          }
+        });
+    }
+    
+  } // ::cukd::numa
+} // ::cukd
@@ -0,0 +1,274 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/*! \file cukd/pca.h PCA-aligned trees, for anisotropic data.
+
+    k-d trees only ever split along the coordinate axes, so for point
+    sets that are strongly elongated along some direction that is
+    _not_ axis-aligned (say, a road corridor running diagonally, or a
+    slanted facade) every split plane cuts across that direction at
+    an angle, and the subtrees' domains overlap with a lot of empty
+    space. The helpers in this file compute a principal component
+    (PCA) frame for such a point set, and rotate the points into that
+    frame - so the dimension of largest variance becomes 'x', the
+    second largest becomes 'y', etc. Trees then get built over the
+    rotated points with any of the regular builders, and queries get
+    transformed into the same frame before tracing:
+
+    auto frame = cukd::pca::computeFrame_host(points,numPoints);
+    cukd::pca::transform_host(frame,points,numPoints);
+    cukd::buildTree_host(points,numPoints);
+    ...
+    int closest = cukd::stackBased::fcp(frame.toFrame(query),points,numPoints);
+
+    Since the frame is orthonormal, distances are preserved (up to
+    float rounding), and the IDs returned by queries refer to the
+    rotated points; frame.fromFrame() maps those back.
+
+    This pays off mostly for data types with explicit split dims
+    (which always split the widest dimension): with round-robin
+    dims, a frame that makes one dimension very thin will have every
+    num_dims'th level split that thin dimension.
+*/
+
+#pragma once
+
+#include "cukd/builder_common.h"
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+namespace cukd {
+  namespace pca {
+
+    // ==================================================================
+    // INTERFACE SECTION
+    // ==================================================================
+
+    /*! an orthonormal frame: origin (the points' centroid), and one
+        unit-length axis per dimension, ordered by decreasing variance
+        of the points along that axis */
+    template<typename point_t>
+    struct Frame {
+      enum { num_dims = num_dims_of<point_t>::value };
+
+      /*! transforms a point into this frame */
+      inline __both__ point_t toFrame(const point_t &p) const;
+
+      /*! transforms a point from this frame back into world space */
+      inline __both__ point_t fromFrame(const point_t &p) const;
+
+      point_t origin;
+      point_t axis[num_dims];
+    };
+
+    /*! computes the PCA frame of the given points (on the host) */
+    template<typename data_t,
+             typename data_traits=default_data_traits<data_t>>
+    Frame<typename data_traits::point_t>
+    computeFrame_host(const data_t *points, int numPoints);
+
+    /*! rotates the given points (or the points of the given data_t's)
+        into the given frame, in place; any payload is left alone.
+        Since data_traits only has a read accessor, this writes through
+        the reference that data_traits::get_point() returns, which thus
+        has to be a reference into the data_t itself */
+    template<typename data_t,
+             typename data_traits=default_data_traits<data_t>>
+    void transform_host(const Frame<typename data_traits::point_t> &frame,
+                        data_t *points,
+                        int numPoints);
+
+    /*! rotates the given device-side points (or data_t's) into the
+        given frame, in place; see transform_host() */
+    template<typename data_t,
+             typename data_traits=default_data_traits<data_t>>
+    void transform(const Frame<typename data_traits::point_t> &frame,
+                   data_t *d_points,
+                   int numPoints,
+                   cudaStream_t stream=0);
+
+    // ==================================================================
+    // IMPLEMENTATION SECTION
+    // ==================================================================
+
+    template<typename point_t>
+    inline __both__ point_t Frame<point_t>::toFrame(const point_t &p) const
+    {
+      using scalar_t = typename scalar_type_of<point_t>::type;
+      point_t result;
+      for (int i=0;i<num_dims;i++) {
+        scalar_t sum = 0;
+        for (int d=0;d<num_dims;d++)
+          sum += (get_coord(p,d)-get_coord(origin,d))*get_coord(axis[i],d);
+        set_coord(result,i,sum);
+      }
+      return result;
+    }
+
+    template<typename point_t>
+    inline __both__ point_t Frame<point_t>::fromFrame(const point_t &p) const
+    {
+      using scalar_t = typename scalar_type_of<point_t>::type;
+      point_t result;
+      for (int d=0;d<num_dims;d++) {
+        scalar_t sum = get_coord(origin,d);
+        for (int i=0;i<num_dims;i++)
+          sum += get_coord(p,i)*get_coord(axis[i],d);
+        set_coord(result,d,sum);
+      }
+      return result;
+    }
+
+    /*! eigen-decomposition of a symmetric n-by-n matrix (in row-major
+        order) with cyclic Jacobi rotations; on return, the diagonal
+        of 'A' holds the eigenvalues, and the columns of 'V' the
+        matching eigenvectors */
+    inline void jacobiEigen(std::vector<double> &A,
+                            std::vector<double> &V,
+                            int n)
+    {
+      V.assign(n*n,0.);
+      for (int i=0;i<n;i++) V[i*n+i] = 1.;
+      for (int sweep=0;sweep<64;sweep++) {
+        double offDiag = 0., diag = 0.;
+        for (int p=0;p<n;p++) {
+          diag += A[p*n+p]*A[p*n+p];
+          for (int q=p+1;q<n;q++)
+            offDiag += A[p*n+q]*A[p*n+q];
+        }
+        if (offDiag <= 1e-24*diag) break;
+        for (int p=0;p<n;p++)
+          for (int q=p+1;q<n;q++) {
+            const double apq = A[p*n+q];
+            if (apq == 0.) continue;
+            const double theta = (A[q*n+q]-A[p*n+p])/(2.*apq);
+            const double t
+              = (theta >= 0. ? 1. : -1.)
+              / (std::fabs(theta)+std::sqrt(theta*theta+1.));
+            const double c = 1./std::sqrt(t*t+1.);
+            const double s = t*c;
+            for (int k=0;k<n;k++) {
+              const double akp = A[k*n+p], akq = A[k*n+q];
+              A[k*n+p] = c*akp - s*akq;
+              A[k*n+q] = s*akp + c*akq;
+            }
+            for (int k=0;k<n;k++) {
+              const double apk = A[p*n+k], aqk = A[q*n+k];
+              A[p*n+k] = c*apk - s*aqk;
+              A[q*n+k] = s*apk + c*aqk;
+            }
+            for (int k=0;k<n;k++) {
+              const double vkp = V[k*n+p], vkq = V[k*n+q];
+              V[k*n+p] = c*vkp - s*vkq;
+              V[k*n+q] = s*vkp + c*vkq;
+            }
+          }
+      }
+    }
+
+    template<typename data_t, typename data_traits>
+    Frame<typename data_traits::point_t>
+    computeFrame_host(const data_t *points, int numPoints)
+    {
+      using point_t  = typename data_traits::point_t;
+      using scalar_t = typename scalar_type_of<point_t>::type;
+      enum { num_dims = num_dims_of<point_t>::value };
+
+      std::vector<double> mean(num_dims,0.);
+      for (int i=0;i<numPoints;i++)
+        for (int d=0;d<num_dims;d++)
+          mean[d] += get_coord(data_traits::get_point(points[i]),d);
+      for (int d=0;d<num_dims;d++)
+        mean[d] /= std::max(numPoints,1);
+
+      std::vector<double> cov(num_dims*num_dims,0.);
+      std::vector<double> diff(num_dims);
+      for (int i=0;i<numPoints;i++) {
+        const point_t p = data_traits::get_point(points[i]);
+        for (int d=0;d<num_dims;d++)
+          diff[d] = get_coord(p,d) - mean[d];
+        for (int a=0;a<num_dims;a++)
+          for (int b=a;b<num_dims;b++)
+            cov[a*num_dims+b] += diff[a]*diff[b];
+      }
+      for (int a=0;a<num_dims;a++)
+        for (int b=0;b<a;b++)
+          cov[a*num_dims+b] = cov[b*num_dims+a];
+
+      std::vector<double> eigenVectors;
+      jacobiEigen(cov,eigenVectors,num_dims);
+      std::vector<int> order(num_dims);
+      for (int i=0;i<num_dims;i++) order[i] = i;
+      std::stable_sort(order.begin(),order.end(),[&](int a, int b)
+                       { return cov[a*num_dims+a] > cov[b*num_dims+b]; });
+
+      Frame<point_t> frame;
+      for (int d=0;d<num_dims;d++)
+        set_coord(frame.origin,d,(scalar_t)mean[d]);
+      for (int i=0;i<num_dims;i++)
+        for (int d=0;d<num_dims;d++)
+          set_coord(frame.axis[i],d,(scalar_t)eigenVectors[d*num_dims+order[i]]);
+      return frame;
+    }
+
+    /*! the (writable) point of the given data_t; see transform_host() */
+    template<typename data_t, typename data_traits>
+    inline __both__ typename data_traits::point_t &pointOf(data_t &data)
+    {
+      static_assert(std::is_reference<decltype(data_traits::get_point(data))>::value,
+                    "cukd::pca::transform needs a data_traits::get_point() that "
+                    "returns a reference into the data_t");
+      return const_cast<typename data_traits::point_t &>
+        (data_traits::get_point(data));
+    }
+    
+    template<typename data_t, typename data_traits>
+    void transform_host(const Frame<typename data_traits::point_t> &frame,
+                        data_t *points,
+                        int numPoints)
+    {
+      for (int i=0;i<numPoints;i++) {
+        auto &point = pointOf<data_t,data_traits>(points[i]);
+        point = frame.toFrame(point);
+      }
+    }
+
+    template<typename data_t, typename data_traits>
+    __global__ void transformPoints(const Frame<typename data_traits::point_t> frame,
+                                    data_t *points,
+                                    int numPoints)
+    {
+      const int tid = threadIdx.x+blockIdx.x*blockDim.x;
+      if (tid >= numPoints) return;
+      auto &point = pointOf<data_t,data_traits>(points[tid]);
+      point = frame.toFrame(point);
+    }
+
+    template<typename data_t, typename data_traits>
+    void transform(const Frame<typename data_traits::point_t> &frame,
+                   data_t *d_points,
+                   int numPoints,
+                   cudaStream_t s)
+    {
+      if (numPoints < 1) return;
+      transformPoints<data_t,data_traits>
+        <<<divRoundUp(numPoints,128),128,0,s>>>
+        (frame,d_points,numPoints);
+    }
+
+  } // ::cukd::pca
+} // ::cukd
@@ -0,0 +1,395 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/*! \file cukd/quantized.h Queries on a quantized copy of a k-d tree.
+
+    For a tree built (by any of the builders) over some data_t, this
+    stores - in a parallel array, in the same order - a copy of each
+    data point's coordinates quantized to 16 (or 8) bit fixed-point
+    values relative to the world bounds. Traversal then only reads
+    the quantized array for its culling decisions: each quantized
+    coordinate tells us an interval that the real coordinate lies
+    in, which gives conservative distances both to split planes and
+    to data points. Only data points whose conservative distance is
+    within the current cull radius get refined with their actual,
+    full-precision coordinates; so results are exactly the same as
+    for the regular traversals, but with a half (or a quarter) of the
+    memory traffic for most of the traversal steps.
+*/
+
+#pragma once
+
+#include "cukd/fcp.h"
+#include "cukd/knn.h"
+#include "cukd/builder_common.h"
+
+namespace cukd {
+  namespace quantized {
+
+    // ==================================================================
+    // INTERFACE SECTION
+    // ==================================================================
+
+    /*! quantized coordinates of one data point, plus - for data that
+        has explicit split dims - that data point's split dim */
+    template<int num_dims, typename storage_t, bool has_explicit_dim>
+    struct Node {
+      inline __both__ int  get_dim() const { return -1; }
+      inline __both__ void set_dim(int) {}
+
+      storage_t coord[num_dims];
+    };
+
+    template<int num_dims, typename storage_t>
+    struct Node<num_dims,storage_t,true> {
+      inline __both__ int  get_dim() const { return dim; }
+      inline __both__ void set_dim(int d) { dim = (uint8_t)d; }
+
+      storage_t coord[num_dims];
+      uint8_t   dim;
+    };
+
+    /*! maps coordinates within a given box to fixed-point storage_t
+        values, and fixed-point values back to the interval of
+        coordinates that map to them */
+    template<int num_dims, typename storage_t=uint16_t>
+    struct Quantizer {
+      static_assert(storage_t(-1) > 0 && sizeof(storage_t) <= 2,
+                    "quantized storage type has to be uint8_t or uint16_t");
+      enum { maxValue = storage_t(-1) };
+
+      /*! creates a quantizer for points within the given bounds */
+      template<typename point_t>
+      static Quantizer over(const box_t<point_t> &bounds);
+
+      /*! quantizes coordinate 'f' of dimension 'd'; guarantees that
+          cellLower(q,d) <= f <= cellUpper(q,d) */
+      inline __both__ storage_t quantize(float f, int d) const;
+
+      inline __both__ float cellLower(int q, int d) const
+      { return cellBoundary(q,d); }
+      inline __both__ float cellUpper(int q, int d) const
+      { return q == maxValue ? upper[d] : cellBoundary(q+1,d); }
+
+      /*! lower end of the q'th quantization interval; computed the
+          same way (and thus with the same rounding) on host and
+          device */
+      inline __both__ float cellBoundary(int q, int d) const;
+
+      float lower[num_dims];
+      float upper[num_dims];
+      float cellSize[num_dims];
+    };
+
+    /*! a k-d tree built over data_t's, plus its quantized copy. Both
+        arrays have to be readable wherever the tree gets queried */
+    template<typename data_t,
+             typename data_traits=default_data_traits<data_t>,
+             typename storage_t=uint16_t>
+    struct Tree {
+      using point_t = typename data_traits::point_t;
+      enum { num_dims = num_dims_of<point_t>::value };
+      using node_t  = Node<num_dims,storage_t,data_traits::has_explicit_dim>;
+
+      /*! quantized coordinates, in the same order as 'points' */
+      const node_t *nodes;
+      /*! the full-precision data points, as produced by the builder */
+      const data_t *points;
+      int           numPoints;
+      Quantizer<num_dims,storage_t> quantizer;
+    };
+
+    /*! fills in the quantized copy of an already built tree, on the
+        device. 'worldBounds' are the bounds of all points (as the
+        builders compute them) */
+    template<typename data_t,
+             typename data_traits=default_data_traits<data_t>,
+             typename storage_t=uint16_t>
+    Tree<data_t,data_traits,storage_t>
+    quantizeTree(typename Tree<data_t,data_traits,storage_t>::node_t *d_nodes,
+                 const data_t *d_points,
+                 int numPoints,
+                 const box_t<typename data_traits::point_t> &worldBounds,
+                 cudaStream_t stream=0);
+
+    /*! same as quantizeTree(), for host-accessible memory */
+    template<typename data_t,
+             typename data_traits=default_data_traits<data_t>,
+             typename storage_t=uint16_t>
+    Tree<data_t,data_traits,storage_t>
+    quantizeTree_host(typename Tree<data_t,data_traits,storage_t>::node_t *nodes,
+                      const data_t *points,
+                      int numPoints,
+                      const box_t<typename data_traits::point_t> &worldBounds);
+
+    /*! stack-based traversal of the quantized tree, with refinement
+        of all candidates that are potentially within the current
+        cull radius; same result_t interface as the other
+        traversals */
+    template<typename result_t,
+             typename data_t,
+             typename data_traits,
+             typename storage_t>
+    inline __both__
+    void traverse(result_t &result,
+                  const Tree<data_t,data_traits,storage_t> &tree,
+                  typename data_traits::point_t queryPoint);
+
+    /*! find-closest-point on a quantized tree; returns the same as
+        stackBased::fcp() on the full-precision points would */
+    template<typename data_t,
+             typename data_traits=default_data_traits<data_t>,
+             typename storage_t=uint16_t>
+    inline __both__
+    int fcp(const Tree<data_t,data_traits,storage_t> &tree,
+            typename data_traits::point_t queryPoint,
+            FcpSearchParams params = FcpSearchParams{});
+
+    /*! k-nearest neighbors on a quantized tree */
+    template<typename CandidateList,
+             typename data_t,
+             typename data_traits=default_data_traits<data_t>,
+             typename storage_t=uint16_t>
+    inline __both__
+    float knn(CandidateList &result,
+              const Tree<data_t,data_traits,storage_t> &tree,
+              typename data_traits::point_t queryPoint);
+
+    // ==================================================================
+    // IMPLEMENTATION SECTION
+    // ==================================================================
+
+    template<int num_dims, typename storage_t>
+    template<typename point_t>
+    Quantizer<num_dims,storage_t>
+    Quantizer<num_dims,storage_t>::over(const box_t<point_t> &bounds)
+    {
+      Quantizer q;
+      for (int d=0;d<num_dims;d++) {
+        q.lower[d]    = float(get_coord(bounds.lower,d));
+        q.upper[d]    = float(get_coord(bounds.upper,d));
+        q.cellSize[d] = (q.upper[d]-q.lower[d]) / (float(maxValue)+1.f);
+      }
+      return q;
+    }
+
+    template<int num_dims, typename storage_t>
+    inline __both__
+    float Quantizer<num_dims,storage_t>::cellBoundary(int q, int d) const
+    {
+#ifdef __CUDA_ARCH__
+      // no fma contraction, so device gets the same values as host
+      return __fadd_rn(lower[d],__fmul_rn(float(q),cellSize[d]));
+#else
+      return lower[d] + float(q)*cellSize[d];
+#endif
+    }
+
+    template<int num_dims, typename storage_t>
+    inline __both__
+    storage_t Quantizer<num_dims,storage_t>::quantize(float f, int d) const
+    {
+      if (!(cellSize[d] > 0.f)) return 0;
+      const float cell = floorf((f-lower[d])/cellSize[d]);
+      int q = (int)fminf(fmaxf(cell,0.f),float(maxValue));
+      // fix up whatever rounding the division introduced
+      while (q > 0 && cellLower(q,d) > f) --q;
+      while (q < maxValue && cellUpper(q,d) < f) ++q;
+      return (storage_t)q;
+    }
+
+    template<typename data_t, typename data_traits, typename storage_t>
+    inline __both__
+    void quantizeNode(typename Tree<data_t,data_traits,storage_t>::node_t &node,
+                      const data_t &point,
+                      const Quantizer<Tree<data_t,data_traits,storage_t>::num_dims,
+                                      storage_t> &quantizer)
+    {
+      enum { num_dims = Tree<data_t,data_traits,storage_t>::num_dims };
+      for (int d=0;d<num_dims;d++)
+        node.coord[d] = quantizer.quantize(float(data_traits::get_coord(point,d)),d);
+      node.set_dim(if_has_dims<data_t,data_traits,data_traits::has_explicit_dim>
+                   ::get_dim(point,-1));
+    }
+
+    template<typename data_t, typename data_traits, typename storage_t>
+    __global__
+    void quantizeNodes(typename Tree<data_t,data_traits,storage_t>::node_t *d_nodes,
+                       const data_t *d_points,
+                       int numPoints,
+                       Quantizer<Tree<data_t,data_traits,storage_t>::num_dims,
+                                 storage_t> quantizer)
+    {
+      const int tid = threadIdx.x+blockIdx.x*blockDim.x;
+      if (tid >= numPoints) return;
+      quantizeNode<data_t,data_traits,storage_t>(d_nodes[tid],d_points[tid],quantizer);
+    }
+
+    template<typename data_t, typename data_traits, typename storage_t>
+    Tree<data_t,data_traits,storage_t>
+    quantizeTree(typename Tree<data_t,data_traits,storage_t>::node_t *d_nodes,
+                 const data_t *d_points,
+                 int numPoints,
+                 const box_t<typename data_traits::point_t> &worldBounds,
+                 cudaStream_t stream)
+    {
+      using tree_t = Tree<data_t,data_traits,storage_t>;
+      tree_t tree;
+      tree.nodes     = d_nodes;
+      tree.points    = d_points;
+      tree.numPoints = numPoints;
+      tree.quantizer = Quantizer<tree_t::num_dims,storage_t>::over(worldBounds);
+      if (numPoints > 0) {
+        const int bs = 128;
+        const int nb = divRoundUp(numPoints,bs);
+        quantizeNodes<data_t,data_traits,storage_t><<<nb,bs,0,stream>>>
+          (d_nodes,d_points,numPoints,tree.quantizer);
+      }
+      return tree;
+    }
+
+    template<typename data_t, typename data_traits, typename storage_t>
+    Tree<data_t,data_traits,storage_t>
+    quantizeTree_host(typename Tree<data_t,data_traits,storage_t>::node_t *nodes,
+                      const data_t *points,
+                      int numPoints,
+                      const box_t<typename data_traits::point_t> &worldBounds)
+    {
+      using tree_t = Tree<data_t,data_traits,storage_t>;
+      tree_t tree;
+      tree.nodes     = nodes;
+      tree.points    = points;
+      tree.numPoints = numPoints;
+      tree.quantizer = Quantizer<tree_t::num_dims,storage_t>::over(worldBounds);
+      for (int i=0;i<numPoints;i++)
+        quantizeNode<data_t,data_traits,storage_t>(nodes[i],points[i],tree.quantizer);
+      return tree;
+    }
+
+    template<typename result_t,
+             typename data_t,
+             typename data_traits,
+             typename storage_t>
+    inline __both__
+    void traverse(result_t &result,
+                  const Tree<data_t,data_traits,storage_t> &tree,
+                  typename data_traits::point_t queryPoint)
+    {
+      using tree_t  = Tree<data_t,data_traits,storage_t>;
+      using node_t  = typename tree_t::node_t;
+      enum { num_dims = tree_t::num_dims };
+      const auto &quantizer = tree.quantizer;
+
+      float cullDist = result.initialCullDist2();
+
+      /* can do at most 2**30 points... */
+      struct StackEntry {
+        int   nodeID;
+        float sqrDist;
+      };
+      StackEntry stackBase[30];
+      StackEntry *stackPtr = stackBase;
+
+      int curr = 0;
+      while (true) {
+        while (curr < tree.numPoints) {
+          CUKD_DEVICE_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
+          const node_t node = tree.nodes[curr];
+          const int curr_dim
+            = data_traits::has_explicit_dim
+            ? node.get_dim()
+            : (BinaryTree::levelOf(curr) % num_dims);
+
+          // conservative distance to this data point: distance to
+          // the box of coordinates that quantize to this node
+          float lowerDist2 = 0.f;
+#pragma unroll
+          for (int d=0;d<num_dims;d++) {
+            const float q = float(get_coord(queryPoint,d));
+            const float dd
+              = fmaxf(fmaxf(quantizer.cellLower(node.coord[d],d)-q,
+                            q-quantizer.cellUpper(node.coord[d],d)),
+                      0.f);
+            lowerDist2 += dd*dd;
+          }
+          if (lowerDist2 <= cullDist) {
+            // could be a candidate - refine with the real point
+            const auto sqrDist
+              = sqrDistance(data_traits::get_point(tree.points[curr]),queryPoint);
+            cullDist = result.processCandidate(curr,sqrDist);
+          }
+
+          // the real split plane lies somewhere in [lo,hi]
+          const float lo = quantizer.cellLower(node.coord[curr_dim],curr_dim);
+          const float hi = quantizer.cellUpper(node.coord[curr_dim],curr_dim);
+          const float query_coord = float(get_coord(queryPoint,curr_dim));
+          const bool  leftIsClose = query_coord < .5f*(lo+hi);
+          const int   lChild = 2*curr+1;
+          const int   rChild = lChild+1;
+
+          const int closeChild = leftIsClose?lChild:rChild;
+          const int farChild   = leftIsClose?rChild:lChild;
+
+          const float distToPlane
+            = fmaxf(leftIsClose ? (lo-query_coord) : (query_coord-hi),0.f);
+          const float sqrDistToPlane = distToPlane*distToPlane;
+          if (sqrDistToPlane < cullDist && farChild < tree.numPoints) {
+            stackPtr->nodeID  = farChild;
+            stackPtr->sqrDist = sqrDistToPlane;
+            ++stackPtr;
+          }
+          curr = closeChild;
+        }
+
+        while (true) {
+          if (stackPtr == stackBase)
+            return;
+          --stackPtr;
+          if (stackPtr->sqrDist >= cullDist)
+            continue;
+          curr = stackPtr->nodeID;
+          break;
+        }
+      }
+    }
+
+    template<typename data_t, typename data_traits, typename storage_t>
+    inline __both__
+    int fcp(const Tree<data_t,data_traits,storage_t> &tree,
+            typename data_traits::point_t queryPoint,
+            FcpSearchParams params)
+    {
+      FCPResult result;
+      result.clear(sqr(params.cutOffRadius));
+      traverse<FCPResult,data_t,data_traits,storage_t>(result,tree,queryPoint);
+      return result.returnValue();
+    }
+
+    template<typename CandidateList,
+             typename data_t,
+             typename data_traits,
+             typename storage_t>
+    inline __both__
+    float knn(CandidateList &result,
+              const Tree<data_t,data_traits,storage_t> &tree,
+              typename data_traits::point_t queryPoint)
+    {
+      traverse<CandidateList,data_t,data_traits,storage_t>(result,tree,queryPoint);
+      return result.returnValue();
+    }
+
+  } // ::cukd::quantized
+} // ::cukd
@@ -0,0 +1,440 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+/*! \file cukd/query-service.h Micro-batching front end for host
+    queries from many concurrent producers.
+
+    In a service, many request threads each have one or a few
+    queries at a time. Traversing each of those on its own thread
+    gives up everything batching buys: spatially close queries
+    running back to back (and thus hitting the same, cached, tree
+    nodes), and a handful of threads that are exactly as many as
+    there are cores. A QueryService instead collects the queries of
+    all producers in a queue, and a dispatcher thread turns that
+    queue into batches - as soon as it holds maxBatchSize queries,
+    or as soon as the oldest query in it has waited for maxDelay
+    seconds, whichever comes first. Each batch gets sorted along a
+    Morton curve, and then traversed with the work-stealing scheduler
+    from batch.h - on the dispatcher plus a pool of worker threads
+    that lives as long as the service, so batches do not pay for
+    thread creation; every request's future completes as soon as all
+    of its queries are done:
+
+    cukd::QueryService<float3> service(tree,numPoints);
+    std::future<int> closest = service.fcp(query);
+    std::future<std::vector<int>> neighbors = service.knn(query,8);
+    ... closest.get() ...
+
+    maxDelay bounds how much latency batching can add when load is
+    light; maxBatchSize bounds how large batches get (and thus how
+    long one takes) when load is heavy. Larger values of either mean
+    better throughput, smaller ones lower latency.
+*/
+
+#pragma once
+
+#include "cukd/batch.h"
+#include "cukd/builder_common.h"
+
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <memory>
+
+namespace cukd {
+
+  // ==================================================================
+  // INTERFACE SECTION
+  // ==================================================================
+
+  struct QueryServiceConfig {
+    /*! dispatch a batch as soon as this many queries are queued */
+    int    maxBatchSize = 4096;
+    /*! ... or as soon as the oldest queued query has waited for this
+        many seconds */
+    double maxDelay     = 200e-6;
+    /*! number of threads each batch gets traversed with: the
+        dispatcher, plus numThreads-1 persistent workers */
+    int    numThreads   = std::thread::hardware_concurrency();
+    /*! whether to sort each batch along a Morton curve before
+        traversing it */
+    bool   mortonOrder  = true;
+  };
+
+  struct QueryServiceStats {
+    size_t numQueries = 0;
+    size_t numBatches = 0;
+    /*! number of batches that got dispatched because they were full
+        (the rest got dispatched because of maxDelay, or shutdown) */
+    size_t numFullBatches = 0;
+    /*! largest batch dispatched so far */
+    size_t maxBatchSize = 0;
+  };
+  
+  /*! a micro-batching query queue in front of one (host-accessible)
+      tree; see top of file. The tree has to stay alive (and
+      unchanged) for as long as the service exists */
+  template<typename data_t,
+           typename data_traits=default_data_traits<data_t>>
+  struct QueryService {
+    using point_t = typename data_traits::point_t;
+
+    QueryService(const data_t *tree,
+                 int numPoints,
+                 QueryServiceConfig config = QueryServiceConfig{});
+    /*! completes all queries that are still queued, then stops the
+        dispatcher and the workers */
+    ~QueryService();
+    QueryService(const QueryService &) = delete;
+    QueryService &operator=(const QueryService &) = delete;
+
+    /*! find-closest-point; the future returns the closest point's ID
+        (or -1 if the tree is empty) */
+    std::future<int> fcp(const point_t &query);
+    
+    /*! find-closest-point for each of the given queries, as one
+        request */
+    std::future<std::vector<int>> fcp(const point_t *queries, int numQueries);
+    
+    /*! the k nearest points, sorted by distance; unused entries are
+        -1 */
+    std::future<std::vector<int>> knn(const point_t &query, int k);
+
+    QueryServiceStats stats();
+
+    const QueryServiceConfig config;
+  private:
+    /*! one producer request, with one or more queries */
+    struct Request {
+      virtual ~Request() {}
+      /*! called once all of its queries are done */
+      virtual void complete() = 0;
+      std::atomic<int> numPending;
+    };
+    template<typename result_t>
+    struct RequestWith : public Request {
+      void complete() override { promise.set_value(std::move(result)); }
+      result_t                result;
+      std::promise<result_t>  promise;
+    };
+
+    /*! one query in the queue */
+    struct Item {
+      point_t  query;
+      /*! 0 for fcp */
+      int      k;
+      /*! where the result (or k results) go */
+      int     *result;
+      Request *request;
+      uint64_t mortonCode;
+      /*! time the query got queued */
+      double   arrival;
+    };
+
+    void enqueue(Request *request, const point_t *queries, int numQueries,
+                 int k, int *results);
+    void dispatcherLoop();
+    void workerLoop(int threadID);
+    void runBatch(std::vector<Item> &batch);
+    /*! runs batch items [begin,end) of the current batch on the given
+        thread */
+    void runItems(int threadID, int begin, int end);
+    uint64_t mortonCodeOf(const point_t &p) const;
+
+    const data_t           *tree;
+    const int               numPoints;
+    box_t<point_t>          worldBounds;
+    
+    std::mutex              mutex;
+    std::condition_variable queueNotEmpty;
+    std::vector<Item>       queue;
+    bool                    shuttingDown  = false;
+    QueryServiceStats       m_stats;
+    std::thread             dispatcher;
+
+    /*! the worker pool: runBatch() publishes a batch (and its
+        scheduler) under poolMutex and bumps batchID; workers with an
+        ID below numActive then join in, and the last one to finish
+        signals batchDone */
+    std::vector<std::thread> workers;
+    std::mutex              poolMutex;
+    std::condition_variable batchReady;
+    std::condition_variable batchDone;
+    uint64_t                batchID       = 0;
+    int                     numActive     = 1;
+    int                     numBusy       = 0;
+    bool                    stopWorkers   = false;
+    std::vector<Item>      *currentBatch  = nullptr;
+    WorkStealingRanges     *currentRanges = nullptr;
+    /*! per-thread knn candidate storage, re-used across batches */
+    std::vector<std::unique_ptr<HostCandidateList>> candidates;
+  };
+  
+  // ==================================================================
+  // IMPLEMENTATION SECTION
+  // ==================================================================
+
+  template<typename data_t, typename data_traits>
+  QueryService<data_t,data_traits>::QueryService(const data_t *tree,
+                                                 int numPoints,
+                                                 QueryServiceConfig config)
+    : config(config), tree(tree), numPoints(numPoints)
+  {
+    if (numPoints > 0)
+      host_computeBounds<data_t,data_traits>(&worldBounds,tree,numPoints);
+    else
+      worldBounds.setEmpty();
+    const int numThreads = std::max(1,config.numThreads);
+    candidates.resize(numThreads);
+    for (int t=1;t<numThreads;t++)
+      workers.push_back(std::thread([this,t]() { workerLoop(t); }));
+    dispatcher = std::thread([this]() { dispatcherLoop(); });
+  }
+
+  template<typename data_t, typename data_traits>
+  QueryService<data_t,data_traits>::~QueryService()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      shuttingDown = true;
+    }
+    queueNotEmpty.notify_one();
+    dispatcher.join();
+    {
+      std::lock_guard<std::mutex> lock(poolMutex);
+      stopWorkers = true;
+    }
+    batchReady.notify_all();
+    for (auto &worker : workers) worker.join();
+  }
+  
+  template<typename data_t, typename data_traits>
+  std::future<int>
+  QueryService<data_t,data_traits>::fcp(const point_t &query)
+  {
+    auto *request = new RequestWith<int>;
+    std::future<int> future = request->promise.get_future();
+    enqueue(request,&query,1,0,&request->result);
+    return future;
+  }
+  
+  template<typename data_t, typename data_traits>
+  std::future<std::vector<int>>
+  QueryService<data_t,data_traits>::fcp(const point_t *queries, int numQueries)
+  {
+    auto *request = new RequestWith<std::vector<int>>;
+    request->result.resize(numQueries);
+    std::future<std::vector<int>> future = request->promise.get_future();
+    enqueue(request,queries,numQueries,0,request->result.data());
+    return future;
+  }
+  
+  template<typename data_t, typename data_traits>
+  std::future<std::vector<int>>
+  QueryService<data_t,data_traits>::knn(const point_t &query, int k)
+  {
+    if (k < 1)
+      throw std::runtime_error("cukd::QueryService::knn: k has to be at least 1");
+    auto *request = new RequestWith<std::vector<int>>;
+    request->result.resize(k);
+    std::future<std::vector<int>> future = request->promise.get_future();
+    enqueue(request,&query,1,k,request->result.data());
+    return future;
+  }
+
+  template<typename data_t, typename data_traits>
+  QueryServiceStats QueryService<data_t,data_traits>::stats()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return m_stats;
+  }
+  
+  template<typename data_t, typename data_traits>
+  void QueryService<data_t,data_traits>::enqueue(Request *request,
+                                                 const point_t *queries,
+                                                 int numQueries,
+                                                 int k,
+                                                 int *results)
+  {
+    if (numQueries <= 0) {
+      request->complete();
+      delete request;
+      return;
+    }
+    request->numPending = numQueries;
+    // compute the sort keys here, on the producers' threads, rather
+    // than serially in the dispatcher
+    std::vector<uint64_t> codes(numQueries,0);
+    if (config.mortonOrder)
+      for (int i=0;i<numQueries;i++)
+        codes[i] = mortonCodeOf(queries[i]);
+    bool wakeDispatcher;
+    const double now = common::getCurrentTime();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (int i=0;i<numQueries;i++)
+        queue.push_back({queries[i],k,results+(k?size_t(i)*k:i),request,codes[i],now});
+      // the dispatcher only has to know when the queue becomes
+      // non-empty (to start the deadline), and when it becomes full
+      wakeDispatcher
+        = (queue.size() == size_t(numQueries))
+        || (queue.size() >= size_t(config.maxBatchSize)
+            && queue.size()-numQueries < size_t(config.maxBatchSize));
+    }
+    if (wakeDispatcher) queueNotEmpty.notify_one();
+  }
+
+  template<typename data_t, typename data_traits>
+  void QueryService<data_t,data_traits>::dispatcherLoop()
+  {
+    std::vector<Item> batch;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        queueNotEmpty.wait(lock,[this]() { return shuttingDown || !queue.empty(); });
+        if (queue.empty()) return;
+        // wait for either a full batch, or the oldest query's deadline
+        const auto deadline
+          = std::chrono::steady_clock::now()
+          + std::chrono::duration<double>
+          (std::max(0.,queue.front().arrival+config.maxDelay-common::getCurrentTime()));
+        queueNotEmpty.wait_until(lock,deadline,[this]() {
+            return shuttingDown || queue.size() >= size_t(config.maxBatchSize);
+          });
+        batch.clear();
+        if (queue.size() > size_t(config.maxBatchSize)) {
+          // take the oldest queries, leave the rest for the next batch
+          batch.assign(queue.begin(),queue.begin()+config.maxBatchSize);
+          queue.erase(queue.begin(),queue.begin()+config.maxBatchSize);
+        } else
+          std::swap(batch,queue);
+        m_stats.numBatches++;
+        m_stats.numQueries += batch.size();
+        if (batch.size() >= size_t(config.maxBatchSize)) m_stats.numFullBatches++;
+        m_stats.maxBatchSize = std::max(m_stats.maxBatchSize,batch.size());
+      }
+      runBatch(batch);
+    }
+  }
+  
+  template<typename data_t, typename data_traits>
+  void QueryService<data_t,data_traits>::runBatch(std::vector<Item> &batch)
+  {
+    if (config.mortonOrder)
+      std::sort(batch.begin(),batch.end(),[](const Item &a, const Item &b)
+                { return a.mortonCode < b.mortonCode; });
+    // only use as many threads as there are chunks to go around
+    const int minChunkSize = 16;
+    const int numThreads
+      = std::min(int(workers.size())+1,divRoundUp((int)batch.size(),minChunkSize));
+    WorkStealingRanges ranges((int)batch.size(),numThreads,minChunkSize);
+    if (numThreads > 1) {
+      {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        currentBatch  = &batch;
+        currentRanges = &ranges;
+        numActive     = numThreads;
+        numBusy       = numThreads-1;
+        batchID++;
+      }
+      batchReady.notify_all();
+    } else
+      currentBatch = &batch;
+    ranges.run(0,[&](int begin, int end) { runItems(0,begin,end); });
+    if (numThreads > 1) {
+      std::unique_lock<std::mutex> lock(poolMutex);
+      batchDone.wait(lock,[this]() { return numBusy == 0; });
+      currentRanges = nullptr;
+    }
+  }
+
+  template<typename data_t, typename data_traits>
+  void QueryService<data_t,data_traits>::workerLoop(int threadID)
+  {
+    uint64_t lastBatchID = 0;
+    while (true) {
+      WorkStealingRanges *ranges;
+      {
+        std::unique_lock<std::mutex> lock(poolMutex);
+        batchReady.wait(lock,[&]() { return stopWorkers || batchID != lastBatchID; });
+        if (stopWorkers) return;
+        lastBatchID = batchID;
+        if (threadID >= numActive) continue;
+        ranges = currentRanges;
+      }
+      ranges->run(threadID,[&](int begin, int end) { runItems(threadID,begin,end); });
+      bool lastOne;
+      {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        lastOne = (--numBusy == 0);
+      }
+      if (lastOne) batchDone.notify_one();
+    }
+  }
+
+  template<typename data_t, typename data_traits>
+  void QueryService<data_t,data_traits>::runItems(int threadID, int begin, int end)
+  {
+    std::unique_ptr<HostCandidateList> &myCandidates = candidates[threadID];
+    for (int i=begin;i<end;i++) {
+      Item &item = (*currentBatch)[i];
+      if (item.k == 0)
+        *item.result = stackBased::fcp<data_t,data_traits>
+          (item.query,tree,numPoints);
+      else {
+        if (!myCandidates || myCandidates->size() != item.k)
+          myCandidates.reset(new HostCandidateList(item.k,INFINITY));
+        else
+          myCandidates->clear(INFINITY);
+        stackBased::knn<HostCandidateList,data_t,data_traits>
+          (*myCandidates,item.query,tree,numPoints);
+        for (int j=0;j<item.k;j++)
+          item.result[j] = myCandidates->get_pointID(j);
+      }
+      if (--item.request->numPending == 0) {
+        item.request->complete();
+        delete item.request;
+      }
+    }
+  }
+
+  template<typename data_t, typename data_traits>
+  uint64_t QueryService<data_t,data_traits>::mortonCodeOf(const point_t &p) const
+  {
+    using point_traits = ::cukd::point_traits<point_t>;
+    enum { num_dims = point_traits::num_dims };
+    const int bitsPerDim = std::max(1,std::min(21,63/int(num_dims)));
+    uint32_t cell[num_dims];
+    for (int d=0;d<num_dims;d++) {
+      const double lo = (double)point_traits::get_coord(worldBounds.lower,d);
+      const double hi = (double)point_traits::get_coord(worldBounds.upper,d);
+      const double f
+        = (hi > lo)
+        ? ((double)point_traits::get_coord(p,d)-lo)/(hi-lo)
+        : 0.;
+      // queries outside the tree's bounds get clamped to its faces
+      cell[d] = uint32_t(std::max(0.,std::min(1.,f))*((1u<<bitsPerDim)-1));
+    }
+    uint64_t code = 0;
+    for (int b=bitsPerDim-1;b>=0;--b)
+      for (int d=0;d<std::min(int(num_dims),63);d++)
+        code = (code << 1) | ((cell[d] >> b) & 1);
+    return code;
+  }
+  
+} // ::cukd
@@ -0,0 +1,191 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/*! \file cukd/reduce.h Reduction ("aggregate") queries over all
+    points within a given radius.
+
+    Many uses of radius queries do not actually need the list of
+    points within the radius, only some reduction over them - e.g.,
+    the number of such points, the sum of their payloads (such as
+    photon power, in photon mapping), or a kernel-weighted average.
+    Rather than first collecting all points (which needs a candidate
+    list large enough to hold them all), the reduce() queries below
+    stream every point within the radius into a user-supplied
+    _reducer_, which only has to implement
+
+    struct MyReducer {
+      inline __both__ void add(int pointID, const data_t &point, float dist2);
+    };
+
+    where 'point' is the data point (with all its payload), and dist2
+    the square distance to the query point. E.g., for density
+    estimation:
+
+    struct PowerSum {
+      inline __both__ void add(int, const Photon &p, float dist2)
+      { power += p.power * (1.f - dist2*invRadius2); }
+      float power = 0.f, invRadius2;
+    };
+    PowerSum sum; sum.invRadius2 = 1.f/(r*r);
+    cukd::stackBased::reduce<PowerSum,Photon,Photon_traits>(sum,query,r,d_photons,N);
+*/
+
+#pragma once
+
+#include "cukd/knn.h"
+
+namespace cukd {
+
+  // ==================================================================
+  // INTERFACE SECTION
+  // ==================================================================
+
+  /*! a reducer that simply counts the points within the radius */
+  struct CountReducer {
+    template<typename data_t, typename dist2_t>
+    inline __both__ void add(int, const data_t &, dist2_t) { count++; }
+
+    /*! for reductions that use subtree aggregates (see aggregates.h) */
+    template<typename aggregate_t>
+    inline __both__ void addSubtree(const aggregate_t &agg, float, float)
+    { count += agg.count; }
+
+    int count = 0;
+  };
+
+  namespace stackBased {
+    /*! passes each point within 'radius' of the query point to
+        reducer.add(), using the default stack-based traversal */
+    template<typename reducer_t,
+             typename data_t,
+             typename data_traits=default_data_traits<data_t>>
+    inline __both__
+    void reduce(reducer_t &reducer,
+                typename data_traits::point_t queryPoint,
+                float radius,
+                const data_t *d_nodes,
+                int numPoints);
+
+    /*! the same, for a _spatial_ k-d tree */
+    template<typename reducer_t,
+             typename data_t,
+             typename data_traits=default_data_traits<data_t>>
+    inline __both__
+    void reduce(reducer_t &reducer,
+                const SpatialKDTree<data_t,data_traits> &tree,
+                typename data_traits::point_t queryPoint,
+                float radius);
+  } // ::cukd::stackBased
+
+  namespace stackFree {
+    /*! passes each point within 'radius' of the query point to
+        reducer.add(), using the stack-free traversal */
+    template<typename reducer_t,
+             typename data_t,
+             typename data_traits=default_data_traits<data_t>>
+    inline __both__
+    void reduce(reducer_t &reducer,
+                typename data_traits::point_t queryPoint,
+                float radius,
+                const data_t *d_nodes,
+                int numPoints);
+  } // ::cukd::stackFree
+
+  // ==================================================================
+  // IMPLEMENTATION SECTION
+  // ==================================================================
+
+  /*! adapts a reducer to the result_t interface used by the
+      traversals: the cull distance never shrinks, and every candidate
+      within the radius gets passed on to the reducer */
+  template<typename reducer_t,
+           typename data_t,
+           typename dist2_t>
+  struct ReducerResult {
+    inline __both__ dist2_t initialCullDist2() const
+    { return radius2; }
+
+    inline __both__ dist2_t processCandidate(int pointID, dist2_t dist2)
+    {
+      if (dist2 < radius2)
+        reducer.add(pointID,points[pointID],dist2);
+      return radius2;
+    }
+
+    inline __both__ float returnValue() const
+    { return radius2; }
+
+    reducer_t    &reducer;
+    const data_t *points;
+    dist2_t       radius2;
+  };
+
+  /*! the ReducerResult for trees over given data */
+  template<typename reducer_t, typename data_t, typename data_traits>
+  using ReducerResultFor
+  = ReducerResult<reducer_t,data_t,
+                  typename dist2_type_of<typename scalar_type_of
+                                         <typename data_traits::point_t>::type>::type>;
+
+  template<typename reducer_t,
+           typename data_t,
+           typename data_traits>
+  inline __both__
+  void stackBased::reduce(reducer_t &reducer,
+                          typename data_traits::point_t queryPoint,
+                          float radius,
+                          const data_t *d_nodes,
+                          int numPoints)
+  {
+    using result_t = ReducerResultFor<reducer_t,data_t,data_traits>;
+    result_t result{reducer,d_nodes,sqr(radius)};
+    traverse_default<result_t,data_t,data_traits>
+      (result,queryPoint,d_nodes,numPoints);
+  }
+
+  template<typename reducer_t,
+           typename data_t,
+           typename data_traits>
+  inline __both__
+  void stackBased::reduce(reducer_t &reducer,
+                          const SpatialKDTree<data_t,data_traits> &tree,
+                          typename data_traits::point_t queryPoint,
+                          float radius)
+  {
+    using result_t = ReducerResultFor<reducer_t,data_t,data_traits>;
+    result_t result{reducer,tree.data,sqr(radius)};
+    // the spatial knn traversal only needs the result_t interface,
+    // so can be used as is
+    stackBased::knn<result_t,data_t,data_traits>(result,tree,queryPoint);
+  }
+
+  template<typename reducer_t,
+           typename data_t,
+           typename data_traits>
+  inline __both__
+  void stackFree::reduce(reducer_t &reducer,
+                         typename data_traits::point_t queryPoint,
+                         float radius,
+                         const data_t *d_nodes,
+                         int numPoints)
+  {
+    using result_t = ReducerResultFor<reducer_t,data_t,data_traits>;
+    result_t result{reducer,d_nodes,sqr(radius)};
+    traverse_stack_free<result_t,data_t,data_traits>
+      (result,queryPoint,d_nodes,numPoints);
+  }
+
+} // ::cukd
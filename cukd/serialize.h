@@ -0,0 +1,389 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/*! \file cukd/serialize.h Serialized (on-disk) format for a built,
+    left-balanced k-d tree.
+
+    A serialized tree is a small header, followed by the world-space
+    bounds of the tree's points, followed by the tree's data points
+    in exactly the order the builders produce them. The data array
+    starts at a page-aligned offset, so a tree file can be memory
+    mapped and then queried directly out of the OS page cache (see
+    MappedTree), without ever having to load all of it into memory.
+*/
+
+#pragma once
+
+#include "cukd/common.h"
+#include "cukd/data.h"
+#include "cukd/helpers.h"
+
+#include <stdint.h>
+#include <climits>
+#ifndef _WIN32
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+namespace cukd {
+  namespace serialized {
+
+    // ==================================================================
+    // INTERFACE SECTION
+    // ==================================================================
+
+    /*! header at the start of each serialized tree file */
+    struct FileHeader {
+      enum : uint64_t { MAGIC = 0x65657274646b7563ull /* "cukdtree" */ };
+      enum : uint32_t { VERSION = 1 };
+      /*! alignment of the data array within the file; large enough
+          for the data array to be mappable on all page sizes we
+          care about */
+      enum : uint64_t { DATA_ALIGNMENT = 64*1024 };
+
+      uint64_t magic;
+      uint32_t version;
+      /*! sizeof(data_t) the tree was written with */
+      uint32_t sizeOfData;
+      /*! sizeof(box_t<point_t>) the tree was written with */
+      uint32_t sizeOfBounds;
+      /*! data_traits::has_explicit_dim the tree was written with */
+      uint32_t hasExplicitDim;
+      /*! number of data points in the tree */
+      uint64_t numPoints;
+      /*! byte offset (from start of file) of the world bounds */
+      uint64_t boundsOffset;
+      /*! byte offset (from start of file) of the first data point */
+      uint64_t dataOffset;
+    };
+
+    /*! largest number of points a tree can have: traversals index
+        nodes with int. saveTree(), loadTree*() and MappedTree throw
+        for anything larger, rather than have queries silently run
+        on a truncated count */
+    const uint64_t maxNumPoints = INT_MAX;
+
+    /*! creates the header for a tree of given size and data type */
+    template<typename data_t, typename data_traits=default_data_traits<data_t>>
+    FileHeader makeHeader(size_t numPoints);
+
+    /*! reads (and sanity-checks) the header of a serialized tree
+        file; throws if the file is not a serialized tree of the given
+        data type */
+    template<typename data_t, typename data_traits=default_data_traits<data_t>>
+    FileHeader readHeader(FILE *file, const std::string &fileName);
+
+    /*! writes a _built_ tree to the given file. 'points' must be
+        host-readable (managed memory is fine) */
+    template<typename data_t, typename data_traits=default_data_traits<data_t>>
+    void saveTree(const std::string &fileName,
+                  const data_t *points,
+                  size_t numPoints,
+                  const box_t<typename data_traits::point_t> &worldBounds);
+
+    /*! reads a serialized tree into managed memory (so it can be
+        used on either host or device), and returns a pointer to
+        that; the caller is responsible for cudaFree'ing it */
+    template<typename data_t, typename data_traits=default_data_traits<data_t>>
+    data_t *loadTree(const std::string &fileName,
+                     size_t &numPoints,
+                     box_t<typename data_traits::point_t> *worldBounds=0);
+
+    /*! reads a serialized tree into host memory allocated from the
+        given memory resource - e.g., a HugePageHostMemoryResource
+        (see hugepages.h), to have host-side traversals of large trees
+        run off huge pages. The caller is responsible for releasing
+        the returned memory through memResource.free() */
+    template<typename data_t, typename data_traits=default_data_traits<data_t>>
+    data_t *loadTree_host(const std::string &fileName,
+                          size_t &numPoints,
+                          box_t<typename data_traits::point_t> *worldBounds,
+                          HostMemoryResource &memResource);
+
+    /*! a serialized tree that is memory-mapped (read-only) rather
+        than loaded; pages of the tree get paged in from disk as the
+        traversal touches them, so this can be used for trees that
+        are much larger than main memory. Use the host-side
+        traversals on this, e.g.,
+
+        MappedTree<float3> tree("points.cukd");
+        int closest = stackBased::fcp<float3>
+           (query,tree.points(),(int)tree.numPoints());
+
+        (numPoints() always fits into an int; see maxNumPoints)
+    */
+    template<typename data_t, typename data_traits=default_data_traits<data_t>>
+    struct MappedTree {
+      using box_t = cukd::box_t<typename data_traits::point_t>;
+
+      MappedTree(const std::string &fileName);
+      ~MappedTree();
+      MappedTree(const MappedTree &) = delete;
+      MappedTree &operator=(const MappedTree &) = delete;
+
+      const data_t *points()      const { return m_points; }
+      size_t        numPoints()   const { return m_header.numPoints; }
+      const box_t  &worldBounds() const { return m_worldBounds; }
+    private:
+      FileHeader    m_header;
+      box_t         m_worldBounds;
+      const data_t *m_points     = 0;
+      void         *m_mapped     = 0;
+      size_t        m_mappedSize = 0;
+#ifdef _WIN32
+      HANDLE        m_file       = INVALID_HANDLE_VALUE;
+      HANDLE        m_mapping    = 0;
+#endif
+    };
+
+    // ==================================================================
+    // IMPLEMENTATION SECTION
+    // ==================================================================
+
+    /*! 64-bit safe fseek (plain fseek takes a 'long', which is only
+        32 bits on windows) */
+    inline int fseek64(FILE *file, uint64_t offset)
+    {
+#ifdef _WIN32
+      return _fseeki64(file,(__int64)offset,SEEK_SET);
+#else
+      return fseeko(file,(off_t)offset,SEEK_SET);
+#endif
+    }
+
+    template<typename data_t, typename data_traits>
+    FileHeader makeHeader(size_t numPoints)
+    {
+      using box_t = cukd::box_t<typename data_traits::point_t>;
+      FileHeader header;
+      memset(&header,0,sizeof(header));
+      header.magic          = FileHeader::MAGIC;
+      header.version        = FileHeader::VERSION;
+      header.sizeOfData     = (uint32_t)sizeof(data_t);
+      header.sizeOfBounds   = (uint32_t)sizeof(box_t);
+      header.hasExplicitDim = data_traits::has_explicit_dim;
+      header.numPoints      = numPoints;
+      header.boundsOffset   = sizeof(FileHeader);
+      header.dataOffset
+        = divRoundUp(uint64_t(sizeof(FileHeader)+sizeof(box_t)),
+                     uint64_t(FileHeader::DATA_ALIGNMENT))
+        * FileHeader::DATA_ALIGNMENT;
+      return header;
+    }
+
+    template<typename data_t, typename data_traits>
+    FileHeader readHeader(FILE *file, const std::string &fileName)
+    {
+      using box_t = cukd::box_t<typename data_traits::point_t>;
+      FileHeader header;
+      if (fread(&header,sizeof(header),1,file) != 1)
+        throw std::runtime_error("cukd::serialized: could not read header from '"
+                                 +fileName+"'");
+      if (header.magic != FileHeader::MAGIC)
+        throw std::runtime_error("cukd::serialized: '"+fileName
+                                 +"' is not a serialized k-d tree");
+      if (header.version != FileHeader::VERSION)
+        throw std::runtime_error("cukd::serialized: '"+fileName
+                                 +"' has unsupported version "
+                                 +std::to_string(header.version));
+      if (header.sizeOfData != sizeof(data_t) ||
+          header.sizeOfBounds != sizeof(box_t) ||
+          header.hasExplicitDim != (uint32_t)data_traits::has_explicit_dim)
+        throw std::runtime_error("cukd::serialized: '"+fileName
+                                 +"' was written with a different data type");
+      if (header.numPoints > maxNumPoints)
+        throw std::runtime_error("cukd::serialized: '"+fileName+"' has "
+                                 +std::to_string(header.numPoints)
+                                 +" points, but trees are limited to 2^31-1 points");
+      return header;
+    }
+
+    template<typename data_t, typename data_traits>
+    void saveTree(const std::string &fileName,
+                  const data_t *points,
+                  size_t numPoints,
+                  const box_t<typename data_traits::point_t> &worldBounds)
+    {
+      if (numPoints > maxNumPoints)
+        throw std::runtime_error("cukd::serialized: cannot save tree with "
+                                 +std::to_string(numPoints)
+                                 +" points; trees are limited to 2^31-1 points");
+      FILE *file = fopen(fileName.c_str(),"wb");
+      if (!file)
+        throw std::runtime_error("cukd::serialized: could not open '"
+                                 +fileName+"' for writing");
+      FileHeader header = makeHeader<data_t,data_traits>(numPoints);
+      bool ok
+        =  fwrite(&header,sizeof(header),1,file) == 1
+        && fwrite(&worldBounds,sizeof(worldBounds),1,file) == 1
+        && fseek64(file,header.dataOffset) == 0
+        && fwrite(points,sizeof(data_t),numPoints,file) == numPoints;
+      fclose(file);
+      if (!ok)
+        throw std::runtime_error("cukd::serialized: error writing '"+fileName+"'");
+    }
+
+    /*! opens a serialized tree file and reads its header and world
+        bounds; returns the (still open) file */
+    template<typename data_t, typename data_traits>
+    FILE *openTree(const std::string &fileName,
+                   FileHeader &header,
+                   box_t<typename data_traits::point_t> &bounds)
+    {
+      FILE *file = fopen(fileName.c_str(),"rb");
+      if (!file)
+        throw std::runtime_error("cukd::serialized: could not open '"+fileName+"'");
+      try {
+        header = readHeader<data_t,data_traits>(file,fileName);
+        if (fseek64(file,header.boundsOffset) != 0 ||
+            fread(&bounds,sizeof(bounds),1,file) != 1)
+          throw std::runtime_error("cukd::serialized: could not read bounds from '"
+                                   +fileName+"'");
+      } catch (...) {
+        fclose(file);
+        throw;
+      }
+      return file;
+    }
+
+    /*! reads the data points of an opened tree file into 'points',
+        and closes the file */
+    template<typename data_t>
+    bool readPoints(FILE *file, const FileHeader &header, data_t *points)
+    {
+      bool ok
+        =  fseek64(file,header.dataOffset) == 0
+        && fread(points,sizeof(data_t),header.numPoints,file) == header.numPoints;
+      fclose(file);
+      return ok;
+    }
+
+    template<typename data_t, typename data_traits>
+    data_t *loadTree(const std::string &fileName,
+                     size_t &numPoints,
+                     box_t<typename data_traits::point_t> *worldBounds)
+    {
+      FileHeader header;
+      box_t<typename data_traits::point_t> bounds;
+      FILE *file = openTree<data_t,data_traits>(fileName,header,bounds);
+
+      data_t *points = 0;
+      CUKD_CUDA_CALL(MallocManaged((void**)&points,
+                                   std::max(header.numPoints,uint64_t(1))
+                                   *sizeof(data_t)));
+      if (!readPoints(file,header,points)) {
+        cudaFree(points);
+        throw std::runtime_error("cukd::serialized: could not read points from '"
+                                 +fileName+"'");
+      }
+      numPoints = header.numPoints;
+      if (worldBounds) *worldBounds = bounds;
+      return points;
+    }
+
+    template<typename data_t, typename data_traits>
+    data_t *loadTree_host(const std::string &fileName,
+                          size_t &numPoints,
+                          box_t<typename data_traits::point_t> *worldBounds,
+                          HostMemoryResource &memResource)
+    {
+      FileHeader header;
+      box_t<typename data_traits::point_t> bounds;
+      FILE *file = openTree<data_t,data_traits>(fileName,header,bounds);
+
+      data_t *points = 0;
+      try {
+        points = (data_t *)memResource.malloc(std::max(header.numPoints,uint64_t(1))
+                                              *sizeof(data_t));
+      } catch (...) {
+        fclose(file);
+        throw;
+      }
+      if (!readPoints(file,header,points)) {
+        memResource.free(points);
+        throw std::runtime_error("cukd::serialized: could not read points from '"
+                                 +fileName+"'");
+      }
+      numPoints = header.numPoints;
+      if (worldBounds) *worldBounds = bounds;
+      return points;
+    }
+
+    template<typename data_t, typename data_traits>
+    MappedTree<data_t,data_traits>::MappedTree(const std::string &fileName)
+    {
+      fclose(openTree<data_t,data_traits>(fileName,m_header,m_worldBounds));
+
+      m_mappedSize = m_header.dataOffset + m_header.numPoints*sizeof(data_t);
+#ifdef _WIN32
+      m_file = CreateFileA(fileName.c_str(),GENERIC_READ,FILE_SHARE_READ,
+                           NULL,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
+      if (m_file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("cukd::serialized: could not open '"+fileName+"'");
+      LARGE_INTEGER fileSize;
+      if (!GetFileSizeEx(m_file,&fileSize) ||
+          (m_header.numPoints > 0 && uint64_t(fileSize.QuadPart) < m_mappedSize)) {
+        CloseHandle(m_file);
+        throw std::runtime_error("cukd::serialized: '"+fileName+"' is truncated");
+      }
+      m_mapping = CreateFileMappingA(m_file,NULL,PAGE_READONLY,0,0,NULL);
+      if (m_mapping)
+        m_mapped = MapViewOfFile(m_mapping,FILE_MAP_READ,0,0,0);
+      if (!m_mapped) {
+        if (m_mapping) CloseHandle(m_mapping);
+        CloseHandle(m_file);
+        throw std::runtime_error("cukd::serialized: could not map '"+fileName+"'");
+      }
+#else
+      int fd = open(fileName.c_str(),O_RDONLY);
+      if (fd < 0)
+        throw std::runtime_error("cukd::serialized: could not open '"+fileName+"'");
+      // touching a mapped page beyond the end of the file would be a
+      // SIGBUS rather than an error we can report, so check first
+      // (an empty tree's file ends before dataOffset, which is fine)
+      struct stat fileInfo;
+      if (fstat(fd,&fileInfo) != 0 ||
+          (m_header.numPoints > 0 && uint64_t(fileInfo.st_size) < m_mappedSize)) {
+        close(fd);
+        throw std::runtime_error("cukd::serialized: '"+fileName+"' is truncated");
+      }
+      m_mapped = mmap(NULL,m_mappedSize,PROT_READ,MAP_SHARED,fd,0);
+      // the mapping stays valid after closing the descriptor
+      close(fd);
+      if (m_mapped == MAP_FAILED) {
+        m_mapped = 0;
+        throw std::runtime_error("cukd::serialized: could not map '"+fileName+"'");
+      }
+#endif
+      m_points = (const data_t *)((const char *)m_mapped + m_header.dataOffset);
+    }
+
+    template<typename data_t, typename data_traits>
+    MappedTree<data_t,data_traits>::~MappedTree()
+    {
+#ifdef _WIN32
+      if (m_mapped) UnmapViewOfFile(m_mapped);
+      if (m_mapping) CloseHandle(m_mapping);
+      if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+#else
+      if (m_mapped) munmap(m_mapped,m_mappedSize);
+#endif
+    }
+
+  } // ::cukd::serialized
+} // ::cukd
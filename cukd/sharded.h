@@ -0,0 +1,528 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/*! \file cukd/sharded.h Support for k-d trees whose points are
+    split across multiple 'shards' (e.g., different query servers).
+
+    The top levels of the (conceptual) tree over all points form a
+    'router': each leaf of the router is one shard, which owns all
+    the points in that leaf's domain, and builds a regular k-d tree
+    over them with any of the normal builders. A kNN query is first
+    sent to its 'home' shard (the one the router puts it in), and the
+    k'th distance found there then bounds which other shards can
+    possibly contain closer points; only those get queried as
+    well. The Coordinator does this for batches of queries, talking
+    to the shards through the abstract ShardClient interface, and
+    merges the per-shard candidate lists. LocalShard implements that
+    interface for a tree in local (host) memory; StreamShardClient
+    and serveShard implement it across a pair of file descriptors,
+    so shards can live in other processes (via pipes) or on other
+    machines (via sockets).
+*/
+
+#pragma once
+
+#include "cukd/knn.h"
+#include "cukd/batch.h"
+
+#include <vector>
+#include <future>
+#include <thread>
+#ifdef _WIN32
+# include <io.h>
+#else
+# include <unistd.h>
+# include <errno.h>
+#endif
+
+namespace cukd {
+  namespace sharded {
+
+    // ==================================================================
+    // INTERFACE SECTION
+    // ==================================================================
+
+    /*! one of the k nearest points found by a single shard; pointID
+        is the index of that point in this shard's tree */
+    struct ShardCandidate {
+      int   pointID;
+      float dist2;
+    };
+
+    /*! one of the k nearest points found across all shards */
+    struct Candidate {
+      int   shardID;
+      int   pointID;
+      float dist2;
+    };
+
+    /*! the top levels of a k-d tree over all points, where each leaf
+        is one shard. The router's inner nodes are stored in the same
+        implicit (heap) order as the k-d trees' nodes */
+    template<typename point_t>
+    struct Router {
+      using scalar_t = typename point_traits<point_t>::scalar_t;
+      struct Plane {
+        int      dim;
+        scalar_t pos;
+      };
+
+      int numShards() const { return (int)shardBounds.size(); }
+
+      /*! the shard whose domain the given point lies in */
+      int homeShardOf(const point_t &query) const;
+
+      /*! (square of the) distance between the query point and the
+          bounding box of a shard's points */
+      float sqrDistToShard(const point_t &query, int shardID) const;
+
+      std::vector<Plane>           planes;
+      /*! (tight) bounding box of each shard's points */
+      std::vector<box_t<point_t>>  shardBounds;
+    };
+
+    /*! re-arranges the given points into 2^numLevels shards of
+        (almost) equal size, and returns the router for those. After
+        this call, shard i owns the points in
+        points[shardBegin[i]..shardBegin[i+1]), over which the caller
+        then builds that shard's tree with any of the normal
+        builders. 'points' has to be host-accessible */
+    template<typename data_t,
+             typename data_traits=default_data_traits<data_t>>
+    Router<typename data_traits::point_t>
+    partitionIntoShards(data_t *points,
+                        int numPoints,
+                        int numLevels,
+                        std::vector<int> &shardBegin);
+
+    /*! abstract interface to a shard, as seen by the coordinator */
+    template<typename point_t>
+    struct ShardClient {
+      virtual ~ShardClient() {}
+
+      /*! performs a kNN query for each of the given query points,
+          only looking for points that are closer than
+          sqrt(maxDist2[i]) to query i. Writes numQueries*k results,
+          with each query's k results sorted by distance, and unused
+          entries having a pointID of -1 */
+      virtual void knn(const point_t *queries,
+                       const float   *maxDist2,
+                       int            numQueries,
+                       int            k,
+                       ShardCandidate *results) = 0;
+    };
+
+    /*! a shard whose tree lives in local, host-accessible memory
+        (e.g., one built with buildTree_host, or a memory-mapped
+        serialized tree) */
+    template<typename data_t,
+             typename data_traits=default_data_traits<data_t>>
+    struct LocalShard : public ShardClient<typename data_traits::point_t> {
+      using point_t = typename data_traits::point_t;
+
+      LocalShard(const data_t *tree, int numPoints,
+                 int numThreads = std::thread::hardware_concurrency(),
+                 /*! where the per-thread candidate lists come from */
+                 HostMemoryResource &memResource = defaultHostMemResource())
+        : tree(tree), numPoints(numPoints), numThreads(std::max(numThreads,1)),
+          memResource(memResource)
+      {}
+
+      void knn(const point_t *queries,
+               const float   *maxDist2,
+               int            numQueries,
+               int            k,
+               ShardCandidate *results) override;
+
+      const data_t *const tree;
+      const int           numPoints;
+      const int           numThreads;
+      HostMemoryResource &memResource;
+    };
+
+    /*! client for a shard that is served (by serveShard()) on the
+        other end of a pair of file descriptors */
+    template<typename point_t>
+    struct StreamShardClient : public ShardClient<point_t> {
+      StreamShardClient(int sendFd, int recvFd)
+        : sendFd(sendFd), recvFd(recvFd)
+      {}
+
+      void knn(const point_t *queries,
+               const float   *maxDist2,
+               int            numQueries,
+               int            k,
+               ShardCandidate *results) override;
+
+      /*! tells the server to stop serving */
+      void shutdown();
+
+      const int sendFd, recvFd;
+    };
+
+    /*! serves requests from a StreamShardClient, and executes them
+        on the given shard; returns when the client shuts down or
+        closes its end of the connection */
+    template<typename point_t>
+    void serveShard(ShardClient<point_t> &shard, int recvFd, int sendFd);
+
+    /*! statistics of a sharded query */
+    struct QueryStats {
+      /*! number of (query,shard) pairs that got sent to shards, in
+          total and in the second (non-home shard) phase */
+      size_t numShardQueries       = 0;
+      size_t numSecondPhaseQueries = 0;
+    };
+
+    /*! issues kNN queries to a set of shards, and merges their
+        results */
+    template<typename point_t>
+    struct Coordinator {
+      Coordinator(const Router<point_t> &router,
+                  const std::vector<ShardClient<point_t> *> &shards);
+
+      /*! finds the k nearest points (within cutOffRadius) for each
+          query, across all shards; writes numQueries*k results, with
+          each query's results sorted by distance, and unused entries
+          having a shardID and pointID of -1; k has to be at least
+          1. All temporary host memory (per-shard batches and
+          results) comes from memResource */
+      void knn(const point_t *queries,
+               int            numQueries,
+               int            k,
+               float          cutOffRadius,
+               Candidate     *results,
+               QueryStats    *stats = 0,
+               HostMemoryResource &memResource = defaultHostMemResource());
+
+      const Router<point_t>                   router;
+      const std::vector<ShardClient<point_t>*> shards;
+    };
+
+    // ==================================================================
+    // IMPLEMENTATION SECTION
+    // ==================================================================
+
+    template<typename point_t>
+    int Router<point_t>::homeShardOf(const point_t &query) const
+    {
+      int node = 0;
+      while (node < (int)planes.size()) {
+        const Plane &plane = planes[node];
+        node = (point_traits<point_t>::get_coord(query,plane.dim) < plane.pos)
+          ? BinaryTree::leftChildOf(node)
+          : BinaryTree::rightChildOf(node);
+      }
+      return node - (int)planes.size();
+    }
+
+    template<typename point_t>
+    float Router<point_t>::sqrDistToShard(const point_t &query, int shardID) const
+    {
+      const box_t<point_t> &bounds = shardBounds[shardID];
+      for (int d=0;d<point_traits<point_t>::num_dims;d++)
+        // empty shard (with fewer points than shards)
+        if (get_coord(bounds.lower,d) > get_coord(bounds.upper,d)) return INFINITY;
+      return (float)sqrDistance(bounds,query);
+    }
+
+    namespace shardedImpl {
+      template<typename data_t, typename data_traits>
+      void partitionRec(Router<typename data_traits::point_t> &router,
+                        std::vector<int> &shardBegin,
+                        data_t *points, int begin, int end,
+                        int node)
+      {
+        using point_t = typename data_traits::point_t;
+        const int numInnerNodes = (int)router.planes.size();
+        box_t<point_t> bounds;
+        bounds.setEmpty();
+        for (int i=begin;i<end;i++)
+          bounds.grow(data_traits::get_point(points[i]));
+
+        if (node >= numInnerNodes) {
+          const int shardID = node - numInnerNodes;
+          router.shardBounds[shardID] = bounds;
+          shardBegin[shardID]   = begin;
+          shardBegin[shardID+1] = end;
+          return;
+        }
+
+        const int dim = (end > begin) ? bounds.widestDimension() : 0;
+        const int mid = begin + (end-begin)/2;
+        std::nth_element(points+begin,points+mid,points+end,
+                         [dim](const data_t &a, const data_t &b)
+                         { return data_traits::get_coord(a,dim)
+                             < data_traits::get_coord(b,dim); });
+        router.planes[node].dim = dim;
+        router.planes[node].pos
+          = (mid < end) ? data_traits::get_coord(points[mid],dim) : 0;
+        partitionRec<data_t,data_traits>(router,shardBegin,points,begin,mid,
+                                         BinaryTree::leftChildOf(node));
+        partitionRec<data_t,data_traits>(router,shardBegin,points,mid,end,
+                                         BinaryTree::rightChildOf(node));
+      }
+
+      inline void readFully(int fd, void *ptr, size_t size)
+      {
+        char *dst = (char *)ptr;
+        while (size > 0) {
+#ifdef _WIN32
+          int n = _read(fd,dst,(unsigned)std::min(size,size_t(1)<<30));
+#else
+          ssize_t n = ::read(fd,dst,size);
+          if (n < 0 && errno == EINTR) continue;
+#endif
+          if (n <= 0)
+            throw std::runtime_error("cukd::sharded: could not read from shard connection");
+          dst += n; size -= n;
+        }
+      }
+
+      inline void writeFully(int fd, const void *ptr, size_t size)
+      {
+        const char *src = (const char *)ptr;
+        while (size > 0) {
+#ifdef _WIN32
+          int n = _write(fd,src,(unsigned)std::min(size,size_t(1)<<30));
+#else
+          ssize_t n = ::write(fd,src,size);
+          if (n < 0 && errno == EINTR) continue;
+#endif
+          if (n <= 0)
+            throw std::runtime_error("cukd::sharded: could not write to shard connection");
+          src += n; size -= n;
+        }
+      }
+
+      /*! header of a request sent from StreamShardClient to
+          serveShard; the header is followed by numQueries point_t's
+          and numQueries floats (the maxDist2's), and gets answered
+          with numQueries*k ShardCandidate's */
+      struct RequestHeader {
+        enum : uint32_t { MAGIC = 0x6b64736e /* "nsdk" */ };
+        uint32_t magic;
+        uint32_t sizeOfPoint;
+        /*! number of queries, or -1 for 'shut down' */
+        int32_t  numQueries;
+        int32_t  k;
+      };
+    } // ::cukd::sharded::shardedImpl
+
+    template<typename data_t, typename data_traits>
+    Router<typename data_traits::point_t>
+    partitionIntoShards(data_t *points,
+                        int numPoints,
+                        int numLevels,
+                        std::vector<int> &shardBegin)
+    {
+      if (numLevels < 0 || numLevels > 16)
+        throw std::runtime_error("cukd::sharded: invalid number of router levels");
+      const int numShards = 1<<numLevels;
+      Router<typename data_traits::point_t> router;
+      router.planes.resize(numShards-1);
+      router.shardBounds.resize(numShards);
+      shardBegin.resize(numShards+1);
+      shardedImpl::partitionRec<data_t,data_traits>
+        (router,shardBegin,points,0,std::max(numPoints,0),0);
+      return router;
+    }
+
+    template<typename data_t, typename data_traits>
+    void LocalShard<data_t,data_traits>::knn(const point_t *queries,
+                                             const float   *maxDist2,
+                                             int            numQueries,
+                                             int            k,
+                                             ShardCandidate *results)
+    {
+      // per-query costs differ a lot (and even more so with the
+      // per-query maxDist2's), so use work stealing rather than one
+      // static range per thread. Same as batch::knn_host(), each
+      // thread allocates one candidate list, on its first chunk
+      std::vector<std::unique_ptr<HostCandidateList>> candidatesOf(numThreads);
+      parallelForPerThread_workStealing
+        (numQueries,[&](int threadID, int begin, int end) {
+          std::unique_ptr<HostCandidateList> &candidates = candidatesOf[threadID];
+          if (!candidates)
+            candidates.reset(new HostCandidateList(k,0.f,memResource));
+          for (int q=begin;q<end;q++) {
+            candidates->clear(maxDist2[q]);
+            stackBased::knn<HostCandidateList,data_t,data_traits>
+              (*candidates,queries[q],tree,numPoints);
+            for (int i=0;i<k;i++) {
+              results[size_t(q)*k+i].pointID = candidates->get_pointID(i);
+              results[size_t(q)*k+i].dist2   = candidates->get_dist2(i);
+            }
+          }
+        },numThreads);
+    }
+
+    template<typename point_t>
+    void StreamShardClient<point_t>::knn(const point_t *queries,
+                                         const float   *maxDist2,
+                                         int            numQueries,
+                                         int            k,
+                                         ShardCandidate *results)
+    {
+      using namespace shardedImpl;
+      RequestHeader header
+        = { RequestHeader::MAGIC, (uint32_t)sizeof(point_t), numQueries, k };
+      writeFully(sendFd,&header,sizeof(header));
+      writeFully(sendFd,queries,numQueries*sizeof(point_t));
+      writeFully(sendFd,maxDist2,numQueries*sizeof(float));
+      readFully(recvFd,results,size_t(numQueries)*k*sizeof(ShardCandidate));
+    }
+
+    template<typename point_t>
+    void StreamShardClient<point_t>::shutdown()
+    {
+      using namespace shardedImpl;
+      RequestHeader header
+        = { RequestHeader::MAGIC, (uint32_t)sizeof(point_t), -1, 0 };
+      writeFully(sendFd,&header,sizeof(header));
+    }
+
+    template<typename point_t>
+    void serveShard(ShardClient<point_t> &shard, int recvFd, int sendFd)
+    {
+      using namespace shardedImpl;
+      std::vector<point_t>        queries;
+      std::vector<float>          maxDist2;
+      std::vector<ShardCandidate> results;
+      while (true) {
+        RequestHeader header;
+        try {
+          readFully(recvFd,&header,sizeof(header));
+        } catch (const std::runtime_error &) {
+          // client closed the connection
+          return;
+        }
+        if (header.magic != RequestHeader::MAGIC ||
+            header.sizeOfPoint != sizeof(point_t))
+          throw std::runtime_error("cukd::sharded: invalid request");
+        if (header.numQueries < 0)
+          return;
+
+        queries.resize(header.numQueries);
+        maxDist2.resize(header.numQueries);
+        results.resize(size_t(header.numQueries)*header.k);
+        readFully(recvFd,queries.data(),queries.size()*sizeof(point_t));
+        readFully(recvFd,maxDist2.data(),maxDist2.size()*sizeof(float));
+        shard.knn(queries.data(),maxDist2.data(),header.numQueries,header.k,
+                  results.data());
+        writeFully(sendFd,results.data(),results.size()*sizeof(ShardCandidate));
+      }
+    }
+
+    template<typename point_t>
+    Coordinator<point_t>::Coordinator(const Router<point_t> &router,
+                                      const std::vector<ShardClient<point_t> *> &shards)
+      : router(router), shards(shards)
+    {
+      if ((int)shards.size() != router.numShards())
+        throw std::runtime_error("cukd::sharded: number of shard clients does"
+                                 " not match the router's number of shards");
+    }
+
+    template<typename point_t>
+    void Coordinator<point_t>::knn(const point_t *queries,
+                                   int            numQueries,
+                                   int            k,
+                                   float          cutOffRadius,
+                                   Candidate     *results,
+                                   QueryStats    *stats,
+                                   HostMemoryResource &memResource)
+    {
+      if (k < 1)
+        throw std::runtime_error("cukd::sharded::Coordinator::knn: k has to be at least 1");
+      const int   numShards = router.numShards();
+      const float cutOff2   = cutOffRadius*cutOffRadius;
+      for (size_t i=0;i<size_t(numQueries)*k;i++)
+        results[i] = { -1, -1, cutOff2 };
+      if (stats) *stats = QueryStats();
+
+      /* sends each shard its batch of (query,maxDist2) pairs - all
+         shards in parallel - and merges the results into each
+         query's k closest so far */
+      const HostAllocator<char> alloc(memResource);
+      std::vector<HostVector<int>>   batchQueryIDs(numShards,HostVector<int>(alloc));
+      std::vector<HostVector<float>> batchMaxDist2(numShards,HostVector<float>(alloc));
+      HostVector<Candidate> merged(alloc);
+      auto runBatches = [&]() {
+        std::vector<std::future<HostVector<ShardCandidate>>> futures(numShards);
+        for (int s=0;s<numShards;s++) {
+          if (batchQueryIDs[s].empty()) continue;
+          if (stats) stats->numShardQueries += batchQueryIDs[s].size();
+          futures[s] = std::async(std::launch::async,[&,s]() {
+            HostVector<point_t> batch(alloc);
+            for (int q : batchQueryIDs[s]) batch.push_back(queries[q]);
+            HostVector<ShardCandidate> shardResults(batch.size()*k,alloc);
+            shards[s]->knn(batch.data(),batchMaxDist2[s].data(),
+                           (int)batch.size(),k,shardResults.data());
+            return shardResults;
+          });
+        }
+        for (int s=0;s<numShards;s++) {
+          if (batchQueryIDs[s].empty()) continue;
+          HostVector<ShardCandidate> shardResults = futures[s].get();
+          for (size_t i=0;i<batchQueryIDs[s].size();i++) {
+            Candidate *queryResults = results+size_t(batchQueryIDs[s][i])*k;
+            merged.assign(queryResults,queryResults+k);
+            for (int j=0;j<k;j++) {
+              const ShardCandidate &c = shardResults[i*k+j];
+              if (c.pointID >= 0) merged.push_back({ s, c.pointID, c.dist2 });
+            }
+            std::sort(merged.begin(),merged.end(),
+                      [](const Candidate &a, const Candidate &b) {
+                        if (a.dist2 != b.dist2) return a.dist2 < b.dist2;
+                        // unused entries (ID -1) go last
+                        if (a.shardID != b.shardID)
+                          return uint32_t(a.shardID) < uint32_t(b.shardID);
+                        return a.pointID < b.pointID;
+                      });
+            std::copy(merged.begin(),merged.begin()+k,queryResults);
+          }
+          batchQueryIDs[s].clear();
+          batchMaxDist2[s].clear();
+        }
+      };
+
+      // phase 1: query each point's home shard
+      for (int q=0;q<numQueries;q++) {
+        const int home = router.homeShardOf(queries[q]);
+        batchQueryIDs[home].push_back(q);
+        batchMaxDist2[home].push_back(cutOff2);
+      }
+      runBatches();
+
+      /* phase 2: the k'th distance found in the home shard bounds
+         which other shards could contain any closer points */
+      for (int q=0;q<numQueries;q++) {
+        const int   home     = router.homeShardOf(queries[q]);
+        const float maxDist2 = results[size_t(q)*k+k-1].dist2;
+        for (int s=0;s<numShards;s++) {
+          if (s == home || router.sqrDistToShard(queries[q],s) >= maxDist2)
+            continue;
+          batchQueryIDs[s].push_back(q);
+          batchMaxDist2[s].push_back(maxDist2);
+          if (stats) stats->numSecondPhaseQueries++;
+        }
+      }
+      runBatches();
+    }
+
+  } // ::cukd::sharded
+} // ::cukd
@@ -0,0 +1,417 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/*! \file cukd/subtree-bounds.h Optional table of per-subtree bounds
+    for (regular, balanced) k-d trees.
+
+    The implicit k-d tree does not store any bounds; traversals that
+    need a subtree's bounds either have to track them on their stack
+    (cct), or re-compute them from the split planes of all the
+    subtree's ancestors (sf-imp, with recomputeBounds(), which costs
+    O(depth) for every node visited). A subtree bounds table stores
+    the _tight_ bounding box of the points in each subtree for the
+    top few levels of the tree, so those traversals can read them in
+    O(1) (and, being tight rather than just the subtree's domain,
+    cull more, in particular for clustered data).
+
+    To bound memory usage the table only ever covers the top
+    config.maxLevels levels, and at most config.maxBytes bytes;
+    recomputeBounds() for nodes below those levels only has to walk
+    up to the closest ancestor that is in the table. Bounds can be
+    stored either as full boxes (SubtreeBoundsTable) or quantized to
+    16 bits per coordinate, relative to the tree's overall bounds
+    (QuantizedSubtreeBoundsTable, rounded outwards, so a bit less
+    tight, but less than a third of the memory for float3).
+
+    cukd::SubtreeBoundsTable<float3> table;
+    cukd::buildSubtreeBounds(table,d_points,numPoints);
+    ...
+    int closest = cukd::cct::fcp(query,worldBounds,table,d_points,numPoints);
+
+    The table has to be rebuilt whenever the tree gets rebuilt.
+*/
+
+#pragma once
+
+#include "cukd/builder_common.h"
+#include <vector>
+#include <algorithm>
+
+namespace cukd {
+
+  // ==================================================================
+  // INTERFACE SECTION
+  // ==================================================================
+
+  struct SubtreeBoundsConfig {
+    /*! max number of tree levels (starting at the root) to store
+        bounds for */
+    int    maxLevels = 32;
+    /*! max number of bytes to use for the table */
+    size_t maxBytes  = size_t(-1);
+  };
+
+  /*! 'table' that does not store any bounds; traversals that take a
+      subtree bounds table use this by default */
+  struct NoSubtreeBounds {
+    template<typename box_t>
+    inline __both__ bool get(int nodeID, box_t &bounds) const { return false; }
+  };
+
+  /*! table of full-precision subtree bounds */
+  template<typename point_t>
+  struct SubtreeBoundsTable {
+    using box_t = cukd::box_t<point_t>;
+    using Entry = box_t;
+
+    /*! returns the tight bounds of the given node's subtree, if that
+        node is in the table (else returns false) */
+    inline __both__ bool get(int nodeID, box_t &bounds) const;
+
+    static inline __both__ Entry encode(const box_t &bounds, const box_t &worldBounds)
+    { return bounds; }
+
+    Entry *entries    = nullptr;
+    int    numEntries = 0;
+    box_t  worldBounds;
+  };
+
+  /*! table of subtree bounds that are quantized to 16 bits per
+      coordinate, relative to the bounds of all points */
+  template<typename point_t>
+  struct QuantizedSubtreeBoundsTable {
+    using box_t    = cukd::box_t<point_t>;
+    using scalar_t = typename scalar_type_of<point_t>::type;
+    enum { num_dims = num_dims_of<point_t>::value };
+    struct Entry {
+      uint16_t lower[num_dims];
+      uint16_t upper[num_dims];
+    };
+
+    inline __both__ bool get(int nodeID, box_t &bounds) const;
+
+    static inline __both__ Entry encode(const box_t &bounds, const box_t &worldBounds);
+
+    Entry *entries    = nullptr;
+    int    numEntries = 0;
+    box_t  worldBounds;
+  };
+
+  /*! builds given table of subtree bounds for a (regular, balanced)
+      tree over the given device-side points */
+  template<typename table_t,
+           typename data_t,
+           typename data_traits=default_data_traits<data_t>>
+  void buildSubtreeBounds(table_t &table,
+                          const data_t *d_points,
+                          int numPoints,
+                          SubtreeBoundsConfig config = {},
+                          cudaStream_t stream = 0,
+                          GpuMemoryResource &memResource=defaultGpuMemResource());
+
+  /*! frees a table built with buildSubtreeBounds() */
+  template<typename point_t>
+  void free(SubtreeBoundsTable<point_t> &table,
+            cudaStream_t stream = 0,
+            GpuMemoryResource &memResource=defaultGpuMemResource());
+  template<typename point_t>
+  void free(QuantizedSubtreeBoundsTable<point_t> &table,
+            cudaStream_t stream = 0,
+            GpuMemoryResource &memResource=defaultGpuMemResource());
+
+  /*! builds given table of subtree bounds for a (regular, balanced)
+      tree over the given host-side points; the table's memory is
+      host memory, and has to be freed with free_host() */
+  template<typename table_t,
+           typename data_t,
+           typename data_traits=default_data_traits<data_t>>
+  void buildSubtreeBounds_host(table_t &table,
+                               const data_t *points,
+                               int numPoints,
+                               SubtreeBoundsConfig config = {});
+
+  template<typename point_t>
+  void free_host(SubtreeBoundsTable<point_t> &table);
+  template<typename point_t>
+  void free_host(QuantizedSubtreeBoundsTable<point_t> &table);
+
+  // ==================================================================
+  // IMPLEMENTATION SECTION
+  // ==================================================================
+
+  template<typename point_t>
+  inline __both__
+  bool SubtreeBoundsTable<point_t>::get(int nodeID, box_t &bounds) const
+  {
+    if (nodeID >= numEntries) return false;
+    bounds = entries[nodeID];
+    return true;
+  }
+
+  template<typename point_t>
+  inline __both__
+  typename QuantizedSubtreeBoundsTable<point_t>::Entry
+  QuantizedSubtreeBoundsTable<point_t>::encode(const box_t &bounds,
+                                               const box_t &worldBounds)
+  {
+    // rounded outwards, with an extra cell of margin so that float
+    // rounding in get() can never make the box any smaller
+    Entry entry;
+    for (int d=0;d<num_dims;d++) {
+      const float lo    = (float)get_coord(worldBounds.lower,d);
+      const float hi    = (float)get_coord(worldBounds.upper,d);
+      const float scale = (hi > lo) ? 65535.f/(hi-lo) : 0.f;
+      const float l = floorf(((float)get_coord(bounds.lower,d)-lo)*scale)-1.f;
+      const float u = ceilf (((float)get_coord(bounds.upper,d)-lo)*scale)+1.f;
+      entry.lower[d] = (uint16_t)max(0.f,min(65535.f,l));
+      entry.upper[d] = (uint16_t)max(0.f,min(65535.f,u));
+    }
+    return entry;
+  }
+
+  template<typename point_t>
+  inline __both__
+  bool QuantizedSubtreeBoundsTable<point_t>::get(int nodeID, box_t &bounds) const
+  {
+    if (nodeID >= numEntries) return false;
+    const Entry entry = entries[nodeID];
+    for (int d=0;d<num_dims;d++) {
+      const scalar_t lo = get_coord(worldBounds.lower,d);
+      const scalar_t hi = get_coord(worldBounds.upper,d);
+      const scalar_t width = hi - lo;
+      set_coord(bounds.lower,d,
+                entry.lower[d] == 0
+                ? lo : scalar_t(lo + width*(entry.lower[d]*(1.f/65535.f))));
+      set_coord(bounds.upper,d,
+                entry.upper[d] == 65535
+                ? hi : scalar_t(lo + width*(entry.upper[d]*(1.f/65535.f))));
+    }
+    return true;
+  }
+
+  /*! number of table entries (ie, nodes in the top levels of the
+      tree) that fit within the given config */
+  template<typename table_t>
+  inline int numSubtreeBoundsEntries(int numPoints,
+                                     const SubtreeBoundsConfig &config)
+  {
+    if (numPoints < 1) return 0;
+    const int numLevels
+      = std::min(config.maxLevels,BinaryTree::levelOf(numPoints-1)+1);
+    size_t numEntries = std::min(size_t(numPoints),(size_t(1)<<numLevels)-1);
+    const size_t maxEntries = config.maxBytes / sizeof(typename table_t::Entry);
+    if (numEntries > maxEntries) {
+      // if the budget cuts off part of the tree, only store as many
+      // full levels (2^k-1 nodes) as fit into it
+      numEntries = 0;
+      while (2*numEntries+1 <= maxEntries)
+        numEntries = 2*numEntries+1;
+    }
+    return (int)numEntries;
+  }
+
+  template<typename data_t,
+           typename data_traits>
+  __global__
+  void growSubtreeBounds(box_t<typename data_traits::point_t> *d_bounds,
+                         int numEntries,
+                         const data_t *d_points,
+                         int numPoints)
+  {
+    using point_t      = typename data_traits::point_t;
+    using point_traits = ::cukd::point_traits<point_t>;
+    enum { num_dims = point_traits::num_dims };
+
+    const int tid = threadIdx.x+blockIdx.x*blockDim.x;
+    if (tid >= numPoints) return;
+
+    const point_t point = data_traits::get_point(d_points[tid]);
+    // every point only grows the bounds of its closest ancestor that
+    // is in the table (for points in the table, that's its own
+    // node); foldSubtreeBoundsOfLevel() then does the rest
+    int nodeID = tid;
+    while (nodeID >= numEntries)
+      nodeID = BinaryTree::parentOf(nodeID);
+    for (int d=0;d<num_dims;d++) {
+      atomicMin(&point_traits::get_coord(d_bounds[nodeID].lower,d),
+                point_traits::get_coord(point,d));
+      atomicMax(&point_traits::get_coord(d_bounds[nodeID].upper,d),
+                point_traits::get_coord(point,d));
+    }
+  }
+
+  /*! grows the bounds of all table nodes on the given level by those
+      of their children - which, with one launch per level, bottom
+      up, are final by then */
+  template<typename point_t>
+  __global__
+  void foldSubtreeBoundsOfLevel(box_t<point_t> *d_bounds,
+                                int numEntries,
+                                int level)
+  {
+    const int nodeID = ((1<<level)-1) + threadIdx.x+blockIdx.x*blockDim.x;
+    if (nodeID >= min(numEntries,(2<<level)-1)) return;
+    box_t<point_t> &bounds = d_bounds[nodeID];
+    for (int child=BinaryTree::leftChildOf(nodeID), i=0; i<2; child++, i++) {
+      if (child >= numEntries) break;
+      bounds.lower = min(bounds.lower,d_bounds[child].lower);
+      bounds.upper = max(bounds.upper,d_bounds[child].upper);
+    }
+  }
+
+  template<typename table_t, typename point_t>
+  __global__
+  void encodeSubtreeBounds(table_t table,
+                           const box_t<point_t> *d_bounds)
+  {
+    const int tid = threadIdx.x+blockIdx.x*blockDim.x;
+    if (tid >= table.numEntries) return;
+    table.entries[tid] = table_t::encode(d_bounds[tid],d_bounds[0]);
+  }
+
+  template<typename point_t>
+  __global__
+  void setEmpty(box_t<point_t> *d_bounds, int numBoxes)
+  {
+    const int tid = threadIdx.x+blockIdx.x*blockDim.x;
+    if (tid >= numBoxes) return;
+    d_bounds[tid].setEmpty();
+  }
+
+  template<typename table_t,
+           typename data_t,
+           typename data_traits>
+  void buildSubtreeBounds(table_t &table,
+                          const data_t *d_points,
+                          int numPoints,
+                          SubtreeBoundsConfig config,
+                          cudaStream_t stream,
+                          GpuMemoryResource &memResource)
+  {
+    using point_t = typename data_traits::point_t;
+    using box_t   = cukd::box_t<point_t>;
+
+    table.numEntries = numSubtreeBoundsEntries<table_t>(numPoints,config);
+    table.entries    = nullptr;
+    table.worldBounds.setEmpty();
+    if (table.numEntries == 0) return;
+
+    box_t *d_bounds = 0;
+    memResource.malloc((void**)&d_bounds,table.numEntries*sizeof(box_t),stream);
+    memResource.malloc((void**)&table.entries,
+                       table.numEntries*sizeof(typename table_t::Entry),stream);
+
+    setEmpty<<<divRoundUp(table.numEntries,128),128,0,stream>>>
+      (d_bounds,table.numEntries);
+    growSubtreeBounds<data_t,data_traits>
+      <<<divRoundUp(numPoints,128),128,0,stream>>>
+      (d_bounds,table.numEntries,d_points,numPoints);
+    for (int level=BinaryTree::levelOf(table.numEntries-1);level>=0;--level)
+      foldSubtreeBoundsOfLevel<point_t>
+        <<<divRoundUp(1<<level,128),128,0,stream>>>
+        (d_bounds,table.numEntries,level);
+    encodeSubtreeBounds<<<divRoundUp(table.numEntries,128),128,0,stream>>>
+      (table,d_bounds);
+    // the root's (tight) bounds are the bounds of all points
+    CUKD_CUDA_CALL(MemcpyAsync(&table.worldBounds,d_bounds,sizeof(box_t),
+                               cudaMemcpyDefault,stream));
+    CUKD_CUDA_CALL(StreamSynchronize(stream));
+    memResource.free(d_bounds,stream);
+  }
+
+  template<typename table_t>
+  void freeSubtreeBounds(table_t &table,
+                         cudaStream_t stream,
+                         GpuMemoryResource &memResource)
+  {
+    if (table.entries)
+      memResource.free(table.entries,stream);
+    table.entries    = nullptr;
+    table.numEntries = 0;
+  }
+
+  template<typename point_t>
+  void free(SubtreeBoundsTable<point_t> &table,
+            cudaStream_t stream,
+            GpuMemoryResource &memResource)
+  { freeSubtreeBounds(table,stream,memResource); }
+
+  template<typename point_t>
+  void free(QuantizedSubtreeBoundsTable<point_t> &table,
+            cudaStream_t stream,
+            GpuMemoryResource &memResource)
+  { freeSubtreeBounds(table,stream,memResource); }
+
+  template<typename table_t,
+           typename data_t,
+           typename data_traits>
+  void buildSubtreeBounds_host(table_t &table,
+                               const data_t *points,
+                               int numPoints,
+                               SubtreeBoundsConfig config)
+  {
+    using point_t = typename data_traits::point_t;
+    using box_t   = cukd::box_t<point_t>;
+
+    table.numEntries = numSubtreeBoundsEntries<table_t>(numPoints,config);
+    table.entries    = nullptr;
+    table.worldBounds.setEmpty();
+    if (table.numEntries == 0) return;
+
+    // only keep boxes for the nodes that are in the table (not one
+    // per point): each point grows the box of its closest ancestor
+    // that is in the table (for points in the table, that's its own
+    // node) ...
+    std::vector<box_t> bounds(table.numEntries);
+    for (auto &box : bounds) box.setEmpty();
+    for (int pointID=0;pointID<numPoints;pointID++) {
+      int nodeID = pointID;
+      while (nodeID >= table.numEntries)
+        nodeID = BinaryTree::parentOf(nodeID);
+      bounds[nodeID].grow(data_traits::get_point(points[pointID]));
+    }
+    // ... and then each node's box gets grown by its children's ones;
+    // children always have larger IDs than their parents, so going
+    // backwards does all children before their parents
+    for (int nodeID=table.numEntries-1;nodeID>0;--nodeID) {
+      box_t &parent = bounds[BinaryTree::parentOf(nodeID)];
+      parent.lower = min(parent.lower,bounds[nodeID].lower);
+      parent.upper = max(parent.upper,bounds[nodeID].upper);
+    }
+
+    table.worldBounds = bounds[0];
+    table.entries = new typename table_t::Entry[table.numEntries];
+    for (int i=0;i<table.numEntries;i++)
+      table.entries[i] = table_t::encode(bounds[i],bounds[0]);
+  }
+
+  template<typename table_t>
+  void freeSubtreeBounds_host(table_t &table)
+  {
+    delete[] table.entries;
+    table.entries    = nullptr;
+    table.numEntries = 0;
+  }
+
+  template<typename point_t>
+  void free_host(SubtreeBoundsTable<point_t> &table)
+  { freeSubtreeBounds_host(table); }
+
+  template<typename point_t>
+  void free_host(QuantizedSubtreeBoundsTable<point_t> &table)
+  { freeSubtreeBounds_host(table); }
+
+} // ::cukd
@@ -0,0 +1,163 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "cukd/helpers.h"
+
+namespace cukd {
+
+  /*! fixed-capacity min-priority queue of (lower-bound distance,
+      subtree) pairs, for the best-bin-first traversal below. If a
+      push finds the queue full, the entry with the largest distance
+      gets dropped (which may be the new one) */
+  template<int capacity>
+  struct BranchQueue {
+    struct Entry {
+      float dist2;
+      int   nodeID;
+    };
+
+    inline __both__ bool empty() const { return size == 0; }
+
+    /*! smallest distance in the queue; only valid if not empty */
+    inline __both__ float minDist2() const { return entry[0].dist2; }
+
+    inline __both__ void push(float dist2, int nodeID)
+    {
+      int pos;
+      if (size < capacity) {
+        pos = size++;
+      } else {
+        // full: the largest entry has to be one of the leaves
+        pos = capacity/2;
+        for (int i=capacity/2+1;i<capacity;i++)
+          if (entry[i].dist2 > entry[pos].dist2) pos = i;
+        if (dist2 >= entry[pos].dist2) return;
+      }
+      while (pos > 0) {
+        const int parent = (pos-1)/2;
+        if (entry[parent].dist2 <= dist2) break;
+        entry[pos] = entry[parent];
+        pos = parent;
+      }
+      entry[pos] = { dist2, nodeID };
+    }
+
+    inline __both__ Entry pop()
+    {
+      const Entry top  = entry[0];
+      const Entry last = entry[--size];
+      int pos = 0;
+      while (true) {
+        int child = 2*pos+1;
+        if (child >= size) break;
+        if (child+1 < size && entry[child+1].dist2 < entry[child].dist2)
+          child++;
+        if (last.dist2 <= entry[child].dist2) break;
+        entry[pos] = entry[child];
+        pos = child;
+      }
+      entry[pos] = last;
+      return top;
+    }
+
+    Entry entry[capacity];
+    int   size = 0;
+  };
+
+  /*! best-bin-first (bbf) traversal: rather than going depth-first
+      like the other traversals, this keeps a priority queue of all
+      not-yet-visited subtrees, keyed by a lower bound of their
+      distance to the query, and always continues with the closest
+      one. Each such subtree gets traversed by descending to a leaf
+      (along the way pushing the far side of each split into the
+      queue).
+
+      params.far_node_inspect_budget limits the number of subtrees
+      that get taken from the queue after the initial descent (0 =
+      only follow the close side all the way down), and
+      params.eps only visits subtrees whose lower bound D satisfies
+      (1+eps)*D < current cull radius. With an unlimited budget and
+      eps=0 this is an exact search - unless more than queue_size
+      subtrees are pending at the same time, in which case the
+      farthest ones get dropped. For high-dimensional data a small
+      budget returns most of the true nearest neighbors for a fraction
+      of the cost of an exact search */
+  template<typename result_t,
+           typename data_t,
+           typename data_traits=default_data_traits<data_t>,
+           int queue_size=64>
+  inline __both__
+  void traverse_bbf(result_t &result,
+                    typename data_traits::point_t queryPoint,
+                    const data_t *d_nodes,
+                    int numPoints,
+                    const FcpSearchParams &params)
+  {
+    using point_t  = typename data_traits::point_t;
+    enum { num_dims = num_dims_of<point_t>::value };
+
+    if (numPoints < 1) return;
+
+    float cullDist = result.initialCullDist2();
+    const float epsScale = sqr(1.f+params.eps);
+
+    BranchQueue<queue_size> queue;
+    queue.push(0.f,0);
+    int budget = params.far_node_inspect_budget;
+    bool initialDescent = true;
+    while (!queue.empty()) {
+      if (queue.minDist2()*epsScale >= cullDist)
+        // everything in the queue is at least that far away
+        break;
+      if (!initialDescent && budget-- <= 0)
+        break;
+      initialDescent = false;
+
+      const auto branch = queue.pop();
+      int curr = branch.nodeID;
+      while (curr < numPoints) {
+        const int  curr_dim
+          = data_traits::has_explicit_dim
+          ? data_traits::get_dim(d_nodes[curr])
+          : (BinaryTree::levelOf(curr) % num_dims);
+        CUKD_DEVICE_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
+        const data_t &curr_node  = d_nodes[curr];
+        const auto sqrDist = sqrDistanceUpTo(data_traits::get_point(curr_node),
+                                             queryPoint,cullDist);
+        cullDist = result.processCandidate(curr,sqrDist);
+
+        const auto node_coord   = data_traits::get_coord(curr_node,curr_dim);
+        const auto query_coord  = get_coord(queryPoint,curr_dim);
+        const bool  leftIsClose = query_coord < node_coord;
+        const int   lChild = 2*curr+1;
+        const int   rChild = lChild+1;
+
+        const int closeChild = leftIsClose?lChild:rChild;
+        const int farChild   = leftIsClose?rChild:lChild;
+
+        // lower bound for far side: can't be closer than the plane,
+        // nor than the subtree we're in
+        const float farDist2 = max(branch.dist2,(float)sqr(query_coord - node_coord));
+        if (farChild < numPoints && farDist2*epsScale < cullDist)
+          queue.push(farDist2,farChild);
+        curr = closeChild;
+      }
+    }
+  }
+
+}
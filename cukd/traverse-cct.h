@@ -20,24 +20,32 @@
    only to the 1-dimensoinal plane */
 #pragma once
 
+#include "cukd/subtree-bounds.h"
+
 namespace cukd {
   
+  /*! if a subtree bounds table is given, the closest corner of each
+      subtree that is in that table gets computed from its (tight)
+      bounds rather than from the split planes */
   template<typename result_t,
            typename data_t,
-           typename data_traits=default_data_traits<data_t>>
-  inline __device__
+           typename data_traits=default_data_traits<data_t>,
+           typename bounds_table_t=NoSubtreeBounds>
+  inline __both__
   void traverse_cct(result_t &result,
                     typename data_traits::point_t queryPoint,
                     const box_t<typename data_traits::point_t> d_bounds,
                     const data_t *d_nodes,
-                    int numPoints)
+                    int numPoints,
+                    const bounds_table_t &subtreeBounds = bounds_table_t())
   {
     using point_t    = typename data_traits::point_t;
     using point_traits = ::cukd::point_traits<point_t>;
     using scalar_t   = typename point_traits::scalar_t;
+    using dist2_t    = typename dist2_type_of<scalar_t>::type;
     enum { num_dims  = point_traits::num_dims };
       
-    scalar_t cullDist = result.initialCullDist2();
+    dist2_t cullDist = result.initialCullDist2();
 
     struct
       StackEntry {
@@ -49,7 +57,9 @@ namespace cukd {
     StackEntry *stackPtr = stackBase;
 
     int nodeID = 0;
-    point_t closestPointOnSubtreeBounds = project(d_bounds,queryPoint);
+    box_t<point_t> stored;
+    point_t closestPointOnSubtreeBounds
+      = project(subtreeBounds.get(0,stored) ? stored : d_bounds,queryPoint);
     if (sqrDistance(queryPoint,closestPointOnSubtreeBounds) > cullDist)
       return;
 
@@ -68,10 +78,10 @@ namespace cukd {
         }
       }
       const auto &node  = d_nodes[nodeID];
-      CUKD_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
+      CUKD_DEVICE_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
       const point_t nodePoint = data_traits::get_point(node);
       {
-        const auto sqrDist = sqrDistance(nodePoint,queryPoint);
+        const auto sqrDist = sqrDistanceUpTo(nodePoint,queryPoint,cullDist);
         cullDist = result.processCandidate(nodeID,sqrDist);
       }
       
@@ -88,6 +98,8 @@ namespace cukd {
       auto farSideCorner = closestPointOnSubtreeBounds;
       const int farChild = leftIsClose?rChild:lChild;
       point_traits::set_coord(farSideCorner,dim,node_dim);
+      if (subtreeBounds.get(farChild,stored))
+        farSideCorner = project(stored,queryPoint);
       if (farChild < numPoints && sqrDistance(farSideCorner,queryPoint) < cullDist) {
         stackPtr->closestCorner = farSideCorner;
         stackPtr->nodeID = farChild;
@@ -95,6 +107,13 @@ namespace cukd {
       }
 
       nodeID = leftIsClose?lChild:rChild;
+      if (subtreeBounds.get(nodeID,stored)) {
+        closestPointOnSubtreeBounds = project(stored,queryPoint);
+        if (sqrDistance(closestPointOnSubtreeBounds,queryPoint) >= cullDist)
+          // close child's points are all out of range: skip it, by
+          // going straight to the stack
+          nodeID = numPoints;
+      }
     }
   }
 
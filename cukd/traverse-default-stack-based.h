@@ -20,21 +20,32 @@
 
 namespace cukd {
 
-  /*! traverse k-d tree with default, stack-based (sb) traversal */
+  /*! subtree filter that never rejects any subtree; see
+      traverse_default() */
+  struct AcceptAllSubtrees {
+    inline __both__ bool accepts(int nodeID) const { return true; }
+  };
+
+  /*! traverse k-d tree with default, stack-based (sb) traversal;
+      subtrees for which subtreeFilter.accepts(nodeID) returns false
+      get skipped entirely (see, e.g., LabelMaskFilter) */
   template<typename result_t,
            typename data_t,
-           typename data_traits=default_data_traits<data_t>>
-  inline __device__
+           typename data_traits=default_data_traits<data_t>,
+           typename subtree_filter_t=AcceptAllSubtrees>
+  inline __both__
   void traverse_default(result_t &result,
                         typename data_traits::point_t queryPoint,
                         const data_t *d_nodes,
-                        int numPoints)
+                        int numPoints,
+                        const subtree_filter_t &subtreeFilter = subtree_filter_t())
   {
     using point_t  = typename data_traits::point_t;
     using scalar_t = typename scalar_type_of<point_t>::type;
+    using dist2_t  = typename dist2_type_of<scalar_t>::type;
     enum { num_dims = num_dims_of<point_t>::value };
     
-    scalar_t cullDist = result.initialCullDist2();
+    dist2_t cullDist = result.initialCullDist2();
 
     bool dbg = 0; //threadIdx.x==0 && blockIdx.x == 0;
     
@@ -46,8 +57,8 @@ namespace cukd {
     
     /* can do at most 2**30 points... */
     struct StackEntry {
-      int   nodeID;
-      float sqrDist;
+      int     nodeID;
+      dist2_t sqrDist;
     };
     StackEntry stackBase[30];
     StackEntry *stackPtr = stackBase;
@@ -56,15 +67,15 @@ namespace cukd {
     int curr = 0;
     
     while (true) {
-      while (curr < numPoints) {
+      while (curr < numPoints && subtreeFilter.accepts(curr)) {
         const int  curr_dim
           = data_traits::has_explicit_dim
           ? data_traits::get_dim(d_nodes[curr])
           : (BinaryTree::levelOf(curr) % num_dims);
-        CUKD_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
+        CUKD_DEVICE_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
         const data_t &curr_node  = d_nodes[curr];
-        const auto sqrDist = sqrDistance(data_traits::get_point(curr_node),
-                                         queryPoint);
+        const auto sqrDist = sqrDistanceUpTo(data_traits::get_point(curr_node),
+                                             queryPoint,cullDist);
         if (dbg) printf("=== %i dim %i sqrDist %f\n",curr,curr_dim,sqrDist);
         
         cullDist = result.processCandidate(curr,sqrDist);
@@ -84,7 +95,7 @@ namespace cukd {
         const int closeChild = leftIsClose?lChild:rChild;
         const int farChild   = leftIsClose?rChild:lChild;
         
-        const float sqrDistToPlane = sqr(query_coord - node_coord);
+        const dist2_t sqrDistToPlane = sqr(query_coord - node_coord);
         if (dbg) printf("sqrDist %f cullDist %f\n",
                         sqrDistToPlane,cullDist);    
         if (sqrDistToPlane < cullDist && farChild < numPoints) {
@@ -0,0 +1,122 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "cukd/helpers.h"
+
+namespace cukd {
+
+  /*! mixed-precision variant of the default stack-based traversal,
+      for trees over double-precision points: coordinates get
+      subtracted from the query in double (so there's no cancellation
+      even for points far away from the origin), but all culling
+      tests - both point distances and distances to split planes - are
+      then done in float on those query-relative offsets. Only nodes
+      that pass the (slightly conservative) float test get their
+      exact distance re-computed in double, and it is only these
+      exact distances that ever get passed to the result. */
+  template<typename result_t,
+           typename data_t,
+           typename data_traits=default_data_traits<data_t>>
+  inline __both__
+  void traverse_mixed(result_t &result,
+                      typename data_traits::point_t queryPoint,
+                      const data_t *d_nodes,
+                      int numPoints)
+  {
+    using point_t  = typename data_traits::point_t;
+    using scalar_t = typename scalar_type_of<point_t>::type;
+    enum { num_dims = num_dims_of<point_t>::value };
+
+    /* float distances of the offsets are accurate to a few ulps, so
+       shrink them by a bit more than that before comparing to the
+       cull distance, so we never cull anything we shouldn't */
+    const float shrink = 1.f - 1e-5f;
+
+    double cullDist  = result.initialCullDist2();
+    float  cullDistF = (float)cullDist;
+
+    /* can do at most 2**30 points... */
+    struct StackEntry {
+      int   nodeID;
+      float sqrDist;
+    };
+    StackEntry stackBase[30];
+    StackEntry *stackPtr = stackBase;
+
+    /*! current node in the tree we're traversing */
+    int curr = 0;
+
+    while (true) {
+      while (curr < numPoints) {
+        const int  curr_dim
+          = data_traits::has_explicit_dim
+          ? data_traits::get_dim(d_nodes[curr])
+          : (BinaryTree::levelOf(curr) % num_dims);
+        CUKD_DEVICE_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
+        const data_t &curr_node  = d_nodes[curr];
+        const point_t &curr_point = data_traits::get_point(curr_node);
+
+        float offset[num_dims];
+        float sqrDistF = 0.f;
+#pragma unroll
+        for (int d=0;d<num_dims;d++) {
+          offset[d] = (float)(get_coord(curr_point,d) - get_coord(queryPoint,d));
+          sqrDistF += offset[d]*offset[d];
+        }
+        if (sqrDistF * shrink < cullDistF) {
+          // refine: exact distance, in double
+          double sqrDist = 0.;
+#pragma unroll
+          for (int d=0;d<num_dims;d++)
+            sqrDist += sqr(double(get_coord(curr_point,d))
+                           -double(get_coord(queryPoint,d)));
+          cullDist  = result.processCandidate(curr,sqrDist);
+          cullDistF = (float)cullDist;
+        }
+
+        const scalar_t node_coord   = data_traits::get_coord(curr_node,curr_dim);
+        const scalar_t query_coord  = get_coord(queryPoint,curr_dim);
+        const bool  leftIsClose = query_coord < node_coord;
+        const int   lChild = 2*curr+1;
+        const int   rChild = lChild+1;
+
+        const int closeChild = leftIsClose?lChild:rChild;
+        const int farChild   = leftIsClose?rChild:lChild;
+
+        const float sqrDistToPlane = sqr(offset[curr_dim]) * shrink;
+        if (sqrDistToPlane < cullDistF && farChild < numPoints) {
+          stackPtr->nodeID  = farChild;
+          stackPtr->sqrDist = sqrDistToPlane;
+          ++stackPtr;
+        }
+        curr = closeChild;
+      }
+
+      while (true) {
+        if (stackPtr == stackBase)
+          return;
+        --stackPtr;
+        if (stackPtr->sqrDist >= cullDistF)
+          continue;
+        curr = stackPtr->nodeID;
+        break;
+      }
+    }
+  }
+
+}
@@ -16,15 +16,23 @@
 
 #pragma once
 
+#include "cukd/subtree-bounds.h"
+
 namespace cukd {
 
+  /*! computes the bounds of the subtree under 'curr', by clipping
+      'bounds' with the split planes of all its ancestors - or, if
+      there is a subtree bounds table, only those up to the first
+      ancestor (or curr itself) that is in that table */
   template<typename data_t,
-           typename data_traits=default_data_traits<data_t>>
-  inline __device__
+           typename data_traits=default_data_traits<data_t>,
+           typename bounds_table_t=NoSubtreeBounds>
+  inline __both__
   box_t<typename data_traits::point_t>
   recomputeBounds(int curr,
                   box_t<typename data_traits::point_t> bounds,
-                  const data_t *d_nodes
+                  const data_t *d_nodes,
+                  const bounds_table_t &subtreeBounds = bounds_table_t()
                   )
   {
     using point_t  = typename data_traits::point_t;
@@ -32,16 +40,22 @@ namespace cukd {
     enum { num_dims = num_dims_of<point_t>::value };
     
     while (true) {
+      box_t<point_t> stored;
+      if (subtreeBounds.get(curr,stored)) {
+        bounds.lower = max(bounds.lower,stored.lower);
+        bounds.upper = min(bounds.upper,stored.upper);
+        break;
+      }
       if (curr == 0) break;
       const int parent = (curr+1)/2-1;
 
       const auto &parent_node = d_nodes[parent];
-      CUKD_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
+      CUKD_DEVICE_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
       const int   parent_dim
         = data_traits::has_explicit_dim
         ? data_traits::get_dim(parent_node)
         : (BinaryTree::levelOf(parent) % num_dims);
-      const float parent_split_pos = data_traits::get_coord(parent_node,parent_dim);
+      const scalar_t parent_split_pos = data_traits::get_coord(parent_node,parent_dim);
       
       if (curr & 1) {
         // curr is left child, set upper
@@ -62,19 +76,24 @@ namespace cukd {
   
   template<typename result_t,
            typename data_t,
-           typename data_traits=default_data_traits<data_t>>
-  inline __device__
+           typename data_traits=default_data_traits<data_t>,
+           typename bounds_table_t=NoSubtreeBounds>
+  inline __both__
   void traverse_sf_imp(result_t &result,
                        typename data_traits::point_t queryPoint,
                        const box_t<typename data_traits::point_t> worldBounds,
                        const data_t *d_nodes,
-                       int numPoints)
+                       int numPoints,
+                       /*! optional table of subtree bounds, to make
+                           recomputeBounds() cheaper */
+                       const bounds_table_t &subtreeBounds = bounds_table_t())
   {
     using point_t  = typename data_traits::point_t;
     using scalar_t = typename scalar_type_of<point_t>::type;
+    using dist2_t  = typename dist2_type_of<scalar_t>::type;
     enum { num_dims = num_dims_of<point_t>::value };
 
-    float cullDist = result.initialCullDist2();
+    dist2_t cullDist = result.initialCullDist2();
     
     
     int prev = -1;
@@ -89,8 +108,8 @@ namespace cukd {
         // the root ... while means we're done.
         return;// closest_found_so_far;
 
-      bounds = recomputeBounds<data_t,data_traits>
-        (curr,worldBounds,d_nodes);
+      bounds = recomputeBounds<data_t,data_traits,bounds_table_t>
+        (curr,worldBounds,d_nodes,subtreeBounds);
       const int parent = (curr+1)/2-1;
       
       point_t closestPointOnSubtreeBounds = project(bounds,queryPoint);
@@ -113,13 +132,13 @@ namespace cukd {
 
         continue;
       }
-      CUKD_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
+      CUKD_DEVICE_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
       const auto &curr_node = d_nodes[curr];
       const int  child = 2*curr+1;
       const bool from_child = (prev >= child);
       if (!from_child) {
         const auto dist_sqr =
-          sqrDistance(queryPoint,data_traits::get_point(curr_node));
+          sqrDistanceUpTo(queryPoint,data_traits::get_point(curr_node),cullDist);
         cullDist = result.processCandidate(curr,dist_sqr);
       }
 
@@ -127,9 +146,9 @@ namespace cukd {
         = data_traits::has_explicit_dim
         ? data_traits::get_dim(d_nodes[curr])
         : (BinaryTree::levelOf(curr) % num_dims);
-      const float curr_split_pos = data_traits::get_coord(curr_node,curr_dim);
-      const float curr_dim_dist = get_coord(queryPoint,curr_dim) - curr_split_pos;
-      const int   curr_side = curr_dim_dist > 0.f;
+      const scalar_t curr_split_pos = data_traits::get_coord(curr_node,curr_dim);
+      const dist2_t curr_dim_dist = get_coord(queryPoint,curr_dim) - curr_split_pos;
+      const int   curr_side = curr_dim_dist > dist2_t(0);
       const int   curr_close_child = 2*curr + 1 + curr_side;
       const int   curr_far_child   = 2*curr + 2 - curr_side;
 
@@ -21,7 +21,7 @@ namespace cukd {
   template<typename result_t,
            typename data_t,
            typename data_traits=default_data_traits<data_t>>
-  inline __device__
+  inline __both__
   void traverse_stack_free(result_t &result,
                            typename data_traits::point_t queryPoint,
                            const data_t *d_nodes,
@@ -30,10 +30,11 @@ namespace cukd {
   {
     using point_t  = typename data_traits::point_t;
     using scalar_t = typename scalar_type_of<point_t>::type;
+    using dist2_t  = typename dist2_type_of<scalar_t>::type;
     enum { num_dims = num_dims_of<point_t>::value };
     const auto epsErr = 1 + eps;
 
-    scalar_t cullDist = result.initialCullDist2();
+    dist2_t cullDist = result.initialCullDist2();
     
     int prev = -1;
     int curr = 0;
@@ -52,13 +53,13 @@ namespace cukd {
 
         continue;
       }
-      CUKD_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
+      CUKD_DEVICE_STATS(if (cukd::g_traversalStats) ::atomicAdd(cukd::g_traversalStats,1));
       const auto &curr_node = d_nodes[curr];
       const int  child = 2*curr+1;
       const bool from_child = (prev >= child);
       if (!from_child) {
         const auto sqrDist =
-          sqrDistance(queryPoint,data_traits::get_point(curr_node));
+          sqrDistanceUpTo(queryPoint,data_traits::get_point(curr_node),cullDist);
         cullDist = result.processCandidate(curr,sqrDist);
       }
 
@@ -66,10 +67,10 @@ namespace cukd {
         = data_traits::has_explicit_dim
         ? data_traits::get_dim(d_nodes[curr])
         : (BinaryTree::levelOf(curr) % num_dims);
-      const float curr_dim_dist
+      const dist2_t curr_dim_dist
         = get_coord(queryPoint,curr_dim)
         - data_traits::get_coord(curr_node,curr_dim);
-      const int   curr_side = curr_dim_dist > 0.f;
+      const int   curr_side = curr_dim_dist > dist2_t(0);
       const int   curr_close_child = 2*curr + 1 + curr_side;
       const int   curr_far_child   = 2*curr + 2 - curr_side;
 
@@ -0,0 +1,140 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+/* checks that the work-stealing scheduler hands out every item
+   exactly once (for many thread counts, sizes, and very skewed
+   per-item costs), and that the batch fcp/knn/reduce queries built
+   on it return the same results as one-at-a-time queries, on
+   clustered data with queries both inside and far outside the
+   clusters */
+
+#include "cukd/builder_host.h"
+#include "cukd/batch.h"
+#include <random>
+#include <thread>
+#include <chrono>
+
+using namespace cukd;
+
+void testScheduler()
+{
+  for (int numThreads : { 1, 2, 3, 8, 33 })
+    for (int numItems : { 0, 1, 7, 100, 12345, 1000000 }) {
+      std::vector<std::atomic<int>> visits(numItems);
+      for (auto &v : visits) v = 0;
+      WorkStealingStats stats;
+      parallelFor_workStealing
+        (numItems,[&](int begin, int end) {
+          if (begin < 0 || begin >= end || end > numItems)
+            throw std::runtime_error("invalid chunk ["+std::to_string(begin)+","
+                                     +std::to_string(end)+")");
+          for (int i=begin;i<end;i++) {
+            visits[i]++;
+            // every 1000th item is _much_ more expensive
+            if (i % 1000 == 0)
+              std::this_thread::sleep_for(std::chrono::microseconds(50));
+          }
+        },numThreads,&stats,4);
+      for (int i=0;i<numItems;i++)
+        if (visits[i] != 1)
+          throw std::runtime_error("item "+std::to_string(i)+" visited "
+                                   +std::to_string(visits[i])+" times with "
+                                   +std::to_string(numThreads)+" threads");
+      if (numItems > 0)
+        if (stats.numChunks == 0)
+          throw std::runtime_error("no chunks counted");
+    }
+  std::cout << "work-stealing scheduler visits all items exactly once" << std::endl;
+}
+
+int main(int, const char **)
+{
+  testScheduler();
+  
+  // a few tight clusters, and queries half in the clusters, half
+  // all over (and far outside) the domain
+  const int numPoints = 200000;
+  const int numQueries = 4000;
+  const int k = 8;
+  const float radius = .01f;
+  std::mt19937 gen(0x1234);
+  std::uniform_real_distribution<float> uniform(0.f,1.f);
+  std::normal_distribution<float> gaussian(0.f,.001f);
+  std::vector<float3> centers(16);
+  for (auto &c : centers)
+    c = make_float3(uniform(gen),uniform(gen),uniform(gen));
+  std::vector<float3> points(numPoints);
+  for (int i=0;i<numPoints;i++) {
+    const float3 c = centers[i % centers.size()];
+    points[i] = make_float3(c.x+gaussian(gen),c.y+gaussian(gen),c.z+gaussian(gen));
+  }
+  buildTree_host(points.data(),numPoints);
+  std::vector<float3> queries(numQueries);
+  for (int q=0;q<numQueries;q++) {
+    const float3 c = centers[q % centers.size()];
+    queries[q]
+      = (q % 2)
+      ? make_float3(c.x+gaussian(gen),c.y+gaussian(gen),c.z+gaussian(gen))
+      : make_float3(4.f*uniform(gen)-2.f,4.f*uniform(gen)-2.f,4.f*uniform(gen)-2.f);
+  }
+
+  for (int numThreads : { 1, 4, 16 }) {
+    const std::string threads = " ("+std::to_string(numThreads)+" threads)";
+    std::vector<int> closest(numQueries);
+    batch::fcp_host<float3>(queries.data(),numQueries,closest.data(),
+                            points.data(),numPoints,FcpSearchParams{},numThreads);
+    for (int q=0;q<numQueries;q++)
+      if (closest[q] != stackBased::fcp<float3>(queries[q],points.data(),numPoints))
+        throw std::runtime_error("batch fcp differs"+threads);
+
+    std::vector<int>   knnIDs(size_t(numQueries)*k);
+    std::vector<float> knnDist2(size_t(numQueries)*k);
+    PooledHostMemoryResource pool;
+    batch::knn_host<float3>(queries.data(),numQueries,k,INFINITY,
+                            knnIDs.data(),knnDist2.data(),
+                            points.data(),numPoints,numThreads,
+                            nullptr,pool);
+    // one candidate list per thread, not per chunk
+    const PooledHostMemoryResource::Stats stats = pool.stats();
+    if (stats.numSystemAllocs == 0 || stats.numSystemAllocs > size_t(numThreads)
+        || stats.bytesInUse != 0)
+      throw std::runtime_error("batch knn candidate lists not allocated once per thread"+threads);
+    HostCandidateList candidates(k,INFINITY);
+    for (int q=0;q<numQueries;q++) {
+      candidates.clear(INFINITY);
+      stackBased::knn<HostCandidateList,float3>(candidates,queries[q],
+                                                points.data(),numPoints);
+      for (int i=0;i<k;i++)
+        if (knnIDs[size_t(q)*k+i] != candidates.get_pointID(i) ||
+            knnDist2[size_t(q)*k+i] != candidates.get_dist2(i))
+          throw std::runtime_error("batch knn differs"+threads);
+    }
+
+    std::vector<CountReducer> counts(numQueries);
+    batch::reduce_host<CountReducer,float3>(counts.data(),queries.data(),numQueries,
+                                            radius,points.data(),numPoints,numThreads);
+    for (int q=0;q<numQueries;q++) {
+      CountReducer count;
+      stackBased::reduce<CountReducer,float3>(count,queries[q],radius,
+                                              points.data(),numPoints);
+      if (counts[q].count != count.count)
+        throw std::runtime_error("batch reduce differs"+threads);
+    }
+  }
+  std::cout << "batch fcp/knn/reduce match one-at-a-time queries" << std::endl;
+  return 0;
+}
@@ -0,0 +1,102 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* checks that best-bin-first fcp and knn queries are exact with
+   default search params, and return valid (if approximate) results
+   when given a budget */
+
+#include "cukd/builder_host.h"
+#include "cukd/knn.h"
+#include <random>
+
+using namespace cukd;
+
+const int numPoints  = 20000;
+const int numQueries = 500;
+const int k = 8;
+
+template<typename point_t>
+void test(const std::string &description,
+          const std::vector<point_t> &input,
+          const std::vector<point_t> &queries)
+{
+  std::cout << "testing best-bin-first queries, " << description << std::endl;
+  std::vector<point_t> points = input;
+  buildTree_host(points.data(),numPoints);
+
+  std::vector<float> dists(numPoints);
+  int numFound[2] = { 0, 0 };
+  for (int q=0;q<numQueries;q++) {
+    const point_t query = queries[q];
+    for (int i=0;i<numPoints;i++)
+      dists[i] = sqrDistance(points[i],query);
+    std::vector<float> sorted = dists;
+    std::sort(sorted.begin(),sorted.end());
+
+    // exact, with default params
+    int closest = bbf::fcp(query,points.data(),numPoints);
+    if (closest < 0 || dists[closest] != sorted[0])
+      throw std::runtime_error("bbf fcp did not find closest point");
+    FixedCandidateList<k> exact(INFINITY);
+    bbf::knn(exact,query,points.data(),numPoints);
+    for (int i=0;i<k;i++)
+      if (exact.get_dist2(i) != sorted[i])
+        throw std::runtime_error("bbf knn returned wrong distance");
+
+    // approximate, with budget
+    for (int budget : { 0, 8 }) {
+      FcpSearchParams params;
+      params.far_node_inspect_budget = budget;
+      FixedCandidateList<k> approx(INFINITY);
+      bbf::knn(approx,query,points.data(),numPoints,params);
+      for (int i=0;i<k;i++) {
+        const int id = approx.get_pointID(i);
+        if (id < 0 || dists[id] != approx.get_dist2(i))
+          throw std::runtime_error("bbf knn with budget returned invalid result");
+        numFound[budget?1:0] += (approx.get_dist2(i) <= sorted[k-1]);
+      }
+    }
+  }
+  std::cout << "  exact results match brute force; recall with budget 0: "
+            << (100.f*numFound[0]/(numQueries*k)) << "%, with budget 8: "
+            << (100.f*numFound[1]/(numQueries*k)) << "%" << std::endl;
+}
+
+int main(int, const char **)
+{
+  std::mt19937 gen(0x5eed);
+  std::uniform_real_distribution<float> uniform(0.f,100.f);
+  {
+    std::vector<float3> points(numPoints), queries(numQueries);
+    for (auto &p : points)  p = make_float3(uniform(gen),uniform(gen),uniform(gen));
+    for (auto &q : queries) q = make_float3(uniform(gen),uniform(gen),uniform(gen));
+    test("float3, uniform random",points,queries);
+  }
+  {
+    using point_t = vec_float<16>;
+    std::normal_distribution<float> noise(0.f,2.f);
+    std::vector<point_t> centers(100), points(numPoints), queries(numQueries);
+    for (auto &c : centers)
+      for (int d=0;d<16;d++) c.v[d] = uniform(gen);
+    for (auto *set : { &points, &queries })
+      for (auto &p : *set) {
+        p = centers[gen()%centers.size()];
+        for (int d=0;d<16;d++) p.v[d] += noise(gen);
+      }
+    test("vec_float<16>, clustered",points,queries);
+  }
+  return 0;
+}
@@ -0,0 +1,83 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* buildTree() with a temporary-memory budget: checks that it picks
+   the builder the budget allows, and that every choice produces the
+   same tree as the host builder */
+
+#include "cukd/builder.h"
+#include "cukd/builder_host.h"
+#include <random>
+#include <cstring>
+
+using namespace cukd;
+
+void testBudgets(int numPoints)
+{
+  std::mt19937 gen(numPoints);
+  std::uniform_real_distribution<float> uniform(0.f,1.f);
+  std::vector<float3> input(numPoints);
+  for (auto &p : input)
+    p = make_float3(uniform(gen),uniform(gen),uniform(gen));
+  std::vector<float3> reference = input;
+  buildTree_host(reference.data(),numPoints);
+
+  const size_t thrustBytes  = tempMemoryNeeded(BUILDER_THRUST,numPoints,sizeof(float3));
+  const size_t bitonicBytes = tempMemoryNeeded(BUILDER_BITONIC,numPoints,sizeof(float3));
+  if (bitonicBytes != numPoints*sizeof(uint32_t))
+    throw std::runtime_error("wrong temp memory estimate for bitonic builder");
+  if (thrustBytes <= bitonicBytes)
+    throw std::runtime_error("thrust builder estimated to need less temp memory than bitonic");
+  if (tempMemoryNeeded(BUILDER_INPLACE,numPoints,sizeof(float3)) != 0)
+    throw std::runtime_error("inPlace builder estimated to need temp memory");
+  
+  const std::pair<size_t,BuilderType> budgets[] = {
+    { size_t(-1),     BUILDER_THRUST  },
+    { thrustBytes,    BUILDER_THRUST  },
+    { thrustBytes-1,  BUILDER_BITONIC },
+    { bitonicBytes,   BUILDER_BITONIC },
+    { bitonicBytes-1, BUILDER_INPLACE },
+    { 0,              BUILDER_INPLACE },
+  };
+  
+  float3 *d_points = 0;
+  CUKD_CUDA_CALL(MallocManaged((void**)&d_points,numPoints*sizeof(float3)));
+  for (auto budget : budgets) {
+    if (chooseBuilder(numPoints,sizeof(float3),MemoryBudget{budget.first})
+        != budget.second)
+      throw std::runtime_error("wrong builder chosen for budget");
+    CUKD_CUDA_CALL(Memcpy(d_points,input.data(),numPoints*sizeof(float3),
+                          cudaMemcpyDefault));
+    BuilderType used = buildTree(d_points,numPoints,MemoryBudget{budget.first});
+    CUKD_CUDA_SYNC_CHECK();
+    if (used != budget.second)
+      throw std::runtime_error("budgeted build used a different builder than chosen");
+    if (memcmp(d_points,reference.data(),numPoints*sizeof(float3)) != 0)
+      throw std::runtime_error(std::string("tree built with ")+toString(used)
+                               +" builder differs");
+    std::cout << numPoints << " points, budget " << budget.first
+              << " bytes: " << toString(used) << " builder" << std::endl;
+  }
+  CUKD_CUDA_CALL(Free(d_points));
+}
+
+int main(int, const char **)
+{
+  testBudgets(1000);
+  testBudgets(100000);
+  std::cout << "all budgeted builds match the host builder" << std::endl;
+  return 0;
+}
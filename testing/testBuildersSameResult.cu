@@ -19,6 +19,8 @@
 #include "cukd/builder_thrust.h"
 #include "cukd/builder_bitonic.h"
 #include "cukd/builder_inplace.h"
+#include "cukd/builder_indirect.h"
+#include "cukd/builder_radix.h"
 #include <random>
 
 template<typename T, int D>
@@ -126,6 +128,57 @@ void test_pointOnly(int numPoints)
 
   size_t hash_host = computeHash((uint32_t*)data_host.data(),numPoints*sizeof(data_t));
   std::cout << "hash host:\t " << (int*)hash_host << std::endl;
+
+  // ------------------------------------------------------------------
+  // partition-based host builder for spatially sorted inputs; this
+  // one isn't any faster on random input, but has to produce the
+  // same tree for _any_ input order
+  // ------------------------------------------------------------------
+  cukd::HostBuildConfig presortedConfig;
+  presortedConfig.inputOrder = cukd::SPATIALLY_SORTED_INPUT;
+  data_host = inputData;
+  cukd::buildTree_host
+    (data_host.data(),numPoints,0,presortedConfig);
+
+  size_t hash_presorted = computeHash((uint32_t*)data_host.data(),numPoints*sizeof(data_t));
+  std::cout << "hash presorted:\t " << (int*)hash_presorted << std::endl;
+
+  // ------------------------------------------------------------------
+  // host port of the bitonic builder
+  // ------------------------------------------------------------------
+  data_host = inputData;
+  cukd::buildTree_bitonic_host
+    (data_host.data(),numPoints);
+
+  size_t hash_bitonicHost = computeHash((uint32_t*)data_host.data(),numPoints*sizeof(data_t));
+  std::cout << "hash bitonic host:\t " << (int*)hash_bitonicHost << std::endl;
+
+  // ------------------------------------------------------------------
+  // index-indirect host builder, in place and into separate output
+  // ------------------------------------------------------------------
+  data_host = inputData;
+  cukd::buildTree_indirect_host
+    (data_host.data(),numPoints);
+
+  size_t hash_indirect = computeHash((uint32_t*)data_host.data(),numPoints*sizeof(data_t));
+  std::cout << "hash indirect:\t " << (int*)hash_indirect << std::endl;
+
+  std::vector<data_t> indirectOutput(numPoints);
+  cukd::buildTree_indirect_host
+    (inputData.data(),indirectOutput.data(),numPoints);
+
+  size_t hash_indirectOutput = computeHash((uint32_t*)indirectOutput.data(),numPoints*sizeof(data_t));
+  std::cout << "hash indirect output:\t " << (int*)hash_indirectOutput << std::endl;
+
+  // ------------------------------------------------------------------
+  // radix-sort based host builder
+  // ------------------------------------------------------------------
+  data_host = inputData;
+  cukd::buildTree_radix_host
+    (data_host.data(),numPoints);
+
+  size_t hash_radix = computeHash((uint32_t*)data_host.data(),numPoints*sizeof(data_t));
+  std::cout << "hash radix:\t " << (int*)hash_radix << std::endl;
   
   // ------------------------------------------------------------------
   CUKD_CUDA_CALL(Memcpy(d_data,inputData.data(),numPoints*sizeof(data_t),cudaMemcpyDefault));
@@ -154,7 +207,12 @@ void test_pointOnly(int numPoints)
 
   if (hash_thrust  != hash_host ||
       hash_bitonic != hash_host ||
-      hash_inPlace  != hash_host)
+      hash_inPlace  != hash_host ||
+      hash_presorted != hash_host ||
+      hash_bitonicHost != hash_host ||
+      hash_indirect != hash_host ||
+      hash_indirectOutput != hash_host ||
+      hash_radix != hash_host)
     throw std::runtime_error("hashes do not match!");
 }
 
@@ -264,6 +322,62 @@ void test_withPayload(int numPoints)
   size_t hash_host = computeHash((uint32_t*)data_host.data(),numPoints*sizeof(data_t));
   std::cout << "hash host:\t " << (int*)hash_host << std::endl;
 
+  // ------------------------------------------------------------------
+  // partition-based host builder for spatially sorted inputs; this
+  // one isn't any faster on random input, but has to produce the
+  // same tree for _any_ input order
+  // ------------------------------------------------------------------
+  cukd::HostBuildConfig presortedConfig;
+  presortedConfig.inputOrder = cukd::SPATIALLY_SORTED_INPUT;
+  data_host = inputData;
+  cukd::buildTree_host
+    <PointWithPayload<T,D>,PointWithPayload_traits<T,D>>
+    (data_host.data(),numPoints,d_bounds,presortedConfig);
+
+  size_t hash_presorted = computeHash((uint32_t*)data_host.data(),numPoints*sizeof(data_t));
+  std::cout << "hash presorted:\t " << (int*)hash_presorted << std::endl;
+
+  // ------------------------------------------------------------------
+  // host port of the bitonic builder
+  // ------------------------------------------------------------------
+  data_host = inputData;
+  cukd::buildTree_bitonic_host
+    <PointWithPayload<T,D>,PointWithPayload_traits<T,D>>
+    (data_host.data(),numPoints,d_bounds);
+
+  size_t hash_bitonicHost = computeHash((uint32_t*)data_host.data(),numPoints*sizeof(data_t));
+  std::cout << "hash bitonic host:\t " << (int*)hash_bitonicHost << std::endl;
+
+  // ------------------------------------------------------------------
+  // index-indirect host builder, in place and into separate output
+  // ------------------------------------------------------------------
+  data_host = inputData;
+  cukd::buildTree_indirect_host
+    <PointWithPayload<T,D>,PointWithPayload_traits<T,D>>
+    (data_host.data(),numPoints,d_bounds);
+
+  size_t hash_indirect = computeHash((uint32_t*)data_host.data(),numPoints*sizeof(data_t));
+  std::cout << "hash indirect:\t " << (int*)hash_indirect << std::endl;
+
+  std::vector<data_t> indirectOutput(numPoints);
+  cukd::buildTree_indirect_host
+    <PointWithPayload<T,D>,PointWithPayload_traits<T,D>>
+    (inputData.data(),indirectOutput.data(),numPoints,d_bounds);
+
+  size_t hash_indirectOutput = computeHash((uint32_t*)indirectOutput.data(),numPoints*sizeof(data_t));
+  std::cout << "hash indirect output:\t " << (int*)hash_indirectOutput << std::endl;
+
+  // ------------------------------------------------------------------
+  // radix-sort based host builder
+  // ------------------------------------------------------------------
+  data_host = inputData;
+  cukd::buildTree_radix_host
+    <PointWithPayload<T,D>,PointWithPayload_traits<T,D>>
+    (data_host.data(),numPoints,d_bounds);
+
+  size_t hash_radix = computeHash((uint32_t*)data_host.data(),numPoints*sizeof(data_t));
+  std::cout << "hash radix:\t " << (int*)hash_radix << std::endl;
+
   // ------------------------------------------------------------------
   CUKD_CUDA_CALL(Memcpy(d_data,inputData.data(),numPoints*sizeof(data_t),cudaMemcpyDefault));
   cukd::buildTree_thrust
@@ -298,7 +412,12 @@ void test_withPayload(int numPoints)
 
   if (hash_thrust  != hash_host ||
       hash_bitonic != hash_host ||
-      hash_inPlace  != hash_host)
+      hash_inPlace  != hash_host ||
+      hash_presorted != hash_host ||
+      hash_bitonicHost != hash_host ||
+      hash_indirect != hash_host ||
+      hash_indirectOutput != hash_host ||
+      hash_radix != hash_host)
     throw std::runtime_error("hashes do not match!");
 
 
@@ -358,6 +477,77 @@ void test_withPayloadAndDim(int numPoints)
   size_t hash_host = computeHash((uint32_t*)data_host.data(),numPoints*sizeof(data_t));
   std::cout << "hash host:\t " << (int*)hash_host << std::endl;
 
+  // ------------------------------------------------------------------
+  // partition-based host builder for spatially sorted inputs; this
+  // one isn't any faster on random input, but has to produce the
+  // same tree for _any_ input order
+  // ------------------------------------------------------------------
+  cukd::HostBuildConfig presortedConfig;
+  presortedConfig.inputOrder = cukd::SPATIALLY_SORTED_INPUT;
+  data_host = inputData;
+  cukd::buildTree_host
+    <PointWithPayloadAndDim<T,D>,PointWithPayloadAndDim_traits<T,D>>
+    (data_host.data(),numPoints,d_bounds,presortedConfig);
+
+  size_t hash_presorted = computeHash((uint32_t*)data_host.data(),numPoints*sizeof(data_t));
+  std::cout << "hash presorted:\t " << (int*)hash_presorted << std::endl;
+
+  // ------------------------------------------------------------------
+  // host port of the bitonic builder
+  // ------------------------------------------------------------------
+  data_host = inputData;
+  cukd::buildTree_bitonic_host
+    <PointWithPayloadAndDim<T,D>,PointWithPayloadAndDim_traits<T,D>>
+    (data_host.data(),numPoints,d_bounds);
+
+  size_t hash_bitonicHost = computeHash((uint32_t*)data_host.data(),numPoints*sizeof(data_t));
+  std::cout << "hash bitonic host:\t " << (int*)hash_bitonicHost << std::endl;
+
+  // ------------------------------------------------------------------
+  // index-indirect host builder, in place and into separate output
+  // ------------------------------------------------------------------
+  data_host = inputData;
+  cukd::buildTree_indirect_host
+    <PointWithPayloadAndDim<T,D>,PointWithPayloadAndDim_traits<T,D>>
+    (data_host.data(),numPoints,d_bounds);
+
+  size_t hash_indirect = computeHash((uint32_t*)data_host.data(),numPoints*sizeof(data_t));
+  std::cout << "hash indirect:\t " << (int*)hash_indirect << std::endl;
+
+  std::vector<data_t> indirectOutput(numPoints);
+  cukd::buildTree_indirect_host
+    <PointWithPayloadAndDim<T,D>,PointWithPayloadAndDim_traits<T,D>>
+    (inputData.data(),indirectOutput.data(),numPoints,d_bounds);
+
+  size_t hash_indirectOutput = computeHash((uint32_t*)indirectOutput.data(),numPoints*sizeof(data_t));
+  std::cout << "hash indirect output:\t " << (int*)hash_indirectOutput << std::endl;
+
+  // ------------------------------------------------------------------
+  // radix-sort based host builder
+  // ------------------------------------------------------------------
+  data_host = inputData;
+  cukd::buildTree_radix_host
+    <PointWithPayloadAndDim<T,D>,PointWithPayloadAndDim_traits<T,D>>
+    (data_host.data(),numPoints,d_bounds);
+
+  size_t hash_radix = computeHash((uint32_t*)data_host.data(),numPoints*sizeof(data_t));
+  std::cout << "hash radix:\t " << (int*)hash_radix << std::endl;
+
+  // ------------------------------------------------------------------
+  // host builder with caller-supplied world bounds (from the previous
+  // build, over the same points), which must not get recomputed
+  // ------------------------------------------------------------------
+  cukd::HostBuildConfig precomputedConfig;
+  precomputedConfig.inputOrder = cukd::UNSORTED_INPUT;
+  precomputedConfig.worldBoundsAreValid = true;
+  data_host = inputData;
+  cukd::buildTree_host
+    <PointWithPayloadAndDim<T,D>,PointWithPayloadAndDim_traits<T,D>>
+    (data_host.data(),numPoints,d_bounds,precomputedConfig);
+
+  size_t hash_precomputed = computeHash((uint32_t*)data_host.data(),numPoints*sizeof(data_t));
+  std::cout << "hash precomputed bounds:\t " << (int*)hash_precomputed << std::endl;
+
   // ------------------------------------------------------------------
   CUKD_CUDA_CALL(Memcpy(d_data,inputData.data(),numPoints*sizeof(data_t),cudaMemcpyDefault));
   cukd::buildTree_thrust
@@ -392,7 +582,13 @@ void test_withPayloadAndDim(int numPoints)
 
   if (hash_thrust  != hash_host ||
       hash_bitonic != hash_host ||
-      hash_inPlace  != hash_host)
+      hash_inPlace  != hash_host ||
+      hash_presorted != hash_host ||
+      hash_bitonicHost != hash_host ||
+      hash_indirect != hash_host ||
+      hash_indirectOutput != hash_host ||
+      hash_radix != hash_host ||
+      hash_precomputed != hash_host)
     throw std::runtime_error("hashes do not match!");
 
 
@@ -421,8 +617,24 @@ void testAll(int sizeToTest)
   testN<8>(sizeToTest);
 }
 
+/*! the radix builder's keys have to order coordinates exactly like
+    float comparisons do - including -0.f and +0.f being equal */
+void testRadixKeys()
+{
+  using cukd::radixSortBuilder::radixKeyOf;
+  const float sorted[] = { -INFINITY, -1.f, -1e-30f, -0.f, 0.f, 1e-30f, 1.f, INFINITY };
+  const int numValues = sizeof(sorted)/sizeof(sorted[0]);
+  for (int i=0;i<numValues;i++)
+    for (int j=0;j<numValues;j++)
+      if ((sorted[i] < sorted[j]) != (radixKeyOf(sorted[i]) < radixKeyOf(sorted[j])))
+        throw std::runtime_error("radix keys do not match float order for "
+                                 +std::to_string(sorted[i])+" vs "
+                                 +std::to_string(sorted[j]));
+}
+
 int main(int, const char **)
 {
+  testRadixKeys();
   std::vector<int> sizesToTest = { 4,10,1000,10000 };
   for (auto sizeToTest : sizesToTest)
     testAll(sizeToTest);
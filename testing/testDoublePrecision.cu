@@ -0,0 +1,107 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* builds trees over double-precision points far away from the origin
+   (where float coordinates could not even tell neighboring points
+   apart), and checks that fcp and knn queries - with the full-double
+   traversals as well as with the mixed-precision one - return the
+   same distances as a brute-force search in double */
+
+#include "cukd/builder_host.h"
+#include "cukd/knn.h"
+#include <random>
+
+using namespace cukd;
+
+const int numPoints  = 20000;
+const int numQueries = 1000;
+const int k = 8;
+
+template<typename point_t>
+double bruteForce_kthDist2(const std::vector<point_t> &points,
+                           point_t query, int kth)
+{
+  std::vector<double> dists(points.size());
+  for (size_t i=0;i<points.size();i++)
+    dists[i] = sqrDistance(points[i],query);
+  std::nth_element(dists.begin(),dists.begin()+kth,dists.end());
+  return dists[kth];
+}
+
+template<typename point_t>
+void test(const std::string &description,
+          point_t (*makePoint)(std::mt19937 &))
+{
+  std::cout << "testing double-precision queries, " << description << std::endl;
+
+  std::mt19937 gen(0x5eed);
+  std::vector<point_t> points(numPoints), queries(numQueries);
+  for (auto &p : points)  p = makePoint(gen);
+  for (auto &q : queries) q = makePoint(gen);
+  std::vector<point_t> input = points;
+
+  box_t<point_t> worldBounds;
+  buildTree_host(points.data(),numPoints,&worldBounds);
+
+  for (int q=0;q<numQueries;q++) {
+    const point_t query = queries[q];
+    const double closest = bruteForce_kthDist2(input,query,0);
+    
+    int sb  = stackBased::fcp(query,points.data(),numPoints);
+    int sf  = stackFree::fcp(query,points.data(),numPoints);
+    int cct = cct::fcp(query,worldBounds,points.data(),numPoints);
+    int mx  = mixed::fcp(query,points.data(),numPoints);
+    for (int found : { sb, sf, cct, mx })
+      if (found < 0 || sqrDistance(points[found],query) != closest)
+        throw std::runtime_error("double fcp did not find closest point, query "
+                                 +std::to_string(q));
+
+    // candidate lists store float distances, so compare to the
+    // float-rounded brute-force results
+    FixedCandidateList<k> sbList(INFINITY), mxList(INFINITY);
+    stackBased::knn(sbList,query,points.data(),numPoints);
+    mixed::knn(mxList,query,points.data(),numPoints);
+    for (int i=0;i<k;i++) {
+      const float expected = (float)bruteForce_kthDist2(input,query,i);
+      if (sbList.get_dist2(i) != expected || mxList.get_dist2(i) != expected)
+        throw std::runtime_error("double knn returned wrong distance, query "
+                                 +std::to_string(q));
+    }
+  }
+  std::cout << "  all results match brute force" << std::endl;
+}
+
+/*! points in a 100m cube, a earth radius away from the origin - at
+    that magnitude, float spacing is half a meter */
+double3 makeFarAwayPoint(std::mt19937 &gen)
+{
+  std::uniform_real_distribution<double> dist(0.,100.);
+  return make_double3(6.4e6+dist(gen),-3.2e6+dist(gen),1.7e6+dist(gen));
+}
+
+/*! points spaced only micrometers apart, at kilometer offsets */
+double2 makeDensePoint(std::mt19937 &gen)
+{
+  std::uniform_real_distribution<double> dist(0.,1e-2);
+  return make_double2(1e3+dist(gen),2e3+dist(gen));
+}
+
+int main(int, const char **)
+{
+  test<double3>("double3, 100m cube at earth-radius offset",makeFarAwayPoint);
+  test<double2>("double2, 1cm square at kilometer offset",makeDensePoint);
+  return 0;
+}
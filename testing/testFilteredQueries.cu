@@ -0,0 +1,198 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* checks filtered fcp and knn queries (same label, not the query
+   point itself, newer than some time) against brute force, with and
+   without per-subtree label masks */
+
+#include "cukd/builder_host.h"
+#include "cukd/filter.h"
+#include <random>
+
+using namespace cukd;
+
+const int numPoints  = 20000;
+const int numQueries = 1000;
+const int numLabels  = 24;
+const int k = 8;
+
+struct LabeledPoint {
+  float3 position;
+  int    label;
+  float  time;
+};
+
+struct LabeledPoint_traits : public default_data_traits<float3> {
+  using data_t = LabeledPoint;
+  static inline __both__ const float3 &get_point(const LabeledPoint &p)
+  { return p.position; }
+  static inline __both__ float get_coord(const LabeledPoint &p, int d)
+  { return cukd::get_coord(p.position,d); }
+  enum { has_explicit_dim = false };
+  static inline __both__ int  get_dim(const LabeledPoint &) { return -1; }
+  static inline __both__ void set_dim(LabeledPoint &, int) {}
+};
+
+struct SameLabel {
+  inline __both__ bool operator()(const LabeledPoint &p) const
+  { ++*numCalls; return p.label == label; }
+  int     label;
+  size_t *numCalls;
+};
+
+struct NotAt {
+  inline __both__ bool operator()(const LabeledPoint &p) const
+  { return p.position.x != position.x
+      || p.position.y != position.y
+      || p.position.z != position.z; }
+  float3 position;
+};
+
+struct NewerThan {
+  inline __both__ bool operator()(const LabeledPoint &p) const
+  { return p.time > time; }
+  float time;
+};
+
+/*! points strictly within the radius, like fcp's cutOffRadius */
+struct WithinRadius {
+  inline __both__ bool operator()(const LabeledPoint &p) const
+  { return sqrDistance(p.position,center) < radius*radius; }
+  float3 center;
+  float  radius;
+};
+
+struct GetLabel {
+  inline __both__ int operator()(const LabeledPoint &p) const
+  { return p.label; }
+};
+
+/*! brute-force distances to the k closest points that pass the filter */
+template<typename filter_t>
+std::vector<float> bruteForce(const std::vector<LabeledPoint> &points,
+                              float3 query, const filter_t &filter, int count)
+{
+  std::vector<float> dists;
+  for (auto &p : points)
+    if (filter(p)) dists.push_back(sqrDistance(p.position,query));
+  std::sort(dists.begin(),dists.end());
+  dists.resize(std::min((int)dists.size(),count));
+  return dists;
+}
+
+template<typename filter_t>
+void checkFCP(const std::vector<LabeledPoint> &tree, float3 query,
+              const filter_t &filter, int result, const char *what)
+{
+  auto expected = bruteForce(tree,query,filter,1);
+  if (expected.empty() ? (result != -1)
+      : (result < 0 || !filter(tree[result])
+         || sqrDistance(tree[result].position,query) != expected[0]))
+    throw std::runtime_error(std::string("wrong fcp result for ")+what);
+}
+
+template<typename filter_t>
+void checkKNN(const std::vector<LabeledPoint> &tree, float3 query,
+              const filter_t &filter, const FixedCandidateList<k> &result,
+              const char *what)
+{
+  auto expected = bruteForce(tree,query,filter,k);
+  for (int i=0;i<k;i++) {
+    const float dist2 = i < (int)expected.size() ? expected[i] : INFINITY;
+    if (result.get_dist2(i) != dist2 ||
+        (i < (int)expected.size() && !filter(tree[result.get_pointID(i)])))
+      throw std::runtime_error(std::string("wrong knn result for ")+what);
+  }
+}
+
+int main(int, const char **)
+{
+  // clustered labels, so label masks can actually prune something
+  std::mt19937 gen(0x5eed);
+  std::uniform_real_distribution<float> uniform(0.f,100.f);
+  std::vector<LabeledPoint> tree(numPoints);
+  for (auto &p : tree) {
+    p.position = make_float3(uniform(gen),uniform(gen),uniform(gen));
+    p.label = int(p.position.x/100.f*numLabels*.5f) + (uniform(gen) < 50.f ? numLabels/2 : 0);
+    p.time  = uniform(gen);
+  }
+  box_t<float3> worldBounds;
+  buildTree_host<LabeledPoint,LabeledPoint_traits>(tree.data(),numPoints,&worldBounds);
+  std::vector<uint32_t> labelMasks(numPoints);
+  computeLabelMasks_host(labelMasks.data(),tree.data(),numPoints,GetLabel());
+
+  size_t callsWithoutMasks = 0, callsWithMasks = 0;
+  for (int q=0;q<numQueries;q++) {
+    const float3 query = make_float3(uniform(gen),uniform(gen),uniform(gen));
+    const LabeledPoint &somePoint = tree[q*(numPoints/numQueries)];
+    size_t numCalls = 0;
+    const SameLabel sameLabel = { int(q % numLabels), &numCalls };
+    const LabelMaskFilter labelMask = { labelMasks.data(), labelMaskOf(sameLabel.label) };
+
+    // same label, without and with label masks, stack-based and cct
+    int result = stackBased::fcp<LabeledPoint,LabeledPoint_traits>
+      (sameLabel,query,tree.data(),numPoints);
+    callsWithoutMasks += numCalls;
+    checkFCP(tree,query,sameLabel,result,"same label");
+    numCalls = 0;
+    result = stackBased::fcp<LabeledPoint,LabeledPoint_traits>
+      (sameLabel,query,tree.data(),numPoints,labelMask);
+    callsWithMasks += numCalls;
+    checkFCP(tree,query,sameLabel,result,"same label, with label masks");
+    result = cct::fcp<LabeledPoint,LabeledPoint_traits>
+      (sameLabel,query,worldBounds,tree.data(),numPoints);
+    checkFCP(tree,query,sameLabel,result,"same label, cct");
+
+    FixedCandidateList<k> knn(INFINITY);
+    stackBased::knn<FixedCandidateList<k>,LabeledPoint,LabeledPoint_traits>
+      (knn,sameLabel,query,tree.data(),numPoints,labelMask);
+    checkKNN(tree,query,sameLabel,knn,"same label, with label masks");
+
+    // not the query point itself
+    const NotAt notSelf = { somePoint.position };
+    result = stackBased::fcp<LabeledPoint,LabeledPoint_traits>
+      (notSelf,somePoint.position,tree.data(),numPoints);
+    checkFCP(tree,somePoint.position,notSelf,result,"not self");
+
+    // k nearest newer than some time
+    const NewerThan newer = { uniform(gen) };
+    FixedCandidateList<k> newerKNN(INFINITY);
+    cct::knn<FixedCandidateList<k>,LabeledPoint,LabeledPoint_traits>
+      (newerKNN,newer,query,worldBounds,tree.data(),numPoints);
+    checkKNN(tree,query,newer,newerKNN,"newer than, cct");
+
+    // unfiltered queries still resolve to the regular overloads
+    FcpSearchParams params;
+    params.cutOffRadius = 10.f;
+    result = stackBased::fcp<LabeledPoint,LabeledPoint_traits>
+      (query,tree.data(),numPoints,params);
+    checkFCP(tree,query,WithinRadius{query,params.cutOffRadius},result,
+             "unfiltered, with cut-off radius");
+  }
+  // nothing within the cut-off radius: fcp has to return -1
+  const float3 farAway = make_float3(1000.f,1000.f,1000.f);
+  FcpSearchParams params;
+  params.cutOffRadius = 10.f;
+  checkFCP(tree,farAway,WithinRadius{farAway,params.cutOffRadius},
+           stackBased::fcp<LabeledPoint,LabeledPoint_traits>
+           (farAway,tree.data(),numPoints,params),
+           "unfiltered, nothing within cut-off radius");
+  
+  std::cout << "all filtered queries match brute force; filter evaluated "
+            << float(callsWithoutMasks)/numQueries << " times per query without, "
+            << float(callsWithMasks)/numQueries << " times with label masks" << std::endl;
+  return 0;
+}
@@ -0,0 +1,84 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* builds trees over 16-bit (half and bfloat16) points, and checks
+   that fcp and knn queries on those return the same distances as a
+   brute-force search over the widened (float) points */
+
+#include "cukd/builder_host.h"
+#include "cukd/knn.h"
+#include "cukd/half.h"
+#include <random>
+
+using namespace cukd;
+
+const int numPoints  = 20000;
+const int numQueries = 1000;
+const int k = 8;
+
+template<typename half_point_t>
+void test(const std::string &description)
+{
+  std::cout << "testing " << description << " points" << std::endl;
+  using traits = half_data_traits<half_point_t>;
+
+  std::mt19937 gen(0x5eed);
+  std::uniform_real_distribution<float> dist(0.f,100.f);
+  std::vector<half_point_t> points(numPoints);
+  for (auto &p : points)
+    p = narrow<half_point_t>(make_float3(dist(gen),dist(gen),dist(gen)));
+  std::vector<float3> widened(numPoints);
+  for (int i=0;i<numPoints;i++)
+    widened[i] = widen(points[i]);
+
+  box_t<float3> worldBounds;
+  buildTree_host<half_point_t,traits>(points.data(),numPoints,&worldBounds);
+  for (int i=0;i<numPoints;i++)
+    if (!worldBounds.contains(widen(points[i])))
+      throw std::runtime_error("point outside of world bounds");
+
+  std::vector<float> dists(numPoints);
+  for (int q=0;q<numQueries;q++) {
+    float3 query = make_float3(dist(gen),dist(gen),dist(gen));
+    for (int i=0;i<numPoints;i++)
+      dists[i] = sqrDistance(widened[i],query);
+    std::sort(dists.begin(),dists.end());
+
+    int sb  = stackBased::fcp<half_point_t,traits>(query,points.data(),numPoints);
+    int sf  = stackFree::fcp<half_point_t,traits>(query,points.data(),numPoints);
+    int cct = cct::fcp<half_point_t,traits>(query,worldBounds,points.data(),numPoints);
+    for (int found : { sb, sf, cct })
+      if (found < 0 || sqrDistance(widen(points[found]),query) != dists[0])
+        throw std::runtime_error("fcp did not find closest point, query "
+                                 +std::to_string(q));
+
+    FixedCandidateList<k> result(INFINITY);
+    stackBased::knn<FixedCandidateList<k>,half_point_t,traits>
+      (result,query,points.data(),numPoints);
+    for (int i=0;i<k;i++)
+      if (result.get_dist2(i) != dists[i])
+        throw std::runtime_error("knn returned wrong distance, query "
+                                 +std::to_string(q));
+  }
+  std::cout << "  all results match brute force" << std::endl;
+}
+
+int main(int, const char **)
+{
+  test<half3>("half3");
+  test<bfloat16_3>("bfloat16_3");
+  return 0;
+}
@@ -0,0 +1,106 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* builds trees over clustered, high-dimensional vec_float<N>
+   "descriptors", and checks that knn queries (which, for these types,
+   stop computing a candidate's distance once it exceeds the cull
+   distance) return the same distances as a brute-force search */
+
+#include "cukd/builder_host.h"
+#include "cukd/knn.h"
+#include <random>
+
+using namespace cukd;
+
+const int numPoints   = 5000;
+const int numQueries  = 200;
+const int numClusters = 50;
+const int k = 8;
+
+template<int N>
+std::vector<vec_float<N>> generateDescriptors(std::mt19937 &gen,
+                                              const std::vector<vec_float<N>> &centers,
+                                              int count)
+{
+  std::uniform_int_distribution<int> whichCenter(0,(int)centers.size()-1);
+  std::normal_distribution<float> noise(0.f,.1f);
+  std::vector<vec_float<N>> result(count);
+  for (auto &p : result) {
+    p = centers[whichCenter(gen)];
+    for (int d=0;d<N;d++) p.v[d] += noise(gen);
+  }
+  return result;
+}
+
+template<int N>
+void test()
+{
+  std::cout << "testing knn on vec_float<" << N << ">" << std::endl;
+
+  std::mt19937 gen(N);
+  std::uniform_real_distribution<float> uniform(0.f,1.f);
+  std::vector<vec_float<N>> centers(numClusters);
+  for (auto &c : centers)
+    for (int d=0;d<N;d++) c.v[d] = uniform(gen);
+  std::vector<vec_float<N>> points  = generateDescriptors<N>(gen,centers,numPoints);
+  std::vector<vec_float<N>> queries = generateDescriptors<N>(gen,centers,numQueries);
+
+  // early-exit distance must either be exact, or exceed the bound
+  for (int i=0;i<numPoints;i++) {
+    const float full = sqrDistance(points[i],queries[0]);
+    const float bound = uniform(gen)*full*2.f;
+    const float upTo = sqrDistanceUpTo(points[i],queries[0],bound);
+    if (upTo != full && !(upTo > bound))
+      throw std::runtime_error("sqrDistanceUpTo returned invalid distance");
+  }
+  
+  buildTree_host(points.data(),numPoints);
+
+  std::vector<float> dists(numPoints);
+  for (int q=0;q<numQueries;q++) {
+    for (int i=0;i<numPoints;i++)
+      dists[i] = sqrDistance(points[i],queries[q]);
+    std::sort(dists.begin(),dists.end());
+
+    FixedCandidateList<k> sb(INFINITY), sf(INFINITY);
+    HeapCandidateList<k> cct(INFINITY);
+    stackBased::knn(sb,queries[q],points.data(),numPoints);
+    stackFree::knn(sf,queries[q],points.data(),numPoints);
+    box_t<vec_float<N>> worldBounds;
+    worldBounds.setInfinite();
+    cct::knn(cct,queries[q],worldBounds,points.data(),numPoints);
+    std::vector<float> cctDists;
+    for (int i=0;i<k;i++)
+      cctDists.push_back(cct.get_dist2(i));
+    std::sort(cctDists.begin(),cctDists.end());
+    for (int i=0;i<k;i++)
+      if (sb.get_dist2(i) != dists[i] ||
+          sf.get_dist2(i) != dists[i] ||
+          cctDists[i] != dists[i])
+        throw std::runtime_error("knn returned wrong distance, query "
+                                 +std::to_string(q));
+  }
+  std::cout << "  all results match brute force" << std::endl;
+}
+
+int main(int, const char **)
+{
+  test<16>();
+  test<32>();
+  test<64>();
+  test<128>();
+  return 0;
+}
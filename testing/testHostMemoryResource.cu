@@ -0,0 +1,92 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* builds the same trees with all host builders, once with the default
+   host memory resource and repeatedly with a pooled one; checks that
+   the trees are the same, that all pool memory gets returned, and
+   that repeated builds do not allocate any new memory */
+
+#include "cukd/builder_host.h"
+#include "cukd/builder_bitonic.h"
+#include "cukd/builder_indirect.h"
+#include "cukd/builder_radix.h"
+#include <random>
+#include <cstring>
+#include <functional>
+
+using namespace cukd;
+using namespace cukd::common;
+
+const int numPoints = 100000;
+const int numRepeats = 3;
+
+int main(int, const char **)
+{
+  std::mt19937 gen(0x1234);
+  std::uniform_real_distribution<float> uniform(0.f,1.f);
+  std::vector<float3> input(numPoints);
+  for (auto &p : input)
+    p = make_float3(uniform(gen),uniform(gen),uniform(gen));
+
+  std::vector<float3> reference = input;
+  buildTree_host(reference.data(),numPoints);
+
+  HostBuildConfig presorted;
+  presorted.inputOrder = SPATIALLY_SORTED_INPUT;
+  HostBuildConfig indirect;
+  indirect.inputOrder = UNSORTED_INPUT;
+  indirect.indirectSort = true;
+  
+  using build_t = std::function<void(float3 *, HostMemoryResource &)>;
+  const std::vector<std::pair<std::string,build_t>> builders = {
+    { "host", [](float3 *points, HostMemoryResource &mr)
+      { buildTree_host(points,numPoints,nullptr,mr); } },
+    { "host, presorted", [&](float3 *points, HostMemoryResource &mr)
+      { buildTree_host(points,numPoints,nullptr,presorted,mr); } },
+    { "host, indirect", [&](float3 *points, HostMemoryResource &mr)
+      { buildTree_host(points,numPoints,nullptr,indirect,mr); } },
+    { "bitonic host", [](float3 *points, HostMemoryResource &mr)
+      { buildTree_bitonic_host(points,numPoints,nullptr,4,mr); } },
+    { "radix", [](float3 *points, HostMemoryResource &mr)
+      { buildTree_radix_host(points,numPoints,nullptr,4,mr); } },
+  };
+  
+  for (auto &builder : builders) {
+    PooledHostMemoryResource pool;
+    size_t allocsAfterFirstBuild = 0;
+    for (int r=0;r<numRepeats;r++) {
+      std::vector<float3> points = input;
+      pool.resetPeak();
+      builder.second(points.data(),pool);
+      if (memcmp(points.data(),reference.data(),numPoints*sizeof(float3)) != 0)
+        throw std::runtime_error(builder.first+": tree differs");
+      const PooledHostMemoryResource::Stats stats = pool.stats();
+      if (stats.bytesInUse != 0)
+        throw std::runtime_error(builder.first+": not all memory returned to pool");
+      if (r == 0)
+        allocsAfterFirstBuild = stats.numSystemAllocs;
+      else if (stats.numSystemAllocs != allocsAfterFirstBuild)
+        throw std::runtime_error(builder.first+": repeated build allocated new memory");
+    }
+    const PooledHostMemoryResource::Stats stats = pool.stats();
+    std::cout << builder.first << ": peak temp memory "
+              << prettyNumber(stats.peakBytesInUse) << "B, "
+              << stats.numSystemAllocs << " system allocs for "
+              << numRepeats << " builds" << std::endl;
+  }
+  std::cout << "all host builders work with pooled memory" << std::endl;
+  return 0;
+}
@@ -0,0 +1,111 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+/* builds a tree in memory from a HugePageHostMemoryResource (in each
+   of its modes), saves it, and loads it back with loadTree_host();
+   checks that queries on all of these match queries on a regular
+   tree, and reports how much of each tree actually ended up on huge
+   pages. Explicit huge pages usually are not reserved on test
+   machines, so those must (and here, do) fall back gracefully */
+
+#include "cukd/builder_host.h"
+#include "cukd/fcp.h"
+#include "cukd/serialize.h"
+#include "cukd/hugepages.h"
+#include <random>
+#include <cstring>
+#include <cstdio>
+
+using namespace cukd;
+using namespace cukd::common;
+
+const int numPoints  = 1000000;
+const int numQueries = 10000;
+
+int main(int, const char **)
+{
+  std::mt19937 gen(0x1234);
+  std::uniform_real_distribution<float> uniform(0.f,1.f);
+  std::vector<float3> input(numPoints);
+  for (auto &p : input)
+    p = make_float3(uniform(gen),uniform(gen),uniform(gen));
+  std::vector<float3> queries(numQueries);
+  for (auto &q : queries)
+    q = make_float3(uniform(gen),uniform(gen),uniform(gen));
+
+  std::vector<float3> reference = input;
+  box_t<float3> worldBounds;
+  buildTree_host(reference.data(),numPoints,&worldBounds);
+  std::vector<int> expected(numQueries);
+  for (int q=0;q<numQueries;q++)
+    expected[q] = stackBased::fcp<float3>(queries[q],reference.data(),numPoints);
+
+  const std::string fileName = "cukdTestHugePages.cukd";
+  serialized::saveTree<float3>(fileName,reference.data(),numPoints,worldBounds);
+  
+  for (auto mode : { NO_HUGE_PAGES, TRANSPARENT_HUGE_PAGES,
+                     HUGE_PAGES_2MB, HUGE_PAGES_1GB }) {
+    HugePageHostMemoryResource hugePages(mode);
+    const size_t numBytes = numPoints*sizeof(float3);
+
+    // build directly into huge-page memory, with the builder's
+    // temporaries coming from the same resource
+    float3 *built = (float3 *)hugePages.malloc(numBytes);
+    if (((size_t)built % (2<<20)) != 0)
+      throw std::runtime_error(std::string(toString(mode))+": allocation not 2MB aligned");
+    memcpy(built,input.data(),numBytes);
+    buildTree_host(built,numPoints,nullptr,hugePages);
+    if (memcmp(built,reference.data(),numBytes) != 0)
+      throw std::runtime_error(std::string(toString(mode))+": tree differs");
+
+    size_t numLoaded = 0;
+    box_t<float3> loadedBounds;
+    float3 *loaded
+      = serialized::loadTree_host<float3>(fileName,numLoaded,&loadedBounds,hugePages);
+    if (numLoaded != (size_t)numPoints ||
+        memcmp(loaded,reference.data(),numBytes) != 0)
+      throw std::runtime_error(std::string(toString(mode))+": loaded tree differs");
+    for (int q=0;q<numQueries;q++)
+      if (stackBased::fcp<float3>(queries[q],loaded,numPoints) != expected[q])
+        throw std::runtime_error(std::string(toString(mode))+": query result differs");
+
+    const size_t onHugePages = bytesOnHugePages(loaded,numBytes);
+    if (mode == NO_HUGE_PAGES)
+      if (onHugePages != 0)
+        throw std::runtime_error("memory without huge pages reported as huge pages");
+    if ((mode == HUGE_PAGES_2MB || mode == HUGE_PAGES_1GB)
+        && hugePages.modeOf(loaded) == mode)
+      if (onHugePages != numBytes)
+        throw std::runtime_error(std::string(toString(mode))+": explicit huge pages not reported");
+    std::cout << toString(mode) << ": got "
+              << toString(hugePages.modeOf(loaded)) << ", "
+              << prettyNumber(onHugePages) << "B of "
+              << prettyNumber(numBytes) << "B on huge pages ("
+              << hugePages.numFallbacks << " fallbacks)" << std::endl;
+    hugePages.free(loaded);
+    hugePages.free(built);
+
+    // small temporaries must not use up (or round up to) huge pages
+    void *small = hugePages.malloc(1000);
+    if (hugePages.modeOf(small) != NO_HUGE_PAGES)
+      throw std::runtime_error(std::string(toString(mode))+": small allocation got huge pages");
+    hugePages.free(small);
+  }
+  remove(fileName.c_str());
+  std::cout << "huge page backed trees work" << std::endl;
+  return 0;
+}
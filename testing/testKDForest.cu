@@ -0,0 +1,121 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* builds randomized k-d forests over clustered 64-dimensional
+   points, and checks that (a) with an unlimited budget forest queries
+   are exact, and (b) for a fixed budget of distance computations, a
+   forest of several trees finds more of the true nearest neighbors
+   than a single tree does */
+
+#include "cukd/forest.h"
+
+using namespace cukd;
+
+const int D          = 64;
+const int numPoints  = 20000;
+const int numQueries = 200;
+const int k          = 8;
+const int maxChecks  = 200;
+
+using point_t = vec_float<D>;
+
+std::vector<point_t> generatePoints(std::mt19937 &gen,
+                                    const std::vector<point_t> &centers,
+                                    int count)
+{
+  std::normal_distribution<float> noise(0.f,.2f);
+  std::vector<point_t> result(count);
+  for (auto &p : result) {
+    p = centers[gen()%centers.size()];
+    for (int d=0;d<D;d++) p.v[d] += noise(gen);
+  }
+  return result;
+}
+
+/*! runs knn on given forest for all queries, checks that results are
+    valid, and returns the fraction of true k nearest neighbors found */
+float recall(const forest::Forest<point_t> &forest,
+             const std::vector<point_t> &points,
+             const std::vector<point_t> &queries,
+             const std::vector<float> &kthDist2,
+             forest::SearchParams params)
+{
+  int numFound = 0;
+  for (int q=0;q<numQueries;q++) {
+    FixedCandidateList<k> result(INFINITY);
+    forest::knn(result,forest,queries[q],params);
+    for (int i=0;i<k;i++) {
+      const int id = result.get_pointID(i);
+      if (id < 0 || sqrDistance(points[id],queries[q]) != result.get_dist2(i))
+        throw std::runtime_error("forest knn returned invalid result");
+      for (int j=0;j<i;j++)
+        if (result.get_pointID(j) == id)
+          throw std::runtime_error("forest knn returned same point twice");
+      numFound += (result.get_dist2(i) <= kthDist2[q]);
+    }
+  }
+  return numFound/float(numQueries*k);
+}
+
+int main(int, const char **)
+{
+  std::mt19937 gen(0x5eed);
+  std::uniform_real_distribution<float> uniform(0.f,1.f);
+  std::vector<point_t> centers(200);
+  for (auto &c : centers)
+    for (int d=0;d<D;d++) c.v[d] = uniform(gen);
+  std::vector<point_t> points  = generatePoints(gen,centers,numPoints);
+  std::vector<point_t> queries = generatePoints(gen,centers,numQueries);
+
+  std::vector<float> kthDist2(numQueries), dists(numPoints);
+  for (int q=0;q<numQueries;q++) {
+    for (int i=0;i<numPoints;i++)
+      dists[i] = sqrDistance(points[i],queries[q]);
+    std::nth_element(dists.begin(),dists.begin()+k-1,dists.end());
+    kthDist2[q] = dists[k-1];
+  }
+
+  forest::BuildConfig config;
+  config.numTrees = 1;
+  auto single = forest::build(points.data(),numPoints,config);
+  config.numTrees = 2;
+  auto pair = forest::build(points.data(),numPoints,config);
+  config.numTrees = 8;
+  auto forest = forest::build(points.data(),numPoints,config);
+
+  std::cout << "testing exact queries on forest of 2 trees, "
+            << numPoints << " points" << std::endl;
+  if (recall(pair,points,queries,kthDist2,forest::SearchParams{}) != 1.f)
+    throw std::runtime_error("forest knn with unlimited budget not exact");
+  for (int q=0;q<numQueries;q++) {
+    const int closest = forest::fcp(pair,queries[q]);
+    float best = INFINITY;
+    for (auto &p : points) best = std::min(best,sqrDistance(p,queries[q]));
+    if (closest < 0 || sqrDistance(points[closest],queries[q]) != best)
+      throw std::runtime_error("forest fcp with unlimited budget not exact");
+  }
+
+  forest::SearchParams params;
+  params.maxChecks = maxChecks;
+  const float singleRecall = recall(single,points,queries,kthDist2,params);
+  const float forestRecall = recall(forest,points,queries,kthDist2,params);
+  std::cout << "recall at " << maxChecks << " checks: single tree "
+            << (100.f*singleRecall) << "%, forest of " << config.numTrees
+            << " trees " << (100.f*forestRecall) << "%" << std::endl;
+  if (forestRecall <= singleRecall)
+    throw std::runtime_error("forest does not improve recall over single tree");
+  return 0;
+}
@@ -0,0 +1,129 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* checks that the incremental nearest-neighbor iterator returns
+   points in the same order (of distances) as a brute-force search,
+   for balanced trees (with and without explicit split dims) and for
+   spatial k-d trees */
+
+#include "cukd/builder_host.h"
+#include "cukd/nearest-iterator.h"
+#include <random>
+
+using namespace cukd;
+
+const int numPoints  = 10000;
+const int numQueries = 500;
+const int numSteps   = 100;
+const float maxRadius = 5.f;
+
+struct PointAndDim {
+  float3 point;
+  int    dim;
+};
+
+struct PointAndDim_traits : public default_data_traits<float3> {
+  using data_t = PointAndDim;
+  enum { has_explicit_dim = true };
+  static inline __both__ const float3 &get_point(const PointAndDim &n)
+  { return n.point; }
+  static inline __both__ float get_coord(const PointAndDim &n, int d)
+  { return cukd::get_coord(n.point,d); }
+  static inline __both__ int  get_dim(const PointAndDim &n) { return n.dim; }
+  static inline __both__ void set_dim(PointAndDim &n, int d) { n.dim = d; }
+};
+
+/*! runs the iterator from make() for each query, and checks the
+    first numSteps results (and, with max radius, the number of all
+    results) against brute force */
+template<typename data_t, typename data_traits, typename MakeIterator>
+void check(const std::string &description,
+           const std::vector<float3> &points,
+           const std::vector<float3> &queries,
+           const MakeIterator &make)
+{
+  std::cout << "testing nearest-neighbor iterator, " << description << std::endl;
+  std::vector<float> dists(points.size());
+  size_t numNodesVisited = 0;
+  for (int q=0;q<numQueries;q++) {
+    for (size_t i=0;i<points.size();i++)
+      dists[i] = sqrDistance(points[i],queries[q]);
+    std::sort(dists.begin(),dists.end());
+
+    NearestNeighborIterator<data_t,data_traits> it = make(queries[q],INFINITY);
+    int pointID; float dist2;
+    for (int i=0;i<numSteps;i++)
+      if (!it.next(pointID,dist2) || dist2 != dists[i])
+        throw std::runtime_error("iterator returned wrong "+std::to_string(i)
+                                 +"th neighbor for query "+std::to_string(q));
+    numNodesVisited += it.numNodesVisited;
+
+    NearestNeighborIterator<data_t,data_traits> inRadius = make(queries[q],maxRadius);
+    size_t count = 0;
+    while (inRadius.next(pointID,dist2)) count++;
+    if (count != size_t(std::lower_bound(dists.begin(),dists.end(),
+                                         maxRadius*maxRadius)-dists.begin()))
+      throw std::runtime_error("iterator returned wrong number of points in radius");
+  }
+  std::cout << "  all results match brute force; " << float(numNodesVisited)/numQueries
+            << " subtrees opened per " << numSteps << " neighbors" << std::endl;
+}
+
+int main(int, const char **)
+{
+  std::mt19937 gen(0x5eed);
+  std::uniform_real_distribution<float> dist(0.f,100.f);
+  std::vector<float3> points(numPoints), queries(numQueries);
+  for (auto &p : points)  p = make_float3(dist(gen),dist(gen),dist(gen));
+  for (auto &q : queries) q = make_float3(dist(gen),dist(gen),dist(gen));
+
+  {
+    std::vector<float3> tree = points;
+    buildTree_host(tree.data(),numPoints);
+    check<float3,default_data_traits<float3>>
+      ("balanced tree",points,queries,[&](float3 query, float radius) {
+        return NearestNeighborIterator<float3>(tree.data(),numPoints,query,radius);
+      });
+  }
+  {
+    std::vector<PointAndDim> tree(numPoints);
+    for (int i=0;i<numPoints;i++) tree[i] = { points[i], 0 };
+    box_t<float3> bounds;
+    buildTree_host<PointAndDim,PointAndDim_traits>(tree.data(),numPoints,&bounds);
+    check<PointAndDim,PointAndDim_traits>
+      ("balanced tree, explicit dims",points,queries,[&](float3 query, float radius) {
+        return NearestNeighborIterator<PointAndDim,PointAndDim_traits>
+          (tree.data(),numPoints,query,radius);
+      });
+  }
+  {
+    ManagedMemMemoryResource managedMem;
+    float3 *d_points = 0;
+    CUKD_CUDA_CALL(MallocManaged((void**)&d_points,numPoints*sizeof(float3)));
+    std::copy(points.begin(),points.end(),d_points);
+    SpatialKDTree<float3> tree;
+    BuildConfig config;
+    buildTree(tree,d_points,numPoints,config,0,managedMem);
+    CUKD_CUDA_SYNC_CHECK();
+    check<float3,default_data_traits<float3>>
+      ("spatial k-d tree",points,queries,[&](float3 query, float radius) {
+        return NearestNeighborIterator<float3>(tree,query,radius);
+      });
+    free(tree,0,managedMem);
+    CUKD_CUDA_CALL(Free(d_points));
+  }
+  return 0;
+}
@@ -0,0 +1,83 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* NUMA helpers: topology parsing, node-interleaved allocation (also
+   as a memory resource for the host builder), and per-node tree
+   replicas with batch queries - checked against the plain host build
+   and plain queries. On single-node machines this only checks the
+   fall-back paths, which is still worth doing. */
+
+#include "cukd/builder_host.h"
+#include "cukd/fcp.h"
+#include "cukd/numa.h"
+#include <random>
+#include <cstring>
+
+using namespace cukd;
+
+const int numPoints  = 100000;
+const int numQueries = 10000;
+
+int main(int, const char **)
+{
+  if (numa::parseList("0-3,8,10-11\n") != std::vector<int>({0,1,2,3,8,10,11}))
+    throw std::runtime_error("wrong result parsing cpu list");
+  if (numa::numNodes() < 1)
+    throw std::runtime_error("no NUMA nodes found");
+  int numCPUs = 0;
+  for (auto &cpus : numa::nodeCPUs()) numCPUs += (int)cpus.size();
+  std::cout << "found " << numa::numNodes() << " node(s) with "
+            << numCPUs << " CPUs" << std::endl;
+  if (numa::currentNode() < 0 || numa::currentNode() >= numa::numNodes())
+    throw std::runtime_error("current node out of range");
+  
+  std::mt19937 gen(0x1234);
+  std::uniform_real_distribution<float> uniform(0.f,1.f);
+  std::vector<float3> input(numPoints);
+  for (auto &p : input)
+    p = make_float3(uniform(gen),uniform(gen),uniform(gen));
+  std::vector<float3> reference = input;
+  buildTree_host(reference.data(),numPoints);
+
+  // build into node-interleaved memory, with interleaved temporaries
+  float3 *interleaved = numa::allocate<float3>(numPoints);
+  memcpy(interleaved,input.data(),numPoints*sizeof(float3));
+  numa::InterleavedHostMemoryResource memResource;
+  buildTree_host(interleaved,numPoints,nullptr,memResource);
+  if (memcmp(interleaved,reference.data(),numPoints*sizeof(float3)) != 0)
+    throw std::runtime_error("tree built in interleaved memory differs");
+
+  // one replica per node
+  numa::ReplicatedTree<float3> replicas(interleaved,numPoints);
+  numa::free(interleaved);
+  for (int node=0;node<numa::numNodes();node++)
+    if (memcmp(replicas.replica(node),reference.data(),
+               numPoints*sizeof(float3)) != 0)
+      throw std::runtime_error("replica on node "+std::to_string(node)+" differs");
+  
+  std::vector<float3> queries(numQueries);
+  for (auto &q : queries)
+    q = make_float3(uniform(gen),uniform(gen),uniform(gen));
+  std::vector<int> results(numQueries,-2);
+  replicas.forEachQuery(numQueries,[&](int q, const float3 *tree) {
+      results[q] = stackBased::fcp(queries[q],tree,numPoints);
+    });
+  for (int q=0;q<numQueries;q++)
+    if (results[q] != stackBased::fcp(queries[q],reference.data(),numPoints))
+      throw std::runtime_error("query on replica: wrong result");
+  std::cout << "interleaved build and replicated queries match" << std::endl;
+  return 0;
+}
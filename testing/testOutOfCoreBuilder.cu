@@ -0,0 +1,268 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* builds trees with the out-of-core builder, using a memory budget
+   that's much smaller than the input, and checks that the resulting
+   (memory-mapped) tree is a valid k-d tree over the same points, and
+   that host-side fcp queries on it return the right points */
+
+#include "cukd/builder_outofcore.h"
+#include "cukd/fcp.h"
+#include <random>
+#include <functional>
+#include <cstddef>
+#include <cstring>
+
+using namespace cukd;
+
+template<typename data_t>
+void writeInputFile(const std::string &fileName,
+                    const std::vector<data_t> &points)
+{
+  std::ofstream out(fileName,std::ios::binary);
+  size_t count = points.size();
+  out.write((const char *)&count,sizeof(count));
+  out.write((const char *)points.data(),count*sizeof(data_t));
+}
+
+template<typename data_t, typename data_traits>
+void checkRec(const data_t *nodes, int numNodes,
+              const box_t<typename data_traits::point_t> &bounds,
+              int curr)
+{
+  using point_t  = typename data_traits::point_t;
+  enum { num_dims = num_dims_of<point_t>::value };
+
+  if (curr >= numNodes) return;
+
+  if (!bounds.contains(data_traits::get_point(nodes[curr])))
+    throw std::runtime_error
+      ("invalid k-d tree - node "+std::to_string(curr)+" not in parent bounds");
+
+  const int curr_dim
+    = data_traits::has_explicit_dim
+    ? data_traits::get_dim(nodes[curr])
+    : (BinaryTree::levelOf(curr) % num_dims);
+  const float curr_s = data_traits::get_coord(nodes[curr],curr_dim);
+
+  box_t<point_t> lBounds = bounds;
+  set_coord(lBounds.upper,curr_dim,curr_s);
+  box_t<point_t> rBounds = bounds;
+  set_coord(rBounds.lower,curr_dim,curr_s);
+  checkRec<data_t,data_traits>(nodes,numNodes,lBounds,2*curr+1);
+  checkRec<data_t,data_traits>(nodes,numNodes,rBounds,2*curr+2);
+}
+
+/*! checks that the mapped tree is a valid k-d tree over the same
+    points as 'input', and that fcp on it matches brute force */
+template<typename data_t, typename data_traits>
+void checkTree(const std::string &treeFileName,
+               std::vector<data_t> input)
+{
+  serialized::MappedTree<data_t,data_traits> tree(treeFileName);
+  const int N = (int)tree.numPoints();
+  if (N != (int)input.size())
+    throw std::runtime_error("tree has wrong number of points");
+
+  // same points (as a set)?
+  auto less = [](const data_t &a, const data_t &b) {
+    for (int d=0;d<3;d++) {
+      float ca = data_traits::get_coord(a,d), cb = data_traits::get_coord(b,d);
+      if (ca != cb) return ca < cb;
+    }
+    return false;
+  };
+  std::vector<data_t> treePoints(tree.points(),tree.points()+N);
+  std::sort(input.begin(),input.end(),less);
+  std::sort(treePoints.begin(),treePoints.end(),less);
+  for (int i=0;i<N;i++)
+    if (less(input[i],treePoints[i]) || less(treePoints[i],input[i]))
+      throw std::runtime_error("tree does not contain the input points");
+
+  box_t<float3> bounds;
+  bounds.setInfinite();
+  checkRec<data_t,data_traits>(tree.points(),N,bounds,0);
+
+  std::mt19937 gen(0x1234);
+  std::uniform_real_distribution<float> dist(-10.f,110.f);
+  for (int q=0;q<1000;q++) {
+    float3 query = make_float3(dist(gen),dist(gen),dist(gen));
+    float bestDist2 = INFINITY;
+    for (int i=0;i<N;i++)
+      bestDist2 = std::min(bestDist2,
+                           sqrDistance(data_traits::get_point(tree.points()[i]),query));
+    int sb = stackBased::fcp<data_t,data_traits>(query,tree.points(),N);
+    int sf = stackFree::fcp<data_t,data_traits>(query,tree.points(),N);
+    if (sb < 0 || sf < 0 ||
+        sqrDistance(data_traits::get_point(tree.points()[sb]),query) != bestDist2 ||
+        sqrDistance(data_traits::get_point(tree.points()[sf]),query) != bestDist2)
+      throw std::runtime_error("fcp on mapped tree did not find closest point");
+  }
+}
+
+namespace test_float3 {
+  void test_simple(bool manyDuplicates)
+  {
+    std::cout << "testing `buildTree_outOfCore` on float3 array, 100000 "
+              << (manyDuplicates ? "duplicate-heavy" : "uniform random")
+              << " points, 64KB memory budget." << std::endl;
+
+    std::vector<float3> points(100000);
+    std::mt19937 gen(manyDuplicates ? 7 : 13);
+    std::uniform_real_distribution<float> dist(0.f,100.f);
+    for (auto &p : points) {
+      p = make_float3(dist(gen),dist(gen),dist(gen));
+      if (manyDuplicates) {
+        p.x = floorf(p.x/25.f);
+        p.y = floorf(p.y/50.f);
+      }
+    }
+    writeInputFile("testOutOfCoreBuilder.points",points);
+
+    OutOfCoreBuildConfig config;
+    config.memoryBudget = 64*1024;
+    config.numSamples   = 256;
+    buildTree_outOfCore<float3>("testOutOfCoreBuilder.points",
+                                "testOutOfCoreBuilder.cukd",
+                                config);
+    checkTree<float3,default_data_traits<float3>>("testOutOfCoreBuilder.cukd",points);
+
+    // a truncated tree file has to be rejected when mapping it, not
+    // crash the first traversal
+    {
+      std::ifstream in("testOutOfCoreBuilder.cukd",std::ios::binary);
+      std::vector<char> bytes((std::istreambuf_iterator<char>(in)),
+                              std::istreambuf_iterator<char>());
+      std::ofstream out("testOutOfCoreBuilder.truncated.cukd",std::ios::binary);
+      out.write(bytes.data(),bytes.size()-sizeof(float3));
+    }
+    bool rejected = false;
+    try {
+      serialized::MappedTree<float3> tree("testOutOfCoreBuilder.truncated.cukd");
+    } catch (std::runtime_error &) {
+      rejected = true;
+    }
+    remove("testOutOfCoreBuilder.truncated.cukd");
+    if (!rejected)
+      throw std::runtime_error("truncated tree file did not get rejected");
+
+    // so does a tree with more points than int-indexed traversals
+    // can handle (the header alone says so), and such an input to
+    // the builder
+    {
+      std::ifstream in("testOutOfCoreBuilder.cukd",std::ios::binary);
+      std::vector<char> bytes((std::istreambuf_iterator<char>(in)),
+                              std::istreambuf_iterator<char>());
+      const uint64_t tooMany = serialized::maxNumPoints+1;
+      memcpy(bytes.data()+offsetof(serialized::FileHeader,numPoints),
+             &tooMany,sizeof(tooMany));
+      std::ofstream out("testOutOfCoreBuilder.huge.cukd",std::ios::binary);
+      out.write(bytes.data(),bytes.size());
+      std::ofstream points("testOutOfCoreBuilder.huge.points",std::ios::binary);
+      const size_t tooManyPoints = tooMany;
+      points.write((const char *)&tooManyPoints,sizeof(tooManyPoints));
+    }
+    auto rejectsTooMany = [](const std::function<void()> &func) {
+      try {
+        func();
+      } catch (std::runtime_error &e) {
+        return std::string(e.what()).find("2^31-1") != std::string::npos;
+      }
+      return false;
+    };
+    const bool hugeRejected
+      =  rejectsTooMany([]() {
+          serialized::MappedTree<float3> tree("testOutOfCoreBuilder.huge.cukd");
+        })
+      && rejectsTooMany([]() {
+          buildTree_outOfCore<float3>("testOutOfCoreBuilder.huge.points",
+                                      "testOutOfCoreBuilder.huge.out.cukd");
+        });
+    remove("testOutOfCoreBuilder.huge.cukd");
+    remove("testOutOfCoreBuilder.huge.points");
+    if (!hugeRejected)
+      throw std::runtime_error("tree with more than 2^31-1 points did not get rejected");
+
+    remove("testOutOfCoreBuilder.points");
+    remove("testOutOfCoreBuilder.cukd");
+  }
+}
+
+namespace test_photon {
+  struct Photon {
+    float3 position;
+    float3 power;
+    uint16_t normal_phi;
+    uint8_t  normal_theta;
+    uint8_t  splitDim;
+  };
+
+  struct Photon_traits {
+    using point_t = float3;
+    enum { has_explicit_dim = true };
+
+    static inline __both__
+    const point_t &get_point(const Photon &p)
+    { return p.position; }
+
+    static inline __both__ float get_coord(const Photon &p, int d)
+    { return cukd::get_coord(p.position,d); }
+
+    static inline __both__ int  get_dim(const Photon &p)
+    { return p.splitDim; }
+
+    static inline __both__ void set_dim(Photon &p, int d)
+    { p.splitDim = d; }
+  };
+
+  void test_simple()
+  {
+    std::cout << "testing `buildTree_outOfCore` on 'Photons' array"
+      " (float3 plus payload), 50000 random photons, 64KB memory budget."
+              << std::endl;
+
+    std::vector<Photon> photons(50000);
+    std::mt19937 gen(17);
+    std::uniform_real_distribution<float> dist(0.f,100.f);
+    for (auto &p : photons) {
+      // make it anisotropic, so 'widest dim' actually matters
+      p.position = make_float3(dist(gen),.2f*dist(gen),.05f*dist(gen));
+      p.power = make_float3(0.f,0.f,0.f);
+      p.normal_theta = 0;
+      p.normal_phi = 0;
+      p.splitDim = 0;
+    }
+    writeInputFile("testOutOfCoreBuilder.photons",photons);
+
+    OutOfCoreBuildConfig config;
+    config.memoryBudget = 64*1024;
+    buildTree_outOfCore<Photon,Photon_traits>("testOutOfCoreBuilder.photons",
+                                              "testOutOfCoreBuilder.cukd",
+                                              config);
+    checkTree<Photon,Photon_traits>("testOutOfCoreBuilder.cukd",photons);
+
+    remove("testOutOfCoreBuilder.photons");
+    remove("testOutOfCoreBuilder.cukd");
+  }
+}
+
+int main(int, const char **)
+{
+  test_float3::test_simple(false);
+  test_float3::test_simple(true);
+  test_photon::test_simple();
+  return 0;
+}
@@ -0,0 +1,154 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* computes the PCA frame of a diagonal "road corridor" point set,
+   checks that the frame is orthonormal and that its first axis is
+   the corridor's direction, and that fcp on a tree over the rotated
+   points finds the closest points - while visiting fewer nodes than
+   on the axis-aligned tree */
+
+#include "cukd/builder_host.h"
+#include "cukd/fcp.h"
+#include "cukd/pca.h"
+#include <random>
+
+using namespace cukd;
+
+const int numPoints  = 50000;
+const int numQueries = 2000;
+
+/*! point plus explicit split dim, so the builder can always split
+    the widest dimension - which is what makes the PCA frame pay off
+    (with round-robin dims, every third level would split the
+    corridor's - tiny - height) */
+struct PointAndDim {
+  float3 point;
+  int    dim;
+};
+
+struct PointAndDim_traits : public default_data_traits<float3> {
+  using data_t = PointAndDim;
+  enum { has_explicit_dim = true };
+  static inline __both__ const float3 &get_point(const PointAndDim &n)
+  { return n.point; }
+  static inline __both__ float get_coord(const PointAndDim &n, int d)
+  { return cukd::get_coord(n.point,d); }
+  static inline __both__ int  get_dim(const PointAndDim &n) { return n.dim; }
+  static inline __both__ void set_dim(PointAndDim &n, int d) { n.dim = d; }
+};
+
+std::vector<PointAndDim> buildTree(const std::vector<float3> &points)
+{
+  std::vector<PointAndDim> tree(points.size());
+  for (size_t i=0;i<points.size();i++)
+    tree[i] = { points[i], 0 };
+  box_t<float3> bounds;
+  buildTree_host<PointAndDim,PointAndDim_traits>(tree.data(),(int)tree.size(),&bounds);
+  return tree;
+}
+
+/*! wraps FCPResult, and counts how many nodes got visited */
+struct CountingResult : public FCPResult {
+  inline float processCandidate(int primID, float dist2)
+  { ++numVisited; return FCPResult::processCandidate(primID,dist2); }
+  size_t numVisited = 0;
+};
+
+size_t countVisits(const std::vector<PointAndDim> &tree,
+                   const std::vector<float3> &queries)
+{
+  size_t numVisited = 0;
+  for (auto query : queries) {
+    CountingResult result;
+    result.clear(INFINITY);
+    traverse_default<CountingResult,PointAndDim,PointAndDim_traits>
+      (result,query,tree.data(),(int)tree.size());
+    numVisited += result.numVisited;
+  }
+  return numVisited;
+}
+
+int main(int, const char **)
+{
+  std::mt19937 gen(0x5eed);
+  std::uniform_real_distribution<float> along(0.f,1000.f);
+  std::uniform_real_distribution<float> across(-1.f,1.f);
+  // corridor direction, width, and height axes (orthonormal)
+  const float3 dir  = make_float3(.6917f,.6917f,.2075f);
+  const float3 side = make_float3(-.7071f,.7071f,0.f);
+  const float3 up   = make_float3(-.1467f,-.1467f,.9782f);
+  auto makePoint = [&]() {
+    const float a = along(gen), w = 4.f*across(gen), h = .5f*across(gen);
+    return make_float3(a*dir.x+w*side.x+h*up.x,
+                       a*dir.y+w*side.y+h*up.y,
+                       a*dir.z+w*side.z+h*up.z);
+  };
+  std::vector<float3> points(numPoints), queries(numQueries);
+  for (auto &p : points)  p = makePoint();
+  for (auto &q : queries) q = makePoint();
+
+  std::cout << "testing PCA frame of " << numPoints << " points in a diagonal corridor"
+            << std::endl;
+  auto frame = pca::computeFrame_host(points.data(),numPoints);
+  for (int i=0;i<3;i++)
+    for (int j=0;j<3;j++)
+      if (fabsf(dot(frame.axis[i],frame.axis[j])-(i==j?1.f:0.f)) > 1e-5f)
+        throw std::runtime_error("PCA frame is not orthonormal");
+  if (fabsf(dot(frame.axis[0],dir)) < .9999f)
+    throw std::runtime_error("first PCA axis is not the corridor direction");
+  if (fabsf(dot(frame.axis[1],side)) < .999f)
+    throw std::runtime_error("second PCA axis is not the corridor's width");
+
+  std::vector<float3> rotatedPoints = points;
+  pca::transform_host(frame,rotatedPoints.data(),numPoints);
+  // same rotation, applied to the data_t's through their traits
+  std::vector<PointAndDim> rotatedData(numPoints);
+  for (int i=0;i<numPoints;i++)
+    rotatedData[i] = { points[i], i };
+  pca::transform_host<PointAndDim,PointAndDim_traits>
+    (frame,rotatedData.data(),numPoints);
+  for (int i=0;i<numPoints;i++)
+    if (sqrDistance(rotatedData[i].point,rotatedPoints[i]) != 0.f
+        || rotatedData[i].dim != i)
+      throw std::runtime_error("transforming data_t's differs from transforming points");
+  std::vector<PointAndDim> aligned = buildTree(points);
+  std::vector<PointAndDim> rotated = buildTree(rotatedPoints);
+
+  for (int q=0;q<numQueries;q++) {
+    float best = INFINITY;
+    for (auto p : points) best = std::min(best,sqrDistance(p,queries[q]));
+    const int found = stackBased::fcp<PointAndDim,PointAndDim_traits>
+      (frame.toFrame(queries[q]),rotated.data(),numPoints);
+    if (found < 0)
+      throw std::runtime_error("fcp in PCA frame did not find any point");
+    const float foundDist2
+      = sqrDistance(frame.fromFrame(rotated[found].point),queries[q]);
+    if (fabsf(sqrtf(foundDist2)-sqrtf(best)) > 1e-3f)
+      throw std::runtime_error("fcp in PCA frame did not find closest point");
+  }
+
+  std::vector<float3> rotatedQueries(numQueries);
+  for (int q=0;q<numQueries;q++)
+    rotatedQueries[q] = frame.toFrame(queries[q]);
+  const size_t visitsAligned = countVisits(aligned,queries);
+  const size_t visitsRotated = countVisits(rotated,rotatedQueries);
+  std::cout << "avg nodes visited per fcp: axis-aligned "
+            << float(visitsAligned)/numQueries << ", PCA-aligned "
+            << float(visitsRotated)/numQueries << std::endl;
+  if (visitsRotated >= visitsAligned)
+    throw std::runtime_error("PCA frame did not reduce number of visited nodes");
+  return 0;
+}
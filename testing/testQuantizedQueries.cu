@@ -0,0 +1,137 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* builds trees on the host, creates 16- and 8-bit quantized copies of
+   them, and checks that fcp and knn queries on the quantized trees
+   return the same distances as the regular (full-precision)
+   traversals do */
+
+#include "cukd/builder_host.h"
+#include "cukd/quantized.h"
+#include <random>
+
+using namespace cukd;
+
+const int numQueries = 2000;
+const int k = 8;
+
+struct Photon {
+  float3   position;
+  float3   power;
+  uint16_t normal_phi;
+  uint8_t  normal_theta;
+  uint8_t  splitDim;
+};
+
+struct Photon_traits {
+  using point_t = float3;
+  enum { has_explicit_dim = true };
+
+  static inline __both__
+  const point_t &get_point(const Photon &p)
+  { return p.position; }
+
+  static inline __both__ float get_coord(const Photon &p, int d)
+  { return cukd::get_coord(p.position,d); }
+
+  static inline __both__ int  get_dim(const Photon &p)
+  { return p.splitDim; }
+
+  static inline __both__ void set_dim(Photon &p, int d)
+  { p.splitDim = d; }
+};
+
+template<typename data_t, typename data_traits, typename storage_t>
+void test(const std::vector<data_t> &input,
+          float cutOffRadius,
+          const std::string &description)
+{
+  std::cout << "testing quantized queries (" << 8*sizeof(storage_t)
+            << " bits), " << description << std::endl;
+
+  using tree_t = quantized::Tree<data_t,data_traits,storage_t>;
+  const int numPoints = (int)input.size();
+  std::vector<data_t> points = input;
+  box_t<float3> worldBounds;
+  buildTree_host<data_t,data_traits>(points.data(),numPoints,&worldBounds);
+
+  std::vector<typename tree_t::node_t> nodes(numPoints);
+  tree_t tree = quantized::quantizeTree_host<data_t,data_traits,storage_t>
+    (nodes.data(),points.data(),numPoints,worldBounds);
+
+  std::mt19937 gen(0x1234);
+  std::uniform_real_distribution<float> dist(-10.f,110.f);
+  FcpSearchParams params;
+  params.cutOffRadius = cutOffRadius;
+  for (int q=0;q<numQueries;q++) {
+    float3 query = make_float3(dist(gen),dist(gen),dist(gen));
+
+    int expected = stackBased::fcp<data_t,data_traits>
+      (query,points.data(),numPoints,params);
+    int found = quantized::fcp(tree,query,params);
+    if ((expected < 0) != (found < 0) ||
+        (found >= 0 &&
+         sqrDistance(data_traits::get_point(points[found]),query) !=
+         sqrDistance(data_traits::get_point(points[expected]),query)))
+      throw std::runtime_error("quantized fcp returned wrong result");
+
+    FixedCandidateList<k> expectedList(cutOffRadius);
+    stackBased::knn<FixedCandidateList<k>,data_t,data_traits>
+      (expectedList,query,points.data(),numPoints);
+    FixedCandidateList<k> foundList(cutOffRadius);
+    quantized::knn(foundList,tree,query);
+    for (int i=0;i<k;i++)
+      if (foundList.get_dist2(i) != expectedList.get_dist2(i))
+        throw std::runtime_error("quantized knn returned wrong result");
+  }
+}
+
+int main(int, const char **)
+{
+  std::mt19937 gen(0x5eed);
+  std::uniform_real_distribution<float> dist(0.f,100.f);
+
+  std::vector<float3> points(100000);
+  for (auto &p : points)
+    p = make_float3(dist(gen),dist(gen),dist(gen));
+  test<float3,default_data_traits<float3>,uint16_t>
+    (points,INFINITY,"float3, uniform random, unbounded");
+  test<float3,default_data_traits<float3>,uint16_t>
+    (points,2.f,"float3, uniform random, cut-off radius 2");
+  test<float3,default_data_traits<float3>,uint8_t>
+    (points,INFINITY,"float3, uniform random, unbounded");
+
+  // many points that quantize to the same values
+  std::vector<float3> clustered(points.size());
+  for (size_t i=0;i<points.size();i++)
+    clustered[i] = make_float3(50.f+1e-3f*points[i].x,
+                               points[i].y,
+                               (i%2) ? 100.f : 0.f);
+  test<float3,default_data_traits<float3>,uint8_t>
+    (clustered,INFINITY,"float3, clustered");
+
+  std::vector<Photon> photons(50000);
+  for (auto &p : photons) {
+    p.position = make_float3(dist(gen),.2f*dist(gen),.05f*dist(gen));
+    p.power = make_float3(0.f,0.f,0.f);
+    p.normal_phi = 0;
+    p.normal_theta = 0;
+    p.splitDim = 0;
+  }
+  test<Photon,Photon_traits,uint16_t>
+    (photons,INFINITY,"photons with explicit split dims");
+  return 0;
+}
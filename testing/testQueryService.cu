@@ -0,0 +1,155 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+/* submits fcp and knn requests from many concurrent producer threads
+   to a QueryService, and checks that every future completes with the
+   same result a direct query gives; checks that a lone query gets
+   dispatched by its deadline (rather than waiting for a full batch),
+   that full batches get dispatched, and that destroying the service
+   completes everything still queued */
+
+#include "cukd/builder_host.h"
+#include "cukd/query-service.h"
+#include <random>
+
+using namespace cukd;
+
+const int numPoints    = 100000;
+const int numProducers = 8;
+const int numRequestsPerProducer = 2000;
+const int k = 4;
+
+std::vector<int> knnDirect(const float3 &query, int k, const float3 *points)
+{
+  HostCandidateList candidates(k,INFINITY);
+  stackBased::knn<HostCandidateList,float3>(candidates,query,points,numPoints);
+  std::vector<int> result(k);
+  for (int i=0;i<k;i++) result[i] = candidates.get_pointID(i);
+  return result;
+}
+
+int main(int, const char **)
+{
+  std::mt19937 gen(0x1234);
+  std::uniform_real_distribution<float> uniform(0.f,1.f);
+  std::vector<float3> points(numPoints);
+  for (auto &p : points)
+    p = make_float3(uniform(gen),uniform(gen),uniform(gen));
+  buildTree_host(points.data(),numPoints);
+
+  {
+    // a lone query has to complete by its deadline, not wait for a
+    // batch that never fills up
+    QueryServiceConfig config;
+    config.maxBatchSize = 1000000;
+    config.maxDelay     = 1e-3;
+    QueryService<float3> service(points.data(),numPoints,config);
+    const float3 query = make_float3(.5f,.5f,.5f);
+    std::future<int> closest = service.fcp(query);
+    if (closest.wait_for(std::chrono::seconds(10)) != std::future_status::ready)
+      throw std::runtime_error("lone query did not get dispatched");
+    if (closest.get() != stackBased::fcp(query,points.data(),numPoints))
+      throw std::runtime_error("lone query: wrong result");
+    if (service.stats().numFullBatches != 0)
+      throw std::runtime_error("lone query counted as full batch");
+  }
+  
+  for (bool mortonOrder : { false, true }) {
+    QueryServiceConfig config;
+    config.maxBatchSize = 256;
+    config.numThreads   = 4;
+    config.mortonOrder  = mortonOrder;
+    QueryService<float3> service(points.data(),numPoints,config);
+    std::vector<std::thread> producers;
+    std::atomic<int> numWrong(0);
+    for (int p=0;p<numProducers;p++)
+      producers.push_back(std::thread([&,p]() {
+            std::mt19937 gen(p);
+            std::uniform_real_distribution<float> uniform(-.1f,1.1f);
+            auto random = [&]() { return make_float3(uniform(gen),uniform(gen),uniform(gen)); };
+            // keep a few requests in flight at a time, like a real
+            // request thread with some async I/O would
+            std::vector<float3> fcpQueries, knnQueries, multiQueries;
+            std::vector<std::future<int>> fcpResults;
+            std::vector<std::future<std::vector<int>>> knnResults, multiResults;
+            for (int r=0;r<numRequestsPerProducer;r++) {
+              switch (r % 3) {
+              case 0:
+                fcpQueries.push_back(random());
+                fcpResults.push_back(service.fcp(fcpQueries.back()));
+                break;
+              case 1:
+                knnQueries.push_back(random());
+                knnResults.push_back(service.knn(knnQueries.back(),k));
+                break;
+              default:
+                for (int i=0;i<3;i++) multiQueries.push_back(random());
+                multiResults.push_back(service.fcp(&multiQueries[multiQueries.size()-3],3));
+              }
+            }
+            for (size_t i=0;i<fcpResults.size();i++)
+              if (fcpResults[i].get()
+                  != stackBased::fcp(fcpQueries[i],points.data(),numPoints))
+                numWrong++;
+            for (size_t i=0;i<knnResults.size();i++)
+              if (knnResults[i].get() != knnDirect(knnQueries[i],k,points.data()))
+                numWrong++;
+            for (size_t i=0;i<multiResults.size();i++) {
+              std::vector<int> result = multiResults[i].get();
+              for (int j=0;j<3;j++)
+                if (result[j] != stackBased::fcp(multiQueries[3*i+j],
+                                                 points.data(),numPoints))
+                  numWrong++;
+            }
+          }));
+    for (auto &p : producers) p.join();
+    if (numWrong != 0)
+      throw std::runtime_error(std::to_string(numWrong)+" wrong results");
+    QueryServiceStats stats = service.stats();
+    size_t expectedQueries = 0;
+    for (int r=0;r<numRequestsPerProducer;r++)
+      expectedQueries += numProducers*((r % 3 == 2) ? 3 : 1);
+    if (stats.numQueries != expectedQueries)
+      throw std::runtime_error("not all queries got dispatched");
+    if (stats.maxBatchSize > (size_t)config.maxBatchSize)
+      throw std::runtime_error("batch too large");
+    std::cout << "morton order " << (mortonOrder?"on":"off") << ": "
+              << stats.numQueries << " queries in " << stats.numBatches
+              << " batches (" << stats.numFullBatches << " full)" << std::endl;
+  }
+  
+  {
+    // whatever is queued when the service goes away still completes
+    std::vector<std::future<int>> results;
+    std::vector<float3> queries(1000);
+    for (auto &q : queries)
+      q = make_float3(uniform(gen),uniform(gen),uniform(gen));
+    {
+      QueryServiceConfig config;
+      config.maxBatchSize = 1000000;
+      config.maxDelay     = 3600.;
+      QueryService<float3> service(points.data(),numPoints,config);
+      for (auto &q : queries)
+        results.push_back(service.fcp(q));
+    }
+    for (size_t i=0;i<queries.size();i++)
+      if (results[i].get() != stackBased::fcp(queries[i],points.data(),numPoints))
+        throw std::runtime_error("query completed at shutdown: wrong result");
+  }
+  std::cout << "query service works" << std::endl;
+  return 0;
+}
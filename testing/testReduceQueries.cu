@@ -0,0 +1,131 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* checks the reduce() queries (count, and kernel-weighted sum of
+   payloads within a radius) against brute force, for balanced and
+   spatial k-d trees */
+
+#include "cukd/builder_host.h"
+#include "cukd/reduce.h"
+#include <random>
+
+using namespace cukd;
+
+const int   numPoints  = 20000;
+const int   numQueries = 1000;
+const float radius     = 4.f;
+
+struct Photon {
+  float3 position;
+  float  power;
+};
+
+struct Photon_traits : public default_data_traits<float3> {
+  using data_t = Photon;
+  static inline __both__ const float3 &get_point(const Photon &p)
+  { return p.position; }
+  static inline __both__ float get_coord(const Photon &p, int d)
+  { return cukd::get_coord(p.position,d); }
+  enum { has_explicit_dim = false };
+  static inline __both__ int  get_dim(const Photon &) { return -1; }
+  static inline __both__ void set_dim(Photon &, int) {}
+};
+
+/*! density estimate with a cone (linear fall-off) kernel */
+struct PowerSum {
+  inline __both__ void add(int, const Photon &p, float dist2)
+  { power += p.power * (1.f - sqrtf(dist2)/radius); }
+
+  float power = 0.f;
+};
+
+template<typename Query>
+void check(const std::string &description,
+           const std::vector<Photon> &photons,
+           const std::vector<float3> &queries,
+           const Query &query)
+{
+  std::cout << "testing reduce(), " << description << std::endl;
+  size_t totalCount = 0;
+  for (auto q : queries) {
+    int count = 0; double power = 0.;
+    for (auto &p : photons) {
+      float dist2 = sqrDistance(p.position,q);
+      if (dist2 >= radius*radius) continue;
+      count++;
+      power += p.power * (1.f - sqrtf(dist2)/radius);
+    }
+    CountReducer counter;
+    PowerSum sum;
+    query(counter,sum,q);
+    if (counter.count != count)
+      throw std::runtime_error("wrong count: "+std::to_string(counter.count)
+                               +", expected "+std::to_string(count));
+    if (fabs(sum.power-power) > 1e-4*(1.+power))
+      throw std::runtime_error("wrong power sum: "+std::to_string(sum.power)
+                               +", expected "+std::to_string(power));
+    totalCount += count;
+  }
+  std::cout << "  all results match brute force (avg "
+            << float(totalCount)/queries.size() << " points per query)" << std::endl;
+}
+
+int main(int, const char **)
+{
+  std::mt19937 gen(0x5eed);
+  std::uniform_real_distribution<float> dist(0.f,50.f);
+  std::vector<Photon> photons(numPoints);
+  for (auto &p : photons)
+    p = { make_float3(dist(gen),dist(gen),dist(gen)), dist(gen) };
+  std::vector<float3> queries(numQueries);
+  for (auto &q : queries) q = make_float3(dist(gen),dist(gen),dist(gen));
+
+  std::vector<Photon> tree = photons;
+  buildTree_host<Photon,Photon_traits>(tree.data(),numPoints);
+  check("stack-based",photons,queries,
+        [&](CountReducer &counter, PowerSum &sum, float3 q) {
+          stackBased::reduce<CountReducer,Photon,Photon_traits>
+            (counter,q,radius,tree.data(),numPoints);
+          stackBased::reduce<PowerSum,Photon,Photon_traits>
+            (sum,q,radius,tree.data(),numPoints);
+        });
+  check("stack-free",photons,queries,
+        [&](CountReducer &counter, PowerSum &sum, float3 q) {
+          stackFree::reduce<CountReducer,Photon,Photon_traits>
+            (counter,q,radius,tree.data(),numPoints);
+          stackFree::reduce<PowerSum,Photon,Photon_traits>
+            (sum,q,radius,tree.data(),numPoints);
+        });
+
+  {
+    ManagedMemMemoryResource managedMem;
+    Photon *d_photons = 0;
+    CUKD_CUDA_CALL(MallocManaged((void**)&d_photons,numPoints*sizeof(Photon)));
+    std::copy(photons.begin(),photons.end(),d_photons);
+    SpatialKDTree<Photon,Photon_traits> spatial;
+    BuildConfig config;
+    buildTree(spatial,d_photons,numPoints,config,0,managedMem);
+    CUKD_CUDA_SYNC_CHECK();
+    check("spatial k-d tree",photons,queries,
+          [&](CountReducer &counter, PowerSum &sum, float3 q) {
+            stackBased::reduce(counter,spatial,q,radius);
+            stackBased::reduce(sum,spatial,q,radius);
+          });
+    free(spatial,0,managedMem);
+    CUKD_CUDA_CALL(Free(d_photons));
+  }
+  return 0;
+}
@@ -0,0 +1,172 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* splits a point set into shards, builds one tree per shard, and
+   checks that sharded kNN queries return the same k distances as a
+   brute-force search over all points - both with all shards in the
+   same process, and (on posix systems) with each shard served by its
+   own process, talking to the coordinator through pipes */
+
+#include "cukd/builder_host.h"
+#include "cukd/sharded.h"
+#include <random>
+#ifndef _WIN32
+# include <sys/wait.h>
+#endif
+
+using namespace cukd;
+using namespace cukd::sharded;
+
+const int numPoints  = 20000;
+const int numQueries = 2000;
+const int k          = 8;
+const int numLevels  = 3;
+const float cutOffRadius = 20.f;
+
+void checkResults(const std::vector<float3> &points,
+                  const std::vector<float3> &queries,
+                  const std::vector<int> &shardBegin,
+                  const std::vector<Candidate> &results)
+{
+  std::vector<float> dists(points.size());
+  for (int q=0;q<numQueries;q++) {
+    for (size_t i=0;i<points.size();i++)
+      dists[i] = sqrDistance(points[i],queries[q]);
+    std::sort(dists.begin(),dists.end());
+    for (int i=0;i<k;i++) {
+      const Candidate &c = results[q*k+i];
+      const bool expectFound = dists[i] < cutOffRadius*cutOffRadius;
+      if (expectFound != (c.pointID >= 0))
+        throw std::runtime_error("sharded knn: wrong number of results");
+      if (!expectFound) continue;
+      const float3 found = points[shardBegin[c.shardID]+c.pointID];
+      if (c.dist2 != dists[i] || sqrDistance(found,queries[q]) != c.dist2)
+        throw std::runtime_error("sharded knn: wrong result for query "
+                                 +std::to_string(q));
+    }
+  }
+}
+
+int main(int, const char **)
+{
+  std::cout << "testing sharded knn, " << numPoints << " points in "
+            << (1<<numLevels) << " shards, k=" << k << std::endl;
+
+  std::mt19937 gen(0x5eed);
+  std::uniform_real_distribution<float> dist(0.f,100.f);
+  std::vector<float3> points(numPoints), queries(numQueries);
+  for (auto &p : points)  p = make_float3(dist(gen),dist(gen),dist(gen));
+  for (auto &q : queries) q = make_float3(dist(gen),dist(gen),dist(gen));
+
+  // partition into shards, and build one (regular) tree per shard
+  std::vector<int> shardBegin;
+  Router<float3> router
+    = partitionIntoShards(points.data(),numPoints,numLevels,shardBegin);
+  const int numShards = router.numShards();
+  for (int s=0;s<numShards;s++)
+    buildTree_host(points.data()+shardBegin[s],shardBegin[s+1]-shardBegin[s]);
+
+  // ------------------------------------------------------------------
+  // all shards in this process
+  // ------------------------------------------------------------------
+  {
+    std::vector<std::unique_ptr<LocalShard<float3>>> localShards;
+    std::vector<ShardClient<float3> *> clients;
+    for (int s=0;s<numShards;s++) {
+      localShards.emplace_back
+        (new LocalShard<float3>(points.data()+shardBegin[s],
+                                shardBegin[s+1]-shardBegin[s]));
+      clients.push_back(localShards.back().get());
+    }
+    Coordinator<float3> coordinator(router,clients);
+    std::vector<Candidate> results(numQueries*k);
+    QueryStats stats;
+    coordinator.knn(queries.data(),numQueries,k,cutOffRadius,results.data(),&stats);
+    checkResults(points,queries,shardBegin,results);
+    std::cout << "local shards: " << stats.numShardQueries << " shard queries for "
+              << numQueries << " queries (" << stats.numSecondPhaseQueries
+              << " to non-home shards)" << std::endl;
+    if (stats.numShardQueries >= size_t(numQueries)*numShards)
+      throw std::runtime_error("sharded knn: no shards got culled");
+
+    // same queries, with all temporary memory from a pool
+    PooledHostMemoryResource pool;
+    coordinator.knn(queries.data(),numQueries,k,cutOffRadius,results.data(),
+                    nullptr,pool);
+    checkResults(points,queries,shardBegin,results);
+    if (pool.stats().bytesInUse != 0 || pool.stats().peakBytesInUse == 0)
+      throw std::runtime_error("sharded knn: pool not used properly");
+
+    // k=0 would leave no slot for the k'th closest distance
+    bool threw = false;
+    try {
+      coordinator.knn(queries.data(),numQueries,0,cutOffRadius,results.data());
+    } catch (const std::runtime_error &) { threw = true; }
+    if (!threw)
+      throw std::runtime_error("sharded knn: k=0 was not rejected");
+  }
+
+#ifndef _WIN32
+  // ------------------------------------------------------------------
+  // one process per shard
+  // ------------------------------------------------------------------
+  {
+    std::vector<std::unique_ptr<StreamShardClient<float3>>> remoteShards;
+    std::vector<ShardClient<float3> *> clients;
+    std::vector<pid_t> children;
+    for (int s=0;s<numShards;s++) {
+      int toShard[2], fromShard[2];
+      if (pipe(toShard) || pipe(fromShard))
+        throw std::runtime_error("could not create pipes");
+      pid_t pid = fork();
+      if (pid < 0) throw std::runtime_error("could not fork");
+      if (pid == 0) {
+        // the child process: serve this shard until parent is done
+        close(toShard[1]);
+        close(fromShard[0]);
+        LocalShard<float3> shard(points.data()+shardBegin[s],
+                                 shardBegin[s+1]-shardBegin[s]);
+        serveShard<float3>(shard,toShard[0],fromShard[1]);
+        _exit(0);
+      }
+      close(toShard[0]);
+      close(fromShard[1]);
+      children.push_back(pid);
+      remoteShards.emplace_back(new StreamShardClient<float3>(toShard[1],fromShard[0]));
+      clients.push_back(remoteShards.back().get());
+    }
+
+    Coordinator<float3> coordinator(router,clients);
+    std::vector<Candidate> results(numQueries*k);
+    coordinator.knn(queries.data(),numQueries,k,cutOffRadius,results.data());
+    checkResults(points,queries,shardBegin,results);
+
+    for (auto &shard : remoteShards) {
+      shard->shutdown();
+      close(shard->sendFd);
+      close(shard->recvFd);
+    }
+    for (pid_t pid : children) {
+      int status = 0;
+      waitpid(pid,&status,0);
+      if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        throw std::runtime_error("shard process failed");
+    }
+    std::cout << "shard processes: results match" << std::endl;
+  }
+#endif
+  return 0;
+}
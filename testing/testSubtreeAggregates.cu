@@ -0,0 +1,141 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* checks per-subtree aggregates (bounds, count, payload sums), and
+   the range-count and reduction queries that use them, against brute
+   force */
+
+#include "cukd/builder_host.h"
+#include "cukd/aggregates.h"
+#include <random>
+
+using namespace cukd;
+
+const int   numPoints  = 50000;
+const int   numQueries = 1000;
+
+struct Photon {
+  float3 position;
+  float  power;
+};
+
+struct Photon_traits : public default_data_traits<float3> {
+  using data_t = Photon;
+  static inline __both__ const float3 &get_point(const Photon &p)
+  { return p.position; }
+  static inline __both__ float get_coord(const Photon &p, int d)
+  { return cukd::get_coord(p.position,d); }
+  enum { has_explicit_dim = false };
+  static inline __both__ int  get_dim(const Photon &) { return -1; }
+  static inline __both__ void set_dim(Photon &, int) {}
+};
+
+struct PowerSum_traits {
+  using payload_t = float;
+  static inline __both__ float payload_of(const Photon &p) { return p.power; }
+  static inline __both__ void  combine(float &a, float b) { a += b; }
+};
+
+using Aggregate = SubtreeAggregateFor<Photon,Photon_traits,PowerSum_traits>;
+
+/*! sums up photon power within the radius, and counts how much work
+    that took */
+struct PowerSum {
+  inline __both__ void add(int, const Photon &p, float)
+  { power += p.power; numPointsVisited++; }
+  inline __both__ void addSubtree(const Aggregate &agg, float, float)
+  { power += agg.payload; numSubtreesAccepted++; }
+
+  double power = 0.;
+  int numPointsVisited = 0;
+  int numSubtreesAccepted = 0;
+};
+
+int main(int, const char **)
+{
+  std::mt19937 gen(0x5eed);
+  std::uniform_real_distribution<float> dist(0.f,100.f);
+  std::vector<Photon> photons(numPoints);
+  for (auto &p : photons)
+    p = { make_float3(dist(gen),dist(gen),dist(gen)), dist(gen) };
+  buildTree_host<Photon,Photon_traits>(photons.data(),numPoints);
+
+  std::vector<Aggregate> aggregates(numPoints);
+  computeAggregates_host<Photon,Photon_traits,PowerSum_traits>
+    (aggregates.data(),photons.data(),numPoints);
+
+  std::cout << "checking subtree aggregates" << std::endl;
+  double totalPower = 0.;
+  box_t<float3> bounds; bounds.setEmpty();
+  for (auto &p : photons) { totalPower += p.power; bounds.grow(p.position); }
+  if (aggregates[0].count != numPoints)
+    throw std::runtime_error("root aggregate has wrong count");
+  if (fabs(aggregates[0].payload-totalPower) > 1e-4*totalPower)
+    throw std::runtime_error("root aggregate has wrong payload sum");
+  if (!(aggregates[0].bounds.contains(bounds) && bounds.contains(aggregates[0].bounds)))
+    throw std::runtime_error("root aggregate has wrong bounds");
+  for (int i=0;i<numPoints;i++)
+    if (!aggregates[i].bounds.contains(photons[i].position))
+      throw std::runtime_error("subtree bounds do not contain subtree's root");
+
+  std::cout << "checking countInBox()" << std::endl;
+  for (int q=0;q<numQueries;q++) {
+    box_t<float3> box;
+    box.setEmpty();
+    box.grow(make_float3(dist(gen),dist(gen),dist(gen)));
+    box.grow(make_float3(dist(gen),dist(gen),dist(gen)));
+    int expected = 0;
+    for (auto &p : photons) expected += box.contains(p.position);
+    const int count
+      = countInBox<Photon,Photon_traits>(box,photons.data(),aggregates.data(),numPoints);
+    if (count != expected)
+      throw std::runtime_error("countInBox: got "+std::to_string(count)
+                               +", expected "+std::to_string(expected));
+  }
+
+  std::cout << "checking reduce() with aggregates" << std::endl;
+  size_t pointsVisited = 0, subtreesAccepted = 0, pointsInRadius = 0;
+  for (int q=0;q<numQueries;q++) {
+    const float3 query = make_float3(dist(gen),dist(gen),dist(gen));
+    const float radius = .2f*dist(gen);
+    int expectedCount = 0; double expectedPower = 0.;
+    for (auto &p : photons)
+      if (sqrDistance(p.position,query) < radius*radius) {
+        expectedCount++;
+        expectedPower += p.power;
+      }
+
+    CountReducer counter;
+    stackBased::reduce<CountReducer,Photon,Photon_traits>
+      (counter,query,radius,photons.data(),aggregates.data(),numPoints);
+    if (counter.count != expectedCount)
+      throw std::runtime_error("reduce: wrong count");
+
+    PowerSum sum;
+    stackBased::reduce<PowerSum,Photon,Photon_traits>
+      (sum,query,radius,photons.data(),aggregates.data(),numPoints);
+    if (fabs(sum.power-expectedPower) > 1e-4*(1.+expectedPower))
+      throw std::runtime_error("reduce: wrong power sum");
+    pointsVisited    += sum.numPointsVisited;
+    subtreesAccepted += sum.numSubtreesAccepted;
+    pointsInRadius   += expectedCount;
+  }
+  std::cout << "  all results match brute force; per query "
+            << float(pointsInRadius)/numQueries << " points in radius, "
+            << float(pointsVisited)/numQueries << " points visited individually, "
+            << float(subtreesAccepted)/numQueries << " subtrees accepted" << std::endl;
+  return 0;
+}
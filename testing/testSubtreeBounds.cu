@@ -0,0 +1,153 @@
+// ======================================================================== //
+// Copyright 2018-2024 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* checks that host- and device-built subtree bounds tables are the
+   same, and hold the tight bounds of each subtree; and that cct and
+   sf-imp fcp/knn queries return the same results with and without
+   (full and quantized, complete and partial) subtree bounds tables */
+
+#include "cukd/builder_host.h"
+#include "cukd/knn.h"
+#include <random>
+#include <cstring>
+
+using namespace cukd;
+
+const int numPoints  = 20000;
+const int numQueries = 2000;
+const int k = 8;
+
+template<typename table_t>
+void check(const std::string &description,
+           const std::vector<float3> &tree,
+           const box_t<float3> &worldBounds,
+           const std::vector<float3> &queries,
+           SubtreeBoundsConfig config)
+{
+  std::cout << "testing " << description << std::endl;
+  const int N = (int)tree.size();
+  table_t table;
+  buildSubtreeBounds_host(table,tree.data(),N,config);
+  if (table.numEntries < 1 || table.numEntries > N ||
+      table.numEntries*sizeof(typename table_t::Entry) > config.maxBytes)
+    throw std::runtime_error("table has wrong size");
+  if (table.numEntries < N && (table.numEntries & (table.numEntries+1)) != 0)
+    throw std::runtime_error("table that does not cover all points has partial level");
+  for (int i=0;i<N;i++) {
+    box_t<float3> bounds;
+    if (table.get(i,bounds) && !bounds.contains(tree[i]))
+      throw std::runtime_error("subtree bounds do not contain subtree's root");
+  }
+
+  // reference: every point grows all of its ancestors' boxes
+  std::vector<box_t<float3>> reference(table.numEntries);
+  for (auto &box : reference) box.setEmpty();
+  for (int i=0;i<N;i++)
+    for (int nodeID=i; ; nodeID=BinaryTree::parentOf(nodeID)) {
+      if (nodeID < table.numEntries) reference[nodeID].grow(tree[i]);
+      if (nodeID == 0) break;
+    }
+  for (int i=0;i<table.numEntries;i++) {
+    const typename table_t::Entry expected
+      = table_t::encode(reference[i],reference[0]);
+    if (memcmp(&table.entries[i],&expected,sizeof(expected)) != 0)
+      throw std::runtime_error("subtree bounds are not the tight bounds");
+  }
+
+  // the device builder has to produce exactly the same table
+  {
+    float3 *d_tree = 0;
+    CUKD_CUDA_CALL(Malloc((void**)&d_tree,N*sizeof(float3)));
+    CUKD_CUDA_CALL(Memcpy(d_tree,tree.data(),N*sizeof(float3),cudaMemcpyDefault));
+    table_t d_table;
+    buildSubtreeBounds(d_table,d_tree,N,config);
+    std::vector<typename table_t::Entry> entries(d_table.numEntries);
+    CUKD_CUDA_CALL(Memcpy(entries.data(),d_table.entries,
+                          d_table.numEntries*sizeof(typename table_t::Entry),
+                          cudaMemcpyDefault));
+    if (d_table.numEntries != table.numEntries ||
+        memcmp(entries.data(),table.entries,
+               table.numEntries*sizeof(typename table_t::Entry)) != 0 ||
+        memcmp(&d_table.worldBounds,&table.worldBounds,sizeof(table.worldBounds)) != 0)
+      throw std::runtime_error("device-built table differs from host-built one");
+    free(d_table);
+    CUKD_CUDA_CALL(Free(d_tree));
+  }
+
+  for (auto query : queries) {
+    const int expected = stackBased::fcp(query,tree.data(),N);
+    const float expectedDist2 = sqrDistance(tree[expected],query);
+    FixedCandidateList<k> expectedKNN(INFINITY);
+    stackBased::knn(expectedKNN,query,tree.data(),N);
+
+    const int cctResult
+      = cct::fcp(query,worldBounds,table,tree.data(),N);
+    const int sfImpResult
+      = sfImp::fcp(query,worldBounds,table,tree.data(),N);
+    if (sqrDistance(tree[cctResult],query) != expectedDist2 ||
+        sqrDistance(tree[sfImpResult],query) != expectedDist2)
+      throw std::runtime_error("wrong fcp result");
+
+    FixedCandidateList<k> cctKNN(INFINITY), sfImpKNN(INFINITY);
+    cct::knn(cctKNN,query,worldBounds,table,tree.data(),N);
+    sfImp::knn(sfImpKNN,query,worldBounds,table,tree.data(),N);
+    for (int i=0;i<k;i++)
+      if (cctKNN.get_dist2(i) != expectedKNN.get_dist2(i) ||
+          sfImpKNN.get_dist2(i) != expectedKNN.get_dist2(i))
+        throw std::runtime_error("wrong knn result");
+  }
+  free_host(table);
+  std::cout << "  all results match" << std::endl;
+}
+
+int main(int, const char **)
+{
+  // clustered data: gaussian blobs of different sizes
+  std::mt19937 gen(0x5eed);
+  std::uniform_real_distribution<float> uniform(0.f,100.f);
+  std::normal_distribution<float> gaussian(0.f,1.f);
+  std::vector<float3> points(numPoints);
+  for (int i=0;i<numPoints;) {
+    const float3 center = make_float3(uniform(gen),uniform(gen),uniform(gen));
+    const float  sigma  = .01f*uniform(gen);
+    for (int j=0;j<500 && i<numPoints;j++)
+      points[i++] = make_float3(center.x+sigma*gaussian(gen),
+                                center.y+sigma*gaussian(gen),
+                                center.z+sigma*gaussian(gen));
+  }
+  std::vector<float3> queries(numQueries);
+  for (auto &q : queries) q = make_float3(uniform(gen),uniform(gen),uniform(gen));
+
+  box_t<float3> worldBounds;
+  buildTree_host(points.data(),numPoints,&worldBounds);
+
+  SubtreeBoundsConfig all;
+  SubtreeBoundsConfig topLevels;
+  topLevels.maxLevels = 6;
+  SubtreeBoundsConfig budget;
+  budget.maxBytes = 1000;
+  check<SubtreeBoundsTable<float3>>
+    ("full subtree bounds, all levels",points,worldBounds,queries,all);
+  check<SubtreeBoundsTable<float3>>
+    ("full subtree bounds, top 6 levels",points,worldBounds,queries,topLevels);
+  check<SubtreeBoundsTable<float3>>
+    ("full subtree bounds, 1000 bytes",points,worldBounds,queries,budget);
+  check<QuantizedSubtreeBoundsTable<float3>>
+    ("quantized subtree bounds, all levels",points,worldBounds,queries,all);
+  check<QuantizedSubtreeBoundsTable<float3>>
+    ("quantized subtree bounds, 1000 bytes",points,worldBounds,queries,budget);
+  return 0;
+}